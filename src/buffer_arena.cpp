@@ -0,0 +1,113 @@
+/*! @file buffer_arena.cpp
+ *  @author Kyle Weicht
+ *  @date 10/20/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "buffer_arena.h"
+
+#include <string.h>
+
+/*
+ * Internal
+ */
+namespace {
+
+void _insert_range(BufferArena* arena, uint32_t index, uint32_t offset, uint32_t size) {
+    ArenaRange* ranges = arena->free_ranges;
+    memmove(ranges+index+1, ranges+index, (arena->num_free-index)*sizeof(ArenaRange));
+    ranges[index].offset = offset;
+    ranges[index].size = size;
+    ++arena->num_free;
+}
+void _remove_range(BufferArena* arena, uint32_t index) {
+    ArenaRange* ranges = arena->free_ranges;
+    memmove(ranges+index, ranges+index+1, (arena->num_free-index-1)*sizeof(ArenaRange));
+    --arena->num_free;
+}
+
+}
+
+/*
+ * External
+ */
+void buffer_arena_init(BufferArena* arena, uint32_t size) {
+    arena->size = 0;
+    arena->num_free = 0;
+    buffer_arena_grow(arena, size);
+}
+int buffer_arena_alloc(BufferArena* arena, uint32_t size, uint32_t alignment, uint32_t* offset) {
+    if(alignment == 0)
+        alignment = 1;
+    for(uint32_t ii=0; ii<arena->num_free; ++ii) {
+        ArenaRange range = arena->free_ranges[ii];
+        uint32_t start = (range.offset + alignment-1)/alignment*alignment;
+        uint32_t padding = start - range.offset;
+        if(padding > range.size || range.size - padding < size)
+            continue;
+        uint32_t remaining = range.size - padding - size;
+
+        // The padding stays free when there's room to track it
+        if(padding && arena->num_free < kArenaMaxFreeRanges) {
+            arena->free_ranges[ii].size = padding;
+            if(remaining)
+                _insert_range(arena, ii+1, start+size, remaining);
+        } else if(remaining) {
+            arena->free_ranges[ii].offset = start+size;
+            arena->free_ranges[ii].size = remaining;
+        } else {
+            _remove_range(arena, ii);
+        }
+        *offset = start;
+        return 1;
+    }
+    return 0;
+}
+void buffer_arena_free(BufferArena* arena, uint32_t offset, uint32_t size) {
+    if(size == 0)
+        return;
+    ArenaRange* ranges = arena->free_ranges;
+    uint32_t index = 0;
+    while(index < arena->num_free && ranges[index].offset < offset)
+        ++index;
+    bool merge_prev = index > 0 && ranges[index-1].offset + ranges[index-1].size == offset;
+    bool merge_next = index < arena->num_free && offset + size == ranges[index].offset;
+    if(merge_prev && merge_next) {
+        ranges[index-1].size += size + ranges[index].size;
+        _remove_range(arena, index);
+    } else if(merge_prev) {
+        ranges[index-1].size += size;
+    } else if(merge_next) {
+        ranges[index].offset = offset;
+        ranges[index].size += size;
+    } else if(arena->num_free < kArenaMaxFreeRanges) {
+        _insert_range(arena, index, offset, size);
+    }
+}
+void buffer_arena_grow(BufferArena* arena, uint32_t size) {
+    if(size <= arena->size)
+        return;
+    uint32_t old_size = arena->size;
+    arena->size = size;
+
+    // The new space is what the caller grew for, so when there's no room to
+    // track it the smallest free range is given up instead
+    uint32_t last = arena->num_free;
+    bool merges = last > 0 && arena->free_ranges[last-1].offset + arena->free_ranges[last-1].size == old_size;
+    if(!merges && arena->num_free == kArenaMaxFreeRanges) {
+        uint32_t smallest = 0;
+        for(uint32_t ii=1; ii<arena->num_free; ++ii) {
+            if(arena->free_ranges[ii].size < arena->free_ranges[smallest].size)
+                smallest = ii;
+        }
+        _remove_range(arena, smallest);
+    }
+    buffer_arena_free(arena, old_size, size - old_size);
+}
+uint32_t buffer_arena_largest_free(const BufferArena* arena) {
+    uint32_t largest = 0;
+    for(uint32_t ii=0; ii<arena->num_free; ++ii) {
+        if(arena->free_ranges[ii].size > largest)
+            largest = arena->free_ranges[ii].size;
+    }
+    return largest;
+}
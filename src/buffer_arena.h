@@ -0,0 +1,61 @@
+/*! @file buffer_arena.h
+ *  @brief First fit suballocation of ranges of a shared buffer
+ *  @author Kyle Weicht
+ *  @date 10/20/26 4:20 AM
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ *	@addtogroup buffer_arena buffer_arena
+ *	@{
+ */
+#ifndef __buffer_arena_h__
+#define __buffer_arena_h__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Only the free ranges are tracked, the caller keeps what it allocated.
+ * Units are up to the caller, bytes or vertices.
+ */
+enum { kArenaMaxFreeRanges = 256 };
+
+typedef struct {
+    uint32_t    offset;
+    uint32_t    size;
+} ArenaRange;
+
+typedef struct {
+    uint32_t    size;
+    uint32_t    num_free;
+    ArenaRange  free_ranges[kArenaMaxFreeRanges];   /*!< Sorted by offset, never adjacent */
+} BufferArena;
+
+/*! @brief Starts with all of size free */
+void buffer_arena_init(BufferArena* arena, uint32_t size);
+
+/*! @brief Takes size units starting at a multiple of alignment from the
+ *         first free range they fit in
+ *  @return Non-zero if there was room
+ */
+int buffer_arena_alloc(BufferArena* arena, uint32_t size, uint32_t alignment, uint32_t* offset);
+
+/*! @brief Returns a range, merging it with its free neighbors. If there are
+ *         already kArenaMaxFreeRanges separate free ranges it's lost.
+ */
+void buffer_arena_free(BufferArena* arena, uint32_t offset, uint32_t size);
+
+/*! @brief Extends the arena to size, the new space is free. It's always
+ *         tracked, if the free ranges are full the smallest one is lost.
+ */
+void buffer_arena_grow(BufferArena* arena, uint32_t size);
+
+/*! @brief The largest allocation that would succeed with an alignment of 1 */
+uint32_t buffer_arena_largest_free(const BufferArena* arena);
+
+#ifdef __cplusplus
+} // extern "C" {
+#endif
+
+/* @} */
+#endif /* include guard */
@@ -0,0 +1,157 @@
+/*! @file culling.cpp
+ *  @author Kyle Weicht
+ *  @date 10/19/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "culling.h"
+
+#include <math.h>
+#include <immintrin.h>
+
+/*
+ * Internal
+ */
+namespace {
+
+float4 _normalize_plane(float a, float b, float c, float d) {
+    float length = sqrtf(a*a + b*b + c*c);
+    float inv_length = (length > 0.0f) ? 1.0f/length : 0.0f;
+    float4 plane = { a*inv_length, b*inv_length, c*inv_length, d*inv_length };
+    return plane;
+}
+
+int _meshlet_visible(const MeshletBounds& bounds, const Frustum* frustum, const float3* camera_position) {
+    if(!sphere_in_frustum(frustum, &bounds.center, bounds.radius))
+        return 0;
+    if(camera_position == NULL)
+        return 1;
+    float3 to_center = float3subtract(&bounds.center, camera_position);
+    float distance = float3length(&to_center);
+    return float3dot(&to_center, &bounds.cone_axis) < bounds.cone_cutoff*distance + bounds.radius;
+}
+
+}
+
+/*
+ * External
+ */
+void frustum_from_matrix(Frustum* frustum, const float4x4* m) {
+    // Gribb/Hartmann, with clip space z in [-w,w] to match what GL clips
+    const float4& r0 = m->r0;
+    const float4& r1 = m->r1;
+    const float4& r2 = m->r2;
+    const float4& r3 = m->r3;
+    frustum->planes[0] = _normalize_plane(r0.w+r0.x, r1.w+r1.x, r2.w+r2.x, r3.w+r3.x);
+    frustum->planes[1] = _normalize_plane(r0.w-r0.x, r1.w-r1.x, r2.w-r2.x, r3.w-r3.x);
+    frustum->planes[2] = _normalize_plane(r0.w+r0.y, r1.w+r1.y, r2.w+r2.y, r3.w+r3.y);
+    frustum->planes[3] = _normalize_plane(r0.w-r0.y, r1.w-r1.y, r2.w-r2.y, r3.w-r3.y);
+    frustum->planes[4] = _normalize_plane(r0.w+r0.z, r1.w+r1.z, r2.w+r2.z, r3.w+r3.z);
+    frustum->planes[5] = _normalize_plane(r0.w-r0.z, r1.w-r1.z, r2.w-r2.z, r3.w-r3.z);
+}
+int sphere_in_frustum(const Frustum* frustum, const float3* center, float radius) {
+    for(int ii=0; ii<6; ++ii) {
+        const float4& p = frustum->planes[ii];
+        if(p.x*center->x + p.y*center->y + p.z*center->z + p.w < -radius)
+            return 0;
+    }
+    return 1;
+}
+uint32_t cull_spheres(uint32_t* visible, const float* x, const float* y, const float* z,
+                      const float* radius, uint32_t count, const Frustum* frustum) {
+    uint32_t visible_count = 0;
+    uint32_t ii = 0;
+
+    __m128 planes[6][4];
+    for(int pp=0; pp<6; ++pp) {
+        planes[pp][0] = _mm_set1_ps(frustum->planes[pp].x);
+        planes[pp][1] = _mm_set1_ps(frustum->planes[pp].y);
+        planes[pp][2] = _mm_set1_ps(frustum->planes[pp].z);
+        planes[pp][3] = _mm_set1_ps(frustum->planes[pp].w);
+    }
+    const __m128 zero = _mm_setzero_ps();
+    for(; ii+4<=count; ii+=4) {
+        __m128 center_x = _mm_loadu_ps(x+ii);
+        __m128 center_y = _mm_loadu_ps(y+ii);
+        __m128 center_z = _mm_loadu_ps(z+ii);
+        __m128 neg_radius = _mm_sub_ps(zero, _mm_loadu_ps(radius+ii));
+        __m128 inside = _mm_cmpeq_ps(zero, zero);
+        for(int pp=0; pp<6; ++pp) {
+            __m128 d = _mm_mul_ps(center_x, planes[pp][0]);
+            d = _mm_add_ps(d, _mm_mul_ps(center_y, planes[pp][1]));
+            d = _mm_add_ps(d, _mm_mul_ps(center_z, planes[pp][2]));
+            d = _mm_add_ps(d, planes[pp][3]);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, neg_radius));
+        }
+        int mask = _mm_movemask_ps(inside);
+        for(uint32_t jj=0; jj<4; ++jj) {
+            if(mask & (1 << jj))
+                visible[visible_count++] = ii+jj;
+        }
+    }
+    for(; ii<count; ++ii) {
+        float3 center = { x[ii], y[ii], z[ii] };
+        if(sphere_in_frustum(frustum, &center, radius[ii]))
+            visible[visible_count++] = ii;
+    }
+    return visible_count;
+}
+int meshlet_cones_usable(const float3* camera_position, const float3* center, float radius) {
+    float3 to_center = float3subtract(center, camera_position);
+    return float3lengthSq(&to_center) > radius*radius;
+}
+uint32_t cull_meshlets(uint32_t* visible, const MeshletBounds* bounds, uint32_t count,
+                       const Frustum* frustum, const float3* camera_position) {
+    uint32_t visible_count = 0;
+    uint32_t ii = 0;
+
+    // Four meshlets at a time, transposed to SoA
+    const float3* camera = camera_position ? camera_position : &float3zero;
+    const __m128 camera_x = _mm_set1_ps(camera->x);
+    const __m128 camera_y = _mm_set1_ps(camera->y);
+    const __m128 camera_z = _mm_set1_ps(camera->z);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 skip_cones = camera_position ? zero : _mm_cmpeq_ps(zero, zero);
+    for(; ii+4<=count; ii+=4) {
+        __m128 center_x = _mm_loadu_ps(&bounds[ii+0].center.x);
+        __m128 center_y = _mm_loadu_ps(&bounds[ii+1].center.x);
+        __m128 center_z = _mm_loadu_ps(&bounds[ii+2].center.x);
+        __m128 radius = _mm_loadu_ps(&bounds[ii+3].center.x);
+        _MM_TRANSPOSE4_PS(center_x, center_y, center_z, radius);
+        __m128 axis_x = _mm_loadu_ps(&bounds[ii+0].cone_axis.x);
+        __m128 axis_y = _mm_loadu_ps(&bounds[ii+1].cone_axis.x);
+        __m128 axis_z = _mm_loadu_ps(&bounds[ii+2].cone_axis.x);
+        __m128 cutoff = _mm_loadu_ps(&bounds[ii+3].cone_axis.x);
+        _MM_TRANSPOSE4_PS(axis_x, axis_y, axis_z, cutoff);
+
+        __m128 neg_radius = _mm_sub_ps(zero, radius);
+        __m128 inside = _mm_cmpeq_ps(zero, zero);
+        for(int pp=0; pp<6; ++pp) {
+            const float4& plane = frustum->planes[pp];
+            __m128 d = _mm_mul_ps(center_x, _mm_set1_ps(plane.x));
+            d = _mm_add_ps(d, _mm_mul_ps(center_y, _mm_set1_ps(plane.y)));
+            d = _mm_add_ps(d, _mm_mul_ps(center_z, _mm_set1_ps(plane.z)));
+            d = _mm_add_ps(d, _mm_set1_ps(plane.w));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, neg_radius));
+        }
+
+        // Backfacing if dot(center-camera, axis) >= cutoff*|center-camera| + radius
+        __m128 to_x = _mm_sub_ps(center_x, camera_x);
+        __m128 to_y = _mm_sub_ps(center_y, camera_y);
+        __m128 to_z = _mm_sub_ps(center_z, camera_z);
+        __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(to_x, axis_x), _mm_mul_ps(to_y, axis_y)), _mm_mul_ps(to_z, axis_z));
+        __m128 distance_sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(to_x, to_x), _mm_mul_ps(to_y, to_y)), _mm_mul_ps(to_z, to_z));
+        __m128 limit = _mm_add_ps(_mm_mul_ps(cutoff, _mm_sqrt_ps(distance_sq)), radius);
+        inside = _mm_and_ps(inside, _mm_or_ps(_mm_cmplt_ps(dot, limit), skip_cones));
+
+        int mask = _mm_movemask_ps(inside);
+        for(uint32_t jj=0; jj<4; ++jj) {
+            if(mask & (1 << jj))
+                visible[visible_count++] = ii+jj;
+        }
+    }
+    for(; ii<count; ++ii) {
+        if(_meshlet_visible(bounds[ii], frustum, camera_position))
+            visible[visible_count++] = ii;
+    }
+    return visible_count;
+}
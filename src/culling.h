@@ -0,0 +1,58 @@
+/*! @file culling.h
+ *  @brief Frustum and backface culling of bounding volumes
+ *  @author Kyle Weicht
+ *  @date 10/19/26 6:20 PM
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ *	@addtogroup culling culling
+ *	@{
+ */
+#ifndef __culling_h__
+#define __culling_h__
+
+#include <stdint.h>
+#include "vec_math.h"
+#include "mesh_optimizer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    float4  planes[6];  /*!< Normalized, pointing inwards: left, right, bottom, top, near, far */
+} Frustum;
+
+/*! @brief Extracts the frustum planes from a row-vector view projection
+ *         matrix. Pass world*view*proj to get the planes in model space.
+ */
+void frustum_from_matrix(Frustum* frustum, const float4x4* view_proj);
+
+/*! @brief Returns non-zero if the sphere is at least partially inside */
+int sphere_in_frustum(const Frustum* frustum, const float3* center, float radius);
+
+/*! @brief Culls bounding spheres kept as separate x, y, z and radius arrays
+ *  @return The number of visible spheres, whose indices go in `visible`
+ */
+uint32_t cull_spheres(uint32_t* visible, const float* x, const float* y, const float* z,
+                      const float* radius, uint32_t count, const Frustum* frustum);
+
+/*! @brief Culls meshlets against the frustum and their normal cones. All
+ *         inputs are in the same space, usually the mesh's model space.
+ *         A NULL camera_position only culls against the frustum.
+ *  @return The number of visible meshlets, whose indices go in `visible`
+ */
+uint32_t cull_meshlets(uint32_t* visible, const MeshletBounds* bounds, uint32_t count,
+                       const Frustum* frustum, const float3* camera_position);
+
+/*! @brief Whether normal cones can cull a mesh seen from camera_position.
+ *         Only from outside its bounding sphere do a closed mesh's front
+ *         faces hide its back faces. From inside, like the sky, everything
+ *         seen is a back face.
+ */
+int meshlet_cones_usable(const float3* camera_position, const float3* center, float radius);
+
+#ifdef __cplusplus
+} // extern "C" {
+#endif
+
+/* @} */
+#endif /* include guard */
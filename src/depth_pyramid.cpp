@@ -0,0 +1,129 @@
+/*! @file depth_pyramid.cpp
+ *  @author Kyle Weicht
+ *  @date 10/20/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "depth_pyramid.h"
+
+#include <string.h>
+
+/*
+ * Internal
+ */
+namespace {
+
+float _max(float a, float b) { return a > b ? a : b; }
+
+int32_t _texel(float ndc, uint32_t size) {
+    int32_t texel = (int32_t)((ndc*0.5f + 0.5f)*size);
+    if(texel < 0)
+        return 0;
+    if(texel >= (int32_t)size)
+        return (int32_t)size-1;
+    return texel;
+}
+
+}
+
+/*
+ * External
+ */
+uint32_t depth_pyramid_texels(uint32_t width, uint32_t height) {
+    uint32_t texels = 0;
+    for(uint32_t level=0; level<kPyramidMaxLevels; ++level) {
+        texels += width*height;
+        if(width == 1 && height == 1)
+            break;
+        width = (width+1)/2;
+        height = (height+1)/2;
+    }
+    return texels;
+}
+void depth_pyramid_build(DepthPyramid* pyramid, float* texels, const float* depth,
+                         uint32_t width, uint32_t height, const float4x4* view_proj) {
+    pyramid->view_proj = *view_proj;
+    pyramid->texels = texels;
+    pyramid->num_levels = 0;
+    uint32_t offset = 0;
+    for(uint32_t level=0; level<kPyramidMaxLevels; ++level) {
+        pyramid->widths[level] = width;
+        pyramid->heights[level] = height;
+        pyramid->offsets[level] = offset;
+        pyramid->num_levels++;
+        offset += width*height;
+        if(width == 1 && height == 1)
+            break;
+        width = (width+1)/2;
+        height = (height+1)/2;
+    }
+    memcpy(texels, depth, pyramid->widths[0]*pyramid->heights[0]*sizeof(float));
+
+    // Odd edges repeat their last texel
+    for(uint32_t level=1; level<pyramid->num_levels; ++level) {
+        const float* src = texels + pyramid->offsets[level-1];
+        float* dst = texels + pyramid->offsets[level];
+        uint32_t src_width = pyramid->widths[level-1];
+        uint32_t src_height = pyramid->heights[level-1];
+        for(uint32_t y=0; y<pyramid->heights[level]; ++y) {
+            uint32_t y0 = y*2;
+            uint32_t y1 = (y0+1 < src_height) ? y0+1 : y0;
+            for(uint32_t x=0; x<pyramid->widths[level]; ++x) {
+                uint32_t x0 = x*2;
+                uint32_t x1 = (x0+1 < src_width) ? x0+1 : x0;
+                dst[y*pyramid->widths[level] + x] = _max(_max(src[y0*src_width + x0], src[y0*src_width + x1]),
+                                                         _max(src[y1*src_width + x0], src[y1*src_width + x1]));
+            }
+        }
+    }
+}
+int depth_pyramid_occluded(const DepthPyramid* pyramid, const float3* center, float radius) {
+    // The screen rectangle and nearest depth of the sphere's box's corners
+    const float4x4& m = pyramid->view_proj;
+    float min_x = 1.0f, max_x = -1.0f;
+    float min_y = 1.0f, max_y = -1.0f;
+    float min_z = 1.0f;
+    for(int ii=0; ii<8; ++ii) {
+        float x = center->x + ((ii & 1) ? radius : -radius);
+        float y = center->y + ((ii & 2) ? radius : -radius);
+        float z = center->z + ((ii & 4) ? radius : -radius);
+        float clip_x = x*m.r0.x + y*m.r1.x + z*m.r2.x + m.r3.x;
+        float clip_y = x*m.r0.y + y*m.r1.y + z*m.r2.y + m.r3.y;
+        float clip_z = x*m.r0.z + y*m.r1.z + z*m.r2.z + m.r3.z;
+        float clip_w = x*m.r0.w + y*m.r1.w + z*m.r2.w + m.r3.w;
+        if(clip_z <= 0.0f || clip_w <= 0.0f)
+            return 0;
+        float inv_w = 1.0f/clip_w;
+        float ndc_x = clip_x*inv_w;
+        float ndc_y = clip_y*inv_w;
+        float ndc_z = clip_z*inv_w;
+        min_x = (ndc_x < min_x) ? ndc_x : min_x;
+        max_x = (ndc_x > max_x) ? ndc_x : max_x;
+        min_y = (ndc_y < min_y) ? ndc_y : min_y;
+        max_y = (ndc_y > max_y) ? ndc_y : max_y;
+        min_z = (ndc_z < min_z) ? ndc_z : min_z;
+    }
+    if(max_x < -1.0f || min_x > 1.0f || max_y < -1.0f || min_y > 1.0f)
+        return 0; // Off screen, the depth says nothing about it
+
+    // The level where the rectangle covers at most 2x2 texels
+    int32_t x0 = _texel(min_x, pyramid->widths[0]);
+    int32_t x1 = _texel(max_x, pyramid->widths[0]);
+    int32_t y0 = _texel(min_y, pyramid->heights[0]);
+    int32_t y1 = _texel(max_y, pyramid->heights[0]);
+    uint32_t level = 0;
+    while(level+1 < pyramid->num_levels && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+        ++level;
+    x0 >>= level;
+    x1 >>= level;
+    y0 >>= level;
+    y1 >>= level;
+
+    const float* texels = pyramid->texels + pyramid->offsets[level];
+    uint32_t width = pyramid->widths[level];
+    float max_depth = 0.0f;
+    for(int32_t y=y0; y<=y1; ++y) {
+        for(int32_t x=x0; x<=x1; ++x)
+            max_depth = _max(max_depth, texels[(uint32_t)y*width + (uint32_t)x]);
+    }
+    return min_z > max_depth;
+}
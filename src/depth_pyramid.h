@@ -0,0 +1,56 @@
+/*! @file depth_pyramid.h
+ *  @brief Hierarchical max depth for occlusion testing bounding spheres
+ *  @author Kyle Weicht
+ *  @date 10/20/26 5:30 AM
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ *	@addtogroup depth_pyramid depth_pyramid
+ *	@{
+ */
+#ifndef __depth_pyramid_h__
+#define __depth_pyramid_h__
+
+#include <stdint.h>
+#include "vec_math.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Depth is post projection z/w, 0 at the near plane and 1 at the far
+ * plane. Each level keeps the farthest depth of the 2x2 texels under it, so
+ * anything nearer than a level's texel is in front of everything it covers.
+ * Row 0 is the bottom of the screen, as glReadPixels returns it.
+ */
+enum { kPyramidMaxLevels = 16 };
+
+typedef struct {
+    float4x4    view_proj;  /*!< What the depth was rendered with */
+    uint32_t    num_levels;
+    uint32_t    widths[kPyramidMaxLevels];
+    uint32_t    heights[kPyramidMaxLevels];
+    uint32_t    offsets[kPyramidMaxLevels]; /*!< Into texels */
+    float*      texels;
+} DepthPyramid;
+
+/*! @brief How many floats a pyramid over a width x height depth buffer
+ *         needs, all of its levels
+ */
+uint32_t depth_pyramid_texels(uint32_t width, uint32_t height);
+
+/*! @brief Copies depth into level 0 of texels, which has room for
+ *         depth_pyramid_texels, and reduces it down to 1x1
+ */
+void depth_pyramid_build(DepthPyramid* pyramid, float* texels, const float* depth,
+                         uint32_t width, uint32_t height, const float4x4* view_proj);
+
+/*! @brief Returns non-zero if the sphere is behind the depth everywhere it
+ *         covers. Spheres reaching the camera's near plane never are.
+ */
+int depth_pyramid_occluded(const DepthPyramid* pyramid, const float3* center, float radius);
+
+#ifdef __cplusplus
+} // extern "C" {
+#endif
+
+/* @} */
+#endif /* include guard */
@@ -13,12 +13,16 @@
 #include "unit_test.h"
 #include "marching_cubes.h"
 #include "perlin_noise.h"
+#include "mesh_simplify.h"
 
 /*
  * Internal
  */
 namespace {
 
+const int kNumPointLights = 511;
+const int kTerrainTiles = 8;    // Per side. Each tile is its own mesh and picks its own LOD
+
 float _rand_float(float min, float max) {
     float r = rand()/(float)RAND_MAX;
     float delta = max-min;
@@ -42,6 +46,9 @@ float terrain_func(float3 v) {
 struct RenderData {
     Resource    mesh;
     Material    material;
+    bool        dynamic;    // Moves, so its shadow can't be cached
+    bool        double_sided;   // Seen from both sides, like the sky from inside
+    Resource    occluder;   // Hides what's behind it on the CPU too, if set
 
     static Render*  _render;
 };
@@ -104,11 +111,49 @@ void smooth_terrain(std::vector<float3>& positions, std::vector<VtxPosNormTex>&
     }
 }
 
+/* Sorts triangles into a grid of tiles on XZ by their centers. Vertices on a
+ * tile's edge are copied into both tiles, the LODs keep mesh borders in place
+ * so the tiles stay joined at any LOD.
+ */
+void split_terrain(const std::vector<VtxPosNormTex>& vertices, const std::vector<uint32_t>& indices,
+                   float3 min, float3 max,
+                   std::vector<VtxPosNormTex>* tile_vertices, std::vector<uint32_t>* tile_indices) {
+    std::vector<uint32_t> tile_triangles[kTerrainTiles*kTerrainTiles];
+    for(uint32_t ii=0; ii<indices.size(); ii += 3) {
+        float x = (vertices[indices[ii+0]].pos.x + vertices[indices[ii+1]].pos.x + vertices[indices[ii+2]].pos.x)/3.0f;
+        float z = (vertices[indices[ii+0]].pos.z + vertices[indices[ii+1]].pos.z + vertices[indices[ii+2]].pos.z)/3.0f;
+        int tile_x = (int)((x - min.x)/(max.x - min.x)*kTerrainTiles);
+        int tile_z = (int)((z - min.z)/(max.z - min.z)*kTerrainTiles);
+        tile_x = (tile_x < 0) ? 0 : (tile_x >= kTerrainTiles) ? kTerrainTiles-1 : tile_x;
+        tile_z = (tile_z < 0) ? 0 : (tile_z >= kTerrainTiles) ? kTerrainTiles-1 : tile_z;
+        tile_triangles[tile_z*kTerrainTiles + tile_x].push_back(ii);
+    }
+    std::vector<uint32_t> remap(vertices.size());
+    std::vector<int> remap_tile(vertices.size(), -1);
+    for(int tile=0; tile<kTerrainTiles*kTerrainTiles; ++tile) {
+        const std::vector<uint32_t>& triangles = tile_triangles[tile];
+        for(uint32_t ii=0; ii<triangles.size(); ++ii) {
+            for(uint32_t jj=0; jj<3; ++jj) {
+                uint32_t index = indices[triangles[ii]+jj];
+                if(remap_tile[index] != tile) {
+                    remap_tile[index] = tile;
+                    remap[index] = (uint32_t)tile_vertices[tile].size();
+                    tile_vertices[tile].push_back(vertices[index]);
+                }
+                tile_indices[tile].push_back(remap[index]);
+            }
+        }
+    }
+}
+
 }
 
 template<> void SimpleSystem<RenderData>::_update(Entity* entity, RenderData* data, float) {
     Transform transform = entity->transform();
-    data->_render->draw_3d(data->mesh, &data->material, TransformGetMatrix(&transform));
+    float4x4 world = TransformGetMatrix(&transform);
+    data->_render->draw_3d(data->mesh, &data->material, world, data->dynamic, data->double_sided);
+    if(data->occluder.ptr)
+        data->_render->draw_occluder(data->occluder, world);
 }
 
 template<> void SimpleSystem<LightData>::_update(Entity* entity, LightData* data, float) {
@@ -246,12 +291,38 @@ void Game::initialize(void) {
     debug_output("time: %f, Num Terrain Vertices: %d\n", timer_delta_time(&_timer), terrain_verts.size());
     debug_output("Num Terrain indices: %d\n", terrain_indices.size());
     timer_reset(&_timer);
-    render_data.mesh = _render->create_mesh((uint32_t)terrain_verts.size(), kVtxPosNormTex, (uint32_t)terrain_indices.size(), sizeof(uint32_t), terrain_verts.data(), terrain_indices.data());
     render_data.material = grass_material;
 
-    EntityID id = _world.create_entity();
-    _world.entity(id)->set_transform(transform)
-                     ->add_component(RenderComponent(render_data));
+    // The terrain hides most of the scene, a coarse copy of it occludes
+    std::vector<float3> occluder_positions(terrain_verts.size());
+    for(size_t ii=0; ii<terrain_verts.size(); ++ii)
+        occluder_positions[ii] = terrain_verts[ii].pos;
+    std::vector<uint32_t> occluder_indices(terrain_indices.size());
+    uint32_t occluder_index_count = simplify_mesh(&occluder_indices[0], &terrain_indices[0], (uint32_t)terrain_indices.size(),
+                                                  &occluder_positions[0], sizeof(float3), (uint32_t)occluder_positions.size(),
+                                                  (uint32_t)terrain_indices.size()/16, 0.25f, NULL);
+    render_data.occluder = _render->create_occluder((uint32_t)occluder_positions.size(), &occluder_positions[0],
+                                                    occluder_index_count, &occluder_indices[0]);
+
+    // Tiles away from the camera drop detail, a single mesh always has the
+    // camera inside its bounds and would stay at full detail
+    std::vector<VtxPosNormTex> tile_verts[kTerrainTiles*kTerrainTiles];
+    std::vector<uint32_t> tile_indices[kTerrainTiles*kTerrainTiles];
+    split_terrain(terrain_verts, terrain_indices, min, max, tile_verts, tile_indices);
+    EntityID id = 0;
+    for(int ii=0; ii<kTerrainTiles*kTerrainTiles; ++ii) {
+        if(tile_indices[ii].empty())
+            continue;
+        render_data.mesh = _render->create_mesh((uint32_t)tile_verts[ii].size(), kVtxPosNormTex,
+                                                (uint32_t)tile_indices[ii].size(), sizeof(uint32_t),
+                                                tile_verts[ii].data(), tile_indices[ii].data());
+        id = _world.create_entity();
+        _world.entity(id)->set_transform(transform)
+                         ->add_component(RenderComponent(render_data));
+        // The occluder covers the whole terrain, one tile draws it
+        render_data.occluder.ptr = NULL;
+    }
+    debug_output("Terrain meshes: %f\n", timer_delta_time(&_timer));
 
     id = _world.create_entity();
     
@@ -266,11 +337,13 @@ void Game::initialize(void) {
     };
     render_data.material = sky_material;
     render_data.mesh = _render->sphere_mesh();
+    render_data.double_sided = true;
     transform = TransformZero();
     transform.scale = -100.0f;
     transform.scale = 1000.0f;
     _world.entity(id)->set_transform(transform)
                      ->add_component(RenderComponent(render_data));
+    render_data.double_sided = false;
 
     for(int ii=0; ii<32;++ii) {
         transform = TransformZero();
@@ -290,10 +363,14 @@ void Game::initialize(void) {
         }
         int material = rand()%3;
         render_data.material = materials[material];
+        render_data.dynamic = (ii < kNumMovingProps);
         id = _world.create_entity();
         _world.entity(id)->set_transform(transform)
                          ->add_component(RenderComponent(render_data));
+        if(render_data.dynamic)
+            _moving_props[ii] = id;
     }
+    render_data.dynamic = false;
 
     Material house_material =
     {
@@ -338,7 +415,7 @@ void Game::initialize(void) {
                           ->add_component(LightComponent(light));
 
     transform = TransformZero();
-    for(int ii=1;ii<MAX_LIGHTS;++ii) {
+    for(int ii=0;ii<kNumPointLights;++ii) {
         light.pos.x = _rand_float(-50.0f, 50.0f);
         light.pos.y = _rand_float(1.0f, 4.0f);
         light.pos.z = _rand_float(-50.0f, 50.0f);
@@ -412,6 +489,23 @@ int Game::on_frame(void) {
         //_world.entity(_sun_id)->activate_component(kLightComponent);
     }
 
+    // The moving props circle the middle of the scene and spin as they go,
+    // their shadows are drawn over the cached ones every frame
+    float3 yaxis = {0.0f, 1.0f, 0.0f};
+    quaternion spin = quaternionFromAxisAngle(&yaxis, _delta_time*0.5f);
+    float orbit_cos = cosf(_delta_time*0.2f);
+    float orbit_sin = sinf(_delta_time*0.2f);
+    for(int ii=0; ii<kNumMovingProps; ++ii) {
+        Entity* prop = _world.entity(_moving_props[ii]);
+        Transform prop_transform = prop->transform();
+        float x = prop_transform.position.x;
+        float z = prop_transform.position.z;
+        prop_transform.position.x = x*orbit_cos - z*orbit_sin;
+        prop_transform.position.z = x*orbit_sin + z*orbit_cos;
+        prop_transform.orientation = quaternionMultiply(&spin, &prop_transform.orientation);
+        prop->set_transform(prop_transform);
+    }
+
     // Frame
     _control_camera(delta_x, delta_y);
     float4x4 view = TransformGetMatrix(&_camera);
@@ -35,6 +35,8 @@ private:
     float       _delta_time;
 
     EntityID    _sun_id;
+    enum { kNumMovingProps = 4 };
+    EntityID    _moving_props[kNumMovingProps]; // Circle the middle of the scene
 
     Transform   _camera;
 
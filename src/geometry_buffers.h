@@ -0,0 +1,171 @@
+/*! @file geometry_buffers.h
+ *  @brief Shared vertex and index buffers, one set per vertex format
+ *  @author Kyle Weicht
+ *  @date 10/20/26 4:40 AM
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ *	@addtogroup geometry_buffers geometry_buffers
+ *	@{
+ */
+#ifndef __geometry_buffers_h__
+#define __geometry_buffers_h__
+
+#include <assert.h>
+#include "buffer_arena.h"
+
+/* Every mesh of a vertex format is a range of the format's buffers and is
+ * drawn with a base vertex and an index offset, so going from one mesh to
+ * the next doesn't touch vertex state. 16 and 32 bit indices share the
+ * index buffer, every mesh's start on a 4 byte boundary. A full buffer is
+ * copied into one twice the size, the ranges in it keep their offsets.
+ */
+class GeometryBuffers {
+public:
+
+enum {
+    kInitialVertices = 64*1024,
+    kInitialIndexBytes = 256*1024,
+    kIndexAlignment = 4
+};
+
+void init(void) {
+    memset(_pools, 0, sizeof(_pools));
+}
+void shutdown(void) {
+    for(int ii=0;ii<kNUM_VERTEX_TYPES;++ii) {
+        Pool& pool = _pools[ii];
+        if(!pool.vao)
+            continue;
+        glDeleteVertexArrays(1, &pool.vao);
+        glDeleteBuffers(1, &pool.vertex_buffer);
+        glDeleteBuffers(1, &pool.index_buffer);
+    }
+    memset(_pools, 0, sizeof(_pools));
+}
+/*! @brief Copies a mesh into its format's buffers */
+GeometryRange alloc(VertexType type, const VertexDescription* format,
+                    uint32_t vertex_count, const void* vertices,
+                    uint32_t index_count, size_t index_size, const void* indices) {
+    Pool& pool = _pools[type];
+    if(!pool.vao)
+        _create_pool(&pool, format, (uint32_t)kVertexSizes[type]);
+
+    uint32_t index_bytes = (uint32_t)(index_count*index_size);
+    uint32_t base_vertex = 0;
+    uint32_t index_start = 0;
+    if(!buffer_arena_alloc(&pool.vertices, vertex_count, 1, &base_vertex)) {
+        _grow(&pool, vertex_count, 0);
+        int grown = buffer_arena_alloc(&pool.vertices, vertex_count, 1, &base_vertex);
+        assert(grown);
+        (void)grown;
+    }
+    if(!buffer_arena_alloc(&pool.indices, index_bytes, kIndexAlignment, &index_start)) {
+        _grow(&pool, 0, index_bytes + kIndexAlignment);
+        int grown = buffer_arena_alloc(&pool.indices, index_bytes, kIndexAlignment, &index_start);
+        assert(grown);
+        (void)grown;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, pool.vertex_buffer);
+    glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)base_vertex*pool.vertex_size, (GLsizeiptr)vertex_count*pool.vertex_size, vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, pool.index_buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)index_start, (GLsizeiptr)index_bytes, indices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    CheckGLError();
+
+    GeometryRange range;
+    range.vao = pool.vao;
+    range.base_vertex = (GLint)base_vertex;
+    range.vertex_count = vertex_count;
+    range.index_start = index_start;
+    range.index_bytes = index_bytes;
+    range.vertex_type = (uint32_t)type;
+    return range;
+}
+void free(const GeometryRange& range) {
+    if(!range.vao)
+        return;
+    Pool& pool = _pools[range.vertex_type];
+    buffer_arena_free(&pool.vertices, (uint32_t)range.base_vertex, range.vertex_count);
+    buffer_arena_free(&pool.indices, range.index_start, range.index_bytes);
+}
+/*! @brief The format's buffers, 0 before its first mesh. They're replaced
+ *         when they grow.
+ */
+GLuint vertex_buffer(VertexType type) const { return _pools[type].vertex_buffer; }
+GLuint index_buffer(VertexType type) const { return _pools[type].index_buffer; }
+
+private:
+
+struct Pool {
+    GLuint      vao;
+    GLuint      vertex_buffer;
+    GLuint      index_buffer;
+    uint32_t    vertex_size;
+    const VertexDescription*    format;
+    BufferArena vertices;   // In vertices
+    BufferArena indices;    // In bytes
+};
+
+void _create_pool(Pool* pool, const VertexDescription* format, uint32_t vertex_size) {
+    glGenVertexArrays(1, &pool->vao);
+    pool->format = format;
+    pool->vertex_size = vertex_size;
+    pool->vertex_buffer = _resize_buffer(0, 0, kInitialVertices*vertex_size);
+    pool->index_buffer = _resize_buffer(0, 0, kInitialIndexBytes);
+    buffer_arena_init(&pool->vertices, kInitialVertices);
+    buffer_arena_init(&pool->indices, kInitialIndexBytes);
+    _attach(pool);
+}
+/* Makes room for at least this many more vertices and index bytes */
+void _grow(Pool* pool, uint32_t vertices, uint32_t index_bytes) {
+    if(vertices) {
+        uint32_t size = pool->vertices.size;
+        uint32_t grown = size*2 > size + vertices ? size*2 : size + vertices;
+        pool->vertex_buffer = _resize_buffer(pool->vertex_buffer, size*pool->vertex_size, grown*pool->vertex_size);
+        buffer_arena_grow(&pool->vertices, grown);
+    }
+    if(index_bytes) {
+        uint32_t size = pool->indices.size;
+        uint32_t grown = size*2 > size + index_bytes ? size*2 : size + index_bytes;
+        pool->index_buffer = _resize_buffer(pool->index_buffer, size, grown);
+        buffer_arena_grow(&pool->indices, grown);
+    }
+    _attach(pool);
+}
+/* Points the VAO at the pool's current buffers */
+static void _attach(const Pool* pool) {
+    glBindVertexArray(pool->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, pool->vertex_buffer);
+    _set_vertex_format(pool->format, pool->vertex_size);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool->index_buffer);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    CheckGLError();
+}
+/* A new buffer of new_size with the old one's contents, the old one is
+ * deleted
+ */
+static GLuint _resize_buffer(GLuint buffer, uint32_t old_size, uint32_t new_size) {
+    GLuint resized = 0;
+    glGenBuffers(1, &resized);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, resized);
+    glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)new_size, NULL, GL_STATIC_DRAW);
+    if(buffer) {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr)old_size);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    CheckGLError();
+    return resized;
+}
+
+Pool    _pools[kNUM_VERTEX_TYPES];
+
+};
+
+/* @} */
+#endif /* include guard */
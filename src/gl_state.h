@@ -0,0 +1,197 @@
+/*! @file gl_state.h
+ *  @brief Tracks bound GL state so redundant binds and uniforms are skipped
+ *  @author Kyle Weicht
+ *  @date 10/20/26 2:30 AM
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ *	@addtogroup gl_state gl_state
+ *	@{
+ */
+#ifndef __gl_state_h__
+#define __gl_state_h__
+
+#include <string.h>
+#include <map>
+#include <utility>
+
+/* Everything drawn in a frame binds through one GLState. Anything bound
+ * around it, texture and mesh uploads, is forgotten by reset() at the start
+ * of the next frame. Uniforms are kept per program and survive resets, they
+ * only change when the program's uniforms are set.
+ */
+class GLState {
+public:
+
+enum {
+    kMaxTextureUnits = 16,
+    kMaxUniformBindings = 8,
+    kMaxUniformWords = 16   // Bigger uniforms always go to GL
+};
+
+GLState()
+    : _issued(0)
+    , _elided(0)
+{
+    reset();
+}
+
+/*! @brief Forgets the bound program, VAO, textures and uniform ranges */
+void reset(void) {
+    _program = kUnknown;
+    _vao = kUnknown;
+    _active_unit = kUnknown;
+    for(int ii=0;ii<kMaxTextureUnits;++ii) {
+        for(int jj=0;jj<kNumTargets;++jj)
+            _textures[ii][jj] = kUnknown;
+    }
+    for(int ii=0;ii<kMaxUniformBindings;++ii)
+        _uniform_ranges[ii].buffer = kUnknown;
+}
+/*! @brief Calls issued and elided since the last call, then zeroes them */
+void read_counters(uint32_t* issued, uint32_t* elided) {
+    *issued = _issued;
+    *elided = _elided;
+    _issued = _elided = 0;
+}
+
+void use_program(GLuint program) {
+    if(_changed(&_program, program))
+        glUseProgram(program);
+}
+void bind_vertex_array(GLuint vao) {
+    if(_changed(&_vao, vao))
+        glBindVertexArray(vao);
+}
+void bind_texture(GLuint unit, GLenum target, GLuint texture) {
+    int slot = _target_slot(target);
+    if(unit >= kMaxTextureUnits || slot < 0) {
+        _active_unit = kUnknown;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(target, texture);
+        _issued += 2;
+        return;
+    }
+    if(_textures[unit][slot] == texture) {
+        ++_elided;
+        return;
+    }
+    if(_changed(&_active_unit, unit))
+        glActiveTexture(GL_TEXTURE0 + unit);
+    _textures[unit][slot] = texture;
+    glBindTexture(target, texture);
+    ++_issued;
+}
+void bind_uniform_range(GLuint binding, GLuint buffer, uint32_t offset, uint32_t size) {
+    if(binding < kMaxUniformBindings) {
+        UniformRange& range = _uniform_ranges[binding];
+        if(range.buffer == buffer && range.offset == offset && range.size == size) {
+            ++_elided;
+            return;
+        }
+        range.buffer = buffer;
+        range.offset = offset;
+        range.size = size;
+    }
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, (GLintptr)offset, (GLsizeiptr)size);
+    ++_issued;
+}
+
+/* Uniforms of the bound program */
+void uniform1i(GLint location, GLint value) {
+    if(_uniform_changed(location, &value, 1))
+        glUniform1i(location, value);
+}
+void uniform1iv(GLint location, GLsizei count, const GLint* values) {
+    if(_uniform_changed(location, values, (uint32_t)count))
+        glUniform1iv(location, count, values);
+}
+void uniform3i(GLint location, GLint x, GLint y, GLint z) {
+    GLint values[] = { x, y, z };
+    if(_uniform_changed(location, values, 3))
+        glUniform3i(location, x, y, z);
+}
+void uniform1f(GLint location, GLfloat value) {
+    if(_uniform_changed(location, &value, 1))
+        glUniform1f(location, value);
+}
+void uniform2f(GLint location, GLfloat x, GLfloat y) {
+    GLfloat values[] = { x, y };
+    if(_uniform_changed(location, values, 2))
+        glUniform2f(location, x, y);
+}
+void uniform3fv(GLint location, GLsizei count, const GLfloat* values) {
+    if(_uniform_changed(location, values, (uint32_t)count*3))
+        glUniform3fv(location, count, values);
+}
+void uniform_matrix4fv(GLint location, GLsizei count, const GLfloat* values) {
+    if(_uniform_changed(location, values, (uint32_t)count*16))
+        glUniformMatrix4fv(location, count, GL_FALSE, values);
+}
+
+private:
+
+enum { kNumTargets = 3 };   // 2D, 2D array and buffer textures
+enum { kUnknown = 0xFFFFFFFF }; // Never a valid name, so the next bind is issued
+
+struct Uniform {
+    uint32_t    words;
+    uint32_t    data[kMaxUniformWords];
+};
+typedef std::pair<GLuint, GLint> UniformKey;
+struct UniformRange {
+    GLuint      buffer;
+    uint32_t    offset;
+    uint32_t    size;
+};
+
+bool _changed(GLuint* cached, GLuint value) {
+    if(*cached == value) {
+        ++_elided;
+        return false;
+    }
+    *cached = value;
+    ++_issued;
+    return true;
+}
+/* Locations of -1 are uniforms the program doesn't use, GL ignores them */
+bool _uniform_changed(GLint location, const void* data, uint32_t words) {
+    if(location < 0) {
+        ++_elided;
+        return false;
+    }
+    if(_program == kUnknown || words > kMaxUniformWords) {
+        ++_issued;
+        return true;
+    }
+    Uniform& cached = _uniforms[UniformKey(_program, location)];
+    if(cached.words == words && memcmp(cached.data, data, words*sizeof(uint32_t)) == 0) {
+        ++_elided;
+        return false;
+    }
+    cached.words = words;
+    memcpy(cached.data, data, words*sizeof(uint32_t));
+    ++_issued;
+    return true;
+}
+static int _target_slot(GLenum target) {
+    switch(target) {
+    case GL_TEXTURE_2D:         return 0;
+    case GL_TEXTURE_2D_ARRAY:   return 1;
+    case GL_TEXTURE_BUFFER:     return 2;
+    default:                    return -1;
+    }
+}
+
+GLuint  _program;
+GLuint  _vao;
+GLuint  _active_unit;
+GLuint  _textures[kMaxTextureUnits][kNumTargets];
+UniformRange    _uniform_ranges[kMaxUniformBindings];
+std::map<UniformKey, Uniform>   _uniforms;
+
+uint32_t    _issued;
+uint32_t    _elided;
+
+};
+
+/* @} */
+#endif /* include guard */
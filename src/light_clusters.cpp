@@ -0,0 +1,183 @@
+/*! @file light_clusters.cpp
+ *  @author Kyle Weicht
+ *  @date 10/19/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "light_clusters.h"
+
+#include <math.h>
+#include <string.h>
+#include <immintrin.h>
+#include <vector>
+
+/*
+ * Internal
+ */
+namespace {
+
+struct LightBounds {
+    int32_t x0, x1;     // Inclusive tile ranges
+    int32_t y0, y1;
+    float   z_near;     // View space depth range, clamped to the near plane
+    float   z_far;
+    uint32_t z0, z1;    // Slice range
+    int32_t visible;
+};
+
+/* Four lights at a time: to view space, then the NDC extents of each
+ * sphere's view space box. x/z is monotonic in x and z, so the extents are
+ * at the box's near and far corners.
+ */
+void _light_bounds(LightBounds* bounds, const float4* spheres, const float4x4* view,
+                   const ClusterFrustum* frustum) {
+    __m128 x = _mm_loadu_ps(&spheres[0].x);
+    __m128 y = _mm_loadu_ps(&spheres[1].x);
+    __m128 z = _mm_loadu_ps(&spheres[2].x);
+    __m128 radius = _mm_loadu_ps(&spheres[3].x);
+    _MM_TRANSPOSE4_PS(x, y, z, radius);
+
+    const float4x4& m = *view;
+    __m128 view_x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(m.r0.x)), _mm_mul_ps(y, _mm_set1_ps(m.r1.x))),
+                               _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(m.r2.x)), _mm_set1_ps(m.r3.x)));
+    __m128 view_y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(m.r0.y)), _mm_mul_ps(y, _mm_set1_ps(m.r1.y))),
+                               _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(m.r2.y)), _mm_set1_ps(m.r3.y)));
+    __m128 view_z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(m.r0.z)), _mm_mul_ps(y, _mm_set1_ps(m.r1.z))),
+                               _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(m.r2.z)), _mm_set1_ps(m.r3.z)));
+
+    const __m128 near_z = _mm_set1_ps(frustum->near_z);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 neg_one = _mm_set1_ps(-1.0f);
+    __m128 z_near = _mm_max_ps(_mm_sub_ps(view_z, radius), near_z);
+    __m128 z_far = _mm_max_ps(_mm_add_ps(view_z, radius), near_z);
+    __m128 inv_near = _mm_div_ps(one, z_near);
+    __m128 inv_far = _mm_div_ps(one, z_far);
+
+    __m128 low = _mm_sub_ps(view_x, radius);
+    __m128 high = _mm_add_ps(view_x, radius);
+    __m128 scale = _mm_set1_ps(frustum->scale_x);
+    __m128 min_x = _mm_mul_ps(_mm_min_ps(_mm_mul_ps(low, inv_near), _mm_mul_ps(low, inv_far)), scale);
+    __m128 max_x = _mm_mul_ps(_mm_max_ps(_mm_mul_ps(high, inv_near), _mm_mul_ps(high, inv_far)), scale);
+    low = _mm_sub_ps(view_y, radius);
+    high = _mm_add_ps(view_y, radius);
+    scale = _mm_set1_ps(frustum->scale_y);
+    __m128 min_y = _mm_mul_ps(_mm_min_ps(_mm_mul_ps(low, inv_near), _mm_mul_ps(low, inv_far)), scale);
+    __m128 max_y = _mm_mul_ps(_mm_max_ps(_mm_mul_ps(high, inv_near), _mm_mul_ps(high, inv_far)), scale);
+
+    __m128 visible = _mm_cmpgt_ps(_mm_add_ps(view_z, radius), near_z);
+    visible = _mm_and_ps(visible, _mm_and_ps(_mm_cmpge_ps(max_x, neg_one), _mm_cmple_ps(min_x, one)));
+    visible = _mm_and_ps(visible, _mm_and_ps(_mm_cmpge_ps(max_y, neg_one), _mm_cmple_ps(min_y, one)));
+
+    // NDC to tiles, clamped before converting so nothing overflows
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 zero = _mm_setzero_ps();
+    __m128 tiles = _mm_set1_ps((float)kClusterTilesX);
+    __m128 last = _mm_set1_ps((float)(kClusterTilesX-1));
+    __m128i x0 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(min_x, half), half), tiles), zero), last));
+    __m128i x1 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(max_x, half), half), tiles), zero), last));
+    tiles = _mm_set1_ps((float)kClusterTilesY);
+    last = _mm_set1_ps((float)(kClusterTilesY-1));
+    __m128i y0 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(min_y, half), half), tiles), zero), last));
+    __m128i y1 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(max_y, half), half), tiles), zero), last));
+
+    int32_t out_x0[4], out_x1[4], out_y0[4], out_y1[4];
+    float out_near[4], out_far[4];
+    _mm_storeu_si128((__m128i*)out_x0, x0);
+    _mm_storeu_si128((__m128i*)out_x1, x1);
+    _mm_storeu_si128((__m128i*)out_y0, y0);
+    _mm_storeu_si128((__m128i*)out_y1, y1);
+    _mm_storeu_ps(out_near, z_near);
+    _mm_storeu_ps(out_far, z_far);
+    int mask = _mm_movemask_ps(visible);
+    for(int ii=0; ii<4; ++ii) {
+        bounds[ii].x0 = out_x0[ii];
+        bounds[ii].x1 = out_x1[ii];
+        bounds[ii].y0 = out_y0[ii];
+        bounds[ii].y1 = out_y1[ii];
+        bounds[ii].z_near = out_near[ii];
+        bounds[ii].z_far = out_far[ii];
+        bounds[ii].visible = (mask >> ii) & 1;
+    }
+}
+
+}
+
+/*
+ * External
+ */
+void cluster_frustum_from_projection(ClusterFrustum* frustum, const float4x4* proj, float far_z) {
+    // See float4x4PerspectiveFovLH, r3.z is -near*r2.z
+    frustum->scale_x = proj->r0.x;
+    frustum->scale_y = proj->r1.y;
+    frustum->near_z = -proj->r3.z/proj->r2.z;
+    frustum->far_z = far_z;
+    frustum->slice_scale = kClusterSlices/logf(far_z/frustum->near_z);
+}
+uint32_t cluster_slice(const ClusterFrustum* frustum, float view_z) {
+    if(view_z <= frustum->near_z)
+        return 0;
+    float slice = logf(view_z/frustum->near_z)*frustum->slice_scale;
+    if(slice >= kClusterSlices-1)
+        return kClusterSlices-1;
+    return (uint32_t)slice;
+}
+uint32_t cluster_index(uint32_t x, uint32_t y, uint32_t slice) {
+    return (slice*kClusterTilesY + y)*kClusterTilesX + x;
+}
+uint32_t build_light_clusters(LightCluster* clusters, uint32_t* indices, uint32_t max_indices,
+                              const float4* spheres, uint32_t num_spheres,
+                              const float4x4* view, const ClusterFrustum* frustum) {
+    std::vector<LightBounds> bounds(num_spheres + 4);
+    uint32_t ii = 0;
+    for(; ii+4<=num_spheres; ii+=4)
+        _light_bounds(&bounds[ii], spheres+ii, view, frustum);
+    if(ii < num_spheres) {
+        // Pad the last group, the extra results are ignored
+        float4 last[4] = { float4zero, float4zero, float4zero, float4zero };
+        memcpy(last, spheres+ii, (num_spheres-ii)*sizeof(float4));
+        _light_bounds(&bounds[ii], last, view, frustum);
+    }
+
+    memset(clusters, 0, kNumClusters*sizeof(LightCluster));
+    for(ii=0; ii<num_spheres; ++ii) {
+        LightBounds& b = bounds[ii];
+        if(!b.visible)
+            continue;
+        b.z0 = cluster_slice(frustum, b.z_near);
+        b.z1 = cluster_slice(frustum, b.z_far);
+        for(uint32_t slice=b.z0; slice<=b.z1; ++slice) {
+            for(int32_t y=b.y0; y<=b.y1; ++y) {
+                for(int32_t x=b.x0; x<=b.x1; ++x)
+                    ++clusters[cluster_index((uint32_t)x, (uint32_t)y, slice)].count;
+            }
+        }
+    }
+
+    std::vector<uint32_t> capacity(kNumClusters);
+    uint32_t offset = 0;
+    for(uint32_t cluster=0; cluster<kNumClusters; ++cluster) {
+        uint32_t count = clusters[cluster].count;
+        if(count > max_indices - offset)
+            count = max_indices - offset;
+        clusters[cluster].offset = offset;
+        clusters[cluster].count = 0;
+        capacity[cluster] = count;
+        offset += count;
+    }
+
+    for(ii=0; ii<num_spheres; ++ii) {
+        const LightBounds& b = bounds[ii];
+        if(!b.visible)
+            continue;
+        for(uint32_t slice=b.z0; slice<=b.z1; ++slice) {
+            for(int32_t y=b.y0; y<=b.y1; ++y) {
+                for(int32_t x=b.x0; x<=b.x1; ++x) {
+                    uint32_t cluster = cluster_index((uint32_t)x, (uint32_t)y, slice);
+                    LightCluster& c = clusters[cluster];
+                    if(c.count < capacity[cluster])
+                        indices[c.offset + c.count++] = ii;
+                }
+            }
+        }
+    }
+    return offset;
+}
@@ -0,0 +1,69 @@
+/*! @file light_clusters.h
+ *  @brief Binning of local lights into view space clusters
+ *  @author Kyle Weicht
+ *  @date 10/19/26 11:40 PM
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ *	@addtogroup light_clusters light_clusters
+ *	@{
+ */
+#ifndef __light_clusters_h__
+#define __light_clusters_h__
+
+#include <stdint.h>
+#include "vec_math.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Screen tiles by exponential depth slices */
+enum {
+    kClusterTilesX = 16,
+    kClusterTilesY = 9,
+    kClusterSlices = 24,
+
+    kNumClusters = kClusterTilesX*kClusterTilesY*kClusterSlices
+};
+
+typedef struct {
+    float   scale_x;        /*!< View space x/z to NDC, proj.r0.x */
+    float   scale_y;
+    float   near_z;
+    float   far_z;          /*!< Anything beyond is in the last slice */
+    float   slice_scale;    /*!< kClusterSlices/log(far_z/near_z) */
+} ClusterFrustum;
+
+typedef struct {
+    uint32_t    offset;     /*!< Into the light index list */
+    uint32_t    count;
+} LightCluster;
+
+/*! @brief Sets up the clusters for a left handed perspective projection */
+void cluster_frustum_from_projection(ClusterFrustum* frustum, const float4x4* proj, float far_z);
+
+/*! @brief The depth slice a view space z falls in, clamped to the grid */
+uint32_t cluster_slice(const ClusterFrustum* frustum, float view_z);
+
+/*! @brief Cluster (x,y,slice) is at (slice*kClusterTilesY + y)*kClusterTilesX + x,
+ *         with tile (0,0) at the bottom left of the screen
+ */
+uint32_t cluster_index(uint32_t x, uint32_t y, uint32_t slice);
+
+/*! @brief Bins light bounding spheres into the kNumClusters clusters. The
+ *         bounds are conservative, a light can be listed in a cluster it
+ *         just misses but never left out of one it touches.
+ *  @param spheres World space center in xyz, radius in w
+ *  @param view World to view space, +z forward
+ *  @return The number of indices written. Clusters past max_indices are
+ *          truncated.
+ */
+uint32_t build_light_clusters(LightCluster* clusters, uint32_t* indices, uint32_t max_indices,
+                              const float4* spheres, uint32_t num_spheres,
+                              const float4x4* view, const ClusterFrustum* frustum);
+
+#ifdef __cplusplus
+} // extern "C" {
+#endif
+
+/* @} */
+#endif /* include guard */
@@ -6,12 +6,14 @@
 
 #include "application.h"
 #include <stdio.h>
+#include <string.h>
 #include "unit_test.h"
 
 #include "game.h"
 #include "world.h"
 
 #include "perlin_noise.h"
+#include "mesh_file.h"
 
 static Game*    _game = NULL;
 
@@ -77,5 +79,8 @@ void on_shutdown(void) {
 int main(int argc, const char* argv[])
 {
     RUN_ALL_TESTS(argc, argv, "-t");
+    // -c input output: cook an .obj or .mesh v1 into a .mesh v2
+    if(argc == 4 && strcmp(argv[1], "-c") == 0)
+        return convert_mesh_file(argv[2], argv[3]) ? 0 : 1;
     return ApplicationMain(argc, argv);
 }
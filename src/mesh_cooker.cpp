@@ -0,0 +1,394 @@
+/*! @file mesh_cooker.cpp
+ *  @author Kyle Weicht
+ *  @date 10/19/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "mesh_cooker.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <map>
+#include "assert.h"
+#include "application.h"
+#include "mesh_simplify.h"
+#include "tangents.h"
+#include "vertex_packing.h"
+
+// Reorder mesh indices/vertices for the post-transform cache, overdraw and
+// vertex fetch
+#define OPTIMIZE_MESHES 1
+// Give packed meshes a deduplicated position-only stream for depth passes
+#define POSITION_STREAMS 1
+// Build a chain of simplified LODs
+#define GENERATE_LODS 1
+// Split large meshes into meshlets for culling
+#define GENERATE_MESHLETS 1
+
+/*
+ * Internal
+ */
+namespace {
+
+enum { kMinLodTriangles = 64, kMinMeshletTriangles = 4096 };
+const float kMinLodReduction = 0.8f;    // Stop once a LOD keeps more than this
+const float kMaxLodError = 0.05f;       // Relative to the mesh radius
+
+struct int3 {
+    int p;
+    int t;
+    int n;
+
+    bool operator<(const int3& r) const {
+        if(p != r.p) return p < r.p;
+        if(t != r.t) return t < r.t;
+        return n < r.n;
+    }
+};
+
+void _read_indices(std::vector<uint32_t>& dst, const void* indices,
+                   uint32_t index_count, size_t index_size) {
+    dst.resize(index_count);
+    for(uint32_t ii=0; ii<index_count; ++ii) {
+        if(index_size == 2)
+            dst[ii] = ((const uint16_t*)indices)[ii];
+        else
+            dst[ii] = ((const uint32_t*)indices)[ii];
+    }
+}
+void _write_indices(std::vector<char>& dst, const std::vector<uint32_t>& indices, size_t index_size) {
+    dst.resize(indices.size()*index_size);
+    for(size_t ii=0; ii<indices.size(); ++ii) {
+        if(index_size == 2)
+            ((uint16_t*)&dst[0])[ii] = (uint16_t)indices[ii];
+        else
+            ((uint32_t*)&dst[0])[ii] = indices[ii];
+    }
+}
+
+uint32_t _optimize_mesh(std::vector<char>& vertices, std::vector<uint32_t>& indices,
+                        uint32_t vertex_count, size_t vertex_size) {
+    uint32_t index_count = (uint32_t)indices.size();
+    if(index_count < 3)
+        return vertex_count;
+    VertexCacheStats before = analyze_vertex_cache(&indices[0], index_count, vertex_count, kVertexCacheSize);
+
+    std::vector<uint32_t> optimized(index_count);
+    optimize_vertex_cache(&optimized[0], &indices[0], index_count, vertex_count);
+    optimize_overdraw(&optimized[0], index_count, &vertices[0], vertex_size, vertex_count, 1.05f);
+
+    std::vector<char> reordered(vertex_count*vertex_size);
+    vertex_count = optimize_vertex_fetch(&reordered[0], &optimized[0], index_count,
+                                         &vertices[0], vertex_count, vertex_size);
+    VertexCacheStats after = analyze_vertex_cache(&optimized[0], index_count, vertex_count, kVertexCacheSize);
+
+    reordered.resize(vertex_count*vertex_size);
+    vertices.swap(reordered);
+    indices.swap(optimized);
+
+    debug_output("Mesh (%d tris): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", index_count/3,
+                 before.acmr, after.acmr, before.atvr, after.atvr);
+    return vertex_count;
+}
+
+void _calculate_bounds(const void* vertices, size_t stride, uint32_t vertex_count,
+                       float3* center, float* radius) {
+    float3 min = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float3 max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for(uint32_t ii=0; ii<vertex_count; ++ii) {
+        const float3& p = *(const float3*)((const char*)vertices + ii*stride);
+        min.x = fminf(min.x, p.x); max.x = fmaxf(max.x, p.x);
+        min.y = fminf(min.y, p.y); max.y = fmaxf(max.y, p.y);
+        min.z = fminf(min.z, p.z); max.z = fmaxf(max.z, p.z);
+    }
+    if(vertex_count == 0)
+        min = max = float3zero;
+    *center = float3add(&min, &max);
+    *center = float3multiplyScalar(center, 0.5f);
+    float radius_sq = 0.0f;
+    for(uint32_t ii=0; ii<vertex_count; ++ii) {
+        const float3& p = *(const float3*)((const char*)vertices + ii*stride);
+        float3 d = float3subtract(&p, center);
+        radius_sq = fmaxf(radius_sq, float3lengthSq(&d));
+    }
+    *radius = sqrtf(radius_sq);
+}
+
+/* Appends each LOD's indices to `indices`, which starts out as the full mesh */
+uint32_t _generate_lods(MeshLod* lods, std::vector<uint32_t>& indices,
+                        const void* vertices, uint32_t vertex_count, size_t vertex_size,
+                        float radius) {
+    uint32_t index_count = (uint32_t)indices.size();
+    std::vector<uint32_t> simplified(index_count);
+    std::vector<uint32_t> optimized(index_count);
+    uint32_t num_lods = 1;
+    // Each LOD halves the previous one until that stops paying off
+    while(num_lods < kMaxMeshLods) {
+        const MeshLod& previous = lods[num_lods-1];
+        if(previous.index_count/3 < kMinLodTriangles)
+            break;
+        float error = 0.0f;
+        uint32_t count = simplify_mesh(&simplified[0], &indices[previous.index_offset], previous.index_count,
+                                       vertices, vertex_size, vertex_count,
+                                       previous.index_count/2, radius*kMaxLodError, &error);
+        if(count > previous.index_count*kMinLodReduction)
+            break;
+        optimize_vertex_cache(&optimized[0], &simplified[0], count, vertex_count);
+
+        MeshLod lod = { (uint32_t)indices.size(), count, previous.error + error };
+        indices.insert(indices.end(), optimized.begin(), optimized.begin()+count);
+        lods[num_lods++] = lod;
+        debug_output("Mesh (%d tris): LOD %d %d tris, error %f\n", index_count/3, num_lods-1,
+                     count/3, lod.error);
+    }
+    return num_lods;
+}
+
+void _build_meshlets(std::vector<Meshlet>& meshlets, std::vector<MeshletBounds>& bounds,
+                     const uint32_t* indices, uint32_t index_count,
+                     const void* vertices, uint32_t vertex_count, size_t vertex_size) {
+    meshlets.resize(meshlet_count_bound(index_count, kMeshletMaxVertices, kMeshletMaxTriangles));
+    uint32_t count = build_meshlets(&meshlets[0], indices, index_count, vertex_count,
+                                    kMeshletMaxVertices, kMeshletMaxTriangles);
+    meshlets.resize(count);
+    bounds.resize(count);
+    uint32_t backface_cullable = 0;
+    for(uint32_t ii=0; ii<count; ++ii) {
+        bounds[ii] = compute_meshlet_bounds(indices + meshlets[ii].index_offset, meshlets[ii].triangle_count,
+                                            vertices, vertex_size);
+        if(bounds[ii].cone_cutoff < 1.0f)
+            ++backface_cullable;
+    }
+    debug_output("Mesh (%d tris): %d meshlets, %d with normal cones\n", index_count/3, count, backface_cullable);
+}
+
+void _create_position_stream(CookedMesh* cooked, const MeshLod* lods, uint32_t num_lods,
+                             const std::vector<uint32_t>& indices, uint32_t vertex_count, size_t index_size) {
+    uint32_t index_count = (uint32_t)indices.size();
+    std::vector<VtxPackedPos> positions(vertex_count);
+    std::vector<uint32_t> position_indices(index_count);
+    uint32_t position_count = deduplicate_positions(&positions[0], sizeof(VtxPackedPos), &position_indices[0],
+                                                    &cooked->vertices[0], kVertexSizes[kVtxPackedPosNormTanTex],
+                                                    sizeof(positions[0].pos), vertex_count,
+                                                    &indices[0], index_count);
+    // Merged seams give the depth pass better cache reuse than the full mesh
+    std::vector<uint32_t> optimized(index_count);
+    for(uint32_t ii=0; ii<num_lods; ++ii) {
+        optimize_vertex_cache(&optimized[lods[ii].index_offset], &position_indices[lods[ii].index_offset],
+                              lods[ii].index_count, position_count);
+    }
+    cooked->positions.resize(position_count);
+    position_count = optimize_vertex_fetch(&cooked->positions[0], &optimized[0], index_count,
+                                           &positions[0], position_count, sizeof(VtxPackedPos));
+    cooked->positions.resize(position_count);
+    _write_indices(cooked->position_indices, optimized, index_size);
+
+    debug_output("Mesh (%d tris): Depth stream %d -> %d vertices, %d -> %d bytes\n", lods[0].index_count/3,
+                 vertex_count, position_count,
+                 (int)(vertex_count*kVertexSizes[kVtxPackedPosNormTanTex]),
+                 (int)(position_count*sizeof(VtxPackedPos)));
+}
+
+}
+
+/*
+ * External
+ */
+void cook_mesh(CookedMesh* cooked, uint32_t vertex_count, VertexType vertex_type,
+               uint32_t index_count, size_t index_size,
+               const void* vertices, const void* indices) {
+    size_t vertex_size = kVertexSizes[vertex_type];
+    std::vector<uint32_t> all_indices;
+    _read_indices(all_indices, indices, index_count, index_size);
+    cooked->vertices.assign((const char*)vertices, (const char*)vertices + vertex_count*vertex_size);
+#if OPTIMIZE_MESHES
+    vertex_count = _optimize_mesh(cooked->vertices, all_indices, vertex_count, vertex_size);
+#endif
+    MeshData& data = cooked->data;
+    _calculate_bounds(&cooked->vertices[0], vertex_size, vertex_count, &data.center, &data.radius);
+
+    // LODs follow the full mesh in the same index buffer
+    data.lods[0].index_offset = 0;
+    data.lods[0].index_count = index_count;
+    data.lods[0].error = 0.0f;
+    data.num_lods = 1;
+    bool is_3d = (vertex_type != kVtxPosTex);
+#if GENERATE_LODS
+    if(is_3d)
+        data.num_lods = _generate_lods(data.lods, all_indices, &cooked->vertices[0], vertex_count, vertex_size, data.radius);
+#endif
+#if GENERATE_MESHLETS
+    if(is_3d && index_count/3 >= kMinMeshletTriangles) {
+        _build_meshlets(cooked->meshlets, cooked->meshlet_bounds, &all_indices[0], index_count,
+                        &cooked->vertices[0], vertex_count, vertex_size);
+    }
+#endif
+
+    // All 3D meshes are expanded to have tangents, then packed
+    if(vertex_type == kVtxPosNormTex) {
+        std::vector<char> tangent_vertices(vertex_count*sizeof(VtxPosNormTanBitanTex));
+        calculate_tangents((VtxPosNormTanBitanTex*)&tangent_vertices[0], (const VtxPosNormTex*)&cooked->vertices[0],
+                           vertex_count, &all_indices[0], index_count);
+        cooked->vertices.swap(tangent_vertices);
+        vertex_type = kVtxPosNormTanBitanTex;
+    }
+    data.dequantize = float4x4identity;
+    if(vertex_type == kVtxPosNormTanBitanTex) {
+        std::vector<char> packed_vertices(vertex_count*sizeof(VtxPackedPosNormTanTex));
+        data.dequantize = pack_vertices((VtxPackedPosNormTanTex*)&packed_vertices[0],
+                                        (const VtxPosNormTanBitanTex*)&cooked->vertices[0], vertex_count);
+        cooked->vertices.swap(packed_vertices);
+        vertex_type = kVtxPackedPosNormTanTex;
+    }
+#if POSITION_STREAMS
+    if(vertex_type == kVtxPackedPosNormTanTex)
+        _create_position_stream(cooked, data.lods, data.num_lods, all_indices, vertex_count, index_size);
+#endif
+    _write_indices(cooked->indices, all_indices, index_size);
+
+    data.vertex_type = vertex_type;
+    data.vertex_count = vertex_count;
+    data.vertices = cooked->vertices.empty() ? NULL : &cooked->vertices[0];
+    data.index_size = (uint32_t)index_size;
+    data.index_count = (uint32_t)all_indices.size();
+    data.indices = cooked->indices.empty() ? NULL : &cooked->indices[0];
+    data.position_count = (uint32_t)cooked->positions.size();
+    data.positions = cooked->positions.empty() ? NULL : &cooked->positions[0];
+    data.position_indices = cooked->position_indices.empty() ? NULL : &cooked->position_indices[0];
+    data.num_meshlets = (uint32_t)cooked->meshlets.size();
+    data.meshlets = cooked->meshlets.empty() ? NULL : &cooked->meshlets[0];
+    data.meshlet_bounds = cooked->meshlet_bounds.empty() ? NULL : &cooked->meshlet_bounds[0];
+}
+int load_obj(std::vector<VtxPosNormTex>* vertices, std::vector<uint32_t>* indices, const char* filename) {
+    std::vector<float3> positions;
+    std::vector<float3> normals;
+    std::vector<float2> texcoords;
+
+    std::vector<int3>   indicies;
+
+    int textured = 0;
+
+    float2 tex = {0.5f, 0.5f};
+    texcoords.push_back(tex);
+
+    FILE* file = fopen(filename, "rt");
+    if(file == NULL)
+        return 0;
+    while(1) {
+        char line_header[128];
+        int res = fscanf(file, "%s", line_header);
+        if(res == EOF)
+            break;
+
+        if(strcmp(line_header, "v") == 0) {
+            float3 v;
+            fscanf(file, "%f %f %f\n", &v.x, &v.y, &v.z);
+            positions.push_back(v);
+            textured = 0;
+        } else if(strcmp(line_header, "vt") == 0) {
+            float2 t;
+            fscanf(file, "%f %f\n", &t.x, &t.y);
+            texcoords.push_back(t);
+            textured = 1;
+        } else if(strcmp(line_header, "vn") == 0) {
+            float3 n;
+            fscanf(file, "%f %f %f\n", &n.x, &n.y, &n.z);
+            normals.push_back(n);
+        } else if(strcmp(line_header, "f") == 0) {
+            int3 triangle[4];
+            int matches;
+            if(textured) {
+                matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n",
+                                 &triangle[0].p, &triangle[0].t, &triangle[0].n,
+                                 &triangle[1].p, &triangle[1].t, &triangle[1].n,
+                                 &triangle[2].p, &triangle[2].t, &triangle[2].n,
+                                 &triangle[3].p, &triangle[3].t, &triangle[3].n);
+                if(matches != 9 && matches != 12) {
+                    debug_output("Can't load this OBJ\n");
+                    fclose(file);
+                    return 0;
+                }
+            } else {
+                matches = fscanf(file, "%d//%d %d//%d %d//%d %d//%d\n",
+                                 &triangle[0].p, &triangle[0].n,
+                                 &triangle[1].p, &triangle[1].n,
+                                 &triangle[2].p, &triangle[2].n,
+                                 &triangle[3].p, &triangle[3].n);
+                if(matches != 6 && matches != 8) {
+                    debug_output("Can't load this OBJ\n");
+                    fclose(file);
+                    return 0;
+                }
+                triangle[0].t = 0;
+                triangle[1].t = 0;
+                triangle[2].t = 0;
+                matches = 9;
+                if(matches == 8) {
+                    triangle[3].t = 0;
+                    matches = 12;
+                }
+            }
+            indicies.push_back(triangle[0]);
+            indicies.push_back(triangle[1]);
+            indicies.push_back(triangle[2]);
+            if(matches == 12) {
+                indicies.push_back(triangle[0]);
+                indicies.push_back(triangle[2]);
+                indicies.push_back(triangle[3]);
+            }
+        } else {
+            // A comment?
+            char buffer[1024];
+            fgets(buffer, sizeof(buffer), file);
+        }
+    }
+    fclose(file);
+
+    // Weld identical position/texcoord/normal triples so the mesh is indexed
+    std::map<int3, uint32_t> vertex_map;
+    vertices->clear();
+    indices->resize(indicies.size());
+    for(int ii=0; ii<(int)indicies.size(); ++ii) {
+        std::map<int3, uint32_t>::iterator iter = vertex_map.find(indicies[ii]);
+        if(iter != vertex_map.end()) {
+            (*indices)[ii] = iter->second;
+            continue;
+        }
+        int pos_index = indicies[ii].p-1;
+        int tex_index = indicies[ii].t;
+        int norm_index = indicies[ii].n-1;
+        VtxPosNormTex vertex;
+        vertex.pos = positions[pos_index];
+        vertex.tex = texcoords[tex_index];
+        vertex.norm = normals[norm_index];
+        uint32_t index = (uint32_t)vertices->size();
+        vertices->push_back(vertex);
+        vertex_map[indicies[ii]] = index;
+        (*indices)[ii] = index;
+    }
+    return 1;
+}
+int load_mesh_v1(std::vector<VtxPosNormTex>* vertices, std::vector<uint32_t>* indices,
+                 const void* data, size_t size) {
+    // Header: vertex stride, vertex count, index size, index count
+    const uint32_t* header = (const uint32_t*)data;
+    if(size < sizeof(uint32_t)*4)
+        return 0;
+    uint32_t nVertexStride = header[0];
+    uint32_t nVertexCount = header[1];
+    uint32_t nIndexSize = header[2];
+    if(nIndexSize > 8) // Convert from bits to bytes
+        nIndexSize /= 8;
+    uint32_t nIndexCount = header[3];
+    if(nVertexStride != sizeof(VtxPosNormTex) || (nIndexSize != 2 && nIndexSize != 4))
+        return 0;
+    if(size < sizeof(uint32_t)*4 + nVertexStride*nVertexCount + nIndexSize*nIndexCount)
+        return 0;
+
+    const char* pData = (const char*)(header + 4);
+    const VtxPosNormTex* v = (const VtxPosNormTex*)pData;
+    vertices->assign(v, v + nVertexCount);
+    _read_indices(*indices, pData + (nVertexStride * nVertexCount), nIndexCount, nIndexSize);
+    return 1;
+}
@@ -0,0 +1,73 @@
+/*! @file mesh_cooker.h
+ *  @brief Turns source geometry into the layout the renderer draws: optimized,
+ *         packed, with LODs, meshlets and a depth-only position stream
+ *  @author Kyle Weicht
+ *  @date 10/19/26 8:30 PM
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ *	@addtogroup mesh_cooker mesh_cooker
+ *	@{
+ */
+#ifndef __mesh_cooker_h__
+#define __mesh_cooker_h__
+
+#include <stdint.h>
+#include <vector>
+#include "vec_math.h"
+#include "render.h"
+#include "mesh_optimizer.h"
+
+enum { kMaxMeshLods = 6 };
+
+typedef struct {
+    uint32_t    index_offset;   // First index of the LOD in the index buffer
+    uint32_t    index_count;
+    float       error;          // Model space distance from the full detail surface
+} MeshLod;
+
+/*! Everything needed to create a mesh on the GPU. The pointers either point
+ *  into a CookedMesh or straight into a loaded .mesh v2 file.
+ */
+typedef struct {
+    VertexType              vertex_type;
+    uint32_t                vertex_count;
+    const void*             vertices;
+    uint32_t                index_size;
+    uint32_t                index_count;        // All LODs
+    const void*             indices;
+    uint32_t                position_count;     // Depth-only stream, 0 if there isn't one
+    const VtxPackedPos*     positions;
+    const void*             position_indices;   // Same size and LOD ranges as `indices`
+    MeshLod                 lods[kMaxMeshLods]; // lods[0] is the full mesh
+    uint32_t                num_lods;
+    uint32_t                num_meshlets;       // Consecutive runs of lods[0]
+    const Meshlet*          meshlets;
+    const MeshletBounds*    meshlet_bounds;     // Model space, before quantization
+    float4x4                dequantize;
+    float3                  center;             // Model space bounding sphere
+    float                   radius;
+} MeshData;
+
+typedef struct {
+    MeshData                    data;
+    std::vector<char>           vertices;
+    std::vector<char>           indices;
+    std::vector<VtxPackedPos>   positions;
+    std::vector<char>           position_indices;
+    std::vector<Meshlet>        meshlets;
+    std::vector<MeshletBounds>  meshlet_bounds;
+} CookedMesh;
+
+/*! @brief Runs the whole pipeline. 3D vertex types come out as
+ *         kVtxPackedPosNormTanTex, kVtxPosTex is only optimized.
+ */
+void cook_mesh(CookedMesh* cooked, uint32_t vertex_count, VertexType vertex_type,
+               uint32_t index_count, size_t index_size,
+               const void* vertices, const void* indices);
+
+/*! @brief Source formats. Return 0 on failure */
+int load_obj(std::vector<VtxPosNormTex>* vertices, std::vector<uint32_t>* indices, const char* filename);
+int load_mesh_v1(std::vector<VtxPosNormTex>* vertices, std::vector<uint32_t>* indices,
+                 const void* data, size_t size);
+
+/* @} */
+#endif /* include guard */
@@ -0,0 +1,220 @@
+/*! @file mesh_file.cpp
+ *  @author Kyle Weicht
+ *  @date 10/19/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "mesh_file.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "application.h"
+
+/*
+ * Internal
+ */
+namespace {
+
+uint32_t _align(uint32_t offset) {
+    return (offset + kMeshFileAlignment-1) & ~(uint32_t)(kMeshFileAlignment-1);
+}
+void _add_chunk(std::vector<char>* file_data, MeshFileChunk* chunk, const void* data, size_t size) {
+    chunk->offset = 0;
+    chunk->size = (uint32_t)size;
+    if(size == 0)
+        return;
+    chunk->offset = _align((uint32_t)file_data->size());
+    file_data->resize(chunk->offset + size);
+    memcpy(&(*file_data)[chunk->offset], data, size);
+}
+/* Sizes are 64 bit so a crafted count can't wrap into a match, even in a
+ * 32 bit build
+ */
+int _chunk_data(const void** chunk_data, const MeshFileChunk& chunk,
+                const char* data, size_t size, uint64_t expected_size) {
+    *chunk_data = NULL;
+    if(chunk.size != expected_size)
+        return 0;
+    if(expected_size == 0)
+        return 1;
+    if(chunk.offset % kMeshFileAlignment || chunk.offset < sizeof(MeshFileHeader) ||
+       chunk.offset > size || size - chunk.offset < chunk.size)
+        return 0;
+    *chunk_data = data + chunk.offset;
+    return 1;
+}
+int _indices_valid(const void* indices, uint32_t index_size, uint32_t index_count, uint32_t vertex_count) {
+    for(uint32_t ii=0; ii<index_count; ++ii) {
+        uint32_t index = (index_size == 2) ? ((const uint16_t*)indices)[ii] : ((const uint32_t*)indices)[ii];
+        if(index >= vertex_count)
+            return 0;
+    }
+    return 1;
+}
+int _read_file(std::vector<char>* file_data, const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if(file == NULL)
+        return 0;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    file_data->resize(size > 0 ? (size_t)size : 0);
+    size_t read = file_data->empty() ? 0 : fread(&(*file_data)[0], 1, file_data->size(), file);
+    fclose(file);
+    return size > 0 && read == (size_t)size;
+}
+
+}
+
+/*
+ * External
+ */
+void serialize_mesh_file(std::vector<char>* file_data, const MeshData* mesh) {
+    MeshFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kMeshFileMagic;
+    header.version = kMeshFileVersion;
+    header.vertex_type = mesh->vertex_type;
+    header.vertex_count = mesh->vertex_count;
+    header.index_size = mesh->index_size;
+    header.index_count = mesh->index_count;
+    header.position_count = mesh->position_count;
+    header.num_lods = mesh->num_lods;
+    header.num_meshlets = mesh->num_meshlets;
+    header.center = mesh->center;
+    header.radius = mesh->radius;
+    header.dequantize = mesh->dequantize;
+    memcpy(header.lods, mesh->lods, sizeof(header.lods));
+
+    file_data->assign(sizeof(header), 0);
+    _add_chunk(file_data, &header.vertices, mesh->vertices, mesh->vertex_count*kVertexSizes[mesh->vertex_type]);
+    _add_chunk(file_data, &header.indices, mesh->indices, mesh->index_count*mesh->index_size);
+    _add_chunk(file_data, &header.positions, mesh->positions, mesh->position_count*sizeof(VtxPackedPos));
+    if(mesh->position_count)
+        _add_chunk(file_data, &header.position_indices, mesh->position_indices, mesh->index_count*mesh->index_size);
+    _add_chunk(file_data, &header.meshlets, mesh->meshlets, mesh->num_meshlets*sizeof(Meshlet));
+    _add_chunk(file_data, &header.meshlet_bounds, mesh->meshlet_bounds, mesh->num_meshlets*sizeof(MeshletBounds));
+    file_data->resize(_align((uint32_t)file_data->size()));
+    header.file_size = (uint32_t)file_data->size();
+    memcpy(&(*file_data)[0], &header, sizeof(header));
+}
+int write_mesh_file(const char* filename, const MeshData* mesh) {
+    std::vector<char> file_data;
+    serialize_mesh_file(&file_data, mesh);
+    FILE* file = fopen(filename, "wb");
+    if(file == NULL)
+        return 0;
+    size_t written = fwrite(&file_data[0], 1, file_data.size(), file);
+    fclose(file);
+    return written == file_data.size();
+}
+int read_mesh_file(MeshData* mesh, const void* data, size_t size) {
+    if(size < sizeof(MeshFileHeader))
+        return 0;
+    const MeshFileHeader* header = (const MeshFileHeader*)data;
+    if(header->magic != kMeshFileMagic || header->version != kMeshFileVersion || header->file_size != size)
+        return 0;
+    if(header->vertex_type >= kNUM_VERTEX_TYPES || (header->index_size != 2 && header->index_size != 4))
+        return 0;
+    if(header->num_lods == 0 || header->num_lods > kMaxMeshLods)
+        return 0;
+    for(uint32_t ii=0; ii<header->num_lods; ++ii) {
+        const MeshLod& lod = header->lods[ii];
+        if(lod.index_offset > header->index_count || header->index_count - lod.index_offset < lod.index_count)
+            return 0;
+    }
+
+    const char* bytes = (const char*)data;
+    uint64_t index_bytes = (uint64_t)header->index_count*header->index_size;
+    const void* vertices;
+    const void* indices;
+    const void* positions;
+    const void* position_indices;
+    const void* meshlets;
+    const void* meshlet_bounds;
+    if(!_chunk_data(&vertices, header->vertices, bytes, size,
+                    (uint64_t)header->vertex_count*kVertexSizes[header->vertex_type]) ||
+       !_chunk_data(&indices, header->indices, bytes, size, index_bytes) ||
+       !_chunk_data(&positions, header->positions, bytes, size, (uint64_t)header->position_count*sizeof(VtxPackedPos)) ||
+       !_chunk_data(&position_indices, header->position_indices, bytes, size, header->position_count ? index_bytes : 0) ||
+       !_chunk_data(&meshlets, header->meshlets, bytes, size, (uint64_t)header->num_meshlets*sizeof(Meshlet)) ||
+       !_chunk_data(&meshlet_bounds, header->meshlet_bounds, bytes, size,
+                    (uint64_t)header->num_meshlets*sizeof(MeshletBounds)))
+        return 0;
+
+    // Out of range indices would read past the vertex buffers on the GPU
+    if(!_indices_valid(indices, header->index_size, header->index_count, header->vertex_count))
+        return 0;
+    if(position_indices && !_indices_valid(position_indices, header->index_size, header->index_count, header->position_count))
+        return 0;
+    for(uint32_t ii=0; ii<header->num_meshlets; ++ii) {
+        const Meshlet& meshlet = ((const Meshlet*)meshlets)[ii];
+        if(meshlet.index_offset > header->lods[0].index_count ||
+           header->lods[0].index_count - meshlet.index_offset < (uint64_t)meshlet.triangle_count*3)
+            return 0;
+    }
+
+    mesh->vertex_type = (VertexType)header->vertex_type;
+    mesh->vertex_count = header->vertex_count;
+    mesh->vertices = vertices;
+    mesh->index_size = header->index_size;
+    mesh->index_count = header->index_count;
+    mesh->indices = indices;
+    mesh->position_count = header->position_count;
+    mesh->positions = (const VtxPackedPos*)positions;
+    mesh->position_indices = position_indices;
+    memcpy(mesh->lods, header->lods, sizeof(mesh->lods));
+    mesh->num_lods = header->num_lods;
+    mesh->num_meshlets = header->num_meshlets;
+    mesh->meshlets = (const Meshlet*)meshlets;
+    mesh->meshlet_bounds = (const MeshletBounds*)meshlet_bounds;
+    mesh->dequantize = header->dequantize;
+    mesh->center = header->center;
+    mesh->radius = header->radius;
+    return 1;
+}
+int load_mesh_data(MeshData* mesh, std::vector<char>* file_data, CookedMesh* cooked, const char* filename) {
+    std::vector<VtxPosNormTex> vertices;
+    std::vector<uint32_t> indices;
+
+    const char* ext = (filename + strlen(filename))-3;
+    if(strncmp(ext, "obj", 4) == 0) {
+        if(!load_obj(&vertices, &indices, filename))
+            return 0;
+    } else {
+        if(!_read_file(file_data, filename))
+            return 0;
+        if(file_data->size() >= sizeof(uint32_t) && *(const uint32_t*)&(*file_data)[0] == kMeshFileMagic) {
+            if(!read_mesh_file(mesh, &(*file_data)[0], file_data->size())) {
+                debug_output("%s: Invalid .mesh file\n", filename);
+                return 0;
+            }
+            return 1;
+        }
+        // Old files get cooked every time they're loaded
+        if(!load_mesh_v1(&vertices, &indices, &(*file_data)[0], file_data->size()))
+            return 0;
+        file_data->clear();
+    }
+    if(indices.empty())
+        return 0;
+    cook_mesh(cooked, (uint32_t)vertices.size(), kVtxPosNormTex, (uint32_t)indices.size(), sizeof(uint32_t),
+              &vertices[0], &indices[0]);
+    *mesh = cooked->data;
+    return 1;
+}
+int convert_mesh_file(const char* input, const char* output) {
+    MeshData mesh;
+    std::vector<char> file_data;
+    CookedMesh cooked;
+    if(!load_mesh_data(&mesh, &file_data, &cooked, input)) {
+        debug_output("Can't load %s\n", input);
+        return 0;
+    }
+    if(!write_mesh_file(output, &mesh)) {
+        debug_output("Can't write %s\n", output);
+        return 0;
+    }
+    debug_output("%s -> %s: %d vertices, %d indices, %d LODs, %d meshlets\n", input, output,
+                 mesh.vertex_count, mesh.index_count, mesh.num_lods, mesh.num_meshlets);
+    return 1;
+}
@@ -0,0 +1,75 @@
+/*! @file mesh_file.h
+ *  @brief The .mesh v2 container: cooked meshes stored in the layout the GPU
+ *         consumes, so loading is a read and a glBufferData per stream
+ *  @author Kyle Weicht
+ *  @date 10/19/26 9:10 PM
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ *	@addtogroup mesh_file mesh_file
+ *	@{
+ */
+#ifndef __mesh_file_h__
+#define __mesh_file_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "mesh_cooker.h"
+
+enum {
+    kMeshFileMagic = 0x4853454D, /* 'MESH' */
+    kMeshFileVersion = 2,
+    kMeshFileAlignment = 16
+};
+
+typedef struct {
+    uint32_t    offset;     // From the start of the file, kMeshFileAlignment aligned
+    uint32_t    size;       // In bytes, 0 if the chunk isn't present
+} MeshFileChunk;
+
+/*! Little endian, followed by the chunks. v1 files have no magic, they start
+ *  with the vertex stride.
+ */
+typedef struct {
+    uint32_t        magic;
+    uint32_t        version;
+    uint32_t        file_size;
+    uint32_t        vertex_type;
+    uint32_t        vertex_count;
+    uint32_t        index_size;
+    uint32_t        index_count;
+    uint32_t        position_count;
+    uint32_t        num_lods;
+    uint32_t        num_meshlets;
+    float3          center;
+    float           radius;
+    float4x4        dequantize;
+    MeshLod         lods[kMaxMeshLods];
+    MeshFileChunk   vertices;
+    MeshFileChunk   indices;
+    MeshFileChunk   positions;
+    MeshFileChunk   position_indices;
+    MeshFileChunk   meshlets;
+    MeshFileChunk   meshlet_bounds;
+} MeshFileHeader;
+
+/*! @brief Serializes a mesh into a .mesh v2 image */
+void serialize_mesh_file(std::vector<char>* file_data, const MeshData* mesh);
+int write_mesh_file(const char* filename, const MeshData* mesh);
+
+/*! @brief Validates a .mesh v2 image and points `mesh` into it. No data is
+ *         copied, so `data` has to outlive `mesh`.
+ *  @return 0 if the data isn't a valid v2 file
+ */
+int read_mesh_file(MeshData* mesh, const void* data, size_t size);
+
+/*! @brief Loads .obj, .mesh v1 or .mesh v2 files. v2 files point into
+ *         `file_data`, the others are cooked into `cooked`.
+ *  @return 0 on failure
+ */
+int load_mesh_data(MeshData* mesh, std::vector<char>* file_data, CookedMesh* cooked, const char* filename);
+
+/*! @brief Cooks an .obj or .mesh v1 file into a .mesh v2 file */
+int convert_mesh_file(const char* input, const char* output);
+
+/* @} */
+#endif /* include guard */
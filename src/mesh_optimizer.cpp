@@ -0,0 +1,468 @@
+/*! @file mesh_optimizer.cpp
+ *  @author Kyle Weicht
+ *  @date 10/19/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "mesh_optimizer.h"
+
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <vector>
+#include <algorithm>
+#include "assert.h"
+
+/*
+ * Internal
+ */
+namespace {
+
+// Tuning constants from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+const float kCacheDecayPower    = 1.5f;
+const float kLastTriScore       = 0.75f;
+const float kValenceBoostScale  = 2.0f;
+const float kValenceBoostPower  = 0.5f;
+
+float _vertex_score(int cache_position, uint32_t live_triangles) {
+    if(live_triangles == 0)
+        return -1.0f; // No triangles left, never pick this vertex
+
+    float score = 0.0f;
+    if(cache_position < 0) {
+        // Not in the cache
+    } else if(cache_position < 3) {
+        // The last triangle's vertices get a fixed score so the same
+        // triangle isn't favored over its neighbors
+        score = kLastTriScore;
+    } else {
+        const float scaler = 1.0f / (kVertexCacheSize - 3);
+        score = 1.0f - (cache_position - 3) * scaler;
+        score = powf(score, kCacheDecayPower);
+    }
+    // Boost vertices with few triangles left so lone triangles get cleaned up
+    score += kValenceBoostScale * powf((float)live_triangles, -kValenceBoostPower);
+    return score;
+}
+
+const float3& _position(const void* positions, size_t stride, uint32_t index) {
+    return *(const float3*)((const char*)positions + stride*index);
+}
+
+uint32_t _hash_bytes(const void* data, size_t size) {
+    // FNV-1a
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint32_t hash = 2166136261u;
+    for(size_t ii=0; ii<size; ++ii) {
+        hash ^= bytes[ii];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+struct Cluster {
+    uint32_t    start;
+    uint32_t    count;
+    float       sort_key;
+};
+bool _cluster_greater(const Cluster& l, const Cluster& r) {
+    return l.sort_key > r.sort_key;
+}
+
+/* Splits a cache-optimized index buffer wherever the cache would have been
+ * flushed, then splits further while the cluster ACMR stays under threshold.
+ * Returns the triangle index each cluster starts at.
+ */
+void _generate_clusters(std::vector<uint32_t>& clusters, const uint32_t* indices,
+                        uint32_t index_count, uint32_t vertex_count, float threshold) {
+    uint32_t triangle_count = index_count/3;
+    std::vector<uint32_t> cache_time(vertex_count, 0);
+    std::vector<uint32_t> hard_boundaries;
+    uint32_t time = kVertexCacheSize+1;
+
+    // Hard boundaries: every vertex of a triangle missed the cache
+    for(uint32_t ii=0; ii<triangle_count; ++ii) {
+        int misses = 0;
+        for(int jj=0; jj<3; ++jj) {
+            uint32_t index = indices[ii*3+jj];
+            if(time - cache_time[index] > kVertexCacheSize) {
+                cache_time[index] = time++;
+                ++misses;
+            }
+        }
+        if(misses == 3 || ii == 0)
+            hard_boundaries.push_back(ii);
+    }
+    hard_boundaries.push_back(triangle_count);
+
+    // Soft boundaries: inside each hard cluster, cut as soon as the running
+    // ACMR gets within threshold of the cluster's overall ACMR
+    for(size_t cc=0; cc+1<hard_boundaries.size(); ++cc) {
+        uint32_t start = hard_boundaries[cc];
+        uint32_t end = hard_boundaries[cc+1];
+        VertexCacheStats stats = analyze_vertex_cache(indices + start*3, (end-start)*3,
+                                                      vertex_count, kVertexCacheSize);
+        float target = stats.acmr * threshold;
+
+        std::fill(cache_time.begin(), cache_time.end(), 0);
+        time = kVertexCacheSize+1;
+        uint32_t misses = 0;
+        uint32_t cluster_start = start;
+        clusters.push_back(start);
+        for(uint32_t ii=start; ii<end; ++ii) {
+            for(int jj=0; jj<3; ++jj) {
+                uint32_t index = indices[ii*3+jj];
+                if(time - cache_time[index] > kVertexCacheSize) {
+                    cache_time[index] = time++;
+                    ++misses;
+                }
+            }
+            uint32_t triangles = ii - cluster_start + 1;
+            if(ii+1 < end && triangles > 8 && misses <= target*triangles) {
+                clusters.push_back(ii+1);
+                cluster_start = ii+1;
+                misses = 0;
+                // Start the next cluster with a cold cache, like the GPU might
+                std::fill(cache_time.begin(), cache_time.end(), 0);
+                time = kVertexCacheSize+1;
+            }
+        }
+    }
+}
+
+}
+
+/*
+ * External
+ */
+VertexCacheStats analyze_vertex_cache(const uint32_t* indices, uint32_t index_count,
+                                      uint32_t vertex_count, uint32_t cache_size) {
+    VertexCacheStats stats = { 0.0f, 0.0f };
+    if(index_count < 3 || vertex_count == 0)
+        return stats;
+
+    // FIFO cache: a vertex is a hit if it was inserted less than `cache_size`
+    // insertions ago
+    std::vector<uint32_t> cache_time(vertex_count, 0);
+    uint32_t time = cache_size+1;
+    uint32_t misses = 0;
+    for(uint32_t ii=0; ii<index_count; ++ii) {
+        uint32_t index = indices[ii];
+        assert(index < vertex_count);
+        if(time - cache_time[index] > cache_size) {
+            cache_time[index] = time++;
+            ++misses;
+        }
+    }
+    stats.acmr = misses / (float)(index_count/3);
+    stats.atvr = misses / (float)vertex_count;
+    return stats;
+}
+void optimize_vertex_cache(uint32_t* dst, const uint32_t* indices,
+                           uint32_t index_count, uint32_t vertex_count) {
+    assert(dst != indices);
+    uint32_t triangle_count = index_count/3;
+    if(triangle_count == 0)
+        return;
+
+    // Vertex -> triangle adjacency
+    std::vector<uint32_t> live_triangles(vertex_count, 0);
+    for(uint32_t ii=0; ii<index_count; ++ii)
+        live_triangles[indices[ii]]++;
+
+    std::vector<uint32_t> adjacency_offset(vertex_count, 0);
+    uint32_t offset = 0;
+    for(uint32_t ii=0; ii<vertex_count; ++ii) {
+        adjacency_offset[ii] = offset;
+        offset += live_triangles[ii];
+    }
+    std::vector<uint32_t> adjacency(index_count);
+    {
+        std::vector<uint32_t> fill = adjacency_offset;
+        for(uint32_t ii=0; ii<index_count; ++ii)
+            adjacency[fill[indices[ii]]++] = ii/3;
+    }
+
+    // Initial scores
+    std::vector<int>    cache_position(vertex_count, -1);
+    std::vector<float>  vertex_score(vertex_count);
+    for(uint32_t ii=0; ii<vertex_count; ++ii)
+        vertex_score[ii] = _vertex_score(-1, live_triangles[ii]);
+
+    std::vector<float>  triangle_score(triangle_count);
+    std::vector<char>   emitted(triangle_count, 0);
+    for(uint32_t ii=0; ii<triangle_count; ++ii) {
+        triangle_score[ii] = vertex_score[indices[ii*3+0]] +
+                             vertex_score[indices[ii*3+1]] +
+                             vertex_score[indices[ii*3+2]];
+    }
+
+    uint32_t cache[kVertexCacheSize+3];
+    uint32_t cache_count = 0;
+    uint32_t input_cursor = 0;
+    uint32_t best_triangle = 0;
+    for(uint32_t ii=1; ii<triangle_count; ++ii) {
+        if(triangle_score[ii] > triangle_score[best_triangle])
+            best_triangle = ii;
+    }
+
+    for(uint32_t output=0; output<triangle_count; ++output) {
+        if(best_triangle == ~0u) {
+            // Nothing in the cache is connected to anything left, fall back
+            // to the next unemitted triangle in input order
+            while(emitted[input_cursor])
+                ++input_cursor;
+            best_triangle = input_cursor;
+        }
+        const uint32_t* tri = indices + best_triangle*3;
+        dst[output*3+0] = tri[0];
+        dst[output*3+1] = tri[1];
+        dst[output*3+2] = tri[2];
+        emitted[best_triangle] = 1;
+
+        // Push the triangle's vertices to the front of the cache
+        uint32_t new_cache[kVertexCacheSize+3];
+        uint32_t new_count = 0;
+        for(int jj=0; jj<3; ++jj) {
+            uint32_t v = tri[jj];
+            new_cache[new_count++] = v;
+
+            // Remove the triangle from the vertex's adjacency
+            uint32_t* begin = &adjacency[adjacency_offset[v]];
+            uint32_t count = live_triangles[v];
+            for(uint32_t kk=0; kk<count; ++kk) {
+                if(begin[kk] == best_triangle) {
+                    begin[kk] = begin[count-1];
+                    break;
+                }
+            }
+            live_triangles[v]--;
+        }
+        for(uint32_t jj=0; jj<cache_count; ++jj) {
+            uint32_t v = cache[jj];
+            if(v != tri[0] && v != tri[1] && v != tri[2])
+                new_cache[new_count++] = v;
+        }
+
+        // Rescore everything that was touched
+        best_triangle = ~0u;
+        float best_score = -1.0f;
+        for(uint32_t jj=0; jj<new_count; ++jj) {
+            uint32_t v = new_cache[jj];
+            int position = (jj < kVertexCacheSize) ? (int)jj : -1;
+            cache_position[v] = position;
+            float score = _vertex_score(position, live_triangles[v]);
+            float delta = score - vertex_score[v];
+            vertex_score[v] = score;
+
+            const uint32_t* adj = &adjacency[adjacency_offset[v]];
+            for(uint32_t kk=0; kk<live_triangles[v]; ++kk) {
+                uint32_t t = adj[kk];
+                triangle_score[t] += delta;
+                if(triangle_score[t] > best_score) {
+                    best_score = triangle_score[t];
+                    best_triangle = t;
+                }
+            }
+        }
+        cache_count = std::min(new_count, (uint32_t)kVertexCacheSize);
+        memcpy(cache, new_cache, cache_count*sizeof(uint32_t));
+    }
+}
+void optimize_overdraw(uint32_t* indices, uint32_t index_count,
+                       const void* positions, size_t stride, uint32_t vertex_count,
+                       float threshold) {
+    uint32_t triangle_count = index_count/3;
+    if(triangle_count < 2)
+        return;
+
+    std::vector<uint32_t> boundaries;
+    _generate_clusters(boundaries, indices, index_count, vertex_count, threshold);
+    boundaries.push_back(triangle_count);
+
+    // Mesh centroid
+    float3 mesh_centroid = float3zero;
+    for(uint32_t ii=0; ii<index_count; ++ii)
+        mesh_centroid = float3add(&mesh_centroid, &_position(positions, stride, indices[ii]));
+    mesh_centroid = float3divideScalar(&mesh_centroid, (float)index_count);
+
+    // Sort clusters so the ones facing away from the center draw first. They
+    // are the most likely to occlude the rest of the mesh.
+    std::vector<Cluster> clusters(boundaries.size()-1);
+    for(size_t cc=0; cc<clusters.size(); ++cc) {
+        Cluster& cluster = clusters[cc];
+        cluster.start = boundaries[cc];
+        cluster.count = boundaries[cc+1]-boundaries[cc];
+
+        float3 centroid = float3zero;
+        float3 normal = float3zero;
+        float area = 0.0f;
+        for(uint32_t ii=cluster.start; ii<cluster.start+cluster.count; ++ii) {
+            const float3& p0 = _position(positions, stride, indices[ii*3+0]);
+            const float3& p1 = _position(positions, stride, indices[ii*3+1]);
+            const float3& p2 = _position(positions, stride, indices[ii*3+2]);
+            float3 e0 = float3subtract(&p1, &p0);
+            float3 e1 = float3subtract(&p2, &p0);
+            float3 n = float3cross(&e0, &e1);
+            float a = float3length(&n);
+
+            float3 c = float3add(&p0, &p1);
+            c = float3add(&c, &p2);
+            c = float3multiplyScalar(&c, a/3.0f);
+            centroid = float3add(&centroid, &c);
+            normal = float3add(&normal, &n);
+            area += a;
+        }
+        if(area > 0.0f)
+            centroid = float3divideScalar(&centroid, area);
+        float length = float3length(&normal);
+        if(length > 0.0f)
+            normal = float3divideScalar(&normal, length);
+
+        float3 to_cluster = float3subtract(&centroid, &mesh_centroid);
+        cluster.sort_key = float3dot(&to_cluster, &normal);
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), _cluster_greater);
+
+    std::vector<uint32_t> sorted(index_count);
+    uint32_t offset = 0;
+    for(size_t cc=0; cc<clusters.size(); ++cc) {
+        memcpy(&sorted[offset], indices + clusters[cc].start*3, clusters[cc].count*3*sizeof(uint32_t));
+        offset += clusters[cc].count*3;
+    }
+    memcpy(indices, &sorted[0], index_count*sizeof(uint32_t));
+}
+uint32_t optimize_vertex_fetch(void* dst_vertices, uint32_t* indices, uint32_t index_count,
+                               const void* vertices, uint32_t vertex_count, size_t vertex_size) {
+    assert(dst_vertices != vertices);
+    std::vector<uint32_t> remap(vertex_count, ~0u);
+    uint32_t next_vertex = 0;
+    for(uint32_t ii=0; ii<index_count; ++ii) {
+        uint32_t index = indices[ii];
+        if(remap[index] == ~0u) {
+            memcpy((char*)dst_vertices + next_vertex*vertex_size,
+                   (const char*)vertices + index*vertex_size, vertex_size);
+            remap[index] = next_vertex++;
+        }
+        indices[ii] = remap[index];
+    }
+    return next_vertex;
+}
+uint32_t deduplicate_positions(void* dst_positions, size_t dst_stride, uint32_t* dst_indices,
+                               const void* vertices, size_t stride, size_t position_size,
+                               uint32_t vertex_count, const uint32_t* indices, uint32_t index_count) {
+    assert(position_size <= dst_stride);
+    // Open addressing hash table of unique position indices
+    uint32_t table_size = 1;
+    while(table_size < vertex_count*2)
+        table_size *= 2;
+    std::vector<uint32_t> table(table_size, ~0u);
+    std::vector<uint32_t> remap(vertex_count, ~0u);
+
+    const char* src = (const char*)vertices;
+    char* dst = (char*)dst_positions;
+    uint32_t unique_count = 0;
+    for(uint32_t ii=0; ii<vertex_count; ++ii) {
+        const char* position = src + ii*stride;
+        uint32_t slot = _hash_bytes(position, position_size) & (table_size-1);
+        while(table[slot] != ~0u) {
+            if(memcmp(dst + table[slot]*dst_stride, position, position_size) == 0)
+                break;
+            slot = (slot+1) & (table_size-1);
+        }
+        if(table[slot] == ~0u) {
+            memset(dst + unique_count*dst_stride, 0, dst_stride);
+            memcpy(dst + unique_count*dst_stride, position, position_size);
+            table[slot] = unique_count++;
+        }
+        remap[ii] = table[slot];
+    }
+    for(uint32_t ii=0; ii<index_count; ++ii)
+        dst_indices[ii] = remap[indices[ii]];
+    return unique_count;
+}
+uint32_t meshlet_count_bound(uint32_t index_count, uint32_t max_vertices, uint32_t max_triangles) {
+    // A meshlet is only closed when the next triangle won't fit
+    uint32_t min_triangles = max_vertices/3;
+    if(min_triangles > max_triangles)
+        min_triangles = max_triangles;
+    assert(min_triangles > 0);
+    return (index_count/3 + min_triangles-1)/min_triangles;
+}
+uint32_t build_meshlets(Meshlet* meshlets, const uint32_t* indices, uint32_t index_count,
+                        uint32_t vertex_count, uint32_t max_vertices, uint32_t max_triangles) {
+    assert(max_vertices >= 3 && max_triangles >= 1);
+    std::vector<uint32_t> owner(vertex_count, ~0u);
+    uint32_t meshlet_count = 0;
+    Meshlet current = { 0, 0, 0 };
+    for(uint32_t ii=0; ii+2<index_count; ii+=3) {
+        uint32_t new_vertices = 0;
+        for(int jj=0; jj<3; ++jj) {
+            uint32_t index = indices[ii+jj];
+            bool repeated = (jj > 0 && indices[ii] == index) || (jj > 1 && indices[ii+1] == index);
+            if(owner[index] != meshlet_count && !repeated)
+                ++new_vertices;
+        }
+        if(current.vertex_count + new_vertices > max_vertices || current.triangle_count == max_triangles) {
+            meshlets[meshlet_count++] = current;
+            current.index_offset = ii;
+            current.triangle_count = 0;
+            current.vertex_count = 0;
+        }
+        for(int jj=0; jj<3; ++jj) {
+            uint32_t index = indices[ii+jj];
+            if(owner[index] != meshlet_count) {
+                owner[index] = meshlet_count;
+                current.vertex_count++;
+            }
+        }
+        current.triangle_count++;
+    }
+    if(current.triangle_count)
+        meshlets[meshlet_count++] = current;
+    return meshlet_count;
+}
+MeshletBounds compute_meshlet_bounds(const uint32_t* indices, uint32_t triangle_count,
+                                     const void* positions, size_t stride) {
+    MeshletBounds bounds;
+    float3 min = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float3 max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    float3 axis = float3zero;
+    for(uint32_t ii=0; ii<triangle_count*3; ++ii) {
+        const float3& p = _position(positions, stride, indices[ii]);
+        min.x = fminf(min.x, p.x); max.x = fmaxf(max.x, p.x);
+        min.y = fminf(min.y, p.y); max.y = fmaxf(max.y, p.y);
+        min.z = fminf(min.z, p.z); max.z = fmaxf(max.z, p.z);
+    }
+    bounds.center = float3add(&min, &max);
+    bounds.center = float3multiplyScalar(&bounds.center, 0.5f);
+    float radius_sq = 0.0f;
+    for(uint32_t ii=0; ii<triangle_count*3; ++ii) {
+        float3 d = float3subtract(&_position(positions, stride, indices[ii]), &bounds.center);
+        radius_sq = fmaxf(radius_sq, float3lengthSq(&d));
+    }
+    bounds.radius = sqrtf(radius_sq);
+
+    // The cone contains every triangle normal
+    std::vector<float3> normals(triangle_count);
+    for(uint32_t ii=0; ii<triangle_count; ++ii) {
+        const float3& p0 = _position(positions, stride, indices[ii*3+0]);
+        const float3& p1 = _position(positions, stride, indices[ii*3+1]);
+        const float3& p2 = _position(positions, stride, indices[ii*3+2]);
+        float3 e0 = float3subtract(&p1, &p0);
+        float3 e1 = float3subtract(&p2, &p0);
+        float3 n = float3cross(&e0, &e1);
+        float length = float3length(&n);
+        normals[ii] = (length > 0.0f) ? float3divideScalar(&n, length) : float3zero;
+        axis = float3add(&axis, &normals[ii]);
+    }
+    float axis_length = float3length(&axis);
+    bounds.cone_axis = (axis_length > 0.0f) ? float3divideScalar(&axis, axis_length) : axis;
+    float min_dot = (axis_length > 0.0f) ? 1.0f : -1.0f;
+    for(uint32_t ii=0; ii<triangle_count; ++ii) {
+        if(float3lengthSq(&normals[ii]) > 0.0f)
+            min_dot = fminf(min_dot, float3dot(&normals[ii], &bounds.cone_axis));
+    }
+    // Wide cones are never fully backfacing, don't bother testing them
+    bounds.cone_cutoff = (min_dot <= 0.1f) ? 1.0f : sqrtf(1.0f - min_dot*min_dot);
+    return bounds;
+}
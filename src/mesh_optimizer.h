@@ -0,0 +1,102 @@
+/*! @file mesh_optimizer.h
+ *  @brief Index and vertex reordering for the post-transform cache, overdraw
+ *         and vertex fetch
+ *  @author Kyle Weicht
+ *  @date 10/19/26 9:12 AM
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ *	@addtogroup mesh_optimizer mesh_optimizer
+ *	@{
+ */
+#ifndef __mesh_optimizer_h__
+#define __mesh_optimizer_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "vec_math.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum { kVertexCacheSize = 32 };
+enum { kMeshletMaxVertices = 64, kMeshletMaxTriangles = 124 };
+
+typedef struct {
+    float   acmr;   /*!< Average cache miss ratio: transformed vertices per triangle */
+    float   atvr;   /*!< Average transformed vertex ratio: transformed vertices per vertex */
+} VertexCacheStats;
+
+typedef struct {
+    uint32_t    index_offset;   /*!< First index of the meshlet */
+    uint32_t    triangle_count;
+    uint32_t    vertex_count;   /*!< Unique vertices referenced */
+} Meshlet;
+
+typedef struct {
+    float3      center;         /*!< Bounding sphere */
+    float       radius;
+    float3      cone_axis;      /*!< Average triangle facing */
+    float       cone_cutoff;    /*!< Sine of the cone's half angle, 1 if it can't be backface culled */
+} MeshletBounds;
+
+/*! @brief Simulates a FIFO post-transform cache of `cache_size` entries */
+VertexCacheStats analyze_vertex_cache(const uint32_t* indices, uint32_t index_count,
+                                      uint32_t vertex_count, uint32_t cache_size);
+
+/*! @brief Reorders triangles for post-transform cache locality (Forsyth's
+ *         linear-speed algorithm). `dst` and `indices` may not alias.
+ */
+void optimize_vertex_cache(uint32_t* dst, const uint32_t* indices,
+                           uint32_t index_count, uint32_t vertex_count);
+
+/*! @brief Reorders clusters of a cache-optimized index buffer so outward facing
+ *         clusters draw first. `threshold` is how much ACMR may grow when
+ *         merging clusters (1.05 keeps cache efficiency within 5%).
+ *  @details `positions` points at the first vertex's float3 position and
+ *           `stride` is the vertex size in bytes.
+ */
+void optimize_overdraw(uint32_t* indices, uint32_t index_count,
+                       const void* positions, size_t stride, uint32_t vertex_count,
+                       float threshold);
+
+/*! @brief Reorders vertices in the order the index buffer first references them
+ *         and rewrites the indices to match. Unreferenced vertices are dropped.
+ *  @return The new vertex count
+ */
+uint32_t optimize_vertex_fetch(void* dst_vertices, uint32_t* indices, uint32_t index_count,
+                               const void* vertices, uint32_t vertex_count, size_t vertex_size);
+
+/*! @brief Builds a position-only vertex stream where vertices with bitwise
+ *         identical positions are merged, e.g. across UV or normal seams.
+ *  @details The first `position_size` bytes of each `stride` sized vertex are
+ *           the position. `dst_positions` receives the unique positions,
+ *           `dst_stride` bytes apart, and `dst_indices` the remapped indices.
+ *  @return The number of unique positions
+ */
+uint32_t deduplicate_positions(void* dst_positions, size_t dst_stride, uint32_t* dst_indices,
+                               const void* vertices, size_t stride, size_t position_size,
+                               uint32_t vertex_count, const uint32_t* indices, uint32_t index_count);
+
+/*! @brief The most meshlets `build_meshlets` can produce */
+uint32_t meshlet_count_bound(uint32_t index_count, uint32_t max_vertices, uint32_t max_triangles);
+
+/*! @brief Splits an index buffer into consecutive runs of triangles that
+ *         reference at most `max_vertices` vertices. Run it on cache-optimized
+ *         indices so each meshlet is a compact patch of the surface.
+ *  @return The number of meshlets
+ */
+uint32_t build_meshlets(Meshlet* meshlets, const uint32_t* indices, uint32_t index_count,
+                        uint32_t vertex_count, uint32_t max_vertices, uint32_t max_triangles);
+
+/*! @brief Bounding sphere and normal cone of a run of triangles. `positions`
+ *         points at the first vertex's float3 position.
+ */
+MeshletBounds compute_meshlet_bounds(const uint32_t* indices, uint32_t triangle_count,
+                                     const void* positions, size_t stride);
+
+#ifdef __cplusplus
+} // extern "C" {
+#endif
+
+/* @} */
+#endif /* include guard */
@@ -0,0 +1,305 @@
+/*! @file mesh_simplify.cpp
+ *  @author Kyle Weicht
+ *  @date 10/19/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "mesh_simplify.h"
+
+#include <math.h>
+#include <float.h>
+#include <vector>
+#include <algorithm>
+#include "assert.h"
+#include "vec_math.h"
+#include "mesh_optimizer.h"
+
+/*
+ * Internal
+ */
+namespace {
+
+/* Symmetric 4x4 quadric of area weighted plane equations (Garland-Heckbert) */
+struct Quadric {
+    float   a00, a11, a22;
+    float   a01, a02, a12;
+    float   b0, b1, b2;
+    float   c;
+    float   weight;
+};
+
+Quadric _quadric_from_plane(const float3& n, float d, float weight) {
+    Quadric q;
+    q.a00 = n.x*n.x*weight;
+    q.a11 = n.y*n.y*weight;
+    q.a22 = n.z*n.z*weight;
+    q.a01 = n.x*n.y*weight;
+    q.a02 = n.x*n.z*weight;
+    q.a12 = n.y*n.z*weight;
+    q.b0 = n.x*d*weight;
+    q.b1 = n.y*d*weight;
+    q.b2 = n.z*d*weight;
+    q.c = d*d*weight;
+    q.weight = weight;
+    return q;
+}
+void _quadric_add(Quadric* q, const Quadric& r) {
+    q->a00 += r.a00; q->a11 += r.a11; q->a22 += r.a22;
+    q->a01 += r.a01; q->a02 += r.a02; q->a12 += r.a12;
+    q->b0 += r.b0; q->b1 += r.b1; q->b2 += r.b2;
+    q->c += r.c;
+    q->weight += r.weight;
+}
+/* Weighted average squared distance from p to the quadric's planes */
+float _quadric_error(const Quadric& q, const float3& p) {
+    float rx = q.a00*p.x + q.a01*p.y + q.a02*p.z;
+    float ry = q.a01*p.x + q.a11*p.y + q.a12*p.z;
+    float rz = q.a02*p.x + q.a12*p.y + q.a22*p.z;
+    float e = p.x*rx + p.y*ry + p.z*rz;
+    e += 2.0f*(q.b0*p.x + q.b1*p.y + q.b2*p.z) + q.c;
+    return fabsf(e) / (q.weight > 0.0f ? q.weight : 1.0f);
+}
+
+struct Collapse {
+    uint32_t    from;
+    uint32_t    to;
+    float       error;
+};
+bool _collapse_less(const Collapse& l, const Collapse& r) {
+    return l.error < r.error;
+}
+
+uint64_t _edge_key(uint32_t a, uint32_t b) {
+    return ((uint64_t)a << 32) | b;
+}
+
+/* Returns true if moving `from` onto `to` would flip or collapse a triangle
+ * that doesn't contain the edge
+ */
+bool _collapse_flips(const std::vector<uint32_t>& indices, const uint32_t* adjacency, uint32_t adjacency_count,
+                     const std::vector<float3>& positions, uint32_t from, uint32_t to) {
+    for(uint32_t ii=0; ii<adjacency_count; ++ii) {
+        const uint32_t* tri = &indices[adjacency[ii]*3];
+        if(tri[0] == to || tri[1] == to || tri[2] == to)
+            continue;
+        int corner = (tri[0] == from) ? 0 : (tri[1] == from) ? 1 : 2;
+        const float3& p1 = positions[tri[(corner+1)%3]];
+        const float3& p2 = positions[tri[(corner+2)%3]];
+
+        float3 e0 = float3subtract(&p1, &positions[from]);
+        float3 e1 = float3subtract(&p2, &positions[from]);
+        float3 before = float3cross(&e0, &e1);
+        e0 = float3subtract(&p1, &positions[to]);
+        e1 = float3subtract(&p2, &positions[to]);
+        float3 after = float3cross(&e0, &e1);
+        if(float3dot(&before, &after) < 0.0f)
+            return true;
+        if(float3lengthSq(&after) == 0.0f && float3lengthSq(&before) > 0.0f)
+            return true;
+    }
+    return false;
+}
+
+}
+
+/*
+ * External
+ */
+uint32_t simplify_mesh(uint32_t* dst, const uint32_t* indices, uint32_t index_count,
+                       const void* positions, size_t stride, uint32_t vertex_count,
+                       uint32_t target_index_count, float target_error, float* result_error) {
+    std::vector<uint32_t> result(indices, indices+index_count);
+    float max_error = 0.0f;
+    if(result_error)
+        *result_error = 0.0f;
+    if(index_count < 3 || vertex_count == 0 || index_count <= target_index_count) {
+        std::copy(result.begin(), result.end(), dst);
+        return index_count;
+    }
+
+    // Work in a unit box so the quadrics stay precise for large meshes
+    float3 min = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float3 max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for(uint32_t ii=0; ii<vertex_count; ++ii) {
+        const float3& p = *(const float3*)((const char*)positions + ii*stride);
+        min.x = fminf(min.x, p.x); max.x = fmaxf(max.x, p.x);
+        min.y = fminf(min.y, p.y); max.y = fmaxf(max.y, p.y);
+        min.z = fminf(min.z, p.z); max.z = fmaxf(max.z, p.z);
+    }
+    float extent = fmaxf(max.x-min.x, fmaxf(max.y-min.y, max.z-min.z));
+    if(extent <= 0.0f)
+        extent = 1.0f;
+    std::vector<float3> vertex_positions(vertex_count);
+    for(uint32_t ii=0; ii<vertex_count; ++ii) {
+        const float3& p = *(const float3*)((const char*)positions + ii*stride);
+        float3 n = float3subtract(&p, &min);
+        vertex_positions[ii] = float3divideScalar(&n, extent);
+    }
+
+    // Vertices sharing a position are wedges of a seam
+    std::vector<uint32_t> position_id(vertex_count);
+    uint32_t position_count = 0;
+    {
+        std::vector<uint32_t> identity(vertex_count);
+        for(uint32_t ii=0; ii<vertex_count; ++ii)
+            identity[ii] = ii;
+        std::vector<float3> unique_positions(vertex_count);
+        position_count = deduplicate_positions(&unique_positions[0], sizeof(float3), &position_id[0],
+                                               positions, stride, sizeof(float3), vertex_count,
+                                               &identity[0], vertex_count);
+    }
+    std::vector<uint32_t> wedge_count(position_count, 0);
+    for(uint32_t ii=0; ii<vertex_count; ++ii)
+        wedge_count[position_id[ii]]++;
+
+    // Border and non-manifold edges don't have exactly one opposite edge
+    std::vector<char> position_locked(position_count, 0);
+    {
+        std::vector<uint64_t> edges;
+        edges.reserve(index_count);
+        for(uint32_t ii=0; ii<index_count; ii+=3) {
+            for(int jj=0; jj<3; ++jj) {
+                uint32_t a = position_id[result[ii+jj]];
+                uint32_t b = position_id[result[ii+(jj+1)%3]];
+                edges.push_back(_edge_key(a, b));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        for(size_t ii=0; ii<edges.size(); ++ii) {
+            uint32_t a = (uint32_t)(edges[ii] >> 32);
+            uint32_t b = (uint32_t)edges[ii];
+            uint64_t reverse = _edge_key(b, a);
+            std::pair<std::vector<uint64_t>::iterator, std::vector<uint64_t>::iterator> range =
+                std::equal_range(edges.begin(), edges.end(), reverse);
+            bool duplicate = (ii > 0 && edges[ii-1] == edges[ii]) || (ii+1 < edges.size() && edges[ii+1] == edges[ii]);
+            if(range.second - range.first != 1 || duplicate)
+                position_locked[a] = position_locked[b] = 1;
+        }
+    }
+    std::vector<char> locked(vertex_count);
+    for(uint32_t ii=0; ii<vertex_count; ++ii)
+        locked[ii] = (wedge_count[position_id[ii]] > 1) || position_locked[position_id[ii]];
+
+    // Per position quadrics, so seam wedges see the whole surface
+    Quadric zero = { 0,0,0, 0,0,0, 0,0,0, 0, 0 };
+    std::vector<Quadric> quadrics(position_count, zero);
+    for(uint32_t ii=0; ii<index_count; ii+=3) {
+        const float3& p0 = vertex_positions[result[ii+0]];
+        const float3& p1 = vertex_positions[result[ii+1]];
+        const float3& p2 = vertex_positions[result[ii+2]];
+        float3 e0 = float3subtract(&p1, &p0);
+        float3 e1 = float3subtract(&p2, &p0);
+        float3 n = float3cross(&e0, &e1);
+        float length = float3length(&n);
+        if(length <= 0.0f)
+            continue;
+        n = float3divideScalar(&n, length);
+        Quadric q = _quadric_from_plane(n, -float3dot(&n, &p0), length*0.5f);
+        for(int jj=0; jj<3; ++jj)
+            _quadric_add(&quadrics[position_id[result[ii+jj]]], q);
+    }
+
+    float error_limit = target_error/extent;
+    error_limit *= error_limit;
+    std::vector<uint32_t> adjacency_offset(vertex_count+1);
+    std::vector<uint32_t> adjacency;
+    std::vector<uint32_t> best_to(vertex_count);
+    std::vector<float> best_error(vertex_count);
+    std::vector<uint32_t> remap(vertex_count);
+    std::vector<char> dirty(vertex_count);
+    std::vector<Collapse> collapses;
+    while(result.size() > target_index_count) {
+        uint32_t current_count = (uint32_t)result.size();
+
+        // Vertex -> triangle adjacency
+        std::fill(adjacency_offset.begin(), adjacency_offset.end(), 0);
+        for(uint32_t ii=0; ii<current_count; ++ii)
+            adjacency_offset[result[ii]+1]++;
+        for(uint32_t ii=0; ii<vertex_count; ++ii)
+            adjacency_offset[ii+1] += adjacency_offset[ii];
+        adjacency.resize(current_count);
+        {
+            std::vector<uint32_t> fill(adjacency_offset.begin(), adjacency_offset.end()-1);
+            for(uint32_t ii=0; ii<current_count; ++ii)
+                adjacency[fill[result[ii]]++] = ii/3;
+        }
+
+        // The cheapest collapse of each free vertex
+        std::fill(best_to.begin(), best_to.end(), ~0u);
+        std::fill(best_error.begin(), best_error.end(), FLT_MAX);
+        for(uint32_t ii=0; ii<current_count; ii+=3) {
+            for(int jj=0; jj<3; ++jj) {
+                uint32_t from = result[ii+jj];
+                if(locked[from])
+                    continue;
+                for(int kk=1; kk<3; ++kk) {
+                    uint32_t to = result[ii+(jj+kk)%3];
+                    Quadric q = quadrics[position_id[from]];
+                    _quadric_add(&q, quadrics[position_id[to]]);
+                    float error = _quadric_error(q, vertex_positions[to]);
+                    if(error < best_error[from]) {
+                        best_error[from] = error;
+                        best_to[from] = to;
+                    }
+                }
+            }
+        }
+        collapses.clear();
+        for(uint32_t ii=0; ii<vertex_count; ++ii) {
+            if(best_to[ii] != ~0u && best_error[ii] <= error_limit) {
+                Collapse c = { ii, best_to[ii], best_error[ii] };
+                collapses.push_back(c);
+            }
+        }
+        if(collapses.empty())
+            break;
+        std::sort(collapses.begin(), collapses.end(), _collapse_less);
+
+        // Collapse greedily, one per neighborhood per pass
+        for(uint32_t ii=0; ii<vertex_count; ++ii)
+            remap[ii] = ii;
+        std::fill(dirty.begin(), dirty.end(), 0);
+        uint32_t triangles_to_remove = (current_count - target_index_count)/3;
+        uint32_t triangles_removed = 0;
+        uint32_t collapse_count = 0;
+        for(size_t ii=0; ii<collapses.size() && triangles_removed < triangles_to_remove; ++ii) {
+            const Collapse& c = collapses[ii];
+            if(dirty[c.from] || dirty[c.to])
+                continue;
+            const uint32_t* adjacent = &adjacency[adjacency_offset[c.from]];
+            uint32_t adjacent_count = adjacency_offset[c.from+1] - adjacency_offset[c.from];
+            if(_collapse_flips(result, adjacent, adjacent_count, vertex_positions, c.from, c.to))
+                continue;
+
+            remap[c.from] = c.to;
+            _quadric_add(&quadrics[position_id[c.to]], quadrics[position_id[c.from]]);
+            for(uint32_t jj=0; jj<adjacent_count; ++jj) {
+                const uint32_t* tri = &result[adjacent[jj]*3];
+                dirty[tri[0]] = dirty[tri[1]] = dirty[tri[2]] = 1;
+            }
+            max_error = fmaxf(max_error, c.error);
+            triangles_removed += 2;
+            ++collapse_count;
+        }
+        if(collapse_count == 0)
+            break;
+
+        // Apply the collapses and drop the degenerate triangles
+        uint32_t write = 0;
+        for(uint32_t ii=0; ii<current_count; ii+=3) {
+            uint32_t a = remap[result[ii+0]];
+            uint32_t b = remap[result[ii+1]];
+            uint32_t c = remap[result[ii+2]];
+            if(a == b || b == c || a == c)
+                continue;
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    std::copy(result.begin(), result.end(), dst);
+    if(result_error)
+        *result_error = sqrtf(max_error)*extent;
+    return (uint32_t)result.size();
+}
@@ -0,0 +1,41 @@
+/*! @file mesh_simplify.h
+ *  @brief Quadric error edge collapse mesh simplification
+ *  @author Kyle Weicht
+ *  @date 10/19/26 4:05 PM
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ *	@addtogroup mesh_simplify mesh_simplify
+ *	@{
+ */
+#ifndef __mesh_simplify_h__
+#define __mesh_simplify_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! @brief Simplifies a triangle list by collapsing edges onto existing
+ *         vertices, so the result indexes the same vertex buffer.
+ *  @details Vertices on open borders and on attribute seams (several vertices
+ *           sharing a position) never move, which keeps the silhouette of open
+ *           meshes and the UV layout intact. `positions` points at the first
+ *           vertex's float3 position and `stride` is the vertex size in bytes.
+ *           Simplification stops at `target_index_count` or when the next
+ *           collapse would move the surface more than `target_error`.
+ *           `dst` and `indices` may alias.
+ *  @param result_error If not NULL, receives the largest distance the surface
+ *         moved, in the units of `positions`
+ *  @return The new index count
+ */
+uint32_t simplify_mesh(uint32_t* dst, const uint32_t* indices, uint32_t index_count,
+                       const void* positions, size_t stride, uint32_t vertex_count,
+                       uint32_t target_index_count, float target_error, float* result_error);
+
+#ifdef __cplusplus
+} // extern "C" {
+#endif
+
+/* @} */
+#endif /* include guard */
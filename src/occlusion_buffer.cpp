@@ -0,0 +1,347 @@
+/*! @file occlusion_buffer.cpp
+ *  @author Kyle Weicht
+ *  @date 10/20/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "occlusion_buffer.h"
+
+#include <float.h>
+#include <math.h>
+#include <vector>
+#include <immintrin.h>
+#include "parallel.h"
+
+/*
+ * Internal
+ */
+namespace {
+
+/* A triangle ready to rasterize. Each edge is A*x + B*y + C, positive on
+ * the inside, and depth is a plane over the screen. An empty box is
+ * skipped, clipping leaves one where a triangle or its second half was.
+ */
+struct ScreenTriangle {
+    float   edges[3][3];
+    float   depth[3];
+    int32_t min_x, max_x;
+    int32_t min_y, max_y;
+};
+
+struct DrawJob {
+    OcclusionBuffer*            buffer;
+    const Occluder*             occluders;
+    uint32_t                    num_occluders;
+    std::vector<float4x4>       world_view_proj;
+    std::vector<uint32_t>       first_triangle;     // Per occluder, and the total at the end
+    std::vector<ScreenTriangle> triangles;          // Two per source triangle
+    std::vector<uint32_t>       first_binned;       // Per band, and the total at the end
+    std::vector<uint32_t>       binned;             // Each band's triangles
+};
+
+const float kMinArea = 1e-6f;
+
+float _min3(float a, float b, float c) { return a < b ? (a < c ? a : c) : (b < c ? b : c); }
+float _max3(float a, float b, float c) { return a > b ? (a > c ? a : c) : (b > c ? b : c); }
+
+float4 _transform(const float4x4& m, const float3& p) {
+    float4 clip = {
+        p.x*m.r0.x + p.y*m.r1.x + p.z*m.r2.x + m.r3.x,
+        p.x*m.r0.y + p.y*m.r1.y + p.z*m.r2.y + m.r3.y,
+        p.x*m.r0.z + p.y*m.r1.z + p.z*m.r2.z + m.r3.z,
+        p.x*m.r0.w + p.y*m.r1.w + p.z*m.r2.w + m.r3.w
+    };
+    return clip;
+}
+float4 _lerp(const float4& a, const float4& b, float t) {
+    float4 v = { a.x + (b.x-a.x)*t, a.y + (b.y-a.y)*t, a.z + (b.z-a.z)*t, a.w + (b.w-a.w)*t };
+    return v;
+}
+void _empty(ScreenTriangle* tri) {
+    tri->min_x = tri->min_y = 1;
+    tri->max_x = tri->max_y = 0;
+}
+
+/* Sets up a triangle from clip space vertices in front of the near plane */
+void _setup_triangle(ScreenTriangle* tri, const float4& c0, const float4& c1, const float4& c2,
+                     uint32_t width, uint32_t height) {
+    float half_width = width*0.5f;
+    float half_height = height*0.5f;
+    float x[3], y[3], z[3];
+    const float4* clip[3] = { &c0, &c1, &c2 };
+    for(int ii=0; ii<3; ++ii) {
+        float inv_w = 1.0f/clip[ii]->w;
+        x[ii] = (clip[ii]->x*inv_w + 1.0f)*half_width;
+        y[ii] = (clip[ii]->y*inv_w + 1.0f)*half_height;
+        z[ii] = clip[ii]->z*inv_w;
+    }
+    float area = (x[1]-x[0])*(y[2]-y[0]) - (x[2]-x[0])*(y[1]-y[0]);
+    if(fabsf(area) < kMinArea) {
+        _empty(tri);
+        return;
+    }
+    if(area < 0.0f) { // Either face, wound so the inside is positive
+        float t = x[1]; x[1] = x[2]; x[2] = t;
+        t = y[1]; y[1] = y[2]; y[2] = t;
+        t = z[1]; z[1] = z[2]; z[2] = t;
+        area = -area;
+    }
+    float min_x = floorf(_min3(x[0], x[1], x[2]));
+    float max_x = floorf(_max3(x[0], x[1], x[2]));
+    float min_y = floorf(_min3(y[0], y[1], y[2]));
+    float max_y = floorf(_max3(y[0], y[1], y[2]));
+    if(max_x < 0.0f || max_y < 0.0f || min_x >= (float)width || min_y >= (float)height) {
+        _empty(tri);
+        return;
+    }
+    tri->min_x = (min_x < 0.0f) ? 0 : (int32_t)min_x;
+    tri->min_y = (min_y < 0.0f) ? 0 : (int32_t)min_y;
+    tri->max_x = (max_x >= (float)width) ? (int32_t)width-1 : (int32_t)max_x;
+    tri->max_y = (max_y >= (float)height) ? (int32_t)height-1 : (int32_t)max_y;
+
+    for(int ii=0; ii<3; ++ii) {
+        int jj = (ii+1)%3;
+        float a = y[ii] - y[jj];
+        float b = x[jj] - x[ii];
+        tri->edges[ii][0] = a;
+        tri->edges[ii][1] = b;
+        tri->edges[ii][2] = -(a*x[ii] + b*y[ii]);
+    }
+    float inv_area = 1.0f/area;
+    float dz_dx = ((z[1]-z[0])*(y[2]-y[0]) - (z[2]-z[0])*(y[1]-y[0]))*inv_area;
+    float dz_dy = ((z[2]-z[0])*(x[1]-x[0]) - (z[1]-z[0])*(x[2]-x[0]))*inv_area;
+    tri->depth[0] = dz_dx;
+    tri->depth[1] = dz_dy;
+    tri->depth[2] = z[0] - dz_dx*x[0] - dz_dy*y[0];
+}
+
+/* Clips the triangle against z >= 0 and sets up the one or two triangles
+ * left, the second slot is emptied when it isn't needed
+ */
+void _setup_clipped(ScreenTriangle* tris, const float4* clip, uint32_t width, uint32_t height) {
+    float4 polygon[4];
+    int count = 0;
+    for(int ii=0; ii<3; ++ii) {
+        const float4& a = clip[ii];
+        const float4& b = clip[(ii+1)%3];
+        if(a.z >= 0.0f)
+            polygon[count++] = a;
+        if((a.z >= 0.0f) != (b.z >= 0.0f)) {
+            // From the corner in front, so either winding gets the same point
+            const float4& in = (a.z >= 0.0f) ? a : b;
+            const float4& out = (a.z >= 0.0f) ? b : a;
+            polygon[count++] = _lerp(in, out, in.z/(in.z - out.z));
+        }
+    }
+    _empty(&tris[0]);
+    _empty(&tris[1]);
+    if(count >= 3)
+        _setup_triangle(&tris[0], polygon[0], polygon[1], polygon[2], width, height);
+    if(count == 4)
+        _setup_triangle(&tris[1], polygon[0], polygon[2], polygon[3], width, height);
+}
+
+void _setup_triangles(void* data, uint32_t begin, uint32_t end) {
+    DrawJob* job = (DrawJob*)data;
+    uint32_t occluder = 0;
+    while(job->first_triangle[occluder+1] <= begin)
+        ++occluder;
+    for(uint32_t ii=begin; ii<end; ++ii) {
+        while(job->first_triangle[occluder+1] <= ii)
+            ++occluder;
+        const Occluder& o = job->occluders[occluder];
+        const float4x4& m = job->world_view_proj[occluder];
+        const uint32_t* indices = o.indices + (ii - job->first_triangle[occluder])*3;
+        float4 clip[3];
+        for(int jj=0; jj<3; ++jj)
+            clip[jj] = _transform(m, o.positions[indices[jj]]);
+        _setup_clipped(&job->triangles[ii*2], clip, job->buffer->width, job->buffer->height);
+    }
+}
+
+void _rasterize(float* depth, uint32_t width, const ScreenTriangle& tri, int32_t first_row, int32_t end_row) {
+    const __m128 lanes = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+    int32_t min_y = tri.min_y > first_row ? tri.min_y : first_row;
+    int32_t max_y = tri.max_y < end_row-1 ? tri.max_y : end_row-1;
+    int32_t min_x = tri.min_x & ~3;
+    __m128 px = _mm_add_ps(_mm_set1_ps((float)min_x), lanes);
+
+    __m128 step[3], row_start[3];
+    for(int ii=0; ii<3; ++ii) {
+        __m128 a = _mm_set1_ps(tri.edges[ii][0]);
+        step[ii] = _mm_set1_ps(tri.edges[ii][0]*4.0f);
+        row_start[ii] = _mm_add_ps(_mm_mul_ps(a, px), _mm_set1_ps(tri.edges[ii][2]));
+    }
+    __m128 z_step = _mm_set1_ps(tri.depth[0]*4.0f);
+    __m128 z_start = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.depth[0]), px), _mm_set1_ps(tri.depth[2]));
+
+    for(int32_t y=min_y; y<=max_y; ++y) {
+        float py = (float)y + 0.5f;
+        __m128 e0 = _mm_add_ps(row_start[0], _mm_set1_ps(tri.edges[0][1]*py));
+        __m128 e1 = _mm_add_ps(row_start[1], _mm_set1_ps(tri.edges[1][1]*py));
+        __m128 e2 = _mm_add_ps(row_start[2], _mm_set1_ps(tri.edges[2][1]*py));
+        __m128 z = _mm_add_ps(z_start, _mm_set1_ps(tri.depth[1]*py));
+        float* row = depth + (uint32_t)y*width;
+        for(int32_t x=min_x; x<=tri.max_x; x+=4) {
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)),
+                                       _mm_cmpge_ps(e2, zero));
+            if(_mm_movemask_ps(inside)) {
+                __m128 old = _mm_loadu_ps(row + x);
+                __m128 nearest = _mm_min_ps(old, z);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+            }
+            e0 = _mm_add_ps(e0, step[0]);
+            e1 = _mm_add_ps(e1, step[1]);
+            e2 = _mm_add_ps(e2, step[2]);
+            z = _mm_add_ps(z, z_step);
+        }
+    }
+}
+
+void _rasterize_bands(void* data, uint32_t begin, uint32_t end) {
+    DrawJob* job = (DrawJob*)data;
+    OcclusionBuffer* buffer = job->buffer;
+    for(uint32_t band=begin; band<end; ++band) {
+        int32_t first_row = (int32_t)(band*kOcclusionBandRows);
+        int32_t end_row = first_row + kOcclusionBandRows;
+        if(end_row > (int32_t)buffer->height)
+            end_row = (int32_t)buffer->height;
+        for(uint32_t ii=job->first_binned[band]; ii<job->first_binned[band+1]; ++ii)
+            _rasterize(buffer->depth, buffer->width, job->triangles[job->binned[ii]], first_row, end_row);
+    }
+}
+
+}
+
+/*
+ * External
+ */
+void occlusion_buffer_init(OcclusionBuffer* buffer, float* depth, uint32_t width, uint32_t height) {
+    buffer->view_proj = float4x4identity;
+    buffer->depth = depth;
+    buffer->width = width;
+    buffer->height = height;
+}
+void occlusion_buffer_clear(OcclusionBuffer* buffer, const float4x4* view_proj) {
+    buffer->view_proj = *view_proj;
+    uint32_t count = buffer->width*buffer->height;
+    for(uint32_t ii=0; ii<count; ++ii)
+        buffer->depth[ii] = 1.0f;
+}
+uint32_t occlusion_buffer_draw(OcclusionBuffer* buffer, const Occluder* occluders, uint32_t count) {
+    DrawJob job;
+    job.buffer = buffer;
+    job.occluders = occluders;
+    job.num_occluders = count;
+    job.world_view_proj.resize(count);
+    job.first_triangle.resize(count+1);
+    uint32_t num_triangles = 0;
+    for(uint32_t ii=0; ii<count; ++ii) {
+        job.world_view_proj[ii] = float4x4multiply(&occluders[ii].transform, &buffer->view_proj);
+        job.first_triangle[ii] = num_triangles;
+        num_triangles += occluders[ii].index_count/3;
+    }
+    job.first_triangle[count] = num_triangles;
+    if(num_triangles == 0)
+        return 0;
+    job.triangles.resize(num_triangles*2);
+
+    parallel_for(_setup_triangles, &job, num_triangles, kOcclusionMinThreadedTriangles);
+
+    // Each triangle goes in every band it touches, so a band only writes
+    // its own rows
+    uint32_t num_bands = (buffer->height + kOcclusionBandRows-1)/kOcclusionBandRows;
+    job.first_binned.assign(num_bands+1, 0);
+    uint32_t drawn = 0;
+    for(size_t ii=0; ii<job.triangles.size(); ++ii) {
+        const ScreenTriangle& tri = job.triangles[ii];
+        if(tri.min_x > tri.max_x)
+            continue;
+        for(int32_t band=tri.min_y/kOcclusionBandRows; band<=tri.max_y/kOcclusionBandRows; ++band)
+            job.first_binned[band+1]++;
+        ++drawn;
+    }
+    for(uint32_t ii=0; ii<num_bands; ++ii)
+        job.first_binned[ii+1] += job.first_binned[ii];
+    job.binned.resize(job.first_binned[num_bands]);
+    std::vector<uint32_t> next(job.first_binned.begin(), job.first_binned.end()-1);
+    for(size_t ii=0; ii<job.triangles.size(); ++ii) {
+        const ScreenTriangle& tri = job.triangles[ii];
+        if(tri.min_x > tri.max_x)
+            continue;
+        for(int32_t band=tri.min_y/kOcclusionBandRows; band<=tri.max_y/kOcclusionBandRows; ++band)
+            job.binned[next[band]++] = (uint32_t)ii;
+    }
+    parallel_for(_rasterize_bands, &job, num_bands,
+                 num_triangles < kOcclusionMinThreadedTriangles ? num_bands : 1);
+    return drawn;
+}
+int occlusion_buffer_occluded(const OcclusionBuffer* buffer, const float3* center, float radius) {
+    // The screen rectangle and nearest depth of the box's corners
+    const float4x4& m = buffer->view_proj;
+    float min_x = FLT_MAX, max_x = -FLT_MAX;
+    float min_y = FLT_MAX, max_y = -FLT_MAX;
+    float min_z = 1.0f;
+    for(int ii=0; ii<8; ++ii) {
+        float3 corner = {
+            center->x + ((ii & 1) ? radius : -radius),
+            center->y + ((ii & 2) ? radius : -radius),
+            center->z + ((ii & 4) ? radius : -radius)
+        };
+        float4 clip = _transform(m, corner);
+        if(clip.z <= 0.0f || clip.w <= 0.0f)
+            return 0;
+        float inv_w = 1.0f/clip.w;
+        float ndc_x = clip.x*inv_w;
+        float ndc_y = clip.y*inv_w;
+        float ndc_z = clip.z*inv_w;
+        min_x = (ndc_x < min_x) ? ndc_x : min_x;
+        max_x = (ndc_x > max_x) ? ndc_x : max_x;
+        min_y = (ndc_y < min_y) ? ndc_y : min_y;
+        max_y = (ndc_y > max_y) ? ndc_y : max_y;
+        min_z = (ndc_z < min_z) ? ndc_z : min_z;
+    }
+    if(max_x < -1.0f || min_x > 1.0f || max_y < -1.0f || min_y > 1.0f)
+        return 0;
+
+    float width = (float)buffer->width;
+    float height = (float)buffer->height;
+    int32_t x0 = (int32_t)floorf((min_x*0.5f + 0.5f)*width);
+    int32_t x1 = (int32_t)floorf((max_x*0.5f + 0.5f)*width);
+    int32_t y0 = (int32_t)floorf((min_y*0.5f + 0.5f)*height);
+    int32_t y1 = (int32_t)floorf((max_y*0.5f + 0.5f)*height);
+    x0 = (x0 < 0) ? 0 : x0;
+    y0 = (y0 < 0) ? 0 : y0;
+    x1 = (x1 >= (int32_t)buffer->width) ? (int32_t)buffer->width-1 : x1;
+    y1 = (y1 >= (int32_t)buffer->height) ? (int32_t)buffer->height-1 : y1;
+    if(x0 > x1 || y0 > y1)
+        return 0;
+
+    // Visible if any texel under it is as far as its nearest point
+    const __m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    __m128 nearest = _mm_set1_ps(min_z);
+    __m128 first = _mm_set1_ps((float)x0 - 0.5f);
+    __m128 last = _mm_set1_ps((float)x1 + 0.5f);
+    for(int32_t y=y0; y<=y1; ++y) {
+        const float* row = buffer->depth + (uint32_t)y*buffer->width;
+        for(int32_t x=x0 & ~3; x<=x1; x+=4) {
+            __m128 px = _mm_add_ps(_mm_set1_ps((float)x), lanes);
+            __m128 covered = _mm_and_ps(_mm_cmpgt_ps(px, first), _mm_cmplt_ps(px, last));
+            __m128 behind = _mm_cmpge_ps(_mm_loadu_ps(row + x), nearest);
+            if(_mm_movemask_ps(_mm_and_ps(covered, behind)))
+                return 0;
+        }
+    }
+    return 1;
+}
+uint32_t occlusion_buffer_cull_spheres(const OcclusionBuffer* buffer, uint32_t* visible, uint32_t count,
+                                       const float* x, const float* y, const float* z, const float* radius) {
+    uint32_t kept = 0;
+    for(uint32_t ii=0; ii<count; ++ii) {
+        uint32_t index = visible[ii];
+        float3 center = { x[index], y[index], z[index] };
+        if(!occlusion_buffer_occluded(buffer, &center, radius[index]))
+            visible[kept++] = index;
+    }
+    return kept;
+}
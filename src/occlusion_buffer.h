@@ -0,0 +1,76 @@
+/*! @file occlusion_buffer.h
+ *  @brief Low resolution software depth buffer of occluders, for culling
+ *         bounding spheres on the CPU in the frame they're drawn
+ *  @author Kyle Weicht
+ *  @date 10/20/26 7:10 AM
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ *	@addtogroup occlusion_buffer occlusion_buffer
+ *	@{
+ */
+#ifndef __occlusion_buffer_h__
+#define __occlusion_buffer_h__
+
+#include <stdint.h>
+#include "vec_math.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Depth is post projection z/w like the depth pyramid's, 0 at the near plane
+ * and 1 at the far plane, row 0 at the bottom of the screen. Texels hold the
+ * nearest occluder depth at their center. Rows are rasterized in bands, one
+ * band at a time per worker thread, 4 texels at a time.
+ */
+enum {
+    kOcclusionBandRows = 16,
+    kOcclusionMinThreadedTriangles = 2048   // Fewer are drawn on the calling thread
+};
+
+typedef struct {
+    float4x4    view_proj;
+    float*      depth;      /*!< width*height, owned by the caller */
+    uint32_t    width;      /*!< A multiple of 4 */
+    uint32_t    height;
+} OcclusionBuffer;
+
+/* A simplified mesh that hides what's behind it, like a terrain chunk or a
+ * building's hull. Its triangles should be inside the real mesh's surface.
+ */
+typedef struct {
+    float4x4        transform;      /*!< Model to world */
+    const float3*   positions;
+    const uint32_t* indices;
+    uint32_t        index_count;
+} Occluder;
+
+/*! @brief Points the buffer at its depth, width must be a multiple of 4 */
+void occlusion_buffer_init(OcclusionBuffer* buffer, float* depth, uint32_t width, uint32_t height);
+
+/*! @brief Clears the depth to the far plane for a new view */
+void occlusion_buffer_clear(OcclusionBuffer* buffer, const float4x4* view_proj);
+
+/*! @brief Rasterizes the occluders' triangles, keeping the nearest depth.
+ *         Both faces are drawn, and triangles are clipped at the near plane.
+ *  @return The number of triangles drawn after clipping
+ */
+uint32_t occlusion_buffer_draw(OcclusionBuffer* buffer, const Occluder* occluders, uint32_t count);
+
+/*! @brief Returns non-zero if the sphere's box is behind the occluders
+ *         everywhere it covers
+ */
+int occlusion_buffer_occluded(const OcclusionBuffer* buffer, const float3* center, float radius);
+
+/*! @brief Removes the occluded spheres from `visible`, a list of indices into
+ *         separate x, y, z and radius arrays. Order is kept.
+ *  @return The number of spheres left
+ */
+uint32_t occlusion_buffer_cull_spheres(const OcclusionBuffer* buffer, uint32_t* visible, uint32_t count,
+                                       const float* x, const float* y, const float* z, const float* radius);
+
+#ifdef __cplusplus
+} // extern "C" {
+#endif
+
+/* @} */
+#endif /* include guard */
@@ -0,0 +1,175 @@
+/*! @file parallel.c
+ *  @author Kyle Weicht
+ *  @date 10/19/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "parallel.h"
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <Windows.h>
+    typedef SRWLOCK             Mutex;
+    typedef CONDITION_VARIABLE  Condition;
+    #define MUTEX_INIT          SRWLOCK_INIT
+    #define CONDITION_INIT      CONDITION_VARIABLE_INIT
+    #define mutex_lock(m)       AcquireSRWLockExclusive(m)
+    #define mutex_unlock(m)     ReleaseSRWLockExclusive(m)
+    #define condition_wait(c,m) SleepConditionVariableSRW(c, m, INFINITE, 0)
+    #define condition_signal(c) WakeConditionVariable(c)
+    #define condition_broadcast(c) WakeAllConditionVariable(c)
+#else
+    #include <pthread.h>
+    #include <unistd.h>
+    typedef pthread_mutex_t     Mutex;
+    typedef pthread_cond_t      Condition;
+    #define MUTEX_INIT          PTHREAD_MUTEX_INITIALIZER
+    #define CONDITION_INIT      PTHREAD_COND_INITIALIZER
+    #define mutex_lock(m)       pthread_mutex_lock(m)
+    #define mutex_unlock(m)     pthread_mutex_unlock(m)
+    #define condition_wait(c,m) pthread_cond_wait(c, m)
+    #define condition_signal(c) pthread_cond_signal(c)
+    #define condition_broadcast(c) pthread_cond_broadcast(c)
+#endif
+
+/*
+ * Internal
+ */
+typedef struct {
+    ParallelFunc*   func;
+    void*           data;
+    uint32_t        begin;
+    uint32_t        end;
+} ParallelRange;
+
+/* The workers are started by the first parallel_for that needs them and
+ * live until the process exits. One loop runs on them at a time, its
+ * ranges are taken by whichever thread gets to them first, the calling
+ * thread included.
+ */
+static Mutex            _lock = MUTEX_INIT;
+static Condition        _work_ready = CONDITION_INIT;
+static Condition        _work_done = CONDITION_INIT;
+static int              _workers_started = 0;
+static int              _busy = 0;
+static ParallelRange    _ranges[kMaxWorkerThreads];
+static uint32_t         _num_ranges = 0;
+static uint32_t         _next_range = 0;
+static uint32_t         _ranges_pending = 0;
+
+/* Runs ranges until there are none left to take. Called and returns with
+ * the lock held.
+ */
+static void _run_ranges(void) {
+    while(_next_range < _num_ranges) {
+        ParallelRange range = _ranges[_next_range++];
+        mutex_unlock(&_lock);
+        range.func(range.data, range.begin, range.end);
+        mutex_lock(&_lock);
+        if(--_ranges_pending == 0)
+            condition_signal(&_work_done);
+    }
+}
+static void _worker(void) {
+    mutex_lock(&_lock);
+    for(;;) {
+        while(_next_range >= _num_ranges)
+            condition_wait(&_work_ready, &_lock);
+        _run_ranges();
+    }
+}
+#ifdef _WIN32
+static DWORD WINAPI _thread_proc(LPVOID param) {
+    (void)param;
+    _worker();
+    return 0;
+}
+#else
+static void* _thread_proc(void* param) {
+    (void)param;
+    _worker();
+    return NULL;
+}
+#endif
+/* With the lock held. Threads that can't be created leave their share to
+ * the others.
+ */
+static void _start_workers(uint32_t count) {
+    uint32_t ii;
+    for(ii=0; ii<count; ++ii) {
+#ifdef _WIN32
+        HANDLE thread = CreateThread(NULL, 0, _thread_proc, NULL, 0, NULL);
+        if(thread != NULL)
+            CloseHandle(thread);
+#else
+        pthread_t thread;
+        if(pthread_create(&thread, NULL, _thread_proc, NULL) == 0)
+            pthread_detach(thread);
+#endif
+    }
+    _workers_started = 1;
+}
+
+/*
+ * External
+ */
+uint32_t hardware_thread_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? (uint32_t)info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (uint32_t)count : 1;
+#endif
+}
+void parallel_for(ParallelFunc* func, void* data, uint32_t count, uint32_t min_batch) {
+    uint32_t hardware_threads = hardware_thread_count();
+    uint32_t num_threads = hardware_threads;
+    uint32_t batch;
+    uint32_t ii;
+
+    if(min_batch == 0)
+        min_batch = 1;
+    if(num_threads > kMaxWorkerThreads)
+        num_threads = kMaxWorkerThreads;
+    if(num_threads > count/min_batch)
+        num_threads = count/min_batch;
+    if(num_threads <= 1) {
+        if(count)
+            func(data, 0, count);
+        return;
+    }
+
+    /* A loop started from inside another one, or from another thread while
+     * one is running, runs on the calling thread
+     */
+    mutex_lock(&_lock);
+    if(_busy) {
+        mutex_unlock(&_lock);
+        func(data, 0, count);
+        return;
+    }
+    if(!_workers_started)
+        _start_workers((hardware_threads < kMaxWorkerThreads ? hardware_threads : kMaxWorkerThreads) - 1);
+    _busy = 1;
+
+    batch = (count + num_threads-1)/num_threads;
+    for(ii=0; ii<num_threads; ++ii) {
+        _ranges[ii].func = func;
+        _ranges[ii].data = data;
+        _ranges[ii].begin = ii*batch;
+        _ranges[ii].end = (ii == num_threads-1) ? count : (ii+1)*batch;
+    }
+    _num_ranges = num_threads;
+    _next_range = 0;
+    _ranges_pending = num_threads;
+    condition_broadcast(&_work_ready);
+
+    _run_ranges();
+    while(_ranges_pending)
+        condition_wait(&_work_done, &_lock);
+    _num_ranges = 0;
+    _next_range = 0;
+    _busy = 0;
+    mutex_unlock(&_lock);
+}
@@ -0,0 +1,39 @@
+/*! @file parallel.h
+ *  @brief Splits loops across worker threads
+ *  @author Kyle Weicht
+ *  @date 10/19/26 10:05 PM
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ *	@addtogroup parallel parallel
+ *	@{
+ */
+#ifndef __parallel_h__
+#define __parallel_h__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" { /* Use C linkage */
+#endif
+
+enum { kMaxWorkerThreads = 32 };
+
+/*! Processes the items [begin, end) */
+typedef void (ParallelFunc)(void* data, uint32_t begin, uint32_t end);
+
+/*! @brief The number of hardware threads, at least 1 */
+uint32_t hardware_thread_count(void);
+
+/*! @brief Calls `func` over [0, count) split into one contiguous range per
+ *         thread, and returns once all of them are done. Ranges are never
+ *         smaller than `min_batch`, so small loops run on the calling thread.
+ *         The worker threads are started on first use and reused; a loop
+ *         started while another is running runs on the calling thread.
+ */
+void parallel_for(ParallelFunc* func, void* data, uint32_t count, uint32_t min_batch);
+
+#ifdef __cplusplus
+} // extern "C" {
+#endif
+
+/* @} */
+#endif /* include guard */
@@ -14,7 +14,7 @@
 #include "vec_math.h"
 #include "resource_manager.h"
 
-#define MAX_LIGHTS (512)
+#define MAX_LIGHTS (1024*32)
 
 #ifndef ARRAYSIZE
     #define ARRAYSIZE(a) (sizeof((a))/sizeof((a)[0]))
@@ -36,13 +36,34 @@ struct VtxPosTex {
     float3  pos;
     float2  tex;
 };
+struct VtxPackedPosNormTanTex {
+    uint16_t    pos[3];     // UNORM16, relative to the mesh bounds
+    int16_t     tan_sign;   // SNORM16, bitangent handedness
+    int16_t     norm[2];    // SNORM16, octahedral encoded
+    int16_t     tan[2];     // SNORM16, octahedral encoded
+    uint16_t    tex[2];     // Half float
+};
+struct VtxPackedPos {
+    uint16_t    pos[3];     // UNORM16, relative to the mesh bounds
+    uint16_t    _padding;
+};
 enum VertexType {
     kVtxPosNormTex,
     kVtxPosTex,
     kVtxPosNormTanBitanTex,
+    kVtxPackedPosNormTanTex,
+    kVtxPackedPos,
 
     kNUM_VERTEX_TYPES
 };
+static const size_t kVertexSizes[kNUM_VERTEX_TYPES] =
+{
+    sizeof(VtxPosNormTex),
+    sizeof(VtxPosTex),
+    sizeof(VtxPosNormTanBitanTex),
+    sizeof(VtxPackedPosNormTanTex),
+    sizeof(VtxPackedPos),
+};
 struct Light {
     float3  pos;
     float   size;
@@ -82,6 +103,9 @@ public:
     virtual Resource create_mesh(uint32_t vertex_count, VertexType vertex_type,
                                  uint32_t index_count, size_t index_size,
                                  const void* vertices, const void* indices) = 0;
+    // A simplified hull, inside the real surface, that culls what it hides
+    virtual Resource create_occluder(uint32_t vertex_count, const float3* positions,
+                                     uint32_t index_count, const uint32_t* indices) = 0;
 
     virtual void* window(void) = 0;
 
@@ -91,7 +115,9 @@ public:
 
     virtual void set_3d_view_matrix(const float4x4& view) = 0;
     virtual void set_2d_view_matrix(const float4x4& view) = 0;
-    virtual void draw_3d(Resource mesh, const Material* material, const float4x4& transform) = 0;
+    virtual void draw_3d(Resource mesh, const Material* material, const float4x4& transform,
+                         bool dynamic, bool double_sided) = 0;
+    virtual void draw_occluder(Resource occluder, const float4x4& transform) = 0;
     virtual void draw_light(const Light& light) = 0;
 
     virtual void toggle_debug_graphics(void) = 0;
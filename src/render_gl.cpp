@@ -32,16 +32,29 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
 #include <vector>
+#include <map>
 #include "assert.h"
 #include "stb_image.h"
 #include "application.h"
 #include "vec_math.h"
 #include "geometry.h"
+#include "mesh_cooker.h"
+#include "mesh_file.h"
+#include "render_queue.h"
 #include "render_gl_helper.h"
+#include "geometry_buffers.h"
+#include "culling.h"
+#include "depth_pyramid.h"
+#include "shadow_cascades.h"
+#include "occlusion_buffer.h"
+#include "timer.h"
 
 #include "renderer.h"
 #include "renderer_deferred.h"
+#include "renderer_visibility.h"
 
 #define CheckGLError()                  \
     do {                                \
@@ -61,15 +74,19 @@
 #define FOURCC_DXT3	MAKEFOURCC('D', 'X', 'T', '3')
 #define FOURCC_DXT5	MAKEFOURCC('D', 'X', 'T', '5')
 
-namespace {
+// Pick one of the mesh's LODs per draw from its screen size
+#define LOD_SELECTION 1
+// Split large meshes into meshlets and only draw the ones the camera sees
+#define MESHLET_CULLING 1
+// Hold back draws an earlier frame's depth hides. They're drawn after the
+// rest of the geometry, each tested on the GPU against the new depth.
+#define HIZ_OCCLUSION_CULLING 1
+// Cull camera draws against occluders rasterized on the CPU this frame
+#define SOFTWARE_OCCLUSION_CULLING 1
+#define SOFTWARE_OCCLUSION_WIDTH 256    // Texels across, the height follows the aspect ratio
 
-enum UniformBufferType {
-    kWorldTransformBuffer,
-    kViewProjTransformBuffer,
-    kLightBuffer,
+namespace {
 
-    kNUM_UNIFORM_BUFFERS
-};
 enum VertexShaderType {
     kVSPos,
 
@@ -91,35 +108,53 @@ enum ProgramType {
 };
 
 
-enum { kMAX_MESHES = 1024, kMAX_TEXTURES = 64, kMAX_RENDER_COMMANDS = 1024*8 };
+enum { kMAX_MESHES = 1024, kMAX_TEXTURES = 64, kMAX_RENDER_COMMANDS = 1024*128, kMAX_OCCLUDERS = 256 };
+
+// LOD selection
+enum { kMAX_CLUSTER_RANGES = 1024*64 };
+const float kLodErrorPixels = 1.0f;     // Allowed on screen error
+const float kLodHysteresis = 0.75f;     // Scales the threshold to switch coarser
+
+// Draw sorting
+const float kMaxSortDepth = 10000.0f;   // The far plane
+const float kShadowSortRange = SHADOW_DISTANCE + SHADOW_CASTER_DISTANCE; // Around the camera, along the light
+
+// Light culling
+const float kMinLightPixels = 1.0f;     // Local lights with a smaller projected radius are skipped
 
 static const VertexDescription kVertexDescriptions[kNUM_VERTEX_TYPES][8] =
 {
     { // kVtxPosNormTex
-        { 0, 3 },
-        { 1, 3 },
-        { 2, 2 },
-        { 0, 0 },
+        { 0, 3, GL_FLOAT, GL_FALSE },
+        { 1, 3, GL_FLOAT, GL_FALSE },
+        { 2, 2, GL_FLOAT, GL_FALSE },
+        { 0, 0, GL_FLOAT, GL_FALSE },
     },
     { // kVtxPosTex
-        { 0, 3 },
-        { 1, 2 },
-        { 0, 0 },
+        { 0, 3, GL_FLOAT, GL_FALSE },
+        { 1, 2, GL_FLOAT, GL_FALSE },
+        { 0, 0, GL_FLOAT, GL_FALSE },
     },
     { // kVtxPosNormTanBitanTex
-        { 0, 3 },
-        { 1, 3 },
-        { 2, 3 },
-        { 3, 3 },
-        { 4, 2 },
-        { 0, 0 },
+        { 0, 3, GL_FLOAT, GL_FALSE },
+        { 1, 3, GL_FLOAT, GL_FALSE },
+        { 2, 3, GL_FLOAT, GL_FALSE },
+        { 3, 3, GL_FLOAT, GL_FALSE },
+        { 4, 2, GL_FLOAT, GL_FALSE },
+        { 0, 0, GL_FLOAT, GL_FALSE },
+    },
+    { // kVtxPackedPosNormTanTex
+        { 0, 3, GL_UNSIGNED_SHORT, GL_TRUE },
+        { 3, 1, GL_SHORT, GL_TRUE },
+        { 1, 2, GL_SHORT, GL_TRUE },
+        { 2, 2, GL_SHORT, GL_TRUE },
+        { 4, 2, GL_HALF_FLOAT, GL_FALSE },
+        { 0, 0, GL_FLOAT, GL_FALSE },
+    },
+    { // kVtxPackedPos
+        { 0, 3, GL_UNSIGNED_SHORT, GL_TRUE },
+        { 0, 0, GL_FLOAT, GL_FALSE },
     },
-};
-static const size_t kVertexSizes[kNUM_VERTEX_TYPES] =
-{
-    sizeof(VtxPosNormTex),
-    sizeof(VtxPosTex),
-    sizeof(VtxPosNormTanBitanTex)
 };
 
 }
@@ -136,8 +171,16 @@ RenderGL()
     , _deferred(1)
     , _debug(0)
     , _num_renderables(0)
+    , _num_occluders(0)
+    , _frame_count(0)
+    , _num_cluster_ranges(0)
+    , _next_mesh_id(1)
 {
     _num_lights = 0;
+    _num_visible_lights = 0;
+    memset(_lod_history, 0, sizeof(_lod_history));
+    memset(&_stats, 0, sizeof(_stats));
+    timer_init(&_occlusion_timer);
 }
 ~RenderGL() {
 }
@@ -205,6 +248,7 @@ void initialize(void* window) {
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
     glClearDepth(1.0f);
     _load_shaders();
+    _geometry.init();
     _create_base_meshes();
     _clear(); // Clear once so the first present isn't garbage
 
@@ -215,16 +259,21 @@ void initialize(void* window) {
 
     _create_framebuffer();
 
-    _deferred_renderer.init();
-    _deferred_renderer.set_sphere_mesh(*((Mesh*)_sphere_mesh.ptr));
-    _deferred_renderer.set_fullscreen_mesh(*((Mesh*)_fullscreen_quad_mesh.ptr));
+    _renderer = &_deferred_renderer;
+    _visibility_renderer.set_geometry_buffers(&_geometry);
+    _start_renderer();
 }
 void shutdown(void) {
-    _deferred_renderer.shutdown();
+    _renderer->shutdown();
+    _geometry.shutdown();
+    for(size_t ii=0; ii<_occluder_meshes.size(); ++ii)
+        delete _occluder_meshes[ii];
+    _occluder_meshes.clear();
 }
 void render(void) {
     _present();
     _clear();
+    _gl_state.reset(); // Uploads since last frame bound around it
 
     glBindFramebuffer(GL_FRAMEBUFFER, _frame_buffer);
     _clear();
@@ -245,18 +294,20 @@ void render(void) {
             float4x4 wvp = float4x4multiply(&r.transform, &view_proj);
             glUniformMatrix4fv(_view_proj_uniform, 1, GL_FALSE, (float*)&wvp);
 
-            glBindVertexArray(r.vao);
+            glBindVertexArray(r.depth_vao);
             _validate_program(_depth_program);
-            glDrawElements(GL_TRIANGLES, (GLsizei)r.index_count, r.index_format, NULL);
+            glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)r.index_count, r.index_format, (GLvoid*)r.depth_index_offset, r.depth_base_vertex);
         }
 
         glColorMask(1, 1, 1, 1);
     }
 
 
-    _deferred_renderer.render(view, proj, _frame_buffer,
-                              _renderables, _num_renderables,
-                              _lights, _num_lights);
+    _cull_lights();
+    _build_render_queues();
+    _renderer->render(view, proj, _frame_buffer,
+                              _renderables, _render_queues,
+                              _visible_lights, _num_visible_lights, &_stats);
 
     // Render the scene from the render target
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -266,10 +317,10 @@ void render(void) {
         float4x4 translate = float4x4Scale(0.5f, 0.5f, 0.5f);
         translate.r3.x = -0.5f;
         translate.r3.y = -0.5f;
-        glUseProgram(_2d_program);
-        glBindVertexArray(mesh.vao);
+        _gl_state.use_program(_2d_program);
+        _gl_state.bind_vertex_array(mesh.geometry.vao);
         _validate_program(_2d_program);
-        glUniformMatrix4fv(_2d_viewproj_uniform, 1, GL_FALSE, (float*)&float4x4identity);
+        _gl_state.uniform_matrix4fv(_2d_viewproj_uniform, 1, (float*)&float4x4identity);
         for(int ii=0;ii<4;++ii) {
             if(ii == 1)
                 translate.r3.y = 0.5f;
@@ -277,9 +328,9 @@ void render(void) {
                 translate.r3.x = 0.5f;
             if(ii == 3)
                 translate.r3.y = -0.5f;
-            glBindTexture(GL_TEXTURE_2D, _deferred_renderer.gbuffer_tex(ii));
-            glUniformMatrix4fv(_2d_world_uniform, 1, GL_FALSE, (float*)&translate);
-            glDrawElements(GL_TRIANGLES, (GLsizei)mesh.index_count, mesh.index_format, NULL);
+            _gl_state.bind_texture(0, GL_TEXTURE_2D, _renderer->gbuffer_tex(ii));
+            _gl_state.uniform_matrix4fv(_2d_world_uniform, 1, (float*)&translate);
+            _draw_mesh(&mesh, 1);
         }
         glEnable(GL_DEPTH_TEST);
     } else {
@@ -288,7 +339,48 @@ void render(void) {
 
     }
 
+    _gl_state.read_counters(&_stats.gl_calls_issued, &_stats.gl_calls_elided);
+    if(++_frame_count % 64 == 0) {
+        debug_output("Triangles: %d of %d (%.1f%% saved by LODs and meshlets), meshlets %d of %d\n",
+                     _stats.triangles_drawn, _stats.triangles_full_detail,
+                     100.0f*(1.0f - _stats.triangles_drawn/(float)(_stats.triangles_full_detail ? _stats.triangles_full_detail : 1)),
+                     _stats.meshlets_visible, _stats.meshlets_total);
+        debug_output("Culling: camera drew %d, culled %d; shadow cascades drew %d, %d, %d, %d\n",
+                     _stats.drawn[kGeometryPass], _stats.culled[kGeometryPass],
+                     _stats.drawn[kShadowPass], _stats.drawn[kShadowPass1],
+                     _stats.drawn[kShadowPass2], _stats.drawn[kShadowPass3]);
+        debug_output("Lights: %d shaded, %d outside the frustum, %d too small; %d fragments shaded\n",
+                     _stats.lights_shaded, _stats.lights_culled, _stats.lights_too_small, _stats.light_fragments);
+        debug_output("Draw calls: %d for %d instances\n", _stats.draw_calls, _stats.instances);
+        debug_output("Shadow cascades: %d redrawn, %d cached saving %.2f ms of GPU time, %d dynamic casters over them\n",
+                     _stats.shadow_renders, _stats.shadow_renders_skipped, _stats.shadow_ms_saved,
+                     _stats.shadow_dynamic_casters);
+        debug_output("Shadow atlas: %d lights shadowed, %d tiles redrawn, %d cached, %d casters drawn\n",
+                     _stats.lights_shadowed, _stats.atlas_tiles_rendered, _stats.atlas_tiles_cached,
+                     _stats.drawn[kShadowAtlasPass]);
+        debug_output("State changes: %d materials, %d meshes (%d, %d in submission order)\n",
+                     _stats.state_changes.materials, _stats.state_changes.meshes,
+                     _stats.state_changes_unsorted.materials, _stats.state_changes_unsorted.meshes);
+        debug_output("GL state: %d binds and uniforms issued, %d redundant ones skipped\n",
+                     _stats.gl_calls_issued, _stats.gl_calls_elided);
+        debug_output("Uniform ring: %d bytes written, %d frames waited on the GPU\n",
+                     _stats.uniform_bytes, _stats.uniform_stalls);
+        debug_output("GPU occlusion: %d runs tested, %d skipped\n",
+                     _stats.occlusion_tests, _stats.occlusion_culled);
+        debug_output("Hi-Z: %d draws tested, %d held back for the retest pass\n",
+                     _stats.hiz_tested, _stats.hiz_occluded);
+        debug_output("Depth pre-pass: %s, overdraw %.2f\n",
+                     _stats.depth_prepass ? "on" : "off", _stats.overdraw);
+        debug_output("Software occlusion: %d occluder triangles, %d draws tested, %d culled in %.2f ms\n",
+                     _stats.occluder_triangles, _stats.software_tested, _stats.software_culled, _stats.software_ms);
+        if(_renderer == &_visibility_renderer)
+            debug_output("Visibility buffer: %d entries, %d materials resolved\n",
+                         _stats.visibility_entries, _stats.visibility_materials);
+    }
+    memset(&_stats, 0, sizeof(_stats));
+    _num_cluster_ranges = 0;
     _num_renderables = 0;
+    _num_occluders = 0;
     _num_lights = 0;
 }
 void resize(int width, int height) {
@@ -300,45 +392,392 @@ void resize(int width, int height) {
 
     // Resize render targets
     _resize_framebuffer();
-    _deferred_renderer.resize(width, height);
+    _renderer->resize(width, height);
+
+    uint32_t occlusion_height = (uint32_t)(SOFTWARE_OCCLUSION_WIDTH*height/(width ? width : 1));
+    if(occlusion_height == 0)
+        occlusion_height = 1;
+    _occlusion_depth.resize(SOFTWARE_OCCLUSION_WIDTH*occlusion_height);
+    occlusion_buffer_init(&_occlusion_buffer, &_occlusion_depth[0], SOFTWARE_OCCLUSION_WIDTH, occlusion_height);
 }
 void _render_fullscreen(GLuint texture) {
     Mesh* mesh = (Mesh*)_fullscreen_quad_mesh.ptr;
-    glUseProgram(_fullscreen_program);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glBindVertexArray(mesh->vao);
+    _gl_state.use_program(_fullscreen_program);
+    _gl_state.bind_texture(0, GL_TEXTURE_2D, texture);
+    _gl_state.bind_vertex_array(mesh->geometry.vao);
     _validate_program(_fullscreen_program);
-    glDrawElements(GL_TRIANGLES, (GLsizei)mesh->index_count, mesh->index_format, NULL);
+    _draw_mesh(mesh, 1);
 }
 
 Resource create_mesh(uint32_t vertex_count, VertexType vertex_type,
                    uint32_t index_count, size_t index_size,
                    const void* vertices, const void* indices) {
+    CookedMesh cooked;
+    cook_mesh(&cooked, vertex_count, vertex_type, index_count, index_size, vertices, indices);
+    return _upload_mesh(cooked.data);
+}
+Resource create_occluder(uint32_t vertex_count, const float3* positions,
+                         uint32_t index_count, const uint32_t* indices) {
+    OccluderMesh* occluder = new OccluderMesh;
+    occluder->positions.assign(positions, positions + vertex_count);
+    occluder->indices.assign(indices, indices + index_count);
+    _occluder_meshes.push_back(occluder);
+    Resource resource = {occluder};
+    return resource;
+}
+Resource _upload_mesh(const MeshData& data) {
     Mesh* mesh = new Mesh;
-    if(vertex_type == kVtxPosNormTex) {
-        VtxPosNormTanBitanTex* new_vertices = _calculate_tangets((VtxPosNormTex*)vertices, vertex_count, indices, index_size, index_count);
-        vertex_type = kVtxPosNormTanBitanTex;
-        *mesh = _create_mesh(vertex_count, kVertexSizes[vertex_type],
-                             index_count, index_size,
-                             new_vertices, indices,
-                             kVertexDescriptions[vertex_type]);
-        delete [] new_vertices;
-    } else {
-        *mesh = _create_mesh(vertex_count, kVertexSizes[vertex_type],
-                             index_count, index_size,
-                             vertices, indices,
-                             kVertexDescriptions[vertex_type]);
+    memset(mesh, 0, sizeof(*mesh));
+    mesh->id = _next_mesh_id++;
+    mesh->geometry = _geometry.alloc(data.vertex_type, kVertexDescriptions[data.vertex_type],
+                                     data.vertex_count, data.vertices,
+                                     data.index_count, data.index_size, data.indices);
+    mesh->index_format = (data.index_size == 2) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    mesh->dequantize = data.dequantize;
+    mesh->index_count = data.lods[0].index_count;
+    memcpy(mesh->lods, data.lods, sizeof(data.lods));
+    mesh->num_lods = data.num_lods;
+    mesh->center = data.center;
+    mesh->radius = data.radius;
+    if(data.num_meshlets) {
+        mesh->num_meshlets = data.num_meshlets;
+        mesh->meshlets = new Meshlet[data.num_meshlets];
+        mesh->meshlet_bounds = new MeshletBounds[data.num_meshlets];
+        memcpy(mesh->meshlets, data.meshlets, data.num_meshlets*sizeof(Meshlet));
+        memcpy(mesh->meshlet_bounds, data.meshlet_bounds, data.num_meshlets*sizeof(MeshletBounds));
+    }
+    if(data.position_count) {
+        mesh->depth = _geometry.alloc(kVtxPackedPos, kVertexDescriptions[kVtxPackedPos],
+                                      data.position_count, data.positions,
+                                      data.index_count, data.index_size, data.position_indices);
     }
     Resource resource = {mesh};
     return resource;
 }
+/* Normal cones only cull what can't be seen, single sided meshes seen from
+ * outside. Everything else is only frustum culled.
+ */
+void _cull_meshlets(Renderable* r, const Mesh* mesh, const float4x4& transform, bool double_sided) {
+    // The planes of world*view*proj are in model space, so are the meshlets
+    float4x4 inv_view = float4x4inverse(&_3d_view);
+    float4x4 view_proj = float4x4multiply(&inv_view, &_perspective_projection);
+    float4x4 world_view_proj = float4x4multiply(&transform, &view_proj);
+    Frustum frustum;
+    frustum_from_matrix(&frustum, &world_view_proj);
+    float4x4 inv_world = float4x4inverse(&transform);
+    float3 camera = { _3d_view.r3.x, _3d_view.r3.y, _3d_view.r3.z };
+    camera = _transform_point(inv_world, camera);
+
+    bool cones = !double_sided && meshlet_cones_usable(&camera, &mesh->center, mesh->radius);
+
+    _visible_meshlets.resize(mesh->num_meshlets);
+    uint32_t visible = cull_meshlets(&_visible_meshlets[0], mesh->meshlet_bounds, mesh->num_meshlets,
+                                     &frustum, cones ? &camera : NULL);
+    _stats.meshlets_visible += visible;
+    _stats.meshlets_total += mesh->num_meshlets;
+    if(visible == mesh->num_meshlets)
+        return;
+
+    // Neighboring meshlets are consecutive in the index buffer, merge them
+    size_t index_size = (mesh->index_format == GL_UNSIGNED_SHORT) ? 2 : 4;
+    int first_range = _num_cluster_ranges;
+    uint32_t range_end = ~0u;
+    uint32_t triangles = 0;
+    for(uint32_t ii=0; ii<visible; ++ii) {
+        const Meshlet& meshlet = mesh->meshlets[_visible_meshlets[ii]];
+        if(meshlet.index_offset == range_end) {
+            _cluster_counts[_num_cluster_ranges-1] += (GLsizei)meshlet.triangle_count*3;
+        } else {
+            if(_num_cluster_ranges == kMAX_CLUSTER_RANGES) {
+                // Out of room, draw the whole mesh
+                _num_cluster_ranges = first_range;
+                return;
+            }
+            _cluster_counts[_num_cluster_ranges] = (GLsizei)meshlet.triangle_count*3;
+            _cluster_offsets[_num_cluster_ranges] = (const GLvoid*)(uintptr_t)(mesh->geometry.index_start + meshlet.index_offset*index_size);
+            _cluster_base_vertices[_num_cluster_ranges] = mesh->geometry.base_vertex;
+            ++_num_cluster_ranges;
+        }
+        range_end = meshlet.index_offset + meshlet.triangle_count*3;
+        triangles += meshlet.triangle_count;
+    }
+    r->cluster_counts = &_cluster_counts[first_range];
+    r->cluster_offsets = &_cluster_offsets[first_range];
+    r->cluster_base_vertices = &_cluster_base_vertices[first_range];
+    r->num_cluster_ranges = _num_cluster_ranges - first_range;
+    _stats.triangles_drawn -= r->index_count/3 - triangles;
+}
+void _build_render_queues(void) {
+    // Cull against the camera, each of the shadow cascades and each local
+    // light shadow view
+    float4x4 inv_view = float4x4inverse(&_3d_view);
+    float4x4 view_proj = float4x4multiply(&inv_view, &_perspective_projection);
+    Frustum frustum;
+    frustum_from_matrix(&frustum, &view_proj);
+    uint32_t num_visible[kNUM_RENDER_PASSES] = { 0 };
+    num_visible[kGeometryPass] = cull_spheres(_visible[kGeometryPass], _bounds_x, _bounds_y, _bounds_z, _bounds_radius,
+                                              (uint32_t)_num_renderables, &frustum);
+#if SOFTWARE_OCCLUSION_CULLING
+    if(_num_occluders) {
+        timer_reset(&_occlusion_timer);
+        occlusion_buffer_clear(&_occlusion_buffer, &view_proj);
+        _stats.occluder_triangles += occlusion_buffer_draw(&_occlusion_buffer, _occluders, (uint32_t)_num_occluders);
+        uint32_t tested = num_visible[kGeometryPass];
+        num_visible[kGeometryPass] = occlusion_buffer_cull_spheres(&_occlusion_buffer, _visible[kGeometryPass], tested,
+                                                                   _bounds_x, _bounds_y, _bounds_z, _bounds_radius);
+        _stats.software_tested += tested;
+        _stats.software_culled += tested - num_visible[kGeometryPass];
+        _stats.software_ms += (float)(timer_delta_time(&_occlusion_timer)*1000.0);
+    }
+#endif
+#if HIZ_OCCLUSION_CULLING
+    const DepthPyramid* pyramid = _renderer->depth_pyramid();
+    if(pyramid) {
+        uint32_t* visible = _visible[kGeometryPass];
+        uint32_t* retest = _visible[kGeometryRetestPass];
+        uint32_t kept = 0;
+        for(uint32_t ii=0; ii<num_visible[kGeometryPass]; ++ii) {
+            uint32_t index = visible[ii];
+            float3 center = { _bounds_x[index], _bounds_y[index], _bounds_z[index] };
+            if(depth_pyramid_occluded(pyramid, &center, _bounds_radius[index]))
+                retest[num_visible[kGeometryRetestPass]++] = index;
+            else
+                visible[kept++] = index;
+        }
+        _stats.hiz_tested += num_visible[kGeometryPass];
+        _stats.hiz_occluded += num_visible[kGeometryRetestPass];
+        num_visible[kGeometryPass] = kept;
+    }
+#endif
+    uint32_t num_cascades = _renderer->update_shadow_cascades(_3d_view, _perspective_projection,
+                                                                      _num_lights ? &_lights[0] : NULL);
+    const ShadowCascade* cascades = _renderer->shadow_cascades();
+    for(uint32_t ii=0; ii<num_cascades; ++ii) {
+        int pass = kShadowPass + (int)ii;
+        frustum_from_matrix(&frustum, &cascades[ii].view_proj);
+        num_visible[pass] = cull_spheres(_visible[pass], _bounds_x, _bounds_y, _bounds_z, _bounds_radius,
+                                         (uint32_t)_num_renderables, &frustum);
+    }
+    uint32_t num_atlas_views = _renderer->update_shadow_atlas(_3d_view, _perspective_projection, _height,
+                                                                      _visible_lights, _num_visible_lights);
+    _cull_shadow_atlas_views(num_atlas_views);
+    num_visible[kShadowAtlasPass] = _render_queues[kShadowAtlasPass].count;
+
+    // Front to back from the camera, and from the shadow casting light
+    float3 camera = { _3d_view.r3.x, _3d_view.r3.y, _3d_view.r3.z };
+    float3 forward = { _3d_view.r2.x, _3d_view.r2.y, _3d_view.r2.z };
+    float3 light_dir = { 0.0f, -1.0f, 0.0f };
+    if(_num_lights)
+        light_dir = _lights[0].dir;
+    light_dir = float3normalize(&light_dir);
+
+    for(int ii=0; ii<kNUM_RENDER_PASSES; ++ii) {
+        uint32_t tested = (uint32_t)_num_renderables;
+        if(ii == kShadowAtlasPass)
+            tested *= num_atlas_views;
+        // Held back draws passed the frustum and count as the retest pass's
+        if(ii == kGeometryPass)
+            tested -= num_visible[kGeometryRetestPass];
+        if(ii == kGeometryRetestPass)
+            tested = num_visible[ii];
+        _render_queues[ii].keys = _render_keys[ii];
+        _render_queues[ii].count = num_visible[ii];
+        _stats.drawn[ii] += num_visible[ii];
+        _stats.culled[ii] += tested - num_visible[ii];
+    }
+    const int kCameraPasses[] = { kGeometryPass, kGeometryRetestPass };
+    for(int jj=0; jj<(int)ARRAYSIZE(kCameraPasses); ++jj) {
+        int pass = kCameraPasses[jj];
+        for(uint32_t ii=0; ii<num_visible[pass]; ++ii) {
+            uint32_t index = _visible[pass][ii];
+            const Renderable& r = _renderables[index];
+            float3 to_center = { _bounds_x[index] - camera.x, _bounds_y[index] - camera.y, _bounds_z[index] - camera.z };
+            RenderKey& key = _render_keys[pass][ii];
+            key.key = render_key((uint32_t)pass, 0, _material_id(r.material), r.mesh*kMaxMeshLods + r.lod,
+                                 float3dot(&to_center, &forward), kMaxSortDepth);
+            key.index = index;
+        }
+    }
+    for(int pass=kShadowPass; pass<kShadowPass+kMaxShadowCascades; ++pass) {
+        for(uint32_t ii=0; ii<num_visible[pass]; ++ii) {
+            uint32_t index = _visible[pass][ii];
+            const Renderable& r = _renderables[index];
+            float3 to_center = { _bounds_x[index] - camera.x, _bounds_y[index] - camera.y, _bounds_z[index] - camera.z };
+            RenderKey& key = _render_keys[pass][ii];
+            // Static casters first, the cascade's cache covers them
+            key.key = render_key((uint32_t)pass, r.dynamic, 0, r.mesh*kMaxMeshLods + r.lod,
+                                 float3dot(&to_center, &light_dir) + kShadowSortRange, kShadowSortRange*2);
+            key.index = index;
+        }
+    }
+    for(int ii=0; ii<kNUM_RENDER_PASSES; ++ii) {
+        RenderQueue& queue = _render_queues[ii];
+        StateChanges before = count_state_changes(queue.keys, queue.count);
+        sort_render_keys(queue.keys, _sort_scratch, queue.count);
+        StateChanges after = count_state_changes(queue.keys, queue.count);
+        _stats.state_changes_unsorted.materials += before.materials;
+        _stats.state_changes_unsorted.meshes += before.meshes;
+        _stats.state_changes_unsorted.programs += before.programs;
+        _stats.state_changes.materials += after.materials;
+        _stats.state_changes.meshes += after.meshes;
+        _stats.state_changes.programs += after.programs;
+    }
+}
+/* Each atlas view's casters go in the kShadowAtlasPass queue, keyed by view
+ * then mesh then distance from the light, so sorting leaves every view's
+ * casters together. Once the queue is full the remaining views are empty.
+ */
+void _cull_shadow_atlas_views(uint32_t num_views) {
+    ShadowAtlasView* views = _renderer->shadow_atlas_views();
+    uint32_t* visible = _visible[kShadowAtlasPass];
+    RenderKey* keys = _render_keys[kShadowAtlasPass];
+    uint32_t count = 0;
+    for(uint32_t view=0; view<num_views; ++view) {
+        Frustum frustum;
+        frustum_from_matrix(&frustum, &views[view].view_proj);
+        uint32_t num_visible = cull_spheres(visible, _bounds_x, _bounds_y, _bounds_z, _bounds_radius,
+                                            (uint32_t)_num_renderables, &frustum);
+        if(num_visible > kMAX_RENDER_COMMANDS - count)
+            num_visible = kMAX_RENDER_COMMANDS - count;
+        const Light& light = _visible_lights[views[view].light];
+        views[view].first_caster = count;
+        views[view].num_casters = num_visible;
+        for(uint32_t ii=0; ii<num_visible; ++ii) {
+            uint32_t index = visible[ii];
+            const Renderable& r = _renderables[index];
+            float3 to_center = { _bounds_x[index] - light.pos.x, _bounds_y[index] - light.pos.y, _bounds_z[index] - light.pos.z };
+            RenderKey& key = keys[count++];
+            key.key = render_key(kShadowAtlasPass, 0, view, r.mesh*kMaxMeshLods + r.lod,
+                                 float3length(&to_center), light.size);
+            key.index = index;
+        }
+    }
+    _render_queues[kShadowAtlasPass].count = count;
+}
+void _cull_lights(void) {
+    // Local lights are frustum culled and dropped once they're tiny on screen,
+    // directional lights are always kept. The order doesn't change so the
+    // first light still casts the shadows.
+    uint32_t num_local = 0;
+    for(int ii=0; ii<_num_lights; ++ii) {
+        const Light& light = _lights[ii];
+        if(light.type == kDirectionalLight)
+            continue;
+        _light_bounds_x[num_local] = light.pos.x;
+        _light_bounds_y[num_local] = light.pos.y;
+        _light_bounds_z[num_local] = light.pos.z;
+        _light_bounds_radius[num_local] = light.size;
+        ++num_local;
+    }
+    float4x4 inv_view = float4x4inverse(&_3d_view);
+    float4x4 view_proj = float4x4multiply(&inv_view, &_perspective_projection);
+    Frustum frustum;
+    frustum_from_matrix(&frustum, &view_proj);
+    uint32_t num_visible = cull_spheres(_visible_local_lights, _light_bounds_x, _light_bounds_y, _light_bounds_z,
+                                        _light_bounds_radius, num_local, &frustum);
+
+    float3 camera = { _3d_view.r3.x, _3d_view.r3.y, _3d_view.r3.z };
+    float pixels_per_unit = _height*0.5f*_perspective_projection.r1.y; // At a distance of 1
+    uint32_t local = 0;
+    uint32_t next_visible = 0;
+    _num_visible_lights = 0;
+    for(int ii=0; ii<_num_lights; ++ii) {
+        const Light& light = _lights[ii];
+        if(light.type != kDirectionalLight) {
+            // The visible list is in ascending order
+            bool visible = (next_visible < num_visible && _visible_local_lights[next_visible] == local);
+            ++local;
+            if(!visible) {
+                _stats.lights_culled++;
+                continue;
+            }
+            ++next_visible;
+            float3 to_light = float3subtract(&light.pos, &camera);
+            float distance = float3length(&to_light);
+            if(distance > light.size && light.size*pixels_per_unit < kMinLightPixels*distance) {
+                _stats.lights_too_small++;
+                continue;
+            }
+        }
+        _visible_lights[_num_visible_lights++] = light;
+    }
+    _stats.lights_shaded += (uint32_t)_num_visible_lights;
+}
+uint32_t _material_id(const Material* material) {
+    std::map<const Material*, uint32_t>::iterator iter = _material_ids.find(material);
+    if(iter != _material_ids.end())
+        return iter->second;
+    uint32_t id = (uint32_t)_material_ids.size();
+    _material_ids[material] = id;
+    return id;
+}
+float _max_scale(const float4x4& m) {
+    float3 axis_x = { m.r0.x, m.r0.y, m.r0.z };
+    float3 axis_y = { m.r1.x, m.r1.y, m.r1.z };
+    float3 axis_z = { m.r2.x, m.r2.y, m.r2.z };
+    return sqrtf(fmaxf(float3lengthSq(&axis_x), fmaxf(float3lengthSq(&axis_y), float3lengthSq(&axis_z))));
+}
+float3 _transform_point(const float4x4& m, const float3& p) {
+    float3 r = {
+        p.x*m.r0.x + p.y*m.r1.x + p.z*m.r2.x + m.r3.x,
+        p.x*m.r0.y + p.y*m.r1.y + p.z*m.r2.y + m.r3.y,
+        p.x*m.r0.z + p.y*m.r1.z + p.z*m.r2.z + m.r3.z
+    };
+    return r;
+}
+uint32_t _select_lod(const Mesh* mesh, const float4x4& transform, int slot) {
+    uint32_t lod = 0;
+    if(mesh->num_lods > 1) {
+        float3 world_center = _transform_point(transform, mesh->center);
+        float scale = _max_scale(transform);
+        float3 to_camera = {
+            _3d_view.r3.x - world_center.x,
+            _3d_view.r3.y - world_center.y,
+            _3d_view.r3.z - world_center.z
+        };
+        float distance = float3length(&to_camera) - mesh->radius*scale;
+
+        if(distance > 0.0f) {
+            // Screen pixels covered by one world unit at that distance
+            float pixels_per_unit = _height*0.5f*_perspective_projection.r1.y/distance;
+            uint32_t previous = (_lod_history[slot].mesh == mesh) ? _lod_history[slot].lod : 0;
+            for(uint32_t ii=1; ii<mesh->num_lods; ++ii) {
+                // Only drop detail once the error is clearly small enough
+                float threshold = (ii > previous) ? kLodErrorPixels*kLodHysteresis : kLodErrorPixels;
+                if(mesh->lods[ii].error*scale*pixels_per_unit > threshold)
+                    break;
+                lod = ii;
+            }
+        }
+    }
+    _lod_history[slot].mesh = mesh;
+    _lod_history[slot].lod = lod;
+    return lod;
+}
 
 Resource cube_mesh(void) { return _cube_mesh; }
 Resource quad_mesh(void) { return _quad_mesh; }
 Resource sphere_mesh(void) { return _sphere_mesh; }
 void toggle_debug_graphics(void) { _debug = !_debug; }
+/* Switches between the G-buffer and visibility buffer renderers. Only one
+ * has its targets and shadow maps at a time.
+ */
 void toggle_deferred(void) {
-    debug_output("Deferred\n");
+    _renderer->shutdown();
+    if(_renderer == &_deferred_renderer)
+        _renderer = &_visibility_renderer;
+    else
+        _renderer = &_deferred_renderer;
+    _start_renderer();
+    _renderer->resize(_width, _height);
+    debug_output(_renderer == &_deferred_renderer ? "Deferred\n" : "Visibility buffer\n");
+}
+void _start_renderer(void) {
+    _renderer->init();
+    _renderer->set_gl_state(&_gl_state);
+    _renderer->set_sphere_mesh(*((Mesh*)_sphere_mesh.ptr));
+    _renderer->set_fullscreen_mesh(*((Mesh*)_fullscreen_quad_mesh.ptr));
+    _renderer->set_box_mesh(*((Mesh*)_cube_mesh.ptr));
 }
 
 void set_3d_view_matrix(const float4x4& view) {
@@ -347,18 +786,61 @@ void set_3d_view_matrix(const float4x4& view) {
 void set_2d_view_matrix(const float4x4& view) {
     _2d_view = view;
 }
-void draw_3d(Resource mesh, const Material* material, const float4x4& transform) {
+void draw_3d(Resource mesh, const Material* material, const float4x4& transform, bool dynamic, bool double_sided) {
     const Mesh* m = (Mesh*)mesh.ptr;
+    assert(_num_renderables < kMAX_RENDER_COMMANDS);
     Renderable& r = _renderables[_num_renderables];
     r.material = material;
-    r.vao = m->vao;
+    r.dynamic = dynamic;
+    r.mesh = m->id;
+    const GeometryRange& depth = m->depth.vao ? m->depth : m->geometry;
+    r.vao = m->geometry.vao;
+    r.base_vertex = m->geometry.base_vertex;
+    r.depth_vao = depth.vao;
+    r.depth_base_vertex = depth.base_vertex;
     r.index_count = m->index_count;
     r.index_format = m->index_format;
-    r.transform = transform;
+    r.cluster_counts = NULL;
+    r.cluster_offsets = NULL;
+    r.cluster_base_vertices = NULL;
+    r.num_cluster_ranges = 0;
+    r.lod = 0;
+    uint32_t lod_start = 0;
+#if LOD_SELECTION
+    r.lod = _select_lod(m, transform, _num_renderables);
+    r.index_count = (GLsizei)m->lods[r.lod].index_count;
+    lod_start = m->lods[r.lod].index_offset*(m->index_format == GL_UNSIGNED_SHORT ? 2 : 4);
+#endif
+    r.index_offset = (const GLvoid*)(uintptr_t)(m->geometry.index_start + lod_start);
+    r.depth_index_offset = (const GLvoid*)(uintptr_t)(depth.index_start + lod_start);
+    _stats.triangles_drawn += r.index_count/3;
+    _stats.triangles_full_detail += m->index_count/3;
+#if MESHLET_CULLING
+    if(r.lod == 0 && m->num_meshlets)
+        _cull_meshlets(&r, m, transform, double_sided);
+#endif
+    r.transform = float4x4multiply(&m->dequantize, &transform);
+    float3 center = _transform_point(transform, m->center);
+    _bounds_x[_num_renderables] = center.x;
+    _bounds_y[_num_renderables] = center.y;
+    _bounds_z[_num_renderables] = center.z;
+    _bounds_radius[_num_renderables] = m->radius*_max_scale(transform);
+    float4 bounds = { center.x, center.y, center.z, _bounds_radius[_num_renderables] };
+    r.bounds = bounds;
 
     _num_renderables++;
 }
+void draw_occluder(Resource occluder, const float4x4& transform) {
+    const OccluderMesh* mesh = (OccluderMesh*)occluder.ptr;
+    assert(_num_occluders < kMAX_OCCLUDERS);
+    Occluder& o = _occluders[_num_occluders++];
+    o.transform = transform;
+    o.positions = &mesh->positions[0];
+    o.indices = &mesh->indices[0];
+    o.index_count = (uint32_t)mesh->indices.size();
+}
 void draw_light(const Light& light) {
+    assert(_num_lights < MAX_LIGHTS);
     int index = _num_lights++;
     _lights[index] = light;
 }
@@ -424,9 +906,10 @@ void _unload_texture(Resource resource) {
 }
 void _unload_mesh(Resource resource) {
     Mesh* mesh = (Mesh*)resource.ptr;
-    glDeleteBuffers(1, &mesh->index_buffer);
-    glDeleteBuffers(1, &mesh->vertex_buffer);
-    glDeleteVertexArrays(1, &mesh->vao);
+    _geometry.free(mesh->geometry);
+    _geometry.free(mesh->depth);
+    delete [] mesh->meshlets;
+    delete [] mesh->meshlet_bounds;
     delete mesh;
 }
 Resource _load_dxt_texture(const char* filename) {
@@ -502,204 +985,12 @@ Resource _load_dxt_texture(const char* filename) {
 }
 
 Resource _load_mesh(const char* filename) {
-    uint32_t nVertexStride;
-    uint32_t nVertexCount;
-    uint32_t nIndexSize;
-    uint32_t nIndexCount;
-    char* pData;
-
-    const char* ext = (filename + strlen(filename))-3;
-    if(strncmp(ext, "obj", 4) == 0) {
-        return _load_obj(filename);
-    }
-
-    FILE* pFile = fopen( filename, "rb" );
-    fread( &nVertexStride, sizeof( nVertexStride ), 1, pFile );
-    fread( &nVertexCount, sizeof( nVertexCount ), 1, pFile );
-    fread( &nIndexSize, sizeof( nIndexSize ), 1, pFile );
-    if(nIndexSize > 8) // Convert from bits to bytes
-        nIndexSize /= 8;
-    fread( &nIndexCount, sizeof( nIndexCount ), 1, pFile );
-
-    pData   = new char[ (nVertexStride * nVertexCount) + (nIndexCount * nIndexSize) ];
-
-    fread( pData, nVertexStride, nVertexCount, pFile );
-    fread( pData + (nVertexStride * nVertexCount), nIndexSize, nIndexCount, pFile );
-    fclose( pFile );
-
-    void* indices = pData + (nVertexStride * nVertexCount);
-
-    VtxPosNormTanBitanTex* new_vertices = _calculate_tangets((VtxPosNormTex*)pData, nVertexCount, indices, (size_t)nIndexSize, nIndexCount);
-
-    Resource resource = create_mesh(nVertexCount, kVtxPosNormTanBitanTex, nIndexCount, nIndexSize, new_vertices, indices);
-    delete [] pData;
-    delete [] new_vertices;
-
-    return resource;
-}
-struct int3 {
-    int p;
-    int t;
-    int n;
-};
-Resource _load_obj(const char* filename) {
-    
-    std::vector<float3> positions;
-    std::vector<float3> normals;
-    std::vector<float2> texcoords;
-
-    std::vector<int3>   indicies;
-
-    int textured = 0;
-
-    float2 tex = {0.5f, 0.5f};
-    texcoords.push_back(tex);
-    
-    FILE* file = fopen(filename, "rt");
-    while(1) {
-        char line_header[128];
-        int res = fscanf(file, "%s", line_header);
-        if(res == EOF)
-            break;
-
-        if(strcmp(line_header, "v") == 0) {
-            float3 v;
-            fscanf(file, "%f %f %f\n", &v.x, &v.y, &v.z);
-            positions.push_back(v);
-            textured = 0;
-        } else if(strcmp(line_header, "vt") == 0) {
-            float2 t;
-            fscanf(file, "%f %f\n", &t.x, &t.y);
-            texcoords.push_back(t);
-            textured = 1;
-        } else if(strcmp(line_header, "vn") == 0) {
-            float3 n;
-            fscanf(file, "%f %f %f\n", &n.x, &n.y, &n.z);
-            normals.push_back(n);
-        } else if(strcmp(line_header, "f") == 0) {
-            int3 triangle[4];
-            int matches;
-            if(textured) {
-                matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n",
-                                 &triangle[0].p, &triangle[0].t, &triangle[0].n,
-                                 &triangle[1].p, &triangle[1].t, &triangle[1].n,
-                                 &triangle[2].p, &triangle[2].t, &triangle[2].n,
-                                 &triangle[3].p, &triangle[3].t, &triangle[3].n);
-                if(matches != 9 && matches != 12) {
-                    debug_output("Can't load this OBJ\n");
-                    fclose(file);
-                    return kInvalidResource;
-                }
-            } else {
-                matches = fscanf(file, "%d//%d %d//%d %d//%d %d//%d\n",
-                                 &triangle[0].p, &triangle[0].n,
-                                 &triangle[1].p, &triangle[1].n,
-                                 &triangle[2].p, &triangle[2].n,
-                                 &triangle[3].p, &triangle[3].n);
-                if(matches != 6 && matches != 8) {
-                    debug_output("Can't load this OBJ\n");
-                    fclose(file);
-                    return kInvalidResource;
-                }
-                triangle[0].t = 0;
-                triangle[1].t = 0;
-                triangle[2].t = 0;
-                matches = 9;
-                if(matches == 8) {
-                    triangle[3].t = 0;
-                    matches = 12;
-                }
-            }
-            indicies.push_back(triangle[0]);
-            indicies.push_back(triangle[1]);
-            indicies.push_back(triangle[2]);
-            if(matches == 12) {
-                indicies.push_back(triangle[0]);
-                indicies.push_back(triangle[2]); 
-                indicies.push_back(triangle[3]);
-            }
-        } else {
-            // A comment?
-            char buffer[1024];
-            fgets(buffer, sizeof(buffer), file);
-        }
-    }
-    fclose(file);
-
-    VtxPosNormTex* vertices = new VtxPosNormTex[indicies.size()];
-    for(int ii=0; ii<(int)indicies.size(); ++ii) {
-        int pos_index = indicies[ii].p-1;
-        int tex_index = indicies[ii].t;
-        int norm_index = indicies[ii].n-1;
-        VtxPosNormTex& vertex = vertices[ii];
-        vertex.pos = positions[pos_index];
-        vertex.tex = texcoords[tex_index];
-        vertex.norm = normals[norm_index];
-    }
-    uint32_t* i = new uint32_t[indicies.size()];
-    for(int ii=0;ii<(int)indicies.size();++ii)
-        i[ii] = ii;
-
-    int vertex_count = (int)indicies.size();
-    int index_count = vertex_count;
-    
-    VtxPosNormTanBitanTex* new_vertices = _calculate_tangets(vertices, vertex_count, i, sizeof(uint32_t), index_count);
-
-    Resource resource = create_mesh(vertex_count, kVtxPosNormTanBitanTex, index_count, sizeof(uint32_t), new_vertices, i);
-    delete [] new_vertices;
-    delete [] vertices;
-    delete [] i;
-
-    return resource;
-}
-VtxPosNormTanBitanTex* _calculate_tangets(const VtxPosNormTex* vertices, int num_vertices, const void* indices, size_t index_size, int num_indices) {
-    VtxPosNormTanBitanTex* new_vertices = new VtxPosNormTanBitanTex[num_vertices];
-    for(int ii=0;ii<num_vertices;++ii) {
-        new_vertices[ii].pos = vertices[ii].pos;
-        new_vertices[ii].norm = vertices[ii].norm;
-        new_vertices[ii].tex = vertices[ii].tex;
-    }
-    for(int ii=0;ii<num_indices;ii+=3) {
-        uint32_t i0,i1,i2;
-        if(index_size == 2) {
-            i0 = ((uint16_t*)indices)[ii+0];
-            i1 = ((uint16_t*)indices)[ii+1];
-            i2 = ((uint16_t*)indices)[ii+2];
-        } else {
-            i0 = ((uint32_t*)indices)[ii+0];
-            i1 = ((uint32_t*)indices)[ii+1];
-            i2 = ((uint32_t*)indices)[ii+2];
-        }
-
-        VtxPosNormTanBitanTex& v0 = new_vertices[i0];
-        VtxPosNormTanBitanTex& v1 = new_vertices[i1];
-        VtxPosNormTanBitanTex& v2 = new_vertices[i2];
-
-        float3 delta_pos1 = float3subtract(&v1.pos, &v0.pos);
-        float3 delta_pos2 = float3subtract(&v2.pos, &v0.pos);
-        float2 delta_uv1 = float2subtract(&v1.tex, &v0.tex);
-        float2 delta_uv2 = float2subtract(&v2.tex, &v0.tex);
-
-        float r = 1.0f / (delta_uv1.x * delta_uv2.y - delta_uv1.y * delta_uv2.x);
-        float3 a = float3multiplyScalar(&delta_pos1, delta_uv2.y);
-        float3 b = float3multiplyScalar(&delta_pos2, delta_uv1.y);
-        float3 tangent = float3subtract(&a,&b);
-        tangent = float3multiplyScalar(&tangent, r);
-
-        a = float3multiplyScalar(&delta_pos2, delta_uv1.x);
-        b = float3multiplyScalar(&delta_pos1, delta_uv2.x);
-        float3 bitangent = float3subtract(&a,&b);
-        bitangent = float3multiplyScalar(&bitangent, r);
-
-        v0.bitan = bitangent;
-        v1.bitan = bitangent;
-        v2.bitan = bitangent;
-
-        v0.tan = tangent;
-        v1.tan = tangent;
-        v2.tan = tangent;
-    }
-    return new_vertices;
+    MeshData data;
+    std::vector<char> file_data;
+    CookedMesh cooked;
+    if(!load_mesh_data(&data, &file_data, &cooked, filename))
+        return kInvalidResource;
+    return _upload_mesh(data);
 }
 private:
 void _clear(void) {
@@ -762,18 +1053,21 @@ void _resize_framebuffer(void) {
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, _depth_buffer);
     CheckGLError();
 
+    // Lights add up in here. Nothing reads the alpha, so HDR color fits in
+    // 32 bits.
     glBindTexture(GL_TEXTURE_2D, _color_texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, _width, _height, 0, GL_RGBA, GL_HALF_FLOAT, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R11F_G11F_B10F, _width, _height, 0, GL_RGB, GL_UNSIGNED_INT_10F_11F_11F_REV, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _color_texture, 0);
     CheckGLError();
     
+    // Matches the deferred renderer's depth so its depth can be blitted in
     glBindTexture(GL_TEXTURE_2D, _depth_texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32, _width, _height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, _width, _height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, _depth_texture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, _depth_texture, 0);
     CheckGLError();
 
     GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
@@ -812,9 +1106,58 @@ float4x4    _2d_view;
 Renderable  _renderables[kMAX_RENDER_COMMANDS];
 int         _num_renderables;
 
+// Occluders drawn this frame into the software depth buffer
+struct OccluderMesh {
+    std::vector<float3>     positions;
+    std::vector<uint32_t>   indices;
+};
+std::vector<OccluderMesh*>  _occluder_meshes;
+Occluder        _occluders[kMAX_OCCLUDERS];
+int             _num_occluders;
+OcclusionBuffer _occlusion_buffer;
+std::vector<float>  _occlusion_depth;
+Timer           _occlusion_timer;
+
+// The LOD each draw slot used last frame, for hysteresis
+struct {
+    const Mesh* mesh;
+    uint32_t    lod;
+}           _lod_history[kMAX_RENDER_COMMANDS];
+
+RenderStats _stats;
+
+// World space bounding spheres of the renderables, SoA for culling
+float       _bounds_x[kMAX_RENDER_COMMANDS];
+float       _bounds_y[kMAX_RENDER_COMMANDS];
+float       _bounds_z[kMAX_RENDER_COMMANDS];
+float       _bounds_radius[kMAX_RENDER_COMMANDS];
+uint32_t    _visible[kNUM_RENDER_PASSES][kMAX_RENDER_COMMANDS];
+
+RenderKey   _render_keys[kNUM_RENDER_PASSES][kMAX_RENDER_COMMANDS];
+RenderKey   _sort_scratch[kMAX_RENDER_COMMANDS];
+RenderQueue _render_queues[kNUM_RENDER_PASSES];
+std::map<const Material*, uint32_t> _material_ids;
+uint32_t    _frame_count;
+
+// Visible meshlet ranges of this frame's renderables
+GLsizei         _cluster_counts[kMAX_CLUSTER_RANGES];
+const GLvoid*   _cluster_offsets[kMAX_CLUSTER_RANGES];
+GLint           _cluster_base_vertices[kMAX_CLUSTER_RANGES];
+int             _num_cluster_ranges;
+std::vector<uint32_t>   _visible_meshlets;
+
 Light       _lights[MAX_LIGHTS];
 int         _num_lights;
 
+// Local light bounds, SoA for culling
+float       _light_bounds_x[MAX_LIGHTS];
+float       _light_bounds_y[MAX_LIGHTS];
+float       _light_bounds_z[MAX_LIGHTS];
+float       _light_bounds_radius[MAX_LIGHTS];
+uint32_t    _visible_local_lights[MAX_LIGHTS];
+Light       _visible_lights[MAX_LIGHTS];
+int         _num_visible_lights;
+
 int _debug;
 int _deferred;
 
@@ -838,6 +1181,11 @@ int     _width;
 int     _height;
 
 RendererDeferred    _deferred_renderer;
+RendererVisibility  _visibility_renderer;
+Renderer*           _renderer;  // One of the two
+GLState             _gl_state;
+GeometryBuffers     _geometry;
+uint32_t            _next_mesh_id;
 
 };
 
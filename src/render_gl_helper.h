@@ -21,35 +21,139 @@ extern "C" { // Use C linkage
     } while(__LINE__ == 0)
 
 
+// glValidateProgram stalls the driver, only check programs before draws
+// when debugging them
+#ifndef VALIDATE_GL_PROGRAMS
+#define VALIDATE_GL_PROGRAMS 0
+#endif
+
 #ifndef ARRAYSIZE
 #define ARRAYSIZE(a) (sizeof((a))/sizeof((a)[0]))
 #endif
 
+/* Where a mesh's vertices and indices are in its vertex format's shared
+ * buffers, see GeometryBuffers
+ */
 typedef struct {
-    GLuint      vao;
-    GLuint      vertex_buffer;
-    GLuint      index_buffer;
+    GLuint      vao;            // The vertex format's, shared by all of its meshes
+    GLint       base_vertex;
+    uint32_t    vertex_count;
+    uint32_t    index_start;    // In bytes, into the format's index buffer
+    uint32_t    index_bytes;
+    uint32_t    vertex_type;
+} GeometryRange;
+
+typedef struct {
+    uint32_t    id;         // Unique per mesh, for sort keys and instancing
+    GeometryRange   geometry;
     uint32_t    index_count;
     GLenum      index_format;
+    float4x4    dequantize; // Takes packed positions back to model space
+    GeometryRange   depth;  // Deduplicated positions only, depth.vao is 0 if there aren't any
+    MeshLod     lods[kMaxMeshLods]; // lods[0] is the full mesh
+    uint32_t    num_lods;
+    float3      center;         // Model space bounding sphere
+    float       radius;
+    Meshlet*        meshlets;   // Consecutive runs of the full LOD, NULL for small meshes
+    MeshletBounds*  meshlet_bounds;
+    uint32_t        num_meshlets;
 } Mesh;
 typedef struct {
     uint32_t slot;
     int count;
+    GLenum type;
+    GLboolean normalized;
 } VertexDescription;
 
 typedef struct {
     float4x4        transform;
+    float4          bounds;     // World space bounding sphere
+    uint32_t        mesh;       // Its ID, draws of the same mesh and LOD can be instanced
     GLuint          vao;
+    GLint           base_vertex;
+    GLuint          depth_vao;  // For depth only passes, same index count
+    GLint           depth_base_vertex;
     GLsizei         index_count;
     GLenum          index_format;
+    const GLvoid*   index_offset;   // In bytes, for glDrawElements
+    const GLvoid*   depth_index_offset;
+    uint32_t        lod;
+    uint32_t        dynamic;    // Redrawn into the cached shadow maps every frame
+    const GLsizei*  cluster_counts; // Meshlet ranges the camera sees, NULL to draw the whole range
+    const GLvoid**  cluster_offsets;
+    const GLint*    cluster_base_vertices;
+    GLsizei         num_cluster_ranges;
     const Material* material;
 } Renderable;
 
 typedef struct {
-    Light   lights[MAX_LIGHTS];
-    int     num_lights;
-    int     _padding[3];
-} LightBuffer;
+    uint32_t    triangles_drawn;
+    uint32_t    triangles_full_detail;  // What would have been drawn without LODs
+    uint32_t    meshlets_visible;
+    uint32_t    meshlets_total;
+    StateChanges    state_changes;          // All passes, in sorted order
+    StateChanges    state_changes_unsorted; // What submission order would have needed
+    uint32_t    drawn[kNUM_RENDER_PASSES];  // Renderables that passed frustum culling
+    uint32_t    culled[kNUM_RENDER_PASSES];
+    uint32_t    lights_shaded;
+    uint32_t    lights_culled;      // Outside the camera frustum
+    uint32_t    lights_too_small;   // Below kMinLightPixels on screen
+    uint32_t    light_fragments;    // Samples the lighting pass shaded, from 2 frames ago
+    uint32_t    draw_calls;     // Geometry and shadow passes, after instancing
+    uint32_t    instances;
+    uint32_t    shadow_renders;         // Cascades whose static casters were redrawn
+    uint32_t    shadow_renders_skipped; // Cascades whose cached static casters were used
+    float       shadow_ms_saved;        // The skipped cascades' last redraw times
+    uint32_t    shadow_dynamic_casters; // Drawn over the cached static casters
+    uint32_t    atlas_tiles_rendered;   // Local light shadow views redrawn
+    uint32_t    atlas_tiles_cached;     // Local light shadow views left as they were
+    uint32_t    lights_shadowed;        // Local lights with a shadow this frame
+    uint32_t    gl_calls_issued;    // Binds and uniforms that went through GLState
+    uint32_t    gl_calls_elided;    // The ones it skipped because nothing changed
+    uint32_t    uniform_bytes;      // Written to the uniform ring
+    uint32_t    uniform_stalls;     // Frames that waited for their ring segment
+    uint32_t    occlusion_tests;    // Geometry pass runs drawn conditionally on their boxes
+    uint32_t    occlusion_culled;   // Of those, ones the GPU skipped, from 2 frames ago
+    uint32_t    hiz_tested;         // Camera draws tested against an earlier frame's depth
+    uint32_t    hiz_occluded;       // Of those, ones held back for the retest pass
+    uint32_t    occluder_triangles; // Rasterized into the software occlusion buffer
+    uint32_t    software_tested;    // Camera draws tested against it
+    uint32_t    software_culled;
+    float       software_ms;        // Rasterizing and testing, on the CPU
+    float       overdraw;           // Camera fragments that passed the depth test per pixel, from 2 frames ago
+    uint32_t    depth_prepass;      // Whether the G-buffer pass had its depth laid down first
+    uint32_t    visibility_entries;     // Camera draw instances in the visibility buffer, 0 for the deferred renderer
+    uint32_t    visibility_materials;   // Resolved one after another over their own pixels
+} RenderStats;
+
+/* Uniform block binding points. The blocks are std140, the structs below
+ * match their layout.
+ */
+enum UniformBinding {
+    kFrameConstantsBinding,
+    kMaterialConstantsBinding,
+    kShadowViewBinding,
+
+    kNUM_UNIFORM_BINDINGS
+};
+
+typedef struct {
+    float4x4    view_proj;
+    float4x4    inverse_view_proj;
+    float4x4    view;               // World to view
+    float4x4    shadow_view_proj[4];    // World to shadow map UV and depth
+    float4      camera_position;
+    float       screen_size[2];
+    int32_t     num_cascades;
+    int32_t     _padding;
+} FrameConstants;
+
+typedef struct {
+    float3      specular_color;
+    float       specular_coefficient;
+    float       specular_exponent;
+    float       _padding[3];
+} MaterialConstants;
 
 static GLuint _compile_shader(GLenum shader_type, const char* filename) {
     MessageBoxResult result = kMBOK;
@@ -117,6 +221,7 @@ static GLuint _create_program(GLuint vertex_shader, GLuint fragment_shader) {
     return program;
 }
 static void _validate_program(GLuint program) {
+#if VALIDATE_GL_PROGRAMS
     GLint status = GL_TRUE;
     glValidateProgram(program);
     CheckGLError();
@@ -131,59 +236,50 @@ static void _validate_program(GLuint program) {
         snprintf(printBuffer, sizeof(printBuffer), "Link error: %s", statusBuffer);
         debug_output("%s\n", printBuffer);
     }
+#else
+    (void)program;
+#endif
 }
-static GLuint _create_buffer(GLenum type, size_t size, const void* data) {\
-    GLuint buffer;
-    glGenBuffers(1, &buffer);
+/* Blocks the program doesn't use are optimized out, that's not an error */
+static void _bind_uniform_block(GLuint program, const char* name, UniformBinding binding) {
+    GLuint index = glGetUniformBlockIndex(program, name);
+    if(index != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, index, (GLuint)binding);
     CheckGLError();
-    assert(buffer);
-    glBindBuffer(type, buffer);
-    CheckGLError();
-    glBufferData(type, (GLsizeiptr)size, data, GL_DYNAMIC_DRAW);
-    CheckGLError();
-    glBindBuffer(type, 0);
-    CheckGLError();
-    return buffer;
 }
-static Mesh _create_mesh(uint32_t vertex_count, size_t vertex_size,
-                         uint32_t index_count, size_t index_size,
-                         const void* vertices, const void* indices,
-                         const VertexDescription* vertex_desc)
-{
-    GLuint vertex_buffer = _create_buffer(GL_ARRAY_BUFFER, vertex_count*vertex_size, vertices);
-    GLuint index_buffer = _create_buffer(GL_ELEMENT_ARRAY_BUFFER, index_size*index_count, indices);
+static size_t _vertex_type_size(GLenum type) {
+    switch(type) {
+    case GL_FLOAT:
+        return sizeof(GLfloat);
+    case GL_HALF_FLOAT:
+    case GL_SHORT:
+    case GL_UNSIGNED_SHORT:
+        return sizeof(GLshort);
+    case GL_BYTE:
+    case GL_UNSIGNED_BYTE:
+        return sizeof(GLbyte);
+    default:
+        assert(0);
+        return 0;
+    }
+}
+/* Points the bound VAO's attributes at the bound array buffer */
+static void _set_vertex_format(const VertexDescription* vertex_desc, size_t vertex_size) {
     intptr_t offset = 0;
-
-    GLuint vao;
-    glGenVertexArrays(1, &vao);
-    assert(vao);
-    CheckGLError();
-    glBindVertexArray(vao);
-    CheckGLError();
-    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-    CheckGLError();
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
-    CheckGLError();
     while(vertex_desc && vertex_desc->count) {
         glEnableVertexAttribArray(vertex_desc->slot);
         CheckGLError();
-        glVertexAttribPointer(vertex_desc->slot, vertex_desc->count, GL_FLOAT, GL_FALSE, (GLsizei)vertex_size, (void*)offset);
+        glVertexAttribPointer(vertex_desc->slot, vertex_desc->count, vertex_desc->type, vertex_desc->normalized, (GLsizei)vertex_size, (void*)offset);
         CheckGLError();
-        offset += sizeof(float) * (uint32_t)vertex_desc->count;
+        offset += _vertex_type_size(vertex_desc->type) * (uint32_t)vertex_desc->count;
         ++vertex_desc;
     }
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    CheckGLError();
-
-    Mesh mesh;
-    mesh.index_buffer = index_buffer;
-    mesh.vertex_buffer = vertex_buffer;
-    mesh.index_count = index_count;
-    mesh.index_format = (index_size == 2) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
-    mesh.vao = vao;
-    return mesh;
+}
+/* Draws a whole mesh, its full LOD, with its format's VAO bound */
+static void _draw_mesh(const Mesh* mesh, GLsizei instances) {
+    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)mesh->index_count, mesh->index_format,
+                                      (const GLvoid*)(uintptr_t)mesh->geometry.index_start,
+                                      instances, mesh->geometry.base_vertex);
 }
 
 #ifdef __cplusplus
@@ -0,0 +1,85 @@
+/*! @file render_queue.cpp
+ *  @author Kyle Weicht
+ *  @date 10/19/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "render_queue.h"
+
+#include <string.h>
+
+/*
+ * Internal
+ */
+namespace {
+
+uint64_t _field(uint32_t value, int bits, int shift) {
+    return (uint64_t)(value & ((1u << bits)-1)) << shift;
+}
+uint32_t _get_field(uint64_t key, int bits, int shift) {
+    return (uint32_t)(key >> shift) & ((1u << bits)-1);
+}
+
+}
+
+/*
+ * External
+ */
+uint64_t render_key(uint32_t pass, uint32_t program, uint32_t material, uint32_t mesh,
+                    float depth, float max_depth) {
+    const uint32_t kMaxDepth = (1u << kKeyDepthBits)-1;
+    uint32_t quantized = 0;
+    if(depth >= max_depth)
+        quantized = kMaxDepth;
+    else if(depth > 0.0f)
+        quantized = (uint32_t)(depth/max_depth*kMaxDepth);
+    return _field(pass, kKeyPassBits, kKeyPassShift) |
+           _field(program, kKeyProgramBits, kKeyProgramShift) |
+           _field(material, kKeyMaterialBits, kKeyMaterialShift) |
+           _field(mesh, kKeyMeshBits, kKeyMeshShift) |
+           _field(quantized, kKeyDepthBits, kKeyDepthShift);
+}
+void sort_render_keys(RenderKey* keys, RenderKey* scratch, uint32_t count) {
+    // All 8 histograms in one read of the keys
+    uint32_t histograms[8][256];
+    memset(histograms, 0, sizeof(histograms));
+    for(uint32_t ii=0; ii<count; ++ii) {
+        uint64_t key = keys[ii].key;
+        for(int byte=0; byte<8; ++byte)
+            ++histograms[byte][(key >> (byte*8)) & 0xFF];
+    }
+
+    RenderKey* src = keys;
+    RenderKey* dst = scratch;
+    for(int byte=0; byte<8; ++byte) {
+        uint32_t* histogram = histograms[byte];
+        if(count == 0 || histogram[(keys[0].key >> (byte*8)) & 0xFF] == count)
+            continue; // Every key has the same byte here
+        uint32_t offset = 0;
+        for(int ii=0; ii<256; ++ii) {
+            uint32_t bucket = histogram[ii];
+            histogram[ii] = offset;
+            offset += bucket;
+        }
+        for(uint32_t ii=0; ii<count; ++ii)
+            dst[histogram[(src[ii].key >> (byte*8)) & 0xFF]++] = src[ii];
+        RenderKey* temp = src;
+        src = dst;
+        dst = temp;
+    }
+    if(src != keys)
+        memcpy(keys, src, count*sizeof(RenderKey));
+}
+StateChanges count_state_changes(const RenderKey* keys, uint32_t count) {
+    StateChanges changes = { 0, 0, 0 };
+    for(uint32_t ii=0; ii<count; ++ii) {
+        uint64_t key = keys[ii].key;
+        uint64_t previous = ii ? keys[ii-1].key : ~key;
+        if(_get_field(key, kKeyProgramBits, kKeyProgramShift) != _get_field(previous, kKeyProgramBits, kKeyProgramShift))
+            ++changes.programs;
+        if(_get_field(key, kKeyMaterialBits, kKeyMaterialShift) != _get_field(previous, kKeyMaterialBits, kKeyMaterialShift))
+            ++changes.materials;
+        if(_get_field(key, kKeyMeshBits, kKeyMeshShift) != _get_field(previous, kKeyMeshBits, kKeyMeshShift))
+            ++changes.meshes;
+    }
+    return changes;
+}
@@ -0,0 +1,85 @@
+/*! @file render_queue.h
+ *  @brief Sort keys for ordering draws by pass, state and depth
+ *  @author Kyle Weicht
+ *  @date 10/19/26 11:00 PM
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ *	@addtogroup render_queue render_queue
+ *	@{
+ */
+#ifndef __render_queue_h__
+#define __render_queue_h__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" { /* Use C linkage */
+#endif
+
+enum RenderPass {
+    kGeometryPass,
+    kShadowPass,        /*!< Shadow cascade N is kShadowPass+N */
+    kShadowPass1,
+    kShadowPass2,
+    kShadowPass3,
+    kShadowAtlasPass,   /*!< Every local light's shadow views, grouped by view */
+    kGeometryRetestPass,/*!< Camera draws last frame's depth hid, drawn after the rest and tested again */
+
+    kNUM_RENDER_PASSES
+};
+
+/* Key layout, most significant first. Draws sort by pass, then group by
+ * state, then go front to back within each group.
+ */
+enum {
+    kKeyDepthBits = 24,
+    kKeyMeshBits = 16,
+    kKeyMaterialBits = 14,
+    kKeyProgramBits = 6,
+    kKeyPassBits = 4,
+
+    kKeyDepthShift = 0,
+    kKeyMeshShift = kKeyDepthShift + kKeyDepthBits,
+    kKeyMaterialShift = kKeyMeshShift + kKeyMeshBits,
+    kKeyProgramShift = kKeyMaterialShift + kKeyMaterialBits,
+    kKeyPassShift = kKeyProgramShift + kKeyProgramBits
+};
+
+typedef struct {
+    uint64_t    key;
+    uint32_t    index;      /*!< Into the frame's renderables */
+    uint32_t    _padding;
+} RenderKey;
+
+typedef struct {
+    RenderKey*  keys;
+    uint32_t    count;
+} RenderQueue;
+
+typedef struct {
+    uint32_t    programs;
+    uint32_t    materials;
+    uint32_t    meshes;
+} StateChanges;
+
+/*! @brief Builds a key. IDs are truncated to their field, depth is clamped
+ *         to [0, max_depth] and quantized.
+ */
+uint64_t render_key(uint32_t pass, uint32_t program, uint32_t material, uint32_t mesh,
+                    float depth, float max_depth);
+
+/*! @brief Stable LSD radix sort on the keys, 8 bits at a time. Bytes that
+ *         are the same in every key are skipped.
+ */
+void sort_render_keys(RenderKey* keys, RenderKey* scratch, uint32_t count);
+
+/*! @brief The program, material and mesh binds needed to issue the draws in
+ *         this order, counting the first draw's
+ */
+StateChanges count_state_changes(const RenderKey* keys, uint32_t count);
+
+#ifdef __cplusplus
+} // extern "C" {
+#endif
+
+/* @} */
+#endif /* include guard */
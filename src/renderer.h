@@ -7,7 +7,22 @@
 #ifndef __renderer_renderer__
 #define __renderer_renderer__
 
+class GLState;
 
+// A spot light's shadow atlas tile or a point light's cube face
+typedef struct {
+    float4x4    view_proj;
+    uint32_t    light;          // Into the frame's lights
+    uint32_t    entry;          // Which AtlasLight has its tile
+    uint32_t    face;
+    uint32_t    first_caster;   // Into the kShadowAtlasPass queue
+    uint32_t    num_casters;
+} ShadowAtlasView;
+
+/* What the frame loop drives a renderer through. A renderer without
+ * shadows or Hi-Z keeps the defaults, which have nothing for the loop to
+ * cull for.
+ */
 class Renderer {
 public:
 
@@ -16,8 +31,23 @@ virtual void init(void) = 0;
 virtual void shutdown(void) = 0;
 virtual void resize(int, int) { }
 virtual void render(const float4x4& view, const float4x4& proj, GLuint frame_buffer,
-                    const Renderable* renderables, int num_renderables,
-                    const Light* lights, int num_lights) = 0;
+                    const Renderable* renderables, const RenderQueue* queues,
+                    const Light* lights, int num_lights, RenderStats* stats) = 0;
+
+virtual void set_gl_state(GLState*) { }
+virtual void set_sphere_mesh(const Mesh&) { }
+virtual void set_fullscreen_mesh(const Mesh&) { }
+virtual void set_box_mesh(const Mesh&) { }
+
+/* Before culling each frame, the depth pyramid and updates once */
+virtual const DepthPyramid* depth_pyramid(void) { return NULL; }
+virtual uint32_t update_shadow_cascades(const float4x4&, const float4x4&, const Light*) { return 0; }
+virtual const ShadowCascade* shadow_cascades(void) const { return NULL; }
+virtual uint32_t update_shadow_atlas(const float4x4&, const float4x4&, int, const Light*, int) { return 0; }
+virtual ShadowAtlasView* shadow_atlas_views(void) { return NULL; }
+
+/* For the debug view, 0 if there's no such buffer */
+virtual GLuint gbuffer_tex(int) { return 0; }
 
 };
 
@@ -7,151 +7,344 @@
 #ifndef __renderer_deferred__
 #define __renderer_deferred__
 
+#include <vector>
+#include <algorithm>
 #include "render_gl_helper.h"
+#include "gl_state.h"
+#include "uniform_ring.h"
+#include "light_clusters.h"
+#include "shadow_cascades.h"
+#include "shadow_atlas.h"
+#include "depth_pyramid.h"
 #include "renderer.h"
 
-// GBuffer format
-//  [0] RGB: Albedo    
-//  [1] RGB: WS Normal  A: Spec coefficient
-//  [2] RGB: Spec Color A: Spec exponent
-//  [3] R: Depth
+// GBuffer format, 12 bytes a pixel plus the depth buffer
+//  [0] RGBA8:  RGB: Albedo     A: Spec coefficient
+//  [1] RG16:   RG: Octahedral WS normal
+//  [2] RGBA8:  RGB: Spec Color A: Spec exponent
+//  [3] The depth buffer, sampled to rebuild the position
 
-#define SHADOW_MAP_RES 4096
+// The first light's shadows are split into cascades over the view frustum.
+// Four 2048 maps take the memory one 4096 map did.
+#define SHADOW_MAP_RES 2048
+#define SHADOW_CASCADES 4
+#define SHADOW_DISTANCE 150.0f          // Nothing further away is shadowed
+#define SHADOW_CASTER_DISTANCE 50.0f    // How far towards the light casters are kept
+#define SHADOW_SPLIT_LAMBDA 0.75f       // 1 is logarithmic splits, 0 is uniform
+
+// Static casters' depth is cached per cascade, and only redrawn when the
+// camera leaves the cascade's margin, the light turns or they change
+#define SHADOW_CACHE_MARGIN 1.25f
+#define SHADOW_CACHE_LIGHT_COS 0.99999f     // About a quarter of a degree
+
+// The most important point and spot lights share one atlas of shadow maps,
+// a tile per spot light and per point light cube face. Tiles are sized by
+// how big the light is on screen and only redrawn when the light or the
+// casters in the tile change, at most SHADOW_ATLAS_MAX_UPDATES a frame.
+#define SHADOW_ATLAS_RES 4096
+#define SHADOW_ATLAS_MIN_TILE 64
+#define SHADOW_ATLAS_MAX_TILE 512
+#define SHADOW_ATLAS_MAX_LIGHTS 32
+#define SHADOW_ATLAS_MAX_UPDATES 8
+
+// Per-instance world transforms, a mat4 takes 4 attribute slots
+#define INSTANCE_TRANSFORM_SLOT 5
+
+// Let the GPU skip hidden geometry pass draws. Big enough instance runs
+// have their bounding boxes drawn against the depth so far under an
+// occlusion query and are drawn conditionally on it, a batch at a time.
+#define GPU_OCCLUSION_CULLING 1
+#define OCCLUSION_MIN_TRIANGLES 1024    // Smaller runs cost less to draw than to test
+#define OCCLUSION_BATCH 32              // Runs whose boxes go out together
+#define OCCLUSION_NEAR_MARGIN 0.5f      // Runs closer to the camera than this are always drawn
+
+// Lay down the camera's depth with the position-only streams first, so the
+// G-buffer pass only writes the nearest fragment of each pixel with an equal
+// depth test. 0 is never, 1 is always and 2 is when the geometry pass's
+// overdraw, measured two frames late, gets high enough.
+#define DEPTH_PREPASS 2
+#define DEPTH_PREPASS_ON_OVERDRAW 1.5f      // Fragments drawn per pixel
+#define DEPTH_PREPASS_OFF_OVERDRAW 1.25f
+
+// The geometry pass's depth is reduced to a small max depth texture and read
+// back a few frames later without stalling, for culling the next frames'
+// draws on the CPU
+#define HIZ_DOWNSAMPLE 8    // Screen pixels per Hi-Z texel across
+#define HIZ_READBACKS 3     // Readbacks in flight
+
+// Shade all lights in one fullscreen pass over view space light clusters,
+// instead of drawing a volume per light
+#define CLUSTERED_LIGHTING 1
+#define CLUSTER_FAR_PLANE 500.0f            // Lights further away share the last slice
+#define MAX_CLUSTER_LIGHT_INDICES (1024*1024)
+
+// A shadowed light's tiles, kept as long as the light doesn't change
+typedef struct {
+    uint32_t    key;        // Hash of the light's position, direction, size and cone
+    uint32_t    num_faces;
+    int         active;
+    int         used;       // Still ranked this frame
+    AtlasTile   tiles[6];
+    uint32_t    caster_hash[6];
+    int         valid[6];
+} AtlasLight;
 
 class RendererDeferred : public Renderer {
 public:
 
 void init(void) {
     glGenFramebuffers(1, &_frame_buffer);
-    glGenRenderbuffers(1, &_depth_buffer);
-    glGenRenderbuffers(ARRAYSIZE(_gbuffer), _gbuffer);
+    glGenTextures(1, &_depth_texture);
     glGenTextures(ARRAYSIZE(_gbuffer_tex), _gbuffer_tex);
 
     { // Deferred Geometry
         GLuint vs = _compile_shader(GL_VERTEX_SHADER, "assets/shaders/deferred/geometry.vsh");
         GLuint fs = _compile_shader(GL_FRAGMENT_SHADER, "assets/shaders/deferred/geometry.fsh");
         _geom_program = _create_program(vs, fs);
+        _bind_uniform_block(_geom_program, "FrameConstants", kFrameConstantsBinding);
+        _bind_uniform_block(_geom_program, "MaterialConstants", kMaterialConstantsBinding);
         glDeleteShader(vs);
         glDeleteShader(fs);
-        _geom_world_uniform = glGetUniformLocation(_geom_program, "kWorld");
-        _geom_viewproj_uniform = glGetUniformLocation(_geom_program, "kViewProj");
         _geom_albedo_uniform = glGetUniformLocation(_geom_program, "kAlbedoTex");
         _geom_normal_uniform = glGetUniformLocation(_geom_program, "kNormalTex");
         _geom_specular_uniform = glGetUniformLocation(_geom_program, "kSpecularTex");
-        _geom_specular_color_uniform = glGetUniformLocation(_geom_program, "kSpecularColor");
-        _geom_specular_coefficient_uniform = glGetUniformLocation(_geom_program, "kSpecularCoefficient");
-        _geom_specular_exponent_uniform = glGetUniformLocation(_geom_program, "kSpecularExponent");
     }    
     { // Deferred lighting
         GLuint vs = _compile_shader(GL_VERTEX_SHADER, "assets/shaders/deferred/light.vsh");
         GLuint fs = _compile_shader(GL_FRAGMENT_SHADER, "assets/shaders/deferred/light.fsh");
         _light_program = _create_program(vs, fs);
+        _bind_uniform_block(_light_program, "FrameConstants", kFrameConstantsBinding);
         glDeleteShader(vs);
         glDeleteShader(fs);
-        _light_world_uniform = glGetUniformLocation(_light_program, "kWorld");
-        _light_viewproj_uniform = glGetUniformLocation(_light_program, "kViewProj");
+        _light_dequantize_uniform = glGetUniformLocation(_light_program, "kDequantize");
         _light_gbuffer_uniform = glGetUniformLocation(_light_program, "GBuffer");
-        _light_light_uniform = glGetUniformLocation(_light_program, "kLight");
-        _light_inv_viewproj_uniform = glGetUniformLocation(_light_program, "kInverseViewProj");
-        _light_cam_pos_uniform = glGetUniformLocation(_light_program, "kCameraPosition");
+        _light_lights_uniform = glGetUniformLocation(_light_program, "kLights");
+        _light_first_light_uniform = glGetUniformLocation(_light_program, "kFirstLight");
+        _light_num_lights_uniform = glGetUniformLocation(_light_program, "kNumLights");
+        _light_fullscreen_uniform = glGetUniformLocation(_light_program, "kFullscreen");
 
         _light_shadow_map_uniform = glGetUniformLocation(_light_program, "kShadowMap");
-        _light_shadow_viewproj_uniform = glGetUniformLocation(_light_program, "kShadowViewProj");
+        _light_shadow_atlas_uniform = glGetUniformLocation(_light_program, "kShadowAtlas");
+        _light_atlas_views_uniform = glGetUniformLocation(_light_program, "kShadowAtlasViews");
+    }
+    { // Clustered lighting
+        GLuint vs = _compile_shader(GL_VERTEX_SHADER, "assets/shaders/2D_fullscreen.vsh");
+        GLuint fs = _compile_shader(GL_FRAGMENT_SHADER, "assets/shaders/deferred/clustered_light.fsh");
+        _cluster_program = _create_program(vs, fs);
+        _bind_uniform_block(_cluster_program, "FrameConstants", kFrameConstantsBinding);
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+        _cluster_gbuffer_uniform = glGetUniformLocation(_cluster_program, "GBuffer");
+        _cluster_shadow_map_uniform = glGetUniformLocation(_cluster_program, "kShadowMap");
+        _cluster_lights_uniform = glGetUniformLocation(_cluster_program, "kLights");
+        _cluster_clusters_uniform = glGetUniformLocation(_cluster_program, "kClusters");
+        _cluster_indices_uniform = glGetUniformLocation(_cluster_program, "kLightIndices");
+        _cluster_shadow_atlas_uniform = glGetUniformLocation(_cluster_program, "kShadowAtlas");
+        _cluster_atlas_views_uniform = glGetUniformLocation(_cluster_program, "kShadowAtlasViews");
+        _cluster_grid_uniform = glGetUniformLocation(_cluster_program, "kClusterGrid");
+        _cluster_depth_uniform = glGetUniformLocation(_cluster_program, "kClusterDepth");
+        _cluster_first_directional_uniform = glGetUniformLocation(_cluster_program, "kFirstDirectionalLight");
+        _cluster_num_directional_uniform = glGetUniformLocation(_cluster_program, "kNumDirectionalLights");
+
+        // Lights, clusters and light indices are read through texture
+        // buffers. The light volumes read the lights too.
+        glGenBuffers(ARRAYSIZE(_cluster_buffers), _cluster_buffers);
+        glGenTextures(ARRAYSIZE(_cluster_textures), _cluster_textures);
+        GLenum formats[] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+        for(int ii=0;ii<(int)ARRAYSIZE(_cluster_buffers);++ii) {
+            _upload_texture_buffer(_cluster_buffers[ii], NULL, 0);
+            glBindTexture(GL_TEXTURE_BUFFER, _cluster_textures[ii]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[ii], _cluster_buffers[ii]);
+        }
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        CheckGLError();
+
+        GLint max_texels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+        _max_buffer_lights = max_texels/4;
+        _light_indices.resize(MAX_CLUSTER_LIGHT_INDICES);
+        if(_light_indices.size() > (size_t)max_texels)
+            _light_indices.resize((size_t)max_texels);
     }
     { // Shadow maps
+        // One layer per cascade. The static casters' depth is kept in its
+        // own array and copied under the dynamic casters.
         glGenFramebuffers(1, &_shadow_fb);
+        glGenFramebuffers(1, &_shadow_static_fb);
+        _shadow_depth = _create_shadow_array();
+        _shadow_static_depth = _create_shadow_array();
+        // Depth only, so neither has a color buffer to draw to or read
         glBindFramebuffer(GL_FRAMEBUFFER, _shadow_fb);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, _shadow_depth, 0, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glBindFramebuffer(GL_FRAMEBUFFER, _shadow_static_fb);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, _shadow_static_depth, 0, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        CheckGLError();
+
+        //assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        glGenQueries(SHADOW_CASCADES, _shadow_timers);
+        for(int ii=0;ii<SHADOW_CASCADES;++ii) {
+            _shadow_static_valid[ii] = 0;
+            _shadow_static_hash[ii] = 0;
+            _shadow_dynamic_casters[ii] = 0;
+            _shadow_timer_pending[ii] = 0;
+            _shadow_static_ms[ii] = 0.0f;
+        }
+        _num_cascades = 0;
 
-        glGenTextures(1, &_shadow_depth);
-        glBindTexture(GL_TEXTURE_2D, _shadow_depth);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT16, SHADOW_MAP_RES, SHADOW_MAP_RES, 0, GL_DEPTH_COMPONENT, GL_HALF_FLOAT, 0);
+        GLuint vs = _compile_shader(GL_VERTEX_SHADER, "assets/shaders/deferred/shadow.vsh");
+        GLuint fs = _compile_shader(GL_FRAGMENT_SHADER, "assets/shaders/depth.fsh");
+        _shadow_program = _create_program(vs, fs);
+        _bind_uniform_block(_shadow_program, "ShadowView", kShadowViewBinding);
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+    }
+    { // Local light shadow atlas
+        glGenTextures(1, &_atlas_depth);
+        glBindTexture(GL_TEXTURE_2D, _atlas_depth);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT16, SHADOW_ATLAS_RES, SHADOW_ATLAS_RES, 0, GL_DEPTH_COMPONENT, GL_HALF_FLOAT, 0);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_R_TO_TEXTURE);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, _shadow_depth, 0);
-        CheckGLError();
-
-        //assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
         glBindTexture(GL_TEXTURE_2D, 0);
+        glGenFramebuffers(1, &_atlas_fb);
+        glBindFramebuffer(GL_FRAMEBUFFER, _atlas_fb);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, _atlas_depth, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-        GLuint vs = _compile_shader(GL_VERTEX_SHADER, "assets/shaders/depth.vsh");
-        GLuint fs = _compile_shader(GL_FRAGMENT_SHADER, "assets/shaders/depth.fsh");
-        _shadow_program = _create_program(vs, fs);
+        // Each view's world to atlas matrix and tile bounds, read by the
+        // lighting shaders
+        glGenBuffers(1, &_atlas_view_buffer);
+        glGenTextures(1, &_atlas_view_texture);
+        _upload_texture_buffer(_atlas_view_buffer, NULL, 0);
+        glBindTexture(GL_TEXTURE_BUFFER, _atlas_view_texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, _atlas_view_buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        CheckGLError();
+
+        uint32_t max_depth = 0;
+        while((SHADOW_ATLAS_RES >> max_depth) > SHADOW_ATLAS_MIN_TILE)
+            ++max_depth;
+        shadow_atlas_init(&_atlas, SHADOW_ATLAS_RES, max_depth);
+        for(int ii=0;ii<SHADOW_ATLAS_MAX_LIGHTS;++ii)
+            _atlas_lights[ii].active = 0;
+        _num_atlas_views = 0;
+    }
+    { // Hi-Z readback
+        GLuint vs = _compile_shader(GL_VERTEX_SHADER, "assets/shaders/2D_fullscreen.vsh");
+        GLuint fs = _compile_shader(GL_FRAGMENT_SHADER, "assets/shaders/deferred/hiz_reduce.fsh");
+        _hiz_program = _create_program(vs, fs);
         glDeleteShader(vs);
         glDeleteShader(fs);
-        _shadow_wvp_uniform = glGetUniformLocation(_shadow_program, "kWorldViewProj");
+        _hiz_depth_uniform = glGetUniformLocation(_hiz_program, "kDepth");
+        _hiz_source_uniform = glGetUniformLocation(_hiz_program, "kSource");
+
+        glGenFramebuffers(1, &_hiz_fb);
+        glGenTextures(1, &_hiz_texture);
+        for(int ii=0;ii<HIZ_READBACKS;++ii) {
+            glGenBuffers(1, &_hiz_readbacks[ii].buffer);
+            _hiz_readbacks[ii].fence = 0;
+            _hiz_readbacks[ii].size = 0;
+        }
+        _hiz_next = 0;
+        _hiz_valid = 0;
     }
+    glGenBuffers(1, &_instance_buffer);
+    _uniforms.init();
+    _num_light_queries[0] = _num_light_queries[1] = 0;
+    _light_query_set = 0;
+    _num_overdraw_queries[0] = _num_overdraw_queries[1] = 0;
+    _overdraw_query_set = 0;
+    _depth_prepass = (DEPTH_PREPASS == 1);
+    _num_occlusion_queries[0] = _num_occlusion_queries[1] = 0;
+    _occlusion_query_set = 0;
 }
 void shutdown(void) {
     glDeleteProgram(_geom_program);
     glDeleteProgram(_light_program);
+    glDeleteProgram(_shadow_program);
+    glDeleteProgram(_cluster_program);
+    glDeleteProgram(_hiz_program);
+    glDeleteFramebuffers(1, &_hiz_fb);
+    glDeleteTextures(1, &_hiz_texture);
+    for(int ii=0;ii<HIZ_READBACKS;++ii) {
+        if(_hiz_readbacks[ii].fence)
+            glDeleteSync(_hiz_readbacks[ii].fence);
+        glDeleteBuffers(1, &_hiz_readbacks[ii].buffer);
+    }
+    glDeleteQueries(SHADOW_CASCADES, _shadow_timers);
+    glDeleteTextures(1, &_shadow_depth);
+    glDeleteTextures(1, &_shadow_static_depth);
+    glDeleteFramebuffers(1, &_shadow_fb);
+    glDeleteFramebuffers(1, &_shadow_static_fb);
+    glDeleteTextures(1, &_atlas_depth);
+    glDeleteFramebuffers(1, &_atlas_fb);
+    glDeleteTextures(1, &_atlas_view_texture);
+    glDeleteBuffers(1, &_atlas_view_buffer);
+    for(int ii=0;ii<2;++ii) {
+        if(!_light_queries[ii].empty())
+            glDeleteQueries((GLsizei)_light_queries[ii].size(), &_light_queries[ii][0]);
+        if(!_occlusion_queries[ii].empty())
+            glDeleteQueries((GLsizei)_occlusion_queries[ii].size(), &_occlusion_queries[ii][0]);
+        if(!_overdraw_queries[ii].empty())
+            glDeleteQueries((GLsizei)_overdraw_queries[ii].size(), &_overdraw_queries[ii][0]);
+    }
+    glDeleteTextures(ARRAYSIZE(_cluster_textures), _cluster_textures);
+    glDeleteBuffers(ARRAYSIZE(_cluster_buffers), _cluster_buffers);
+    glDeleteBuffers(1, &_instance_buffer);
+    _uniforms.shutdown();
     
-    glDeleteRenderbuffers(ARRAYSIZE(_gbuffer), _gbuffer);
     glDeleteTextures(ARRAYSIZE(_gbuffer_tex), _gbuffer_tex);
 
-    glDeleteRenderbuffers(1, &_depth_buffer);
+    glDeleteTextures(1, &_depth_texture);
     glDeleteFramebuffers(1, &_frame_buffer);
 }
 void resize(int width, int height) {
     glBindFramebuffer(GL_FRAMEBUFFER, _frame_buffer);
     glViewport(0, 0, width, height);
 
-    glBindRenderbuffer(GL_RENDERBUFFER, _depth_buffer);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32, width, height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, _depth_buffer);
-    CheckGLError();
-
-    glBindRenderbuffer(GL_RENDERBUFFER, _gbuffer[0]);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA, width, height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _gbuffer[0]);
-    CheckGLError();
-
-    glBindRenderbuffer(GL_RENDERBUFFER, _gbuffer[1]);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA16F, width, height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_RENDERBUFFER, _gbuffer[1]);
-    CheckGLError();
-    
-    glBindRenderbuffer(GL_RENDERBUFFER, _gbuffer[2]);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA, width, height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_RENDERBUFFER, _gbuffer[2]);
-    CheckGLError();
-    
-    glBindRenderbuffer(GL_RENDERBUFFER, _gbuffer[3]);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA32F, width, height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_RENDERBUFFER, _gbuffer[3]);
+    // Blitted into the output frame buffer for the light volumes' depth test,
+    // and read by the lighting and Hi-Z shaders instead of a depth target
+    glBindTexture(GL_TEXTURE_2D, _depth_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, _depth_texture, 0);
     CheckGLError();
 
     glBindTexture(GL_TEXTURE_2D, _gbuffer_tex[0]);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _gbuffer_tex[0], 0);
     CheckGLError();
 
+    // Filtering would blend encoded normals across the octahedron's folds
     glBindTexture(GL_TEXTURE_2D, _gbuffer_tex[1]);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16, width, height, 0, GL_RG, GL_UNSIGNED_SHORT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, _gbuffer_tex[1], 0);
     CheckGLError();
     
     glBindTexture(GL_TEXTURE_2D, _gbuffer_tex[2]);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, _gbuffer_tex[2], 0);
     CheckGLError();
-    
-    glBindTexture(GL_TEXTURE_2D, _gbuffer_tex[3]);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, _gbuffer_tex[3], 0);
-    CheckGLError();
+    glBindTexture(GL_TEXTURE_2D, 0);
 
     GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
     if( status != GL_FRAMEBUFFER_COMPLETE) {
@@ -159,216 +352,1218 @@ void resize(int width, int height) {
     }
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+    // Readbacks still in flight are the old size and are dropped
+    _hiz_width = (width + HIZ_DOWNSAMPLE-1)/HIZ_DOWNSAMPLE;
+    _hiz_height = (height + HIZ_DOWNSAMPLE-1)/HIZ_DOWNSAMPLE;
+    glBindTexture(GL_TEXTURE_2D, _hiz_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, _hiz_width, _hiz_height, 0, GL_RED, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, _hiz_fb);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _hiz_texture, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    CheckGLError();
+    for(int ii=0;ii<HIZ_READBACKS;++ii) {
+        if(_hiz_readbacks[ii].fence)
+            glDeleteSync(_hiz_readbacks[ii].fence);
+        _hiz_readbacks[ii].fence = 0;
+    }
+    _hiz_valid = 0;
+
     _width = width;
     _height = height;
 }
 void render(const float4x4& view, const float4x4& proj, GLuint frame_buffer,
-            const Renderable* renderables, int num_renderables,
-            const Light* lights, int num_lights)
+            const Renderable* renderables, const RenderQueue* queues,
+            const Light* lights, int num_lights, RenderStats* stats)
 {
     float4x4 inv_view = float4x4inverse(&view);
     float4x4 view_proj = float4x4multiply(&inv_view, &proj);
-    { // Render geometry
-        glBindFramebuffer(GL_FRAMEBUFFER, _frame_buffer);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glActiveTexture(GL_TEXTURE0);
-        GLenum buffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3};
-        glDrawBuffers(4, buffers);
-
-        glUseProgram(_geom_program);
-
-        glUniformMatrix4fv(_geom_viewproj_uniform, 1, GL_FALSE, (float*)&view_proj);
-        for(int ii=0;ii<num_renderables;++ii) {
-            const Renderable& r = renderables[ii];
-            glUniformMatrix4fv(_geom_world_uniform, 1, GL_FALSE, (float*)&r.transform);
-            
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, (GLuint)r.material->albedo_tex.i);
-            glUniform1i(_geom_albedo_uniform, 0);
-            
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, (GLuint)r.material->normal_tex.i);
-            glUniform1i(_geom_normal_uniform, 1);
-            
-            glActiveTexture(GL_TEXTURE2);
-            glBindTexture(GL_TEXTURE_2D, (GLuint)r.material->specular_tex.i);
-            glUniform1i(_geom_specular_uniform, 2);
-
-            glUniform3fv(_geom_specular_color_uniform, 1, (float*)&r.material->specular_color);
-            glUniform1f(_geom_specular_coefficient_uniform, r.material->specular_coefficient);
-            glUniform1f(_geom_specular_exponent_uniform, r.material->specular_power);
-            
-            glBindVertexArray(r.vao);
-            _validate_program(_geom_program);
-            glDrawElements(GL_TRIANGLES, (GLsizei)r.index_count, r.index_format, NULL);
-        }
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    }
-    float4x4 shadow_vp;
-    { // Draw shadow map
-        glBindFramebuffer(GL_FRAMEBUFFER, _shadow_fb);
-        glDrawBuffer(GL_NONE);
+    _upload_instances(renderables, queues);
+    _upload_constants(view, view_proj, renderables, queues, stats);
+    _bind_constants(kFrameConstantsBinding, _frame_offset, sizeof(FrameConstants));
+    _render_geometry(view, view_proj, renderables, queues, stats);
+    { // Draw shadow cascades
         glViewport(0, 0, SHADOW_MAP_RES, SHADOW_MAP_RES);
         glClearDepth(1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        float4x4 shadow_proj;
-        const float kShadowMapSize = 30.0f;
-        if(lights[0].type == kDirectionalLight)
-            shadow_proj = float4x4OrthographicOffCenterLH(-kShadowMapSize, kShadowMapSize, kShadowMapSize, -kShadowMapSize, -30.0f, 30.0f);
-        else if(lights[0].type == kSpotLight)
-            shadow_proj = float4x4OrthographicOffCenterLH(-40.0f, 40.0f, 40.0f, -40.0f, -30.0f, 30.0f);
-        float3 look = lights[0].dir;
-        float3 up = {0,1,0};
-        look = float3normalize(&look);
-        float3 right = float3cross(&up, &look);
-        right = float3normalize(&right);
-        up = float3cross(&look, &right);
-        float4x4 shadow_view =
-        {
-            { right.x, right.y, right.z, 0.0f },
-            {    up.x,    up.y,    up.z, 0.0f },
-            {  look.x,  look.y,  look.z, 0.0f },
-            view.r3
-        };
-        shadow_view = float4x4inverse(&shadow_view);
-        shadow_vp = float4x4multiply(&shadow_view, &shadow_proj);
 
         //glCullFace(GL_FRONT); // TODO: Odd artifacts when switching culling the "right" way
-        glUseProgram(_shadow_program);
-        for(int ii=0;ii<num_renderables;++ii) {
-            const Renderable& r = renderables[ii];
-            float4x4 wvp = float4x4multiply(&r.transform, &shadow_vp);
-            glUniformMatrix4fv(_shadow_wvp_uniform, 1, GL_FALSE, (float*)&wvp);
-
-            glBindVertexArray(r.vao);
-            _validate_program(_shadow_program);
-            glDrawElements(GL_TRIANGLES, (GLsizei)r.index_count, r.index_format, NULL);
+        _state->use_program(_shadow_program);
+        for(uint32_t cascade=0;cascade<_num_cascades;++cascade) {
+            _bind_constants(kShadowViewBinding, _shadow_view_offsets[cascade], sizeof(float4x4));
+
+            // Each cascade only has the casters that passed its own culling,
+            // sorted static first
+            int pass = kShadowPass + (int)cascade;
+            const RenderQueue& queue = queues[pass];
+            uint32_t num_static = 0;
+            while(num_static < queue.count && !renderables[queue.keys[num_static].index].dynamic)
+                ++num_static;
+            uint32_t num_dynamic = queue.count - num_static;
+            uint32_t hash = _hash_casters(renderables, queue, 0, num_static);
+
+            _read_shadow_timer(cascade);
+            bool static_dirty = !_shadow_static_valid[cascade] || hash != _shadow_static_hash[cascade];
+            if(static_dirty) {
+                glBindFramebuffer(GL_FRAMEBUFFER, _shadow_static_fb);
+                glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, _shadow_static_depth, 0, (GLint)cascade);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                if(!_shadow_timer_pending[cascade])
+                    glBeginQuery(GL_TIME_ELAPSED, _shadow_timers[cascade]);
+                _draw_shadow_casters(renderables, queue, 0, num_static, _first_instance[pass], stats);
+                if(!_shadow_timer_pending[cascade]) {
+                    glEndQuery(GL_TIME_ELAPSED);
+                    _shadow_timer_pending[cascade] = 1;
+                }
+                _shadow_static_valid[cascade] = 1;
+                _shadow_static_hash[cascade] = hash;
+                stats->shadow_renders++;
+            } else {
+                stats->shadow_renders_skipped++;
+                stats->shadow_ms_saved += _shadow_static_ms[cascade];
+            }
+
+            // Last frame's dynamic casters have to be erased too
+            if(static_dirty || num_dynamic || _shadow_dynamic_casters[cascade]) {
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, _shadow_static_fb);
+                glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, _shadow_static_depth, 0, (GLint)cascade);
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _shadow_fb);
+                glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, _shadow_depth, 0, (GLint)cascade);
+                glBlitFramebuffer(0, 0, SHADOW_MAP_RES, SHADOW_MAP_RES, 0, 0, SHADOW_MAP_RES, SHADOW_MAP_RES, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+                glBindFramebuffer(GL_FRAMEBUFFER, _shadow_fb);
+                _draw_shadow_casters(renderables, queue, num_static, queue.count, _first_instance[pass], stats);
+                stats->shadow_dynamic_casters += num_dynamic;
+            }
+            _shadow_dynamic_casters[cascade] = num_dynamic;
         }
         glCullFace(GL_BACK);
         
-        glActiveTexture(GL_TEXTURE0);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
         glViewport(0, 0, _width, _height);
     }
+    { // Draw local light shadows into the atlas
+        // Views are in order of importance, so when too many changed the
+        // least important ones wait. One that was drawn before keeps its
+        // old casters, one that never was leaves its light unshadowed.
+        glBindFramebuffer(GL_FRAMEBUFFER, _atlas_fb);
+        glEnable(GL_SCISSOR_TEST);
+        _state->use_program(_shadow_program);
+        const RenderQueue& queue = queues[kShadowAtlasPass];
+        uint32_t updates = 0;
+        for(uint32_t ii=0;ii<_num_atlas_views;++ii) {
+            const ShadowAtlasView& atlas_view = _atlas_views[ii];
+            AtlasLight& entry = _atlas_lights[atlas_view.entry];
+            uint32_t face = atlas_view.face;
+            uint32_t end = atlas_view.first_caster + atlas_view.num_casters;
+            uint32_t hash = _hash_casters(renderables, queue, atlas_view.first_caster, end);
+            if(entry.valid[face] && hash == entry.caster_hash[face]) {
+                stats->atlas_tiles_cached++;
+                continue;
+            }
+            if(updates == SHADOW_ATLAS_MAX_UPDATES)
+                continue;
+            ++updates;
+            const AtlasTile& tile = entry.tiles[face];
+            glViewport((GLint)tile.x, (GLint)tile.y, (GLsizei)tile.size, (GLsizei)tile.size);
+            glScissor((GLint)tile.x, (GLint)tile.y, (GLsizei)tile.size, (GLsizei)tile.size);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            _bind_constants(kShadowViewBinding, _shadow_view_offsets[kMaxShadowCascades + ii], sizeof(float4x4));
+            _draw_shadow_casters(renderables, queue, atlas_view.first_caster, end, _first_instance[kShadowAtlasPass], stats);
+            entry.valid[face] = 1;
+            entry.caster_hash[face] = hash;
+            stats->atlas_tiles_rendered++;
+        }
+        glDisable(GL_SCISSOR_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, _width, _height);
+        _upload_atlas_views(stats);
+    }
 
     { // Render lights
         glBindFramebuffer(GL_FRAMEBUFFER, frame_buffer);
         GLenum buffers[] = {GL_COLOR_ATTACHMENT0};
         glDrawBuffers(1, buffers);
         
-        glUseProgram(_light_program);
         for(int ii=0;ii<(int)ARRAYSIZE(_gbuffer_tex);++ii) {
-            glActiveTexture(GL_TEXTURE0+ii);
-            glBindTexture(GL_TEXTURE_2D, _gbuffer_tex[ii]);
+            _state->bind_texture(ii, GL_TEXTURE_2D, _gbuffer_tex[ii]);
         }
+        _state->bind_texture(3, GL_TEXTURE_2D, _depth_texture);
         int i[] = {0,1,2,3};
-        glUniform1iv(_light_gbuffer_uniform, ARRAYSIZE(i), i);
 
         glEnable(GL_BLEND);
         glBlendFunc(GL_ONE, GL_ONE);
         glDepthMask(GL_FALSE);
         
-        float4x4 inv_viewproj = float4x4inverse(&view_proj);
-        glUniformMatrix4fv(_light_viewproj_uniform, 1, GL_FALSE, (float*)&view_proj);
-        glUniformMatrix4fv(_light_inv_viewproj_uniform, 1, GL_FALSE, (float*)&inv_viewproj);
-        glUniform3fv(_light_cam_pos_uniform, 1, (float*)&view.r3);
-        float4x4 bias = {
-            0.5, 0.0, 0.0, 0.0,
-            0.0, 0.5, 0.0, 0.0,
-            0.0, 0.0, 0.5, 0.0,
-            0.5, 0.5, 0.5, 1.0
-        };
-        float4x4 shadow_viewproj = float4x4multiply(&shadow_vp, &bias);
-        glUniformMatrix4fv(_light_shadow_viewproj_uniform, 1, GL_FALSE, (float*)&shadow_viewproj);
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, _shadow_depth);
-        glUniform1i(_light_shadow_map_uniform, 4);
-        for(int ii=0;ii<num_lights;++ii) {
-            Light light = lights[ii];
-            if(light.type == kDirectionalLight) {            
-                glUniformMatrix4fv(_light_world_uniform, 1, GL_FALSE, (float*)&float4x4identity);
-                glUniformMatrix4fv(_light_viewproj_uniform, 1, GL_FALSE, (float*)&float4x4identity);
-                glUniform4fv(_light_light_uniform, 4, (float*)&light);
-                
-                glBindVertexArray(_fullscreen_mesh.vao);
-                _validate_program(_light_program);
-                glDrawElements(GL_TRIANGLES, (GLsizei)_fullscreen_mesh.index_count, _fullscreen_mesh.index_format, NULL);
-                
-                glUniformMatrix4fv(_light_viewproj_uniform, 1, GL_FALSE, (float*)&view_proj);
-            } else if(light.type == kPointLight || light.type == kSpotLight) {
-                float4x4 transform = float4x4Scale(light.size, light.size, light.size);
-                transform.r3.x = light.pos.x;
-                transform.r3.y = light.pos.y;
-                transform.r3.z = light.pos.z;
-
-                float3 v = float3subtract((float3*)&transform.r3, (float3*)&view.r3);
-                if(float3lengthSq(&v) < (light.size*light.size)) {
-                    glCullFace(GL_FRONT);
-                }
-                glUniformMatrix4fv(_light_world_uniform, 1, GL_FALSE, (float*)&transform);
-                glUniform4fv(_light_light_uniform, 4, (float*)&light);
-                glBindVertexArray(_sphere_mesh.vao);
-                _validate_program(_light_program);
-                glDrawElements(GL_TRIANGLES, (GLsizei)_sphere_mesh.index_count, _sphere_mesh.index_format, NULL);
-                glCullFace(GL_BACK);
-            }
-        }
+        _state->bind_texture(4, GL_TEXTURE_2D_ARRAY, _shadow_depth);
+        _read_light_queries(stats);
+        if(num_lights > _max_buffer_lights)
+            num_lights = _max_buffer_lights;
+        int first_directional = _upload_lights(lights, num_lights);
+        _state->bind_texture(5, GL_TEXTURE_BUFFER, _cluster_textures[0]);
+        _state->bind_texture(8, GL_TEXTURE_2D, _atlas_depth);
+        _state->bind_texture(9, GL_TEXTURE_BUFFER, _atlas_view_texture);
+#if CLUSTERED_LIGHTING
+        _state->use_program(_cluster_program);
+        _state->uniform1iv(_cluster_gbuffer_uniform, (GLsizei)ARRAYSIZE(i), i);
+        _state->uniform1i(_cluster_shadow_map_uniform, 4);
+        _state->uniform1i(_cluster_shadow_atlas_uniform, 8);
+        _state->uniform1i(_cluster_atlas_views_uniform, 9);
+        _render_clustered_lights(inv_view, proj, first_directional, num_lights);
+#else
+        // The scene's depth, so each volume can find the pixels inside it
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, _frame_buffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, frame_buffer);
+        glBlitFramebuffer(0, 0, _width, _height, 0, 0, _width, _height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, frame_buffer);
 
+        _state->use_program(_light_program);
+        _state->uniform1iv(_light_gbuffer_uniform, (GLsizei)ARRAYSIZE(i), i);
+        _state->uniform_matrix4fv(_light_dequantize_uniform, 1, (float*)&_sphere_mesh.dequantize);
+        _state->uniform1i(_light_shadow_map_uniform, 4);
+        _state->uniform1i(_light_lights_uniform, 5);
+        _state->uniform1i(_light_shadow_atlas_uniform, 8);
+        _state->uniform1i(_light_atlas_views_uniform, 9);
+        if(first_directional) {
+            // Every local light's sphere in one draw, the instance picks the
+            // light. Only faces behind the scene pass, so nothing behind a
+            // volume is shaded. Geometry inside a volume is behind its front
+            // face and passes once, for the back face. Geometry in front of
+            // a volume passes twice but is outside the light and skipped.
+            _state->uniform1i(_light_fullscreen_uniform, 0);
+            _state->uniform1i(_light_first_light_uniform, 0);
+            glDepthFunc(GL_GEQUAL);
+            _state->bind_vertex_array(_sphere_mesh.geometry.vao);
+            _validate_program(_light_program);
+            _begin_light_query();
+            _draw_mesh(&_sphere_mesh, first_directional);
+            glEndQuery(GL_SAMPLES_PASSED);
+            glDepthFunc(GL_LESS);
+        }
+        if(first_directional < num_lights) {
+            // Directional lights cover the screen, one pass loops over them all
+            _state->uniform1i(_light_fullscreen_uniform, 1);
+            _state->uniform1i(_light_first_light_uniform, first_directional);
+            _state->uniform1i(_light_num_lights_uniform, num_lights - first_directional);
+            glDisable(GL_DEPTH_TEST);
+            _state->bind_vertex_array(_fullscreen_mesh.geometry.vao);
+            _validate_program(_light_program);
+            _begin_light_query();
+            _draw_mesh(&_fullscreen_mesh, 1);
+            glEndQuery(GL_SAMPLES_PASSED);
+            glEnable(GL_DEPTH_TEST);
+        }
+#endif
         glDepthMask(GL_TRUE);
-        glActiveTexture(GL_TEXTURE0);
         glDisable(GL_BLEND);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
+    _uniforms.end_frame();
 }
+/*! @brief Fits the first light's shadow cascades to the camera, keeping the
+ *         cached ones that still cover their slice. Call once a frame
+ *         before culling, each cascade's casters are culled against it.
+ *  @return The number of cascades, 0 if the light doesn't cast shadows
+ */
+uint32_t update_shadow_cascades(const float4x4& view, const float4x4& proj, const Light* light) {
+    // Only directional lights are shadowed
+    if(light == NULL || light->type != kDirectionalLight) {
+        _num_cascades = 0;
+        return 0;
+    }
+    float3 dir = float3normalize(&light->dir);
+    bool light_moved = (_num_cascades == 0 || float3dot(&dir, &_shadow_light_dir) < SHADOW_CACHE_LIGHT_COS);
+    if(light_moved)
+        _shadow_light_dir = dir;
+
+    ShadowCascade fitted[kMaxShadowCascades];
+    build_shadow_cascades(fitted, SHADOW_CASCADES, &view, &proj,
+                          SHADOW_DISTANCE, SHADOW_SPLIT_LAMBDA, &_shadow_light_dir,
+                          SHADOW_CASTER_DISTANCE, SHADOW_MAP_RES, SHADOW_CACHE_MARGIN);
+    for(int ii=0;ii<SHADOW_CASCADES;++ii) {
+        if(light_moved || !shadow_cascade_contains(&_cascades[ii], &fitted[ii])) {
+            _cascades[ii] = fitted[ii];
+            _shadow_static_valid[ii] = 0;
+        }
+    }
+    _num_cascades = SHADOW_CASCADES;
+    return _num_cascades;
+}
+const ShadowCascade* shadow_cascades(void) const { return _cascades; }
+/*! @brief Picks the local lights that get shadows this frame and gives each
+ *         atlas tiles, keeping the tiles of lights that haven't changed.
+ *         Every tile is a view to draw casters for, see shadow_atlas_views.
+ *  @return The number of views
+ */
+uint32_t update_shadow_atlas(const float4x4& view, const float4x4& proj, int height,
+                             const Light* lights, int num_lights) {
+    // A light's importance is its radius on screen, in pixels
+    float3 camera = { view.r3.x, view.r3.y, view.r3.z };
+    float pixels_per_unit = height*0.5f*proj.r1.y;
+    _atlas_ranking.clear();
+    for(int ii=0;ii<num_lights;++ii) {
+        const Light& light = lights[ii];
+        if(light.type == kDirectionalLight)
+            continue;
+        float3 to_light = float3subtract(&light.pos, &camera);
+        float distance = float3length(&to_light);
+        if(distance < light.size)
+            distance = light.size;
+        _atlas_ranking.push_back(std::make_pair(-light.size*pixels_per_unit/distance, ii));
+    }
+    std::sort(_atlas_ranking.begin(), _atlas_ranking.end());
+    if(_atlas_ranking.size() > SHADOW_ATLAS_MAX_LIGHTS)
+        _atlas_ranking.resize(SHADOW_ATLAS_MAX_LIGHTS);
+
+    // Keep the tiles of lights that are still ranked and close to the same
+    // size, so they don't have to be redrawn
+    uint32_t num_ranked = (uint32_t)_atlas_ranking.size();
+    int entries[SHADOW_ATLAS_MAX_LIGHTS];
+    uint32_t resolutions[SHADOW_ATLAS_MAX_LIGHTS];
+    uint32_t keys[SHADOW_ATLAS_MAX_LIGHTS];
+    for(int ii=0;ii<SHADOW_ATLAS_MAX_LIGHTS;++ii)
+        _atlas_lights[ii].used = 0;
+    for(uint32_t ii=0;ii<num_ranked;++ii) {
+        const Light& light = lights[_atlas_ranking[ii].second];
+        uint32_t resolution = SHADOW_ATLAS_MIN_TILE;
+        while(resolution < SHADOW_ATLAS_MAX_TILE && resolution < -_atlas_ranking[ii].first)
+            resolution *= 2;
+        resolutions[ii] = resolution;
+        keys[ii] = _hash_light(light);
+        entries[ii] = -1;
+        for(int jj=0;jj<SHADOW_ATLAS_MAX_LIGHTS;++jj) {
+            AtlasLight& entry = _atlas_lights[jj];
+            if(entry.active && !entry.used && entry.key == keys[ii] &&
+               entry.tiles[0].size <= resolution*2 && entry.tiles[0].size*2 >= resolution) {
+                entry.used = 1;
+                entries[ii] = jj;
+                break;
+            }
+        }
+    }
+    for(int ii=0;ii<SHADOW_ATLAS_MAX_LIGHTS;++ii) {
+        AtlasLight& entry = _atlas_lights[ii];
+        if(entry.active && !entry.used) {
+            for(uint32_t face=0;face<entry.num_faces;++face)
+                shadow_atlas_free(&_atlas, &entry.tiles[face]);
+            entry.active = 0;
+        }
+    }
+
+    // New lights, most important first. Halve the tiles until they fit.
+    for(uint32_t ii=0;ii<num_ranked;++ii) {
+        if(entries[ii] >= 0)
+            continue;
+        int slot = 0;
+        while(_atlas_lights[slot].active)
+            ++slot;
+        AtlasLight& entry = _atlas_lights[slot];
+        entry.num_faces = (lights[_atlas_ranking[ii].second].type == kPointLight) ? 6 : 1;
+        for(uint32_t resolution=resolutions[ii]; resolution>=SHADOW_ATLAS_MIN_TILE; resolution/=2) {
+            uint32_t face = 0;
+            while(face < entry.num_faces && shadow_atlas_alloc(&_atlas, resolution, &entry.tiles[face]))
+                ++face;
+            if(face == entry.num_faces) {
+                entry.active = 1;
+                break;
+            }
+            while(face--)
+                shadow_atlas_free(&_atlas, &entry.tiles[face]);
+        }
+        if(!entry.active)
+            continue; // The atlas is full
+        entry.key = keys[ii];
+        entry.used = 1;
+        for(uint32_t face=0;face<entry.num_faces;++face)
+            entry.valid[face] = 0;
+        entries[ii] = slot;
+    }
+
+    // A view per tile, a light's faces next to each other
+    _num_atlas_views = 0;
+    _light_shadow_views.assign((size_t)num_lights, -1);
+    for(uint32_t ii=0;ii<num_ranked;++ii) {
+        if(entries[ii] < 0)
+            continue;
+        int index = _atlas_ranking[ii].second;
+        const Light& light = lights[index];
+        const AtlasLight& entry = _atlas_lights[entries[ii]];
+        float4x4 view_projs[6];
+        if(entry.num_faces == 6)
+            point_shadow_view_projs(view_projs, &light.pos, light.size);
+        else
+            view_projs[0] = spot_shadow_view_proj(&light.pos, &light.dir, light.outer_cos, light.size);
+        _light_shadow_views[index] = (int)_num_atlas_views;
+        for(uint32_t face=0;face<entry.num_faces;++face) {
+            ShadowAtlasView& atlas_view = _atlas_views[_num_atlas_views++];
+            atlas_view.view_proj = view_projs[face];
+            atlas_view.light = (uint32_t)index;
+            atlas_view.entry = (uint32_t)entries[ii];
+            atlas_view.face = face;
+            atlas_view.first_caster = 0;
+            atlas_view.num_casters = 0;
+        }
+    }
+    return _num_atlas_views;
+}
+/*! @brief The views update_shadow_atlas picked. The caller culls casters
+ *         for each and fills in where they are in the kShadowAtlasPass queue.
+ */
+ShadowAtlasView* shadow_atlas_views(void) { return _atlas_views; }
+/*! @brief The newest geometry pass depth that's finished reading back, a
+ *         few frames old. Call once a frame before culling.
+ *  @return NULL until the first readback finishes
+ */
+const DepthPyramid* depth_pyramid(void) {
+    // Oldest first, so the last one finished is the newest
+    int newest = -1;
+    for(int ii=0;ii<HIZ_READBACKS;++ii) {
+        HiZReadback& readback = _hiz_readbacks[(_hiz_next + ii) % HIZ_READBACKS];
+        if(!readback.fence)
+            continue;
+        GLenum status = glClientWaitSync(readback.fence, 0, 0);
+        if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        glDeleteSync(readback.fence);
+        readback.fence = 0;
+        newest = (_hiz_next + ii) % HIZ_READBACKS;
+    }
+    if(newest != -1) {
+        const HiZReadback& readback = _hiz_readbacks[newest];
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+        const float* depth = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)readback.size, GL_MAP_READ_BIT);
+        if(depth) {
+            _hiz_texels.resize(depth_pyramid_texels(readback.width, readback.height));
+            depth_pyramid_build(&_hiz, &_hiz_texels[0], depth, readback.width, readback.height, &readback.view_proj);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            _hiz_valid = 1;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        CheckGLError();
+    }
+    return _hiz_valid ? &_hiz : NULL;
+}
+void set_gl_state(GLState* state) { _state = state; }
 void set_sphere_mesh(const Mesh& mesh) { _sphere_mesh = mesh; }
 void set_fullscreen_mesh(const Mesh& mesh) { _fullscreen_mesh = mesh; }
+void set_box_mesh(const Mesh& mesh) { _box_mesh = mesh; }
 
 GLuint gbuffer_tex(int index)
 {
+    if(index == (int)ARRAYSIZE(_gbuffer_tex))
+        return _depth_texture;
     return _gbuffer_tex[index];
 }
 
-private:
+protected:
+
+/* Fills the G-buffer and its depth from the camera's queues */
+virtual void _render_geometry(const float4x4& view, const float4x4& view_proj, const Renderable* renderables,
+                              const RenderQueue* queues, RenderStats* stats) {
+    glBindFramebuffer(GL_FRAMEBUFFER, _frame_buffer);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    GLenum buffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+    glDrawBuffers(3, buffers);
+
+    _state->use_program(_geom_program);
+
+    _state->uniform1i(_geom_albedo_uniform, 0);
+    _state->uniform1i(_geom_normal_uniform, 1);
+    _state->uniform1i(_geom_specular_uniform, 2);
+
+    // What last frame's depth hid goes last, every run tested against
+    // what's been drawn by then
+    float3 camera = { view.r3.x, view.r3.y, view.r3.z };
+    _read_occlusion_queries(stats);
+    _read_overdraw_queries(stats);
+    if(_depth_prepass)
+        _draw_depth_prepass(renderables, queues[kGeometryPass], stats);
+    uint32_t next_material = 0;
+    _draw_geometry_queue(renderables, queues, kGeometryPass, camera, _depth_prepass, &next_material, stats);
+    _draw_geometry_queue(renderables, queues, kGeometryRetestPass, camera, false, &next_material, stats);
+    _downsample_depth(view_proj);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+static GLuint _create_shadow_array(void) {
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT16, SHADOW_MAP_RES, SHADOW_MAP_RES, SHADOW_CASCADES, 0, GL_DEPTH_COMPONENT, GL_HALF_FLOAT, 0);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_R_TO_TEXTURE);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    CheckGLError();
+    return texture;
+}
+/* Reduces the geometry pass's depth into the Hi-Z texture and starts
+ * reading it back. Skipped when every readback is still in flight.
+ */
+void _downsample_depth(const float4x4& view_proj) {
+    HiZReadback& readback = _hiz_readbacks[_hiz_next];
+    if(readback.fence)
+        return;
+    glBindFramebuffer(GL_FRAMEBUFFER, _hiz_fb);
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    glViewport(0, 0, _hiz_width, _hiz_height);
+    glDisable(GL_DEPTH_TEST);
+    _state->use_program(_hiz_program);
+    _state->bind_texture(0, GL_TEXTURE_2D, _depth_texture);
+    _state->uniform1i(_hiz_depth_uniform, 0);
+    _state->uniform3i(_hiz_source_uniform, _width, _height, HIZ_DOWNSAMPLE);
+    _state->bind_vertex_array(_fullscreen_mesh.geometry.vao);
+    _validate_program(_hiz_program);
+    _draw_mesh(&_fullscreen_mesh, 1);
+    glEnable(GL_DEPTH_TEST);
+
+    readback.width = (uint32_t)_hiz_width;
+    readback.height = (uint32_t)_hiz_height;
+    readback.view_proj = view_proj;
+    uint32_t size = readback.width*readback.height*(uint32_t)sizeof(float);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    if(size != readback.size) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)size, NULL, GL_STREAM_READ);
+        readback.size = size;
+    }
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(0, 0, _hiz_width, _hiz_height, GL_RED, GL_FLOAT, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _hiz_next = (_hiz_next + 1) % HIZ_READBACKS;
+    glViewport(0, 0, _width, _height);
+    CheckGLError();
+}
+/* Draws queue entries [begin, end) into the bound shadow map */
+void _draw_shadow_casters(const Renderable* renderables, const RenderQueue& queue,
+                          uint32_t begin, uint32_t end, uint32_t first_instance, RenderStats* stats) {
+    GLuint vao = 0;
+    for(uint32_t ii=begin;ii<end;) {
+        const Renderable& r = renderables[queue.keys[ii].index];
+        uint32_t instances = _instance_run(renderables, queue, ii, end, true);
+
+        if(r.depth_vao != vao) {
+            if(vao)
+                _unbind_instances();
+            vao = r.depth_vao;
+            _state->bind_vertex_array(vao);
+        }
+        _bind_instances(first_instance + ii);
+        _validate_program(_shadow_program);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)r.index_count, r.index_format, r.depth_index_offset,
+                                          (GLsizei)instances, r.depth_base_vertex);
+        stats->draw_calls++;
+        stats->instances += instances;
+        ii += instances;
+    }
+    if(vao)
+        _unbind_instances();
+}
+/* Identifies the casters in queue entries [begin, end). Added up rather than
+ * chained so the order they're sorted in, which follows the camera, doesn't
+ * matter. LODs aren't included, a cached caster at an old LOD is close enough.
+ */
+static uint32_t _hash_casters(const Renderable* renderables, const RenderQueue& queue,
+                              uint32_t begin, uint32_t end) {
+    uint32_t hash = end - begin;
+    for(uint32_t ii=begin;ii<end;++ii) {
+        const Renderable& r = renderables[queue.keys[ii].index];
+        const uint32_t* words = (const uint32_t*)&r.transform;
+        uint32_t h = 2166136261u ^ r.mesh;
+        for(int jj=0;jj<16;++jj)
+            h = (h ^ words[jj])*16777619u;
+        hash += h;
+    }
+    return hash;
+}
+/* Everything that changes what a light's shadow views see */
+static uint32_t _hash_light(const Light& light) {
+    const uint32_t* words = (const uint32_t*)&light;
+    uint32_t hash = 2166136261u;
+    for(int ii=0;ii<8;++ii) // pos, size, dir, type
+        hash = (hash ^ words[ii])*16777619u;
+    const uint32_t* outer_cos = (const uint32_t*)&light.outer_cos;
+    return (hash ^ *outer_cos)*16777619u;
+}
+/* Five texels per view, the world to atlas matrix then the tile's bounds
+ * inset by half a texel so filtering doesn't read the next tile. Lights
+ * with a view that's never been drawn aren't shadowed.
+ */
+void _upload_atlas_views(RenderStats* stats) {
+    _atlas_view_data.clear();
+    for(uint32_t ii=0;ii<_num_atlas_views;++ii) {
+        const ShadowAtlasView& atlas_view = _atlas_views[ii];
+        const AtlasLight& entry = _atlas_lights[atlas_view.entry];
+        const AtlasTile& tile = entry.tiles[atlas_view.face];
+        if(!entry.valid[atlas_view.face])
+            _light_shadow_views[atlas_view.light] = -1;
+        float4x4 to_atlas = shadow_atlas_tile_matrix(&atlas_view.view_proj, &tile, SHADOW_ATLAS_RES);
+        const float kTexel = 1.0f/SHADOW_ATLAS_RES;
+        float4 bounds = { (tile.x + 0.5f)*kTexel, (tile.y + 0.5f)*kTexel,
+                          (tile.x + tile.size - 0.5f)*kTexel, (tile.y + tile.size - 0.5f)*kTexel };
+        _atlas_view_data.push_back(to_atlas.r0);
+        _atlas_view_data.push_back(to_atlas.r1);
+        _atlas_view_data.push_back(to_atlas.r2);
+        _atlas_view_data.push_back(to_atlas.r3);
+        _atlas_view_data.push_back(bounds);
+    }
+    for(size_t ii=0;ii<_light_shadow_views.size();++ii) {
+        if(_light_shadow_views[ii] >= 0)
+            stats->lights_shadowed++;
+    }
+    _upload_texture_buffer(_atlas_view_buffer, _atlas_view_data.empty() ? NULL : &_atlas_view_data[0], _atlas_view_data.size()*sizeof(float4));
+}
+/* The GPU time of a cascade's last static redraw, what skipping one saves.
+ * Only read once it's ready so nothing waits on the GPU.
+ */
+void _read_shadow_timer(uint32_t cascade) {
+    if(!_shadow_timer_pending[cascade])
+        return;
+    GLuint available = 0;
+    glGetQueryObjectuiv(_shadow_timers[cascade], GL_QUERY_RESULT_AVAILABLE, &available);
+    if(!available)
+        return;
+    GLuint64 nanoseconds = 0;
+    glGetQueryObjectui64v(_shadow_timers[cascade], GL_QUERY_RESULT, &nanoseconds);
+    _shadow_static_ms[cascade] = nanoseconds/1000000.0f;
+    _shadow_timer_pending[cascade] = 0;
+}
+/* Every queued draw's transform, one pass's queue after another, in
+ * sorted order so each run of instances is contiguous
+ */
+void _upload_instances(const Renderable* renderables, const RenderQueue* queues) {
+    uint32_t instance = 0;
+    for(int pass=0; pass<kNUM_RENDER_PASSES; ++pass) {
+        _first_instance[pass] = instance;
+        instance += queues[pass].count;
+    }
+    const int kCameraPasses[] = { kGeometryPass, kGeometryRetestPass };
+    for(int ii=0; ii<2; ++ii) {
+        _first_proxy[kCameraPasses[ii]] = instance;
+        instance += queues[kCameraPasses[ii]].count;
+    }
+    _instance_transforms.resize(instance);
+    instance = 0;
+    for(int pass=0; pass<kNUM_RENDER_PASSES; ++pass) {
+        const RenderQueue& queue = queues[pass];
+        for(uint32_t ii=0;ii<queue.count;++ii)
+            _instance_transforms[instance++] = renderables[queue.keys[ii].index].transform;
+    }
+    // The camera's draws' occlusion proxies, a box around each bounding sphere
+    for(int pass=0; pass<2; ++pass) {
+        const RenderQueue& queue = queues[kCameraPasses[pass]];
+        for(uint32_t ii=0;ii<queue.count;++ii) {
+            const float4& bounds = renderables[queue.keys[ii].index].bounds;
+            float4x4 box = float4x4Scale(bounds.w*2, bounds.w*2, bounds.w*2);
+            box.r3.x = bounds.x;
+            box.r3.y = bounds.y;
+            box.r3.z = bounds.z;
+            _instance_transforms[instance++] = float4x4multiply(&_box_mesh.dequantize, &box);
+        }
+    }
+    if(_instance_transforms.empty())
+        return;
+    GLsizeiptr size = (GLsizeiptr)(_instance_transforms.size()*sizeof(float4x4));
+    glBindBuffer(GL_ARRAY_BUFFER, _instance_buffer);
+    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW); // Orphan last frame's
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, &_instance_transforms[0]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+/* Writes the frame's constants, each material's and each shadow view's into
+ * the uniform ring before anything draws. Materials are written in the
+ * order the camera's queues change to them, each queue starting over.
+ */
+void _upload_constants(const float4x4& view, const float4x4& view_proj, const Renderable* renderables,
+                       const RenderQueue* queues, RenderStats* stats) {
+    const RenderQueue* camera_queues[] = { &queues[kGeometryPass], &queues[kGeometryRetestPass] };
+    _material_offsets.clear();
+    uint32_t num_materials = 0;
+    for(int pass=0;pass<2;++pass) {
+        const RenderQueue& queue = *camera_queues[pass];
+        const Material* material = NULL;
+        for(uint32_t ii=0;ii<queue.count;++ii) {
+            const Material* next = renderables[queue.keys[ii].index].material;
+            if(next != material) {
+                material = next;
+                ++num_materials;
+            }
+        }
+    }
+    uint32_t num_views = kMaxShadowCascades + _num_atlas_views + 1; // And the camera, for occlusion proxies
+    uint32_t bytes = _uniforms.aligned_size(sizeof(FrameConstants)) +
+                     num_materials*_uniforms.aligned_size(sizeof(MaterialConstants)) +
+                     num_views*_uniforms.aligned_size(sizeof(float4x4));
+    if(_uniforms.begin_frame(bytes))
+        stats->uniform_stalls++;
+
+    const float4x4 bias = {
+        0.5, 0.0, 0.0, 0.0,
+        0.0, 0.5, 0.0, 0.0,
+        0.0, 0.0, 0.5, 0.0,
+        0.5, 0.5, 0.5, 1.0
+    };
+    FrameConstants frame;
+    frame.view_proj = view_proj;
+    frame.inverse_view_proj = float4x4inverse(&view_proj);
+    frame.view = float4x4inverse(&view);
+    for(uint32_t ii=0;ii<kMaxShadowCascades;++ii)
+        frame.shadow_view_proj[ii] = float4x4multiply(&_cascades[ii].view_proj, &bias);
+    frame.camera_position = view.r3;
+    frame.screen_size[0] = (float)_width;
+    frame.screen_size[1] = (float)_height;
+    frame.num_cascades = (int32_t)_num_cascades;
+    frame._padding = 0;
+    _frame_offset = _uniforms.write(&frame, sizeof(frame));
+
+    for(int pass=0;pass<2;++pass) {
+        const RenderQueue& queue = *camera_queues[pass];
+        const Material* material = NULL;
+        for(uint32_t ii=0;ii<queue.count;++ii) {
+            const Material* next = renderables[queue.keys[ii].index].material;
+            if(next == material)
+                continue;
+            material = next;
+            MaterialConstants constants;
+            constants.specular_color = material->specular_color;
+            constants.specular_coefficient = material->specular_coefficient;
+            constants.specular_exponent = material->specular_power;
+            constants._padding[0] = constants._padding[1] = constants._padding[2] = 0.0f;
+            _material_offsets.push_back(_uniforms.write(&constants, sizeof(constants)));
+        }
+    }
+    for(uint32_t ii=0;ii<kMaxShadowCascades;++ii)
+        _shadow_view_offsets[ii] = _uniforms.write(&_cascades[ii].view_proj, sizeof(float4x4));
+    for(uint32_t ii=0;ii<_num_atlas_views;++ii)
+        _shadow_view_offsets[kMaxShadowCascades + ii] = _uniforms.write(&_atlas_views[ii].view_proj, sizeof(float4x4));
+    _camera_view_offset = _uniforms.write(&view_proj, sizeof(float4x4));
+    _uniforms.end_writes();
+    stats->uniform_bytes += _uniforms.bytes_used();
+}
+void _bind_constants(UniformBinding binding, uint32_t offset, uint32_t size) {
+    _state->bind_uniform_range((GLuint)binding, _uniforms.buffer(), offset, size);
+}
+/* Points the bound VAO's instance attributes at a run. GL 3.3 has no base
+ * instance, so the offset goes in the attribute pointers instead.
+ */
+void _bind_instances(uint32_t first_instance) {
+    glBindBuffer(GL_ARRAY_BUFFER, _instance_buffer);
+    for(int ii=0;ii<4;++ii) {
+        GLuint slot = INSTANCE_TRANSFORM_SLOT + ii;
+        intptr_t offset = (intptr_t)(first_instance*sizeof(float4x4) + ii*sizeof(float4));
+        glEnableVertexAttribArray(slot);
+        glVertexAttribPointer(slot, 4, GL_FLOAT, GL_FALSE, sizeof(float4x4), (void*)offset);
+        glVertexAttribDivisor(slot, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+/* The VAOs are shared with draws that don't read instances, don't leave
+ * them pointing into a buffer that gets resized
+ */
+void _unbind_instances(void) {
+    for(int ii=0;ii<4;++ii)
+        glDisableVertexAttribArray(INSTANCE_TRANSFORM_SLOT + ii);
+}
+/* Uploads the lights, local lights first so the cluster indices and
+ * instance IDs address them directly. Returns the first directional light.
+ */
+int _upload_lights(const Light* lights, int num_lights) {
+    _light_data.clear();
+    _light_spheres.clear();
+    for(int ii=0;ii<num_lights;++ii) {
+        if(lights[ii].type != kDirectionalLight) {
+            float4 sphere = { lights[ii].pos.x, lights[ii].pos.y, lights[ii].pos.z, lights[ii].size };
+            _light_spheres.push_back(sphere);
+            _push_light(lights[ii], ii < (int)_light_shadow_views.size() ? _light_shadow_views[ii] : -1);
+        }
+    }
+    int first_directional = (int)_light_spheres.size();
+    for(int ii=0;ii<num_lights;++ii) {
+        if(lights[ii].type == kDirectionalLight)
+            _push_light(lights[ii], -1);
+    }
+    _upload_texture_buffer(_cluster_buffers[0], _light_data.empty() ? NULL : &_light_data[0], _light_data.size()*sizeof(float4));
+    return first_directional;
+}
+/* Bins the uploaded local lights into clusters, uploads the clusters and
+ * draws one fullscreen pass. The program and light buffer are already bound.
+ */
+void _render_clustered_lights(const float4x4& world_to_view, const float4x4& proj,
+                              int first_directional, int num_lights) {
+    ClusterFrustum frustum;
+    cluster_frustum_from_projection(&frustum, &proj, CLUSTER_FAR_PLANE);
+    uint32_t num_indices = build_light_clusters(_clusters, &_light_indices[0], (uint32_t)_light_indices.size(),
+                                                _light_spheres.empty() ? NULL : &_light_spheres[0],
+                                                (uint32_t)_light_spheres.size(), &world_to_view, &frustum);
 
-Mesh    _sphere_mesh;
-Mesh    _fullscreen_mesh;
+    _upload_texture_buffer(_cluster_buffers[1], _clusters, sizeof(_clusters));
+    _upload_texture_buffer(_cluster_buffers[2], &_light_indices[0], num_indices*sizeof(uint32_t));
+    for(int ii=1;ii<(int)ARRAYSIZE(_cluster_textures);++ii)
+        _state->bind_texture(5+ii, GL_TEXTURE_BUFFER, _cluster_textures[ii]);
+    _state->uniform1i(_cluster_lights_uniform, 5);
+    _state->uniform1i(_cluster_clusters_uniform, 6);
+    _state->uniform1i(_cluster_indices_uniform, 7);
+    _state->uniform3i(_cluster_grid_uniform, kClusterTilesX, kClusterTilesY, kClusterSlices);
+    _state->uniform2f(_cluster_depth_uniform, frustum.near_z, frustum.slice_scale);
+    _state->uniform1i(_cluster_first_directional_uniform, first_directional);
+    _state->uniform1i(_cluster_num_directional_uniform, num_lights - first_directional);
+
+    _state->bind_vertex_array(_fullscreen_mesh.geometry.vao);
+    _validate_program(_cluster_program);
+    _begin_light_query();
+    _draw_mesh(&_fullscreen_mesh, 1);
+    glEndQuery(GL_SAMPLES_PASSED);
+}
+/* Each lighting draw counts the samples it shades. The counts are read two
+ * frames later, when they're done, so the CPU doesn't wait on the GPU. A
+ * set the GPU hasn't finished by then is dropped.
+ */
+void _read_light_queries(RenderStats* stats) {
+    _light_query_set = (_light_query_set+1) % 2;
+    std::vector<GLuint>& queries = _light_queries[_light_query_set];
+    uint32_t count = _num_light_queries[_light_query_set];
+    _num_light_queries[_light_query_set] = 0;
+    if(!_queries_available(queries, count))
+        return;
+    for(uint32_t ii=0;ii<count;++ii) {
+        GLuint samples = 0;
+        glGetQueryObjectuiv(queries[ii], GL_QUERY_RESULT, &samples);
+        stats->light_fragments += samples;
+    }
+}
+/* Whether every one of a set's first count queries has its result. The last
+ * ones are checked first, they're the likeliest to still be running.
+ */
+static bool _queries_available(const std::vector<GLuint>& queries, uint32_t count) {
+    for(uint32_t ii=count;ii>0;--ii) {
+        GLuint available = 0;
+        glGetQueryObjectuiv(queries[ii-1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available)
+            return false;
+    }
+    return true;
+}
+void _begin_light_query(void) {
+    std::vector<GLuint>& queries = _light_queries[_light_query_set];
+    uint32_t& count = _num_light_queries[_light_query_set];
+    if(count == queries.size()) {
+        GLuint query = 0;
+        glGenQueries(1, &query);
+        queries.push_back(query);
+    }
+    glBeginQuery(GL_SAMPLES_PASSED, queries[count++]);
+}
+/* Four texels per light, the shader's fetch_light unpacks them. The shadow
+ * view is the light's first atlas view, -1 when it has no shadow.
+ */
+void _push_light(const Light& light, int shadow_view) {
+    float4 texels[4] = {
+        { light.pos.x, light.pos.y, light.pos.z, light.size },
+        { light.dir.x, light.dir.y, light.dir.z, light.type },
+        { light.color.x, light.color.y, light.color.z, light.inner_cos },
+        { light.outer_cos, (float)shadow_view, 0.0f, 0.0f }
+    };
+    _light_data.insert(_light_data.end(), texels, texels+4);
+}
+static void _upload_texture_buffer(GLuint buffer, const void* data, size_t size) {
+    // Never empty, a texture buffer needs storage behind it
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)(size ? size : sizeof(float4)), NULL, GL_STREAM_DRAW);
+    if(size)
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, (GLsizeiptr)size, data);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+/* Draws one of the camera's queues into the G-buffer. The queue is sorted
+ * by state, only what changes is bound. Every run of the retest queue is
+ * occlusion tested.
+ */
+void _draw_geometry_queue(const Renderable* renderables, const RenderQueue* queues, int pass,
+                          const float3& camera, bool depth_equal, uint32_t* next_material, RenderStats* stats) {
+    const RenderQueue& queue = queues[pass];
+    bool measure = (pass == kGeometryPass && !depth_equal);
+    _build_geometry_runs(renderables, queue, camera, pass == kGeometryRetestPass);
+    _state->use_program(_geom_program);
+    const Material* material = NULL;
+    GLuint vao = 0;
+    for(uint32_t batch=0;batch<_geometry_runs.size();batch+=OCCLUSION_BATCH) {
+        uint32_t batch_end = (uint32_t)std::min(_geometry_runs.size(), (size_t)batch+OCCLUSION_BATCH);
+        if(_has_occlusion_tests(batch, batch_end)) {
+            if(vao)
+                _unbind_instances();
+            vao = 0;
+            _draw_occlusion_proxies(batch, batch_end, _first_proxy[pass], stats);
+            _state->use_program(_geom_program);
+        }
+        // The proxies need their own occlusion queries and depth state
+        if(depth_equal) {
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+        if(measure)
+            _begin_overdraw_query();
+        for(uint32_t run=batch;run<batch_end;++run) {
+            const GeometryRun& geometry_run = _geometry_runs[run];
+            uint32_t ii = geometry_run.first;
+            uint32_t instances = geometry_run.instances;
+            const Renderable& r = renderables[queue.keys[ii].index];
+
+            if(r.material != material) {
+                material = r.material;
+                _state->bind_texture(0, GL_TEXTURE_2D, (GLuint)material->albedo_tex.i);
+                _state->bind_texture(1, GL_TEXTURE_2D, (GLuint)material->normal_tex.i);
+                _state->bind_texture(2, GL_TEXTURE_2D, (GLuint)material->specular_tex.i);
+                _bind_constants(kMaterialConstantsBinding, _material_offsets[(*next_material)++], sizeof(MaterialConstants));
+            }
+            if(r.vao != vao) {
+                if(vao)
+                    _unbind_instances();
+                vao = r.vao;
+                _state->bind_vertex_array(vao);
+            }
+            _bind_instances(_first_instance[pass] + ii);
+            _validate_program(_geom_program);
+            if(geometry_run.query >= 0)
+                glBeginConditionalRender(_occlusion_queries[_occlusion_query_set][geometry_run.query], GL_QUERY_NO_WAIT);
+            if(r.cluster_counts) {
+                if(r.num_cluster_ranges)
+                    glMultiDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei*)r.cluster_counts, r.index_format, (GLvoid**)r.cluster_offsets,
+                                                  r.num_cluster_ranges, (GLint*)r.cluster_base_vertices);
+            } else {
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)r.index_count, r.index_format, r.index_offset,
+                                                  (GLsizei)instances, r.base_vertex);
+            }
+            if(geometry_run.query >= 0)
+                glEndConditionalRender();
+            stats->draw_calls++;
+            stats->instances += instances;
+        }
+        if(measure)
+            glEndQuery(GL_SAMPLES_PASSED);
+    }
+    if(vao)
+        _unbind_instances();
+    if(depth_equal) {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+}
+/* The camera queue's depth, in the same runs the geometry pass draws.
+ * Meshlet culled draws only have their visible meshlets' ranges in the full
+ * vertex format, everything else uses the position-only streams.
+ */
+void _draw_depth_prepass(const Renderable* renderables, const RenderQueue& queue, RenderStats* stats) {
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    _state->use_program(_shadow_program);
+    _bind_constants(kShadowViewBinding, _camera_view_offset, sizeof(float4x4));
+    _begin_overdraw_query();
+    GLuint vao = 0;
+    for(uint32_t ii=0;ii<queue.count;) {
+        const Renderable& r = renderables[queue.keys[ii].index];
+        uint32_t instances = _instance_run(renderables, queue, ii, queue.count, false);
+        GLuint run_vao = r.cluster_counts ? r.vao : r.depth_vao;
+        if(run_vao != vao) {
+            if(vao)
+                _unbind_instances();
+            vao = run_vao;
+            _state->bind_vertex_array(vao);
+        }
+        _bind_instances(_first_instance[kGeometryPass] + ii);
+        _validate_program(_shadow_program);
+        if(r.cluster_counts) {
+            if(r.num_cluster_ranges)
+                glMultiDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei*)r.cluster_counts, r.index_format, (GLvoid**)r.cluster_offsets,
+                                              r.num_cluster_ranges, (GLint*)r.cluster_base_vertices);
+        } else {
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)r.index_count, r.index_format, r.depth_index_offset,
+                                              (GLsizei)instances, r.depth_base_vertex);
+        }
+        stats->draw_calls++;
+        stats->instances += instances;
+        ii += instances;
+    }
+    if(vao)
+        _unbind_instances();
+    glEndQuery(GL_SAMPLES_PASSED);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    _state->use_program(_geom_program);
+}
+/* The fragments the camera queue's nearest-depth pass let through, over
+ * the screen's pixels. Read two frames later like the light queries, and
+ * dropped if they aren't done, leaving the pre-pass as it was. The pre-pass
+ * turns on and off at different overdraws so it doesn't flicker between
+ * the two.
+ */
+void _read_overdraw_queries(RenderStats* stats) {
+    _overdraw_query_set = (_overdraw_query_set+1) % 2;
+    std::vector<GLuint>& queries = _overdraw_queries[_overdraw_query_set];
+    uint32_t count = _num_overdraw_queries[_overdraw_query_set];
+    _num_overdraw_queries[_overdraw_query_set] = 0;
+    stats->depth_prepass = _depth_prepass;
+    if(count == 0 || !_queries_available(queries, count))
+        return;
+    uint64_t fragments = 0;
+    for(uint32_t ii=0;ii<count;++ii) {
+        GLuint samples = 0;
+        glGetQueryObjectuiv(queries[ii], GL_QUERY_RESULT, &samples);
+        fragments += samples;
+    }
+    float overdraw = fragments/(float)(_width*_height);
+    if(DEPTH_PREPASS == 2) {
+        if(!_depth_prepass && overdraw > DEPTH_PREPASS_ON_OVERDRAW)
+            _depth_prepass = true;
+        else if(_depth_prepass && overdraw < DEPTH_PREPASS_OFF_OVERDRAW)
+            _depth_prepass = false;
+    }
+    stats->overdraw = overdraw;
+    stats->depth_prepass = _depth_prepass;
+}
+void _begin_overdraw_query(void) {
+    std::vector<GLuint>& queries = _overdraw_queries[_overdraw_query_set];
+    uint32_t& count = _num_overdraw_queries[_overdraw_query_set];
+    if(count == queries.size()) {
+        GLuint query = 0;
+        glGenQueries(1, &query);
+        queries.push_back(query);
+    }
+    glBeginQuery(GL_SAMPLES_PASSED, queries[count++]);
+}
+/* Splits a camera queue into instance runs and picks the ones to test.
+ * A box the camera is in, or nearly, would be clipped and could fail the
+ * test while the run is on screen, so those are always drawn.
+ */
+void _build_geometry_runs(const Renderable* renderables, const RenderQueue& queue, const float3& camera, bool test_all) {
+    _geometry_runs.clear();
+    for(uint32_t ii=0;ii<queue.count;) {
+        GeometryRun run;
+        run.first = ii;
+        run.instances = _instance_run(renderables, queue, ii, queue.count, false);
+        run.query = -1;
+        const Renderable& r = renderables[queue.keys[ii].index];
+        bool testable = test_all || (GPU_OCCLUSION_CULLING && (r.index_count/3)*run.instances >= OCCLUSION_MIN_TRIANGLES);
+        for(uint32_t jj=ii;testable && jj<ii+run.instances;++jj) {
+            const float4& bounds = renderables[queue.keys[jj].index].bounds;
+            float reach = bounds.w + OCCLUSION_NEAR_MARGIN;
+            if(fabsf(bounds.x - camera.x) < reach && fabsf(bounds.y - camera.y) < reach && fabsf(bounds.z - camera.z) < reach)
+                testable = false;
+        }
+        if(testable)
+            run.query = (int)_next_occlusion_query();
+        _geometry_runs.push_back(run);
+        ii += run.instances;
+    }
+}
+bool _has_occlusion_tests(uint32_t begin, uint32_t end) const {
+    for(uint32_t ii=begin;ii<end;++ii) {
+        if(_geometry_runs[ii].query >= 0)
+            return true;
+    }
+    return false;
+}
+/* Each tested run's boxes, one instanced draw per run, against the depth
+ * the batches before wrote. Nothing is written.
+ */
+void _draw_occlusion_proxies(uint32_t begin, uint32_t end, uint32_t first_proxy, RenderStats* stats) {
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glDepthFunc(GL_LEQUAL);
+    _state->use_program(_shadow_program);
+    _bind_constants(kShadowViewBinding, _camera_view_offset, sizeof(float4x4));
+    const GeometryRange& box = _box_mesh.depth.vao ? _box_mesh.depth : _box_mesh.geometry;
+    _state->bind_vertex_array(box.vao);
+    const std::vector<GLuint>& queries = _occlusion_queries[_occlusion_query_set];
+    for(uint32_t ii=begin;ii<end;++ii) {
+        const GeometryRun& run = _geometry_runs[ii];
+        if(run.query < 0)
+            continue;
+        _bind_instances(first_proxy + run.first);
+        _validate_program(_shadow_program);
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, queries[(size_t)run.query]);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)_box_mesh.index_count, _box_mesh.index_format,
+                                          (const GLvoid*)(uintptr_t)box.index_start, (GLsizei)run.instances, box.base_vertex);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+        stats->occlusion_tests++;
+    }
+    _unbind_instances();
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+/* Like the light queries the results are read two frames later, if
+ * they're done, only to count what the GPU skipped
+ */
+void _read_occlusion_queries(RenderStats* stats) {
+    _occlusion_query_set = (_occlusion_query_set+1) % 2;
+    std::vector<GLuint>& queries = _occlusion_queries[_occlusion_query_set];
+    uint32_t count = _num_occlusion_queries[_occlusion_query_set];
+    _num_occlusion_queries[_occlusion_query_set] = 0;
+    if(!_queries_available(queries, count))
+        return;
+    for(uint32_t ii=0;ii<count;++ii) {
+        GLuint visible = 0;
+        glGetQueryObjectuiv(queries[ii], GL_QUERY_RESULT, &visible);
+        if(!visible)
+            stats->occlusion_culled++;
+    }
+}
+uint32_t _next_occlusion_query(void) {
+    std::vector<GLuint>& queries = _occlusion_queries[_occlusion_query_set];
+    uint32_t& count = _num_occlusion_queries[_occlusion_query_set];
+    if(count == queries.size()) {
+        GLuint query = 0;
+        glGenQueries(1, &query);
+        queries.push_back(query);
+    }
+    return count++;
+}
+/* How many draws from first up to end can go out as one instanced draw.
+ * Meshlet culled draws have their own index ranges and are never merged.
+ */
+static uint32_t _instance_run(const Renderable* renderables, const RenderQueue& queue,
+                              uint32_t first, uint32_t end, bool depth_only) {
+    const Renderable& a = renderables[queue.keys[first].index];
+    if(!depth_only && a.cluster_counts)
+        return 1;
+    uint32_t last = first+1;
+    for(; last<end; ++last) {
+        const Renderable& b = renderables[queue.keys[last].index];
+        if(b.mesh != a.mesh || b.lod != a.lod || b.dynamic != a.dynamic)
+            break;
+        if(!depth_only && (b.material != a.material || b.cluster_counts))
+            break;
+    }
+    return last-first;
+}
+
+GLState*    _state;     // Shared with the rest of the frame's draws
+Mesh        _sphere_mesh;
+Mesh        _fullscreen_mesh;
+Mesh        _box_mesh;      // Unit cube, for occlusion proxies
 
 int _width;
 int _height;
 
 GLuint  _geom_program;
-GLuint  _geom_world_uniform;
-GLuint  _geom_viewproj_uniform;
 GLuint  _geom_albedo_uniform;
 GLuint  _geom_normal_uniform;
 GLuint  _geom_specular_uniform;
-GLuint  _geom_specular_coefficient_uniform;
-GLuint  _geom_specular_exponent_uniform;
-GLuint  _geom_specular_color_uniform;
 
 GLuint  _light_program;
-GLuint  _light_world_uniform;
-GLuint  _light_viewproj_uniform;
-GLuint  _light_light_uniform;
+GLuint  _light_dequantize_uniform;
+GLuint  _light_lights_uniform;
+GLuint  _light_first_light_uniform;
+GLuint  _light_num_lights_uniform;
+GLuint  _light_fullscreen_uniform;
 GLuint  _light_gbuffer_uniform;
-GLuint  _light_inv_viewproj_uniform;
-GLuint  _light_cam_pos_uniform;
 GLuint  _light_shadow_map_uniform;
-GLuint  _light_shadow_viewproj_uniform;
+GLuint  _light_shadow_atlas_uniform;
+GLuint  _light_atlas_views_uniform;
+
+GLuint  _cluster_program;
+GLuint  _cluster_gbuffer_uniform;
+GLuint  _cluster_shadow_map_uniform;
+GLuint  _cluster_lights_uniform;
+GLuint  _cluster_clusters_uniform;
+GLuint  _cluster_indices_uniform;
+GLuint  _cluster_shadow_atlas_uniform;
+GLuint  _cluster_atlas_views_uniform;
+GLuint  _cluster_grid_uniform;
+GLuint  _cluster_depth_uniform;
+GLuint  _cluster_first_directional_uniform;
+GLuint  _cluster_num_directional_uniform;
+GLuint  _cluster_buffers[3];    // Lights, clusters, light indices
+GLuint  _cluster_textures[3];
+int     _max_buffer_lights;
+
+std::vector<float4>     _light_data;
+std::vector<float4>     _light_spheres;
+std::vector<uint32_t>   _light_indices;
+LightCluster            _clusters[kNumClusters];
+
+struct GeometryRun {
+    uint32_t    first;      // Into the geometry queue
+    uint32_t    instances;
+    int         query;      // Into this frame's occlusion queries, -1 if it isn't tested
+};
+std::vector<GeometryRun>    _geometry_runs;
+std::vector<GLuint> _occlusion_queries[2];
+uint32_t            _num_occlusion_queries[2];
+uint32_t            _occlusion_query_set;
+
+std::vector<GLuint> _light_queries[2];
+uint32_t            _num_light_queries[2];
+uint32_t            _light_query_set;
+
+std::vector<GLuint> _overdraw_queries[2];
+uint32_t            _num_overdraw_queries[2];
+uint32_t            _overdraw_query_set;
+bool                _depth_prepass;
+
+struct HiZReadback {
+    GLuint      buffer;
+    GLsync      fence;      // 0 when nothing's in flight
+    float4x4    view_proj;  // The depth's
+    uint32_t    width;
+    uint32_t    height;
+    uint32_t    size;       // Of the buffer, in bytes
+};
+GLuint  _hiz_program;
+GLuint  _hiz_depth_uniform;
+GLuint  _hiz_source_uniform;
+GLuint  _hiz_fb;
+GLuint  _hiz_texture;
+int     _hiz_width;
+int     _hiz_height;
+HiZReadback         _hiz_readbacks[HIZ_READBACKS];
+int                 _hiz_next;
+DepthPyramid        _hiz;
+std::vector<float>  _hiz_texels;
+int                 _hiz_valid;
 
 GLuint  _frame_buffer;
-GLuint  _depth_buffer;
+GLuint  _depth_texture;
 
-GLuint  _gbuffer[4];
-GLuint  _gbuffer_tex[4];
+GLuint  _gbuffer_tex[3];
 
 GLuint  _shadow_fb;
 GLuint  _shadow_depth;
+GLuint  _shadow_static_fb;
+GLuint  _shadow_static_depth;
+ShadowCascade   _cascades[kMaxShadowCascades];
+uint32_t        _num_cascades;
+float3          _shadow_light_dir;      // What the cascades were built for
+int             _shadow_static_valid[kMaxShadowCascades];
+uint32_t        _shadow_static_hash[kMaxShadowCascades];
+uint32_t        _shadow_dynamic_casters[kMaxShadowCascades];   // Last frame's
+GLuint          _shadow_timers[kMaxShadowCascades];
+int             _shadow_timer_pending[kMaxShadowCascades];
+float           _shadow_static_ms[kMaxShadowCascades];
 GLuint  _shadow_program;
-GLuint  _shadow_wvp_uniform;
+
+GLuint          _atlas_fb;
+GLuint          _atlas_depth;
+GLuint          _atlas_view_buffer;
+GLuint          _atlas_view_texture;
+ShadowAtlas     _atlas;
+AtlasLight      _atlas_lights[SHADOW_ATLAS_MAX_LIGHTS];
+ShadowAtlasView _atlas_views[SHADOW_ATLAS_MAX_LIGHTS*6];
+uint32_t        _num_atlas_views;
+std::vector<int>    _light_shadow_views;    // Per light, its first view or -1
+std::vector<float4> _atlas_view_data;
+std::vector<std::pair<float, int> > _atlas_ranking;  // Negated importance, light
+
+UniformRing             _uniforms;
+uint32_t                _frame_offset;
+std::vector<uint32_t>   _material_offsets;
+uint32_t                _shadow_view_offsets[kMaxShadowCascades + SHADOW_ATLAS_MAX_LIGHTS*6];
+uint32_t                _camera_view_offset;
+
+GLuint  _instance_buffer;
+std::vector<float4x4>   _instance_transforms;
+uint32_t                _first_instance[kNUM_RENDER_PASSES];
+uint32_t                _first_proxy[kNUM_RENDER_PASSES];   // The camera queues' occlusion proxies follow every pass
 
 };
 
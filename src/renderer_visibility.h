@@ -0,0 +1,389 @@
+/*! @file renderer_visibility.h
+ *  @brief Visibility buffer renderer. The geometry pass only writes triangle
+ *         IDs and depth, materials are resolved once per pixel after it.
+ *  @author Kyle Weicht
+ *  @date 10/20/26 9:40 AM
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#ifndef __renderer_visibility__
+#define __renderer_visibility__
+
+#include <map>
+#include "renderer_deferred.h"
+#include "geometry_buffers.h"
+#include "visibility_ids.h"
+
+#define VISIBILITY_MAX_MATERIALS 65535  // Each is a 16 bit material depth, the clear depth is none
+
+/* Shares the deferred renderer's shadows, lighting and G-buffer. Only the
+ * camera's geometry is drawn differently:
+ *  1. Every camera draw goes into the visibility and depth buffers with no
+ *     textures or materials bound. It's drawn from the full vertex stream,
+ *     the position-only stream has its triangles in a different order and
+ *     gl_PrimitiveID has to find the resolve's triangle.
+ *  2. A fullscreen pass writes each pixel's material as its depth.
+ *  3. Each material is drawn fullscreen at its own depth with an equal test.
+ *     Its pixels fetch their triangle's vertices from the shared buffers,
+ *     interpolate them and write the G-buffer, each pixel once.
+ */
+class RendererVisibility : public RendererDeferred {
+public:
+
+void init(void) {
+    RendererDeferred::init();
+    { // Visibility
+        GLuint vs = _compile_shader(GL_VERTEX_SHADER, "assets/shaders/deferred/visibility.vsh");
+        GLuint fs = _compile_shader(GL_FRAGMENT_SHADER, "assets/shaders/deferred/visibility.fsh");
+        _visibility_program = _create_program(vs, fs);
+        _bind_uniform_block(_visibility_program, "FrameConstants", kFrameConstantsBinding);
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+        _visibility_first_entry_uniform = glGetUniformLocation(_visibility_program, "kFirstEntry");
+    }
+    { // Material depth
+        GLuint vs = _compile_shader(GL_VERTEX_SHADER, "assets/shaders/2D_fullscreen.vsh");
+        GLuint fs = _compile_shader(GL_FRAGMENT_SHADER, "assets/shaders/deferred/visibility_material.fsh");
+        _material_program = _create_program(vs, fs);
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+        _material_visibility_uniform = glGetUniformLocation(_material_program, "kVisibility");
+        _material_entries_uniform = glGetUniformLocation(_material_program, "kEntries");
+    }
+    { // Resolve
+        GLuint vs = _compile_shader(GL_VERTEX_SHADER, "assets/shaders/2D_fullscreen.vsh");
+        GLuint fs = _compile_shader(GL_FRAGMENT_SHADER, "assets/shaders/deferred/visibility_resolve.fsh");
+        _resolve_program = _create_program(vs, fs);
+        _bind_uniform_block(_resolve_program, "FrameConstants", kFrameConstantsBinding);
+        _bind_uniform_block(_resolve_program, "MaterialConstants", kMaterialConstantsBinding);
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+        _resolve_albedo_uniform = glGetUniformLocation(_resolve_program, "kAlbedoTex");
+        _resolve_normal_uniform = glGetUniformLocation(_resolve_program, "kNormalTex");
+        _resolve_specular_uniform = glGetUniformLocation(_resolve_program, "kSpecularTex");
+        _resolve_visibility_uniform = glGetUniformLocation(_resolve_program, "kVisibility");
+        _resolve_instances_uniform = glGetUniformLocation(_resolve_program, "kInstances");
+        _resolve_entries_uniform = glGetUniformLocation(_resolve_program, "kEntries");
+        _resolve_vertices_uniform = glGetUniformLocation(_resolve_program, "kVertices");
+        _resolve_indices16_uniform = glGetUniformLocation(_resolve_program, "kIndices16");
+        _resolve_indices32_uniform = glGetUniformLocation(_resolve_program, "kIndices32");
+    }
+    glGenFramebuffers(1, &_visibility_fb);
+    glGenTextures(1, &_visibility_texture);
+    glGenFramebuffers(1, &_material_fb);
+    glGenRenderbuffers(1, &_material_depth);
+
+    // Entries and instances never change buffers, the shared vertex and
+    // index buffers do when they grow
+    glGenBuffers(1, &_entry_buffer);
+    glGenTextures(ARRAYSIZE(_buffer_textures), _buffer_textures);
+    _upload_texture_buffer(_entry_buffer, NULL, 0);
+    _upload_texture_buffer(_instance_buffer, NULL, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, _buffer_textures[kEntryTexture]);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32UI, _entry_buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, _buffer_textures[kInstanceTexture]);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, _instance_buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    CheckGLError();
+    _vertex_buffer = 0;
+    _index_buffer = 0;
+}
+void shutdown(void) {
+    glDeleteProgram(_visibility_program);
+    glDeleteProgram(_material_program);
+    glDeleteProgram(_resolve_program);
+    glDeleteFramebuffers(1, &_visibility_fb);
+    glDeleteTextures(1, &_visibility_texture);
+    glDeleteFramebuffers(1, &_material_fb);
+    glDeleteRenderbuffers(1, &_material_depth);
+    glDeleteTextures(ARRAYSIZE(_buffer_textures), _buffer_textures);
+    glDeleteBuffers(1, &_entry_buffer);
+    RendererDeferred::shutdown();
+}
+void resize(int width, int height) {
+    RendererDeferred::resize(width, height);
+
+    // Shares the G-buffer's depth
+    glBindTexture(GL_TEXTURE_2D, _visibility_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, width, height, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, _visibility_fb);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _visibility_texture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, _depth_texture, 0);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        debug_output("FBO initialization failed\n");
+    CheckGLError();
+
+    // The G-buffer's colors over the material depth
+    glBindRenderbuffer(GL_RENDERBUFFER, _material_depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, _material_fb);
+    for(int ii=0;ii<(int)ARRAYSIZE(_gbuffer_tex);++ii)
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + ii, GL_TEXTURE_2D, _gbuffer_tex[ii], 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, _material_depth);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        debug_output("FBO initialization failed\n");
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    CheckGLError();
+}
+void set_geometry_buffers(const GeometryBuffers* geometry) { _geometry = geometry; }
+
+protected:
+
+void _render_geometry(const float4x4&, const float4x4& view_proj, const Renderable* renderables,
+                      const RenderQueue* queues, RenderStats* stats) {
+    _build_entries(renderables, queues, stats);
+
+    // The G-buffer's colors stay cleared where nothing was drawn
+    glBindFramebuffer(GL_FRAMEBUFFER, _frame_buffer);
+    GLenum buffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+    glDrawBuffers(3, buffers);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, _visibility_fb);
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    const GLuint nothing[4] = { 0, 0, 0, 0 };
+    glClearBufferuiv(GL_COLOR, 0, nothing);
+    _draw_visibility(stats);
+    _downsample_depth(view_proj);
+    if(_draws.empty()) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return;
+    }
+    _bind_geometry_buffers();
+
+    // Material depth
+    glBindFramebuffer(GL_FRAMEBUFFER, _material_fb);
+    glDrawBuffers(3, buffers);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthFunc(GL_ALWAYS);
+    _state->use_program(_material_program);
+    _state->bind_texture(3, GL_TEXTURE_2D, _visibility_texture);
+    _state->bind_texture(4, GL_TEXTURE_BUFFER, _buffer_textures[kEntryTexture]);
+    _state->uniform1i(_material_visibility_uniform, 3);
+    _state->uniform1i(_material_entries_uniform, 4);
+    _state->bind_vertex_array(_fullscreen_mesh.geometry.vao);
+    _validate_program(_material_program);
+    _draw_mesh(&_fullscreen_mesh, 1);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+    // Resolve each material over its own pixels. A depth range of one value
+    // puts the whole quad at the material's depth.
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(GL_FALSE);
+    _state->use_program(_resolve_program);
+    _state->bind_texture(5, GL_TEXTURE_BUFFER, _buffer_textures[kInstanceTexture]);
+    _state->bind_texture(6, GL_TEXTURE_BUFFER, _buffer_textures[kVertexTexture]);
+    _state->bind_texture(7, GL_TEXTURE_BUFFER, _buffer_textures[kIndex16Texture]);
+    _state->bind_texture(8, GL_TEXTURE_BUFFER, _buffer_textures[kIndex32Texture]);
+    _state->uniform1i(_resolve_albedo_uniform, 0);
+    _state->uniform1i(_resolve_normal_uniform, 1);
+    _state->uniform1i(_resolve_specular_uniform, 2);
+    _state->uniform1i(_resolve_visibility_uniform, 3);
+    _state->uniform1i(_resolve_entries_uniform, 4);
+    _state->uniform1i(_resolve_instances_uniform, 5);
+    _state->uniform1i(_resolve_vertices_uniform, 6);
+    _state->uniform1i(_resolve_indices16_uniform, 7);
+    _state->uniform1i(_resolve_indices32_uniform, 8);
+    for(uint32_t ii=0;ii<_materials.size();++ii) {
+        const VisibilityMaterial& material = _materials[ii];
+        double depth = ii/65535.0;
+        glDepthRange(depth, depth);
+        _state->bind_texture(0, GL_TEXTURE_2D, (GLuint)material.material->albedo_tex.i);
+        _state->bind_texture(1, GL_TEXTURE_2D, (GLuint)material.material->normal_tex.i);
+        _state->bind_texture(2, GL_TEXTURE_2D, (GLuint)material.material->specular_tex.i);
+        _bind_constants(kMaterialConstantsBinding, material.constants, sizeof(MaterialConstants));
+        _validate_program(_resolve_program);
+        _draw_mesh(&_fullscreen_mesh, 1);
+    }
+    glDepthRange(0.0, 1.0);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    stats->visibility_materials += (uint32_t)_materials.size();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+private:
+
+enum {
+    kEntryTexture,
+    kInstanceTexture,
+    kVertexTexture,
+    kIndex16Texture,
+    kIndex32Texture,
+
+    kNUM_BUFFER_TEXTURES
+};
+enum {
+    kEntryIndex32Bit = 0x80000000u,
+    kEntryTriangles = 1 << VISIBILITY_TRIANGLE_BITS
+};
+
+/* Instances of one mesh split the same way, an entry per instance */
+struct VisibilityDraw {
+    uint32_t        first_entry;
+    uint32_t        first_instance; // Into the instance transforms
+    uint32_t        instances;
+    GLuint          vao;
+    GLint           base_vertex;
+    GLsizei         index_count;
+    GLenum          index_format;
+    const GLvoid*   index_offset;
+};
+struct VisibilityMaterial {
+    const Material* material;
+    uint32_t        constants;  // Offset in the uniform ring
+};
+
+/* Turns the camera queues into draws and their entries. Materials are
+ * numbered in the order they were uploaded, the first time each one's seen.
+ * Meshlet culled draws are drawn whole, one draw can't tell its ranges apart.
+ */
+void _build_entries(const Renderable* renderables, const RenderQueue* queues, RenderStats* stats) {
+    const int kCameraPasses[] = { kGeometryPass, kGeometryRetestPass };
+    _draws.clear();
+    _entries.clear();
+    _materials.clear();
+    _material_index.clear();
+    uint32_t next_material = 0;
+    for(int pass=0;pass<2;++pass) {
+        const RenderQueue& queue = queues[kCameraPasses[pass]];
+        const Material* material = NULL;
+        for(uint32_t ii=0;ii<queue.count;++ii) {
+            const Material* next = renderables[queue.keys[ii].index].material;
+            if(next == material)
+                continue;
+            material = next;
+            uint32_t constants = _material_offsets[next_material++];
+            if(_material_index.find(material) != _material_index.end() || _materials.size() == (size_t)VISIBILITY_MAX_MATERIALS)
+                continue;
+            _material_index[material] = (uint32_t)_materials.size();
+            VisibilityMaterial entry = { material, constants };
+            _materials.push_back(entry);
+        }
+    }
+    for(int pass=0;pass<2;++pass) {
+        const RenderQueue& queue = queues[kCameraPasses[pass]];
+        for(uint32_t ii=0;ii<queue.count;) {
+            const Renderable& r = renderables[queue.keys[ii].index];
+            uint32_t instances = _instance_run(renderables, queue, ii, queue.count, true);
+            uint32_t index_size = (r.index_format == GL_UNSIGNED_SHORT) ? 2 : 4;
+            uint32_t first_index = (uint32_t)((uintptr_t)r.index_offset/index_size);
+            _splits.resize(visibility_split_count((uint32_t)r.index_count, kEntryTriangles));
+            uint32_t num_splits = visibility_split_draw(&_splits[0], first_index, (uint32_t)r.index_count, kEntryTriangles);
+            for(uint32_t split=0;split<num_splits;++split) {
+                if(_entries.size()/4 + instances > (size_t)VISIBILITY_MAX_ENTRIES)
+                    break;
+                VisibilityDraw draw;
+                draw.first_entry = (uint32_t)_entries.size()/4;
+                draw.first_instance = _first_instance[kCameraPasses[pass]] + ii;
+                draw.instances = instances;
+                draw.vao = r.vao;
+                draw.base_vertex = r.base_vertex;
+                draw.index_count = (GLsizei)_splits[split].index_count;
+                draw.index_format = r.index_format;
+                draw.index_offset = (const GLvoid*)((uintptr_t)_splits[split].first_index*index_size);
+                _draws.push_back(draw);
+                for(uint32_t jj=0;jj<instances;++jj) {
+                    const Material* material = renderables[queue.keys[ii+jj].index].material;
+                    std::map<const Material*, uint32_t>::const_iterator iter = _material_index.find(material);
+                    uint32_t index = (iter != _material_index.end()) ? iter->second : 0;
+                    _entries.push_back(draw.first_instance + jj);
+                    _entries.push_back((uint32_t)r.base_vertex);
+                    _entries.push_back(_splits[split].first_index);
+                    _entries.push_back(index | (index_size == 4 ? (uint32_t)kEntryIndex32Bit : 0u));
+                }
+            }
+            ii += instances;
+        }
+    }
+    _upload_texture_buffer(_entry_buffer, _entries.empty() ? NULL : &_entries[0], _entries.size()*sizeof(uint32_t));
+    stats->visibility_entries += (uint32_t)_entries.size()/4;
+}
+void _draw_visibility(RenderStats* stats) {
+    _state->use_program(_visibility_program);
+    GLuint vao = 0;
+    for(size_t ii=0;ii<_draws.size();++ii) {
+        const VisibilityDraw& draw = _draws[ii];
+        if(draw.vao != vao) {
+            if(vao)
+                _unbind_instances();
+            vao = draw.vao;
+            _state->bind_vertex_array(vao);
+        }
+        _bind_instances(draw.first_instance);
+        _state->uniform1i(_visibility_first_entry_uniform, (GLint)draw.first_entry);
+        _validate_program(_visibility_program);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, draw.index_count, draw.index_format, draw.index_offset,
+                                          (GLsizei)draw.instances, draw.base_vertex);
+        stats->draw_calls++;
+        stats->instances += draw.instances;
+    }
+    if(vao)
+        _unbind_instances();
+}
+/* Points the buffer textures at the packed format's current buffers. They
+ * were bound around the GL state, so it starts over.
+ */
+void _bind_geometry_buffers(void) {
+    GLuint vertex_buffer = _geometry->vertex_buffer(kVtxPackedPosNormTanTex);
+    GLuint index_buffer = _geometry->index_buffer(kVtxPackedPosNormTanTex);
+    if(vertex_buffer == _vertex_buffer && index_buffer == _index_buffer)
+        return;
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, _buffer_textures[kVertexTexture]);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, vertex_buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, _buffer_textures[kIndex16Texture]);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R16UI, index_buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, _buffer_textures[kIndex32Texture]);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, index_buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    CheckGLError();
+    _state->reset();
+    _vertex_buffer = vertex_buffer;
+    _index_buffer = index_buffer;
+}
+
+const GeometryBuffers*  _geometry;
+GLuint  _vertex_buffer;     // What the buffer textures point at
+GLuint  _index_buffer;
+
+GLuint  _visibility_program;
+GLuint  _visibility_first_entry_uniform;
+
+GLuint  _material_program;
+GLuint  _material_visibility_uniform;
+GLuint  _material_entries_uniform;
+
+GLuint  _resolve_program;
+GLuint  _resolve_albedo_uniform;
+GLuint  _resolve_normal_uniform;
+GLuint  _resolve_specular_uniform;
+GLuint  _resolve_visibility_uniform;
+GLuint  _resolve_instances_uniform;
+GLuint  _resolve_entries_uniform;
+GLuint  _resolve_vertices_uniform;
+GLuint  _resolve_indices16_uniform;
+GLuint  _resolve_indices32_uniform;
+
+GLuint  _visibility_fb;
+GLuint  _visibility_texture;
+GLuint  _material_fb;
+GLuint  _material_depth;
+
+GLuint  _entry_buffer;
+GLuint  _buffer_textures[kNUM_BUFFER_TEXTURES];
+
+std::vector<VisibilityDraw>     _draws;
+std::vector<VisibilitySplit>    _splits;    // One draw's
+std::vector<uint32_t>           _entries;   // 4 words each
+std::vector<VisibilityMaterial> _materials;
+std::map<const Material*, uint32_t> _material_index;
+
+};
+
+#endif /* include guard */
@@ -0,0 +1,155 @@
+/*! @file shadow_atlas.cpp
+ *  @author Kyle Weicht
+ *  @date 10/20/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "shadow_atlas.h"
+
+#include <math.h>
+#include <string.h>
+
+/*
+ * Internal
+ */
+namespace {
+
+enum {
+    kNodeFree,
+    kNodeSplit, // Some of its children are used
+    kNodeUsed
+};
+
+const float kShadowNearScale = 0.01f;   // The near plane, relative to the light's range
+
+// Nodes are stored level by level, each level's in Morton order
+uint32_t _level_start(uint32_t depth) {
+    return ((1u << (2*depth)) - 1)/3;
+}
+uint32_t _node_depth(uint32_t node) {
+    uint32_t depth = 0;
+    while(node >= _level_start(depth+1))
+        ++depth;
+    return depth;
+}
+
+int _alloc(ShadowAtlas* atlas, uint32_t node, uint32_t depth, uint32_t target) {
+    uint8_t& state = atlas->nodes[node];
+    if(state == kNodeUsed)
+        return -1;
+    if(depth == target) {
+        if(state != kNodeFree)
+            return -1;
+        state = kNodeUsed;
+        return (int)node;
+    }
+    uint32_t first_child = _level_start(depth+1) + (node - _level_start(depth))*4;
+    if(state == kNodeFree) {
+        state = kNodeSplit;
+        memset(&atlas->nodes[first_child], kNodeFree, 4);
+    }
+    for(uint32_t ii=0; ii<4; ++ii) {
+        int found = _alloc(atlas, first_child+ii, depth+1, target);
+        if(found >= 0)
+            return found;
+    }
+    return -1;
+}
+
+float4x4 _look_view_proj(const float3& pos, const float3& look, const float3& up_hint,
+                         float fov, float range) {
+    float3 up = up_hint;
+    float3 right = float3cross(&up, &look);
+    right = float3normalize(&right);
+    up = float3cross(&look, &right);
+    float4x4 view = {
+        { right.x, right.y, right.z, 0.0f },
+        {    up.x,    up.y,    up.z, 0.0f },
+        {  look.x,  look.y,  look.z, 0.0f },
+        {   pos.x,   pos.y,   pos.z, 1.0f }
+    };
+    view = float4x4inverse(&view);
+    float4x4 proj = float4x4PerspectiveFovLH(fov, 1.0f, range*kShadowNearScale, range);
+    return float4x4multiply(&view, &proj);
+}
+
+}
+
+/*
+ * External
+ */
+void shadow_atlas_init(ShadowAtlas* atlas, uint32_t size, uint32_t max_depth) {
+    atlas->size = size;
+    atlas->max_depth = (max_depth > kAtlasMaxDepth) ? (uint32_t)kAtlasMaxDepth : max_depth;
+    memset(atlas->nodes, kNodeFree, sizeof(atlas->nodes));
+}
+int shadow_atlas_alloc(ShadowAtlas* atlas, uint32_t size, AtlasTile* tile) {
+    uint32_t depth = 0;
+    while(depth < atlas->max_depth && (atlas->size >> (depth+1)) >= size)
+        ++depth;
+    int node = _alloc(atlas, 0, 0, depth);
+    if(node < 0)
+        return 0;
+
+    // The node's index in its level is its Morton code
+    uint32_t index = (uint32_t)node - _level_start(depth);
+    uint32_t x = 0, y = 0;
+    for(uint32_t bit=0; bit<depth; ++bit) {
+        x |= ((index >> (2*bit)) & 1) << bit;
+        y |= ((index >> (2*bit+1)) & 1) << bit;
+    }
+    tile->size = atlas->size >> depth;
+    tile->x = x*tile->size;
+    tile->y = y*tile->size;
+    tile->node = (uint32_t)node;
+    return 1;
+}
+void shadow_atlas_free(ShadowAtlas* atlas, const AtlasTile* tile) {
+    uint32_t node = tile->node;
+    uint32_t depth = _node_depth(node);
+    atlas->nodes[node] = kNodeFree;
+    while(depth > 0) {
+        uint32_t index = node - _level_start(depth);
+        uint32_t first_sibling = _level_start(depth) + (index & ~3u);
+        for(uint32_t ii=0; ii<4; ++ii) {
+            if(atlas->nodes[first_sibling+ii] != kNodeFree)
+                return;
+        }
+        --depth;
+        node = _level_start(depth) + index/4;
+        atlas->nodes[node] = kNodeFree;
+    }
+}
+float4x4 shadow_atlas_tile_matrix(const float4x4* view_proj, const AtlasTile* tile, uint32_t atlas_size) {
+    // Applied before the divide, so the offsets are scaled by w
+    float scale = 0.5f*tile->size/atlas_size;
+    float4x4 bias = {
+        { scale, 0.0f, 0.0f, 0.0f },
+        { 0.0f, scale, 0.0f, 0.0f },
+        { 0.0f, 0.0f, 0.5f, 0.0f },
+        { (tile->x + 0.5f*tile->size)/atlas_size, (tile->y + 0.5f*tile->size)/atlas_size, 0.5f, 1.0f }
+    };
+    return float4x4multiply(view_proj, &bias);
+}
+void point_shadow_view_projs(float4x4* view_projs, const float3* pos, float range) {
+    const float3 looks[6] = {
+        {  1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f },
+        { 0.0f,  1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f },
+        { 0.0f, 0.0f,  1.0f }, { 0.0f, 0.0f, -1.0f }
+    };
+    const float3 y_up = { 0.0f, 1.0f, 0.0f };
+    const float3 z_up = { 0.0f, 0.0f, 1.0f };
+    for(int ii=0; ii<6; ++ii)
+        view_projs[ii] = _look_view_proj(*pos, looks[ii], (ii == 2 || ii == 3) ? z_up : y_up, kPiDiv2, range);
+}
+float4x4 spot_shadow_view_proj(const float3* pos, const float3* dir, float outer_cos, float range) {
+    float3 look = float3normalize(dir);
+    float3 up = { 0.0f, 1.0f, 0.0f };
+    if(fabsf(look.y) > 0.99f) {
+        up.y = 0.0f;
+        up.z = 1.0f;
+    }
+    float fov = 2.0f*acosf(outer_cos);
+    if(fov > DegToRad(170.0f))
+        fov = DegToRad(170.0f);
+    return _look_view_proj(*pos, look, up, fov, range);
+}
@@ -0,0 +1,72 @@
+/*! @file shadow_atlas.h
+ *  @brief Quadtree allocation of shadow map tiles for local lights
+ *  @author Kyle Weicht
+ *  @date 10/20/26 1:40 AM
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ *	@addtogroup shadow_atlas shadow_atlas
+ *	@{
+ */
+#ifndef __shadow_atlas_h__
+#define __shadow_atlas_h__
+
+#include <stdint.h>
+#include "vec_math.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Tiles are square powers of two, from the whole atlas down to
+ * 1/2^(kAtlasMaxDepth) of its width
+ */
+enum {
+    kAtlasMaxDepth = 6,
+    kAtlasMaxNodes = (1 << (2*(kAtlasMaxDepth+1)))/3 /* 1 + 4 + ... + 4^kAtlasMaxDepth */
+};
+
+typedef struct {
+    uint32_t    x;      /*!< In texels */
+    uint32_t    y;
+    uint32_t    size;
+    uint32_t    node;   /*!< Where it is in the quadtree, for freeing it */
+} AtlasTile;
+
+typedef struct {
+    uint32_t    size;
+    uint32_t    max_depth;
+    uint8_t     nodes[kAtlasMaxNodes];
+} ShadowAtlas;
+
+/*! @brief Starts with the whole atlas free. Tiles can be as small as
+ *         size >> max_depth, max_depth is clamped to kAtlasMaxDepth.
+ */
+void shadow_atlas_init(ShadowAtlas* atlas, uint32_t size, uint32_t max_depth);
+
+/*! @brief Allocates a tile of the given size, rounded up to a power of two
+ *         and clamped to what the atlas supports
+ *  @return Non-zero if there was room
+ */
+int shadow_atlas_alloc(ShadowAtlas* atlas, uint32_t size, AtlasTile* tile);
+
+/*! @brief Frees a tile. Free siblings are merged back into their parent. */
+void shadow_atlas_free(ShadowAtlas* atlas, const AtlasTile* tile);
+
+/*! @brief Maps a light's clip space into a tile of the atlas: x and y to
+ *         the tile's texture coordinates and z to [0,1] depth
+ */
+float4x4 shadow_atlas_tile_matrix(const float4x4* view_proj, const AtlasTile* tile, uint32_t atlas_size);
+
+/*! @brief The view projections of a point light's six cube faces, in the
+ *         order +x, -x, +y, -y, +z, -z
+ */
+void point_shadow_view_projs(float4x4* view_projs, const float3* pos, float range);
+
+/*! @brief The view projection of a spot light's cone */
+float4x4 spot_shadow_view_proj(const float3* pos, const float3* dir, float outer_cos, float range);
+
+#ifdef __cplusplus
+} // extern "C" {
+#endif
+
+/* @} */
+#endif /* include guard */
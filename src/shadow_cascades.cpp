@@ -0,0 +1,121 @@
+/*! @file shadow_cascades.cpp
+ *  @author Kyle Weicht
+ *  @date 10/20/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "shadow_cascades.h"
+
+#include <math.h>
+
+/*
+ * Internal
+ */
+namespace {
+
+float3 _transform_point(const float4x4& m, float x, float y, float z) {
+    float3 p = {
+        x*m.r0.x + y*m.r1.x + z*m.r2.x + m.r3.x,
+        x*m.r0.y + y*m.r1.y + z*m.r2.y + m.r3.y,
+        x*m.r0.z + y*m.r1.z + z*m.r2.z + m.r3.z
+    };
+    return p;
+}
+
+}
+
+/*
+ * External
+ */
+void shadow_cascade_splits(float* splits, uint32_t num_cascades, float near_z, float far_z, float lambda) {
+    for(uint32_t ii=1; ii<=num_cascades; ++ii) {
+        float t = ii/(float)num_cascades;
+        float log_split = near_z*powf(far_z/near_z, t);
+        float uniform_split = near_z + (far_z-near_z)*t;
+        splits[ii-1] = lambda*log_split + (1.0f-lambda)*uniform_split;
+    }
+    splits[num_cascades-1] = far_z;
+}
+void build_shadow_cascades(ShadowCascade* cascades, uint32_t num_cascades,
+                           const float4x4* camera_world, const float4x4* proj,
+                           float shadow_distance, float lambda, const float3* light_dir,
+                           float caster_distance, uint32_t resolution, float margin) {
+    // See float4x4PerspectiveFovLH, r3.z is -near*r2.z
+    float near_z = -proj->r3.z/proj->r2.z;
+    float tan_x = 1.0f/proj->r0.x;
+    float tan_y = 1.0f/proj->r1.y;
+    float splits[kMaxShadowCascades];
+    shadow_cascade_splits(splits, num_cascades, near_z, shadow_distance, lambda);
+
+    // The light's basis, the same one for every cascade
+    float3 look = float3normalize(light_dir);
+    float3 up = {0,1,0};
+    if(fabsf(look.y) > 0.99f) {
+        up.y = 0.0f;
+        up.z = 1.0f;
+    }
+    float3 right = float3cross(&up, &look);
+    right = float3normalize(&right);
+    up = float3cross(&look, &right);
+
+    for(uint32_t ii=0; ii<num_cascades; ++ii) {
+        ShadowCascade& cascade = cascades[ii];
+        cascade.near_z = ii ? splits[ii-1] : near_z;
+        cascade.far_z = splits[ii];
+
+        // The slice is symmetric about the view axis, so is its bounding
+        // sphere. Its center is the point on the axis equidistant from the
+        // near and far corners, clamped to the slice.
+        float n = cascade.near_z;
+        float f = cascade.far_z;
+        float k = tan_x*tan_x + tan_y*tan_y;
+        float center_z = 0.5f*(n + f)*(1.0f + k);
+        if(center_z > f)
+            center_z = f;
+        float far_x = f*tan_x;
+        float far_y = f*tan_y;
+        float near_x = n*tan_x;
+        float near_y = n*tan_y;
+        float dz_far = f - center_z;
+        float dz_near = n - center_z;
+        float radius = sqrtf(far_x*far_x + far_y*far_y + dz_far*dz_far);
+        float near_radius = sqrtf(near_x*near_x + near_y*near_y + dz_near*dz_near);
+        if(near_radius > radius)
+            radius = near_radius;
+        cascade.fit_radius = radius;
+        // Rounded up so float error doesn't change the texel size
+        radius = ceilf(radius*margin*16.0f)/16.0f;
+        cascade.radius = radius;
+
+        // Snap the center to whole texels in the light's space
+        float3 center = _transform_point(*camera_world, 0.0f, 0.0f, center_z);
+        float texel = 2.0f*radius/resolution;
+        cascade.texel = texel;
+        float light_x = floorf(float3dot(&center, &right)/texel)*texel;
+        float light_y = floorf(float3dot(&center, &up)/texel)*texel;
+        float light_z = float3dot(&center, &look);
+        cascade.center.x = light_x;
+        cascade.center.y = light_y;
+        cascade.center.z = light_z;
+
+        float4x4 shadow_view = {
+            { right.x, right.y, right.z, 0.0f },
+            {    up.x,    up.y,    up.z, 0.0f },
+            {  look.x,  look.y,  look.z, 0.0f },
+            { 0.0f, 0.0f, 0.0f, 1.0f }
+        };
+        shadow_view.r3.x = right.x*light_x + up.x*light_y + look.x*light_z;
+        shadow_view.r3.y = right.y*light_x + up.y*light_y + look.y*light_z;
+        shadow_view.r3.z = right.z*light_x + up.z*light_y + look.z*light_z;
+        shadow_view = float4x4inverse(&shadow_view);
+        float4x4 shadow_proj = float4x4OrthographicOffCenterLH(-radius, radius, radius, -radius,
+                                                               -radius-caster_distance, radius);
+        cascade.view_proj = float4x4multiply(&shadow_view, &shadow_proj);
+    }
+}
+int shadow_cascade_contains(const ShadowCascade* cached, const ShadowCascade* fitted) {
+    // Snapping moved the fitted center up to a texel from the slice's
+    float slack = cached->radius - fitted->fit_radius - fitted->texel;
+    return fabsf(fitted->center.x - cached->center.x) <= slack &&
+           fabsf(fitted->center.y - cached->center.y) <= slack &&
+           fabsf(fitted->center.z - cached->center.z) <= slack;
+}
@@ -0,0 +1,65 @@
+/*! @file shadow_cascades.h
+ *  @brief Cascaded shadow map splits and fitting
+ *  @author Kyle Weicht
+ *  @date 10/20/26 12:30 AM
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ *	@addtogroup shadow_cascades shadow_cascades
+ *	@{
+ */
+#ifndef __shadow_cascades_h__
+#define __shadow_cascades_h__
+
+#include <stdint.h>
+#include "vec_math.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum { kMaxShadowCascades = 4 };
+
+typedef struct {
+    float4x4    view_proj;  /*!< World to the cascade's clip space */
+    float3      center;     /*!< In the light's space, snapped to texels */
+    float       radius;     /*!< Half the width of the map in world units */
+    float       fit_radius; /*!< The bounding sphere of the slice it was fitted to */
+    float       texel;      /*!< The width of a texel in world units */
+    float       near_z;     /*!< The camera's view space depth range it covers */
+    float       far_z;
+} ShadowCascade;
+
+/*! @brief Splits [near_z, far_z] into num_cascades slices, blending a
+ *         logarithmic split with a uniform one by lambda (1 is fully
+ *         logarithmic). splits[ii] is the far end of slice ii.
+ */
+void shadow_cascade_splits(float* splits, uint32_t num_cascades, float near_z, float far_z, float lambda);
+
+/*! @brief Fits an orthographic cascade around each slice of the camera's
+ *         frustum. The cascades are bounding spheres of the slices so
+ *         they don't change size as the camera turns, and are moved in
+ *         whole texels so the shadows' edges don't crawl as it moves.
+ *  @param camera_world The camera's world matrix, +z forward
+ *  @param proj The camera's left handed perspective projection
+ *  @param light_dir The direction the light shines in
+ *  @param caster_distance How far towards the light casters are kept
+ *  @param resolution The width of one cascade's map in texels
+ *  @param margin Scales the map past the slice's bounds, so a cached map
+ *         stays usable while the camera moves a little. 1 is a tight fit.
+ */
+void build_shadow_cascades(ShadowCascade* cascades, uint32_t num_cascades,
+                           const float4x4* camera_world, const float4x4* proj,
+                           float shadow_distance, float lambda, const float3* light_dir,
+                           float caster_distance, uint32_t resolution, float margin);
+
+/*! @brief Returns non-zero if the cached cascade's map still covers the
+ *         slice the fitted one was fitted to. Both must have been built for
+ *         the same light direction.
+ */
+int shadow_cascade_contains(const ShadowCascade* cached, const ShadowCascade* fitted);
+
+#ifdef __cplusplus
+} // extern "C" {
+#endif
+
+/* @} */
+#endif /* include guard */
@@ -0,0 +1,311 @@
+/*! @file tangents.cpp
+ *  @author Kyle Weicht
+ *  @date 10/19/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "tangents.h"
+
+#include <math.h>
+#include <vector>
+#include <immintrin.h>
+#include "parallel.h"
+
+/*
+ * Internal
+ */
+namespace {
+
+enum {
+    kMinChunkTriangles = 1024*16,
+    kMinVertexGroups = 1024,        // Groups of 4 vertices per thread, at least
+    kMaxChunks = kMaxWorkerThreads
+};
+
+const float kEpsilon = 1e-12f;
+
+/* A contiguous range of triangles, accumulated into the vertices it touches.
+ * Sums are 4 floats per vertex: tan xyz, and the area weighted handedness.
+ */
+struct TangentChunk {
+    uint32_t            begin_triangle;
+    uint32_t            end_triangle;
+    uint32_t            begin_vertex;
+    uint32_t            end_vertex;
+    std::vector<float>  sums;
+};
+
+struct TangentJob {
+    const VtxPosNormTex*    src;
+    VtxPosNormTanBitanTex*  dst;
+    uint32_t                vertex_count;
+    const uint32_t*         indices;
+    TangentChunk            chunks[kMaxChunks];
+    uint32_t                num_chunks;
+};
+
+inline __m128 _dot(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz) {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+}
+/* 1/sqrt(x) to about 22 bits where `mask` is set, 0 elsewhere */
+inline __m128 _masked_rsqrt(__m128 x, __m128 mask) {
+    __m128 r = _mm_rsqrt_ps(x);
+    __m128 rx = _mm_mul_ps(_mm_mul_ps(r, r), x);
+    r = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), r), _mm_sub_ps(_mm_set1_ps(3.0f), rx));
+    return _mm_and_ps(r, mask);
+}
+
+float3 _any_perpendicular(const float3& n) {
+    float3 axis = { 1.0f, 0.0f, 0.0f };
+    if(fabsf(n.x) > 0.9f) {
+        axis.x = 0.0f;
+        axis.y = 1.0f;
+    }
+    float3 t = float3cross(&n, &axis);
+    return float3normalize(&t);
+}
+
+void _chunk_extents(void* data, uint32_t begin, uint32_t end) {
+    TangentJob* job = (TangentJob*)data;
+    for(uint32_t ii=begin; ii<end; ++ii) {
+        TangentChunk& chunk = job->chunks[ii];
+        uint32_t min = ~0u;
+        uint32_t max = 0;
+        for(uint32_t jj=chunk.begin_triangle*3; jj<chunk.end_triangle*3; ++jj) {
+            uint32_t index = job->indices[jj];
+            min = (index < min) ? index : min;
+            max = (index > max) ? index : max;
+        }
+        chunk.begin_vertex = (min <= max) ? min : 0;
+        chunk.end_vertex = (min <= max) ? max+1 : 0;
+    }
+}
+
+/* Computes the area weighted tangent of 4 triangles at a time, and adds it
+ * to the chunk's vertices along with each corner's handedness
+ */
+void _accumulate_chunks(void* data, uint32_t begin, uint32_t end) {
+    TangentJob* job = (TangentJob*)data;
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 epsilon = _mm_set1_ps(kEpsilon);
+    const __m128 sign_bit = _mm_set1_ps(-0.0f);
+    for(uint32_t ii=begin; ii<end; ++ii) {
+        TangentChunk& chunk = job->chunks[ii];
+        chunk.sums.assign((chunk.end_vertex - chunk.begin_vertex)*4, 0.0f);
+        for(uint32_t first=chunk.begin_triangle; first<chunk.end_triangle; first+=4) {
+            uint32_t lanes = chunk.end_triangle - first;
+            if(lanes > 4)
+                lanes = 4;
+            // Lanes past the end repeat the last triangle and are ignored
+            const uint32_t* triangles[4];
+            for(uint32_t lane=0; lane<4; ++lane)
+                triangles[lane] = job->indices + (first + (lane < lanes ? lane : lanes-1))*3;
+
+            __m128 px[3], py[3], pz[3], nx[3], ny[3], nz[3], u[3], v[3];
+            for(int corner=0; corner<3; ++corner) {
+                const VtxPosNormTex* v0 = job->src + triangles[0][corner];
+                const VtxPosNormTex* v1 = job->src + triangles[1][corner];
+                const VtxPosNormTex* v2 = job->src + triangles[2][corner];
+                const VtxPosNormTex* v3 = job->src + triangles[3][corner];
+                __m128 r0 = _mm_loadu_ps(&v0->pos.x), r1 = _mm_loadu_ps(&v1->pos.x);
+                __m128 r2 = _mm_loadu_ps(&v2->pos.x), r3 = _mm_loadu_ps(&v3->pos.x);
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                px[corner] = r0; py[corner] = r1; pz[corner] = r2; nx[corner] = r3;
+                // norm.y, norm.z, tex.x, tex.y
+                r0 = _mm_loadu_ps(&v0->norm.y); r1 = _mm_loadu_ps(&v1->norm.y);
+                r2 = _mm_loadu_ps(&v2->norm.y); r3 = _mm_loadu_ps(&v3->norm.y);
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                ny[corner] = r0; nz[corner] = r1; u[corner] = r2; v[corner] = r3;
+            }
+            __m128 e1x = _mm_sub_ps(px[1], px[0]), e1y = _mm_sub_ps(py[1], py[0]), e1z = _mm_sub_ps(pz[1], pz[0]);
+            __m128 e2x = _mm_sub_ps(px[2], px[0]), e2y = _mm_sub_ps(py[2], py[0]), e2z = _mm_sub_ps(pz[2], pz[0]);
+            __m128 du1 = _mm_sub_ps(u[1], u[0]), dv1 = _mm_sub_ps(v[1], v[0]);
+            __m128 du2 = _mm_sub_ps(u[2], u[0]), dv2 = _mm_sub_ps(v[2], v[0]);
+
+            // tan = (e1*dv2 - e2*dv1)/det. Only the sign of det matters, the
+            // direction gets normalized below
+            __m128 det = _mm_sub_ps(_mm_mul_ps(du1, dv2), _mm_mul_ps(dv1, du2));
+            __m128 sign = _mm_and_ps(det, sign_bit);
+            __m128 valid_uvs = _mm_cmpgt_ps(_mm_mul_ps(det, det), epsilon);
+            __m128 tx = _mm_xor_ps(_mm_sub_ps(_mm_mul_ps(e1x, dv2), _mm_mul_ps(e2x, dv1)), sign);
+            __m128 ty = _mm_xor_ps(_mm_sub_ps(_mm_mul_ps(e1y, dv2), _mm_mul_ps(e2y, dv1)), sign);
+            __m128 tz = _mm_xor_ps(_mm_sub_ps(_mm_mul_ps(e1z, dv2), _mm_mul_ps(e2z, dv1)), sign);
+
+            // Weight the unit direction by the triangle's area
+            __m128 cx = _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y));
+            __m128 cy = _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z));
+            __m128 cz = _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x));
+            __m128 area = _mm_mul_ps(_mm_sqrt_ps(_dot(cx, cy, cz, cx, cy, cz)), half);
+            __m128 t_length_sq = _dot(tx, ty, tz, tx, ty, tz);
+            __m128 t_valid = _mm_and_ps(valid_uvs, _mm_cmpgt_ps(t_length_sq, epsilon));
+            __m128 t_scale = _mm_mul_ps(area, _masked_rsqrt(t_length_sq, t_valid));
+            tx = _mm_mul_ps(tx, t_scale); ty = _mm_mul_ps(ty, t_scale); tz = _mm_mul_ps(tz, t_scale);
+
+            // The bitangent is (e2*du1 - e1*du2)/det, so cross(tan, bitan) is
+            // the face normal over det. A corner is mirrored when that points
+            // away from its vertex normal.
+            area = _mm_and_ps(_mm_xor_ps(area, sign), t_valid);
+            for(int corner=0; corner<3; ++corner) {
+                __m128 facing = _mm_and_ps(_dot(nx[corner], ny[corner], nz[corner], cx, cy, cz), sign_bit);
+                __m128 r0 = tx, r1 = ty, r2 = tz, r3 = _mm_xor_ps(area, facing);
+                // Back to one row per triangle to add into the vertices
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                __m128 rows[4] = { r0, r1, r2, r3 };
+                for(uint32_t lane=0; lane<lanes; ++lane) {
+                    float* sum = &chunk.sums[(triangles[lane][corner] - chunk.begin_vertex)*4];
+                    _mm_storeu_ps(sum, _mm_add_ps(_mm_loadu_ps(sum), rows[lane]));
+                }
+            }
+        }
+    }
+}
+
+/* One group is 4 vertices. Each vertex sums the chunks it is part of, then
+ * gets orthonormalized.
+ */
+void _vertex_frames(void* data, uint32_t begin, uint32_t end) {
+    TangentJob* job = (TangentJob*)data;
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 epsilon = _mm_set1_ps(kEpsilon);
+    for(uint32_t group=begin; group<end; ++group) {
+        uint32_t first = group*4;
+        uint32_t lanes = job->vertex_count - first;
+        if(lanes > 4)
+            lanes = 4;
+        __m128 t_rows[4], b_rows[4], n_rows[4];
+        for(uint32_t lane=0; lane<4; ++lane) {
+            t_rows[lane] = zero;
+            if(lane >= lanes) {
+                n_rows[lane] = n_rows[0];
+                continue;
+            }
+            uint32_t vertex = first + lane;
+            n_rows[lane] = _mm_loadu_ps(&job->src[vertex].norm.x);
+            for(uint32_t ii=0; ii<job->num_chunks; ++ii) {
+                const TangentChunk& chunk = job->chunks[ii];
+                if(vertex < chunk.begin_vertex || vertex >= chunk.end_vertex)
+                    continue;
+                const float* sum = &chunk.sums[(vertex - chunk.begin_vertex)*4];
+                t_rows[lane] = _mm_add_ps(t_rows[lane], _mm_loadu_ps(sum));
+            }
+        }
+        __m128 nx = n_rows[0], ny = n_rows[1], nz = n_rows[2], nw = n_rows[3];
+        __m128 tx = t_rows[0], ty = t_rows[1], tz = t_rows[2], tw = t_rows[3];
+        _MM_TRANSPOSE4_PS(nx, ny, nz, nw);
+        _MM_TRANSPOSE4_PS(tx, ty, tz, tw);
+        __m128 mirrored = _mm_cmplt_ps(tw, zero);
+
+        __m128 n_length_sq = _dot(nx, ny, nz, nx, ny, nz);
+        __m128 valid = _mm_cmpgt_ps(n_length_sq, epsilon);
+        __m128 inv_length = _masked_rsqrt(n_length_sq, valid);
+        nx = _mm_mul_ps(nx, inv_length);
+        ny = _mm_mul_ps(ny, inv_length);
+        nz = _mm_mul_ps(nz, inv_length);
+
+        // Gram-Schmidt: t = normalize(t - n*dot(n, t))
+        __m128 n_dot_t = _dot(nx, ny, nz, tx, ty, tz);
+        tx = _mm_sub_ps(tx, _mm_mul_ps(nx, n_dot_t));
+        ty = _mm_sub_ps(ty, _mm_mul_ps(ny, n_dot_t));
+        tz = _mm_sub_ps(tz, _mm_mul_ps(nz, n_dot_t));
+        __m128 t_length_sq = _dot(tx, ty, tz, tx, ty, tz);
+        valid = _mm_and_ps(valid, _mm_cmpgt_ps(t_length_sq, epsilon));
+        inv_length = _masked_rsqrt(t_length_sq, valid);
+        tx = _mm_mul_ps(tx, inv_length);
+        ty = _mm_mul_ps(ty, inv_length);
+        tz = _mm_mul_ps(tz, inv_length);
+
+        // The bitangent is rebuilt from n and t, flipped where most of the
+        // vertex's area is mirrored
+        __m128 cx = _mm_sub_ps(_mm_mul_ps(ny, tz), _mm_mul_ps(nz, ty));
+        __m128 cy = _mm_sub_ps(_mm_mul_ps(nz, tx), _mm_mul_ps(nx, tz));
+        __m128 cz = _mm_sub_ps(_mm_mul_ps(nx, ty), _mm_mul_ps(ny, tx));
+        __m128 sign = _mm_and_ps(mirrored, _mm_set1_ps(-0.0f));
+        cx = _mm_xor_ps(cx, sign);
+        cy = _mm_xor_ps(cy, sign);
+        cz = _mm_xor_ps(cz, sign);
+        __m128 cw = zero;
+        _MM_TRANSPOSE4_PS(nx, ny, nz, nw);
+        _MM_TRANSPOSE4_PS(tx, ty, tz, tw);
+        _MM_TRANSPOSE4_PS(cx, cy, cz, cw);
+        n_rows[0] = nx; n_rows[1] = ny; n_rows[2] = nz; n_rows[3] = nw;
+        t_rows[0] = tx; t_rows[1] = ty; t_rows[2] = tz; t_rows[3] = tw;
+        b_rows[0] = cx; b_rows[1] = cy; b_rows[2] = cz; b_rows[3] = cw;
+
+        int valid_mask = _mm_movemask_ps(valid);
+        for(uint32_t lane=0; lane<lanes; ++lane) {
+            const VtxPosNormTex& s = job->src[first + lane];
+            VtxPosNormTanBitanTex& d = job->dst[first + lane];
+            if(valid_mask & (1 << lane)) {
+                // Each 4 wide store spills into the next member, which is
+                // written afterwards
+                _mm_storeu_ps(&d.pos.x, _mm_loadu_ps(&s.pos.x));
+                _mm_storeu_ps(&d.norm.x, n_rows[lane]);
+                _mm_storeu_ps(&d.tan.x, t_rows[lane]);
+                _mm_storeu_ps(&d.bitan.x, b_rows[lane]);
+                d.tex = s.tex;
+            } else {
+                // No UVs or no normal, any frame will do
+                float3 n = s.norm;
+                if(float3lengthSq(&n) > kEpsilon) {
+                    n = float3normalize(&n);
+                } else {
+                    n.x = 0.0f; n.y = 1.0f; n.z = 0.0f;
+                }
+                d.pos = s.pos;
+                d.norm = n;
+                d.tan = _any_perpendicular(n);
+                d.bitan = float3cross(&n, &d.tan);
+                d.tex = s.tex;
+            }
+        }
+    }
+}
+
+}
+
+/*
+ * External
+ */
+void calculate_tangents(VtxPosNormTanBitanTex* dst, const VtxPosNormTex* src, uint32_t vertex_count,
+                        const uint32_t* indices, uint32_t index_count) {
+    TangentJob job;
+    job.src = src;
+    job.dst = dst;
+    job.vertex_count = vertex_count;
+    job.indices = indices;
+
+    // One chunk per thread, each summing into its own vertex range
+    uint32_t triangle_count = index_count/3;
+    uint32_t num_chunks = hardware_thread_count();
+    if(num_chunks > triangle_count/kMinChunkTriangles)
+        num_chunks = triangle_count/kMinChunkTriangles;
+    if(num_chunks > kMaxChunks)
+        num_chunks = kMaxChunks;
+    if(num_chunks == 0)
+        num_chunks = 1;
+    uint32_t batch = (triangle_count + num_chunks-1)/num_chunks;
+    for(uint32_t ii=0; ii<num_chunks; ++ii) {
+        job.chunks[ii].begin_triangle = ii*batch;
+        job.chunks[ii].end_triangle = (ii == num_chunks-1) ? triangle_count : (ii+1)*batch;
+    }
+    job.num_chunks = num_chunks;
+    if(num_chunks == 1) {
+        job.chunks[0].begin_vertex = 0;
+        job.chunks[0].end_vertex = vertex_count;
+    } else {
+        parallel_for(_chunk_extents, &job, num_chunks, 1);
+    }
+
+    // Vertex fetch optimized meshes give mostly disjoint ranges. Scattered
+    // meshes would need a full copy of the vertices per chunk instead.
+    uint64_t total_extent = 0;
+    for(uint32_t ii=0; ii<num_chunks; ++ii)
+        total_extent += job.chunks[ii].end_vertex - job.chunks[ii].begin_vertex;
+    if(num_chunks > 1 && total_extent > (uint64_t)vertex_count*2) {
+        job.chunks[0].end_triangle = triangle_count;
+        job.chunks[0].begin_vertex = 0;
+        job.chunks[0].end_vertex = vertex_count;
+        job.num_chunks = 1;
+    }
+    parallel_for(_accumulate_chunks, &job, job.num_chunks, 1);
+    parallel_for(_vertex_frames, &job, (vertex_count+3)/4, kMinVertexGroups);
+}
@@ -0,0 +1,25 @@
+/*! @file tangents.h
+ *  @brief Tangent frame generation for normal mapping
+ *  @author Kyle Weicht
+ *  @date 10/19/26 10:20 PM
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ *	@addtogroup tangents tangents
+ *	@{
+ */
+#ifndef __tangents_h__
+#define __tangents_h__
+
+#include <stdint.h>
+#include "render.h"
+
+/*! @brief Fills in `dst` with orthonormal tangent frames. Each vertex gets
+ *         the area weighted average of its triangles' UV directions,
+ *         Gram-Schmidt orthogonalized against the normal. The bitangent is
+ *         cross(norm, tan), negated where the UVs are mirrored.
+ *         Runs in parallel, with 4 triangles/vertices per SSE operation.
+ */
+void calculate_tangents(VtxPosNormTanBitanTex* dst, const VtxPosNormTex* src, uint32_t vertex_count,
+                        const uint32_t* indices, uint32_t index_count);
+
+/* @} */
+#endif /* include guard */
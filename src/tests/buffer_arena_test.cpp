@@ -0,0 +1,81 @@
+/*! @file buffer_arena_test.cpp
+ *  @author Kyle Weicht
+ *  @date 10/20/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "unit_test.h"
+#include "buffer_arena.h"
+
+namespace {
+
+TEST(ArenaAllocsAlignedAndDisjoint)
+{
+    BufferArena arena;
+    buffer_arena_init(&arena, 1000);
+    uint32_t offsets[4];
+    const uint32_t sizes[4] = { 6, 30, 2, 100 };
+    for(int ii=0; ii<4; ++ii) {
+        CHECK_TRUE(buffer_arena_alloc(&arena, sizes[ii], 4, &offsets[ii]));
+        CHECK_EQUAL(0u, offsets[ii] % 4);
+        CHECK_LESS_THAN_EQUAL(offsets[ii] + sizes[ii], 1000u);
+        for(int jj=0; jj<ii; ++jj)
+            CHECK_TRUE(offsets[ii] >= offsets[jj] + sizes[jj] || offsets[jj] >= offsets[ii] + sizes[ii]);
+    }
+    uint32_t offset;
+    CHECK_FALSE(buffer_arena_alloc(&arena, 1000, 1, &offset));
+}
+
+TEST(ArenaFreeMergesNeighbors)
+{
+    BufferArena arena;
+    buffer_arena_init(&arena, 300);
+    uint32_t a, b, c;
+    CHECK_TRUE(buffer_arena_alloc(&arena, 100, 1, &a));
+    CHECK_TRUE(buffer_arena_alloc(&arena, 100, 1, &b));
+    CHECK_TRUE(buffer_arena_alloc(&arena, 100, 1, &c));
+    CHECK_EQUAL(0u, arena.num_free);
+
+    buffer_arena_free(&arena, a, 100);
+    buffer_arena_free(&arena, c, 100);
+    CHECK_EQUAL(2u, arena.num_free);
+    CHECK_EQUAL(100u, buffer_arena_largest_free(&arena));
+
+    buffer_arena_free(&arena, b, 100);
+    CHECK_EQUAL(1u, arena.num_free);
+    CHECK_EQUAL(300u, buffer_arena_largest_free(&arena));
+}
+
+TEST(ArenaGrowExtendsTheLastRange)
+{
+    BufferArena arena;
+    buffer_arena_init(&arena, 100);
+    uint32_t a, b;
+    CHECK_TRUE(buffer_arena_alloc(&arena, 60, 1, &a));
+    CHECK_FALSE(buffer_arena_alloc(&arena, 60, 1, &b));
+
+    buffer_arena_grow(&arena, 200);
+    CHECK_EQUAL(1u, arena.num_free);
+    CHECK_TRUE(buffer_arena_alloc(&arena, 140, 1, &b));
+    CHECK_EQUAL(60u, b);
+}
+
+TEST(ArenaGrowKeepsTheNewSpaceWhenFull)
+{
+    // Every other unit allocated leaves as many free ranges as fit
+    BufferArena arena;
+    buffer_arena_init(&arena, kArenaMaxFreeRanges*2);
+    uint32_t offsets[kArenaMaxFreeRanges*2];
+    for(uint32_t ii=0; ii<kArenaMaxFreeRanges*2; ++ii)
+        CHECK_TRUE(buffer_arena_alloc(&arena, 1, 1, &offsets[ii]));
+    for(uint32_t ii=0; ii<kArenaMaxFreeRanges*2; ii+=2)
+        buffer_arena_free(&arena, offsets[ii], 1);
+    CHECK_EQUAL((uint32_t)kArenaMaxFreeRanges, arena.num_free);
+
+    uint32_t offset;
+    buffer_arena_grow(&arena, kArenaMaxFreeRanges*2 + 100);
+    CHECK_EQUAL((uint32_t)kArenaMaxFreeRanges, arena.num_free);
+    CHECK_TRUE(buffer_arena_alloc(&arena, 100, 1, &offset));
+    CHECK_EQUAL(kArenaMaxFreeRanges*2u, offset);
+}
+
+} // anonymous namespace
@@ -0,0 +1,198 @@
+/*! @file culling_test.cpp
+ *  @author Kyle Weicht
+ *  @date 10/19/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "unit_test.h"
+#include "culling.h"
+#include "mesh_optimizer.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+
+namespace {
+
+struct FrustumFixture {
+    FrustumFixture() {
+        // Camera at the origin looking down +Z
+        float4x4 proj = float4x4PerspectiveFovLH(DegToRad(90.0f), 1.0f, 0.1f, 100.0f);
+        frustum_from_matrix(&frustum, &proj);
+    }
+    ~FrustumFixture() {
+    }
+    MeshletBounds meshlet(float x, float y, float z, float axis_z) {
+        MeshletBounds b = { { x, y, z }, 1.0f, { 0.0f, 0.0f, axis_z }, 0.1f };
+        return b;
+    }
+    /* A closed sphere, big enough to be split into meshlets like the sky.
+     * Its faces point out and its poles are on the Z axis, so the meshlets
+     * around them face toward the camera or away from it.
+     */
+    void build_sphere(const float3& center, float radius) {
+        enum { kRings = 48, kSegments = 48 };
+        positions.clear();
+        indices.clear();
+        for(int ring=0; ring<=kRings; ++ring) {
+            float theta = ring*kPi/kRings;
+            for(int segment=0; segment<kSegments; ++segment) {
+                float phi = segment*2.0f*kPi/kSegments;
+                float3 p = { center.x + radius*sinf(theta)*cosf(phi), center.y + radius*sinf(theta)*sinf(phi),
+                             center.z + radius*cosf(theta) };
+                positions.push_back(p);
+            }
+        }
+        for(int ring=0; ring<kRings; ++ring) {
+            for(int segment=0; segment<kSegments; ++segment) {
+                uint32_t i0 = ring*kSegments + segment;
+                uint32_t i1 = ring*kSegments + (segment+1)%kSegments;
+                uint32_t quad[] = { i0, i0+kSegments, i1, i1, i0+kSegments, i1+kSegments };
+                indices.insert(indices.end(), quad, quad+6);
+            }
+        }
+        std::vector<uint32_t> optimized(indices.size());
+        optimize_vertex_cache(&optimized[0], &indices[0], (uint32_t)indices.size(), (uint32_t)positions.size());
+        indices.swap(optimized);
+        sphere_meshlets.resize(meshlet_count_bound((uint32_t)indices.size(), kMeshletMaxVertices, kMeshletMaxTriangles));
+        sphere_meshlets.resize(build_meshlets(&sphere_meshlets[0], &indices[0], (uint32_t)indices.size(),
+                                              (uint32_t)positions.size(), kMeshletMaxVertices, kMeshletMaxTriangles));
+        sphere_bounds.resize(sphere_meshlets.size());
+        for(size_t ii=0; ii<sphere_meshlets.size(); ++ii) {
+            const Meshlet& meshlet = sphere_meshlets[ii];
+            sphere_bounds[ii] = compute_meshlet_bounds(&indices[meshlet.index_offset], meshlet.triangle_count,
+                                                       &positions[0], sizeof(float3));
+        }
+    }
+    /* How many meshlets the frustum alone keeps */
+    uint32_t in_frustum(void) {
+        uint32_t count = 0;
+        for(size_t ii=0; ii<sphere_bounds.size(); ++ii)
+            count += sphere_in_frustum(&frustum, &sphere_bounds[ii].center, sphere_bounds[ii].radius) ? 1 : 0;
+        return count;
+    }
+    /* Whether any of a meshlet's triangles faces the camera at the origin */
+    bool front_facing(const Meshlet& meshlet) {
+        for(uint32_t ii=0; ii<meshlet.triangle_count; ++ii) {
+            const uint32_t* tri = &indices[meshlet.index_offset + ii*3];
+            float3 e0 = float3subtract(&positions[tri[1]], &positions[tri[0]]);
+            float3 e1 = float3subtract(&positions[tri[2]], &positions[tri[0]]);
+            float3 normal = float3cross(&e0, &e1);
+            if(float3dot(&positions[tri[0]], &normal) < 0.0f)
+                return true;
+        }
+        return false;
+    }
+
+    std::vector<float3>         positions;
+    std::vector<uint32_t>       indices;
+    std::vector<Meshlet>        sphere_meshlets;
+    std::vector<MeshletBounds>  sphere_bounds;
+
+    Frustum frustum;
+};
+
+TEST_FIXTURE(FrustumFixture, SphereInFrustum)
+{
+    float3 in_front = { 0.0f, 0.0f, 10.0f };
+    float3 behind = { 0.0f, 0.0f, -10.0f };
+    float3 left = { -20.0f, 0.0f, 10.0f };
+    float3 straddling = { -10.5f, 0.0f, 10.0f };
+    float3 too_far = { 0.0f, 0.0f, 200.0f };
+    CHECK_TRUE(sphere_in_frustum(&frustum, &in_front, 1.0f));
+    CHECK_FALSE(sphere_in_frustum(&frustum, &behind, 1.0f));
+    CHECK_FALSE(sphere_in_frustum(&frustum, &left, 1.0f));
+    CHECK_TRUE(sphere_in_frustum(&frustum, &straddling, 1.0f));
+    CHECK_FALSE(sphere_in_frustum(&frustum, &too_far, 1.0f));
+}
+TEST_FIXTURE(FrustumFixture, CullSpheresMatchesSphereInFrustum)
+{
+    // Not a multiple of 4, so both the SIMD and the scalar path run
+    enum { kCount = 1003 };
+    float x[kCount], y[kCount], z[kCount], radius[kCount];
+    srand(7);
+    for(int ii=0; ii<kCount; ++ii) {
+        x[ii] = rand()/(float)RAND_MAX*200.0f - 100.0f;
+        y[ii] = rand()/(float)RAND_MAX*200.0f - 100.0f;
+        z[ii] = rand()/(float)RAND_MAX*200.0f - 50.0f;
+        radius[ii] = rand()/(float)RAND_MAX*5.0f;
+    }
+    uint32_t visible[kCount];
+    uint32_t count = cull_spheres(visible, x, y, z, radius, kCount, &frustum);
+    CHECK_LESS_THAN(0u, count);
+    CHECK_LESS_THAN(count, (uint32_t)kCount);
+
+    uint32_t next = 0;
+    for(uint32_t ii=0; ii<kCount; ++ii) {
+        float3 center = { x[ii], y[ii], z[ii] };
+        if(sphere_in_frustum(&frustum, &center, radius[ii])) {
+            CHECK_EQUAL(ii, visible[next]);
+            ++next;
+        }
+    }
+    CHECK_EQUAL(count, next);
+}
+TEST_FIXTURE(FrustumFixture, CullMeshlets)
+{
+    // Enough to use both the SIMD and the scalar path
+    MeshletBounds bounds[] = {
+        meshlet(0.0f, 0.0f, 10.0f, -1.0f),  // Facing the camera
+        meshlet(0.0f, 0.0f, 10.0f, 1.0f),   // Facing away
+        meshlet(0.0f, 0.0f, -10.0f, -1.0f), // Behind
+        meshlet(5.0f, 5.0f, 20.0f, -1.0f),
+        meshlet(50.0f, 0.0f, 10.0f, -1.0f), // Outside
+        meshlet(0.0f, -5.0f, 30.0f, 1.0f),  // Facing away
+        meshlet(0.0f, 5.0f, 30.0f, -1.0f),
+    };
+    uint32_t visible[7];
+    float3 camera = { 0.0f, 0.0f, 0.0f };
+    uint32_t count = cull_meshlets(visible, bounds, 7, &frustum, &camera);
+    CHECK_EQUAL(3, count);
+    CHECK_EQUAL(0, visible[0]);
+    CHECK_EQUAL(3, visible[1]);
+    CHECK_EQUAL(6, visible[2]);
+
+    // A wide cone is never backface culled
+    bounds[1].cone_cutoff = 1.0f;
+    bounds[5].cone_cutoff = 1.0f;
+    count = cull_meshlets(visible, bounds, 7, &frustum, &camera);
+    CHECK_EQUAL(5, count);
+}
+
+TEST_FIXTURE(FrustumFixture, MeshletConesFromInsideAClosedMesh)
+{
+    // At the center and off it, like the camera in the sky
+    const float3 camera = float3zero;
+    const float3 centers[] = { { 0.0f, 0.0f, 0.0f }, { 3.0f, -2.0f, 4.0f } };
+    for(int ii=0; ii<2; ++ii) {
+        build_sphere(centers[ii], 10.0f);
+        CHECK_FALSE(meshlet_cones_usable(&camera, &centers[ii], 10.0f));
+
+        // Every meshlet in view is seen from behind, the cones would cull some
+        std::vector<uint32_t> visible(sphere_bounds.size());
+        uint32_t with_cones = cull_meshlets(&visible[0], &sphere_bounds[0], (uint32_t)sphere_bounds.size(), &frustum, &camera);
+        uint32_t without = cull_meshlets(&visible[0], &sphere_bounds[0], (uint32_t)sphere_bounds.size(), &frustum, NULL);
+        CHECK_EQUAL(in_frustum(), without);
+        CHECK_LESS_THAN(with_cones, without);
+    }
+}
+TEST_FIXTURE(FrustumFixture, MeshletConesFromOutsideAClosedMesh)
+{
+    const float3 camera = float3zero;
+    const float3 center = { 0.0f, 0.0f, 40.0f };
+    build_sphere(center, 10.0f);
+    CHECK_TRUE(meshlet_cones_usable(&camera, &center, 10.0f));
+
+    // Only meshlets with no triangle facing the camera are culled
+    std::vector<uint32_t> visible(sphere_bounds.size());
+    uint32_t count = cull_meshlets(&visible[0], &sphere_bounds[0], (uint32_t)sphere_bounds.size(), &frustum, &camera);
+    CHECK_LESS_THAN(count, in_frustum());
+    std::vector<bool> kept(sphere_bounds.size(), false);
+    for(uint32_t ii=0; ii<count; ++ii)
+        kept[visible[ii]] = true;
+    for(size_t ii=0; ii<sphere_bounds.size(); ++ii) {
+        if(!kept[ii])
+            CHECK_FALSE(front_facing(sphere_meshlets[ii]));
+    }
+}
+
+} // anonymous namespace
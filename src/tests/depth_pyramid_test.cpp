@@ -0,0 +1,59 @@
+/*! @file depth_pyramid_test.cpp
+ *  @author Kyle Weicht
+ *  @date 10/20/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "unit_test.h"
+#include "depth_pyramid.h"
+
+#include <vector>
+
+namespace {
+
+// A wall at depth 0.5 over the left half of the screen, nothing on the right
+struct HalfWall {
+    HalfWall() : depth(64*32) {
+        for(uint32_t y=0; y<32; ++y) {
+            for(uint32_t x=0; x<64; ++x)
+                depth[y*64 + x] = (x < 32) ? 0.5f : 1.0f;
+        }
+        view_proj = float4x4PerspectiveFovLH(DegToRad(90.0f), 2.0f, 1.0f, 100.0f);
+        texels.resize(depth_pyramid_texels(64, 32));
+        depth_pyramid_build(&pyramid, &texels[0], &depth[0], 64, 32, &view_proj);
+    }
+    std::vector<float>  depth;
+    std::vector<float>  texels;
+    float4x4        view_proj;
+    DepthPyramid    pyramid;
+};
+
+TEST(PyramidLevelsKeepTheFarthestDepth)
+{
+    HalfWall wall;
+    const DepthPyramid& pyramid = wall.pyramid;
+    CHECK_EQUAL(7u, pyramid.num_levels);
+    CHECK_EQUAL(1u, pyramid.widths[6]);
+    CHECK_EQUAL(1u, pyramid.heights[6]);
+    CHECK_EQUAL_FLOAT(1.0f, pyramid.texels[pyramid.offsets[6]]);
+    // Level 1 texels over the wall only see the wall
+    CHECK_EQUAL_FLOAT(0.5f, pyramid.texels[pyramid.offsets[1]]);
+    CHECK_EQUAL_FLOAT(1.0f, pyramid.texels[pyramid.offsets[1] + 31]);
+}
+
+TEST(PyramidOccludesOnlyWhatsBehind)
+{
+    HalfWall wall;
+    float3 behind = { -3.0f, 0.0f, 20.0f };
+    float3 beside = { 3.0f, 0.0f, 20.0f };
+    float3 in_front = { -0.5f, 0.0f, 1.5f };
+    float3 at_camera = { -3.0f, 0.0f, 1.0f };
+    CHECK_TRUE(depth_pyramid_occluded(&wall.pyramid, &behind, 1.0f));
+    CHECK_FALSE(depth_pyramid_occluded(&wall.pyramid, &beside, 1.0f));
+    CHECK_FALSE(depth_pyramid_occluded(&wall.pyramid, &in_front, 0.2f));
+    CHECK_FALSE(depth_pyramid_occluded(&wall.pyramid, &at_camera, 0.5f));
+
+    // Big enough to poke out past the wall's edge
+    CHECK_FALSE(depth_pyramid_occluded(&wall.pyramid, &behind, 5.0f));
+}
+
+} // anonymous namespace
@@ -0,0 +1,154 @@
+/*! @file light_clusters_test.cpp
+ *  @author Kyle Weicht
+ *  @date 10/19/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "unit_test.h"
+#include "light_clusters.h"
+
+#include <stdlib.h>
+#include <vector>
+
+namespace {
+
+struct ClusterFixture {
+    ClusterFixture()
+        : clusters(kNumClusters)
+        , indices(1024*64)
+    {
+        // Camera at the origin looking down +Z
+        proj = float4x4PerspectiveFovLH(DegToRad(60.0f), 16.0f/9.0f, 0.1f, 10000.0f);
+        view = float4x4identity;
+        cluster_frustum_from_projection(&frustum, &proj, 500.0f);
+    }
+    ~ClusterFixture() {
+    }
+    uint32_t build(const float4* spheres, uint32_t count) {
+        return build_light_clusters(&clusters[0], &indices[0], (uint32_t)indices.size(),
+                                    spheres, count, &view, &frustum);
+    }
+    bool listed(uint32_t cluster, uint32_t light) {
+        const LightCluster& c = clusters[cluster];
+        for(uint32_t ii=0; ii<c.count; ++ii) {
+            if(indices[c.offset+ii] == light)
+                return true;
+        }
+        return false;
+    }
+    // The cluster a view space point is in, the same way the shader finds it
+    uint32_t cluster_of(float x, float y, float z) {
+        float ndc_x = x*proj.r0.x/z;
+        float ndc_y = y*proj.r1.y/z;
+        uint32_t tile_x = (uint32_t)((ndc_x*0.5f + 0.5f)*kClusterTilesX);
+        uint32_t tile_y = (uint32_t)((ndc_y*0.5f + 0.5f)*kClusterTilesY);
+        return cluster_index(tile_x, tile_y, cluster_slice(&frustum, z));
+    }
+
+    float4x4    proj;
+    float4x4    view;
+    ClusterFrustum  frustum;
+    std::vector<LightCluster>   clusters;
+    std::vector<uint32_t>       indices;
+};
+
+TEST_FIXTURE(ClusterFixture, ClusterFrustumFromProjection)
+{
+    CHECK_EQUAL_FLOAT(0.1f, frustum.near_z);
+    CHECK_EQUAL_FLOAT(proj.r0.x, frustum.scale_x);
+    CHECK_EQUAL_FLOAT(proj.r1.y, frustum.scale_y);
+}
+
+TEST_FIXTURE(ClusterFixture, ClusterSlicesAreMonotonic)
+{
+    CHECK_EQUAL(0u, cluster_slice(&frustum, -5.0f));
+    CHECK_EQUAL(0u, cluster_slice(&frustum, 0.1f));
+    CHECK_EQUAL((uint32_t)kClusterSlices-1, cluster_slice(&frustum, 500.0f));
+    CHECK_EQUAL((uint32_t)kClusterSlices-1, cluster_slice(&frustum, 1e9f));
+    uint32_t previous = 0;
+    for(float z=0.1f; z<600.0f; z *= 1.05f) {
+        uint32_t slice = cluster_slice(&frustum, z);
+        CHECK_LESS_THAN_EQUAL(previous, slice);
+        previous = slice;
+    }
+}
+
+TEST_FIXTURE(ClusterFixture, LightsLandInTheirClusters)
+{
+    float4 spheres[] = {
+        { 0.0f, 0.0f, 20.0f, 1.0f },    // Straight ahead
+        { 0.0f, 0.0f, -20.0f, 1.0f },   // Behind
+        { 0.0f, 0.0f, 0.0f, 2.0f },     // Around the camera
+        { 200.0f, 0.0f, 20.0f, 1.0f },  // Off to the side
+    };
+    uint32_t count = build(spheres, 4);
+    CHECK_LESS_THAN(0u, count);
+
+    uint32_t ahead = cluster_of(0.0f, 0.0f, 20.0f);
+    CHECK_TRUE(listed(ahead, 0));
+    CHECK_FALSE(listed(cluster_index(0, 0, cluster_slice(&frustum, 20.0f)), 0));
+    CHECK_FALSE(listed(cluster_of(0.0f, 0.0f, 100.0f), 0));
+    for(uint32_t ii=0; ii<kNumClusters; ++ii) {
+        CHECK_FALSE(listed(ii, 1));
+        CHECK_FALSE(listed(ii, 3));
+    }
+    // Every tile of the first slice sees the light the camera is in
+    for(uint32_t y=0; y<kClusterTilesY; ++y) {
+        for(uint32_t x=0; x<kClusterTilesX; ++x)
+            CHECK_TRUE(listed(cluster_index(x, y, 0), 2));
+    }
+}
+
+TEST_FIXTURE(ClusterFixture, ClustersAreConservative)
+{
+    // Not a multiple of 4, so the padded group is used
+    enum { kNumLights = 99 };
+    float4 spheres[kNumLights];
+    srand(11);
+    for(int ii=0; ii<kNumLights; ++ii) {
+        spheres[ii].x = rand()/(float)RAND_MAX*60.0f - 30.0f;
+        spheres[ii].y = rand()/(float)RAND_MAX*40.0f - 20.0f;
+        spheres[ii].z = rand()/(float)RAND_MAX*80.0f - 5.0f;
+        spheres[ii].w = rand()/(float)RAND_MAX*6.0f + 0.5f;
+    }
+    build(spheres, kNumLights);
+
+    // Any visible point inside a light must find it in its cluster
+    for(int ii=0; ii<kNumLights; ++ii) {
+        for(int jj=0; jj<64; ++jj) {
+            float x = rand()/(float)RAND_MAX*2.0f - 1.0f;
+            float y = rand()/(float)RAND_MAX*2.0f - 1.0f;
+            float z = rand()/(float)RAND_MAX*2.0f - 1.0f;
+            float r = spheres[ii].w*0.99f;
+            x = spheres[ii].x + x*r;
+            y = spheres[ii].y + y*r;
+            z = spheres[ii].z + z*r;
+            float3 d = { x - spheres[ii].x, y - spheres[ii].y, z - spheres[ii].z };
+            if(float3lengthSq(&d) > r*r || z < 0.2f)
+                continue;
+            float ndc_x = x*proj.r0.x/z;
+            float ndc_y = y*proj.r1.y/z;
+            if(ndc_x <= -1.0f || ndc_x >= 1.0f || ndc_y <= -1.0f || ndc_y >= 1.0f)
+                continue;
+            CHECK_TRUE(listed(cluster_of(x, y, z), (uint32_t)ii));
+        }
+    }
+}
+
+TEST_FIXTURE(ClusterFixture, IndicesAreCapped)
+{
+    float4 spheres[8];
+    for(int ii=0; ii<8; ++ii) {
+        float4 s = { 0.0f, 0.0f, 0.0f, 100.0f };
+        spheres[ii] = s;
+    }
+    uint32_t total = build_light_clusters(&clusters[0], &indices[0], 100, spheres, 8, &view, &frustum);
+    CHECK_EQUAL(100u, total);
+    uint32_t sum = 0;
+    for(uint32_t ii=0; ii<kNumClusters; ++ii) {
+        CHECK_LESS_THAN_EQUAL(clusters[ii].offset + clusters[ii].count, 100u);
+        sum += clusters[ii].count;
+    }
+    CHECK_EQUAL(100u, sum);
+}
+
+} // anonymous namespace
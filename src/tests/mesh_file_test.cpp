@@ -0,0 +1,125 @@
+/*! @file mesh_file_test.cpp
+ *  @author Kyle Weicht
+ *  @date 10/19/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "unit_test.h"
+#include "mesh_file.h"
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+namespace {
+
+/* A bumpy grid, big enough to get LODs and meshlets */
+struct CookedGridFixture {
+    enum { kSize = 80 };
+
+    CookedGridFixture() {
+        std::vector<VtxPosNormTex> vertices;
+        std::vector<uint32_t> indices;
+        for(int y=0; y<=kSize; ++y) {
+            for(int x=0; x<=kSize; ++x) {
+                VtxPosNormTex v = {
+                    { (float)x, sinf(x*0.3f)*cosf(y*0.2f), (float)y },
+                    { 0.0f, 1.0f, 0.0f },
+                    { x/(float)kSize, y/(float)kSize }
+                };
+                vertices.push_back(v);
+            }
+        }
+        for(int y=0; y<kSize; ++y) {
+            for(int x=0; x<kSize; ++x) {
+                uint32_t i0 = y*(kSize+1) + x;
+                uint32_t quad[] = { i0, i0+kSize+1, i0+1, i0+1, i0+kSize+1, i0+kSize+2 };
+                indices.insert(indices.end(), quad, quad+6);
+            }
+        }
+        cook_mesh(&cooked, (uint32_t)vertices.size(), kVtxPosNormTex, (uint32_t)indices.size(), sizeof(uint32_t),
+                  &vertices[0], &indices[0]);
+        serialize_mesh_file(&file_data, &cooked.data);
+    }
+    ~CookedGridFixture() {
+    }
+    MeshFileHeader* header(void) {
+        return (MeshFileHeader*)&file_data[0];
+    }
+
+    CookedMesh          cooked;
+    std::vector<char>   file_data;
+};
+
+TEST_FIXTURE(CookedGridFixture, MeshFileRoundTrip)
+{
+    const MeshData& original = cooked.data;
+    CHECK_EQUAL(kVtxPackedPosNormTanTex, original.vertex_type);
+    CHECK_LESS_THAN(1u, original.num_lods);
+    CHECK_LESS_THAN(0u, original.num_meshlets);
+    CHECK_LESS_THAN(0u, original.position_count);
+    CHECK_EQUAL(0u, (uint32_t)file_data.size() % kMeshFileAlignment);
+
+    MeshData mesh;
+    CHECK_TRUE(read_mesh_file(&mesh, &file_data[0], file_data.size()));
+    CHECK_EQUAL(original.vertex_type, mesh.vertex_type);
+    CHECK_EQUAL(original.vertex_count, mesh.vertex_count);
+    CHECK_EQUAL(original.index_count, mesh.index_count);
+    CHECK_EQUAL(original.position_count, mesh.position_count);
+    CHECK_EQUAL(original.num_lods, mesh.num_lods);
+    CHECK_EQUAL(original.num_meshlets, mesh.num_meshlets);
+    CHECK_EQUAL_FLOAT(original.radius, mesh.radius);
+    CHECK_TRUE(memcmp(&original.dequantize, &mesh.dequantize, sizeof(float4x4)) == 0);
+    CHECK_TRUE(memcmp(original.lods, mesh.lods, sizeof(mesh.lods)) == 0);
+
+    // Every stream points straight into the file, aligned for upload
+    const void* streams[] = { mesh.vertices, mesh.indices, mesh.positions, mesh.position_indices,
+                              mesh.meshlets, mesh.meshlet_bounds };
+    for(int ii=0; ii<6; ++ii) {
+        size_t offset = (const char*)streams[ii] - &file_data[0];
+        CHECK_LESS_THAN(offset, file_data.size());
+        CHECK_EQUAL(0u, (uint32_t)offset % kMeshFileAlignment);
+    }
+    CHECK_TRUE(memcmp(original.vertices, mesh.vertices, mesh.vertex_count*kVertexSizes[mesh.vertex_type]) == 0);
+    CHECK_TRUE(memcmp(original.indices, mesh.indices, mesh.index_count*mesh.index_size) == 0);
+    CHECK_TRUE(memcmp(original.positions, mesh.positions, mesh.position_count*sizeof(VtxPackedPos)) == 0);
+    CHECK_TRUE(memcmp(original.position_indices, mesh.position_indices, mesh.index_count*mesh.index_size) == 0);
+    CHECK_TRUE(memcmp(original.meshlet_bounds, mesh.meshlet_bounds, mesh.num_meshlets*sizeof(MeshletBounds)) == 0);
+}
+TEST_FIXTURE(CookedGridFixture, MeshFileRejectsBadData)
+{
+    MeshData mesh;
+    CHECK_FALSE(read_mesh_file(&mesh, &file_data[0], file_data.size()-kMeshFileAlignment));
+
+    header()->version = 1;
+    CHECK_FALSE(read_mesh_file(&mesh, &file_data[0], file_data.size()));
+    header()->version = kMeshFileVersion;
+
+    header()->lods[1].index_count = header()->index_count;
+    CHECK_FALSE(read_mesh_file(&mesh, &file_data[0], file_data.size()));
+    header()->lods[1] = cooked.data.lods[1];
+
+    uint32_t* indices = (uint32_t*)&file_data[header()->indices.offset];
+    indices[7] = header()->vertex_count;
+    CHECK_FALSE(read_mesh_file(&mesh, &file_data[0], file_data.size()));
+    indices[7] = 0;
+    CHECK_TRUE(read_mesh_file(&mesh, &file_data[0], file_data.size()));
+}
+TEST_FIXTURE(CookedGridFixture, MeshFileRejectsWrappingCounts)
+{
+    // 0x55555556 triangles is 2 indices in 32 bits
+    MeshData mesh;
+    Meshlet* meshlets = (Meshlet*)&file_data[header()->meshlets.offset];
+    Meshlet meshlet = meshlets[0];
+    meshlets[0].triangle_count = 0x55555556u;
+    CHECK_FALSE(read_mesh_file(&mesh, &file_data[0], file_data.size()));
+    meshlets[0] = meshlet;
+
+    // A count whose chunk size is the real one's in 32 bits
+    uint32_t num_meshlets = header()->num_meshlets;
+    header()->num_meshlets = num_meshlets + 0x40000000u;
+    CHECK_FALSE(read_mesh_file(&mesh, &file_data[0], file_data.size()));
+    header()->num_meshlets = num_meshlets;
+    CHECK_TRUE(read_mesh_file(&mesh, &file_data[0], file_data.size()));
+}
+
+} // anonymous namespace
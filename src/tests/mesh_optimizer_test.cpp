@@ -0,0 +1,195 @@
+/*! @file mesh_optimizer_test.cpp
+ *  @author Kyle Weicht
+ *  @date 10/19/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "unit_test.h"
+#include "mesh_optimizer.h"
+#include "vec_math.h"
+
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+namespace {
+
+struct GridFixture {
+    enum { kSize = 64 };
+
+    GridFixture() {
+        for(int y=0; y<=kSize; ++y) {
+            for(int x=0; x<=kSize; ++x) {
+                float3 p = { (float)x, 0.0f, (float)y };
+                positions.push_back(p);
+            }
+        }
+        for(int y=0; y<kSize; ++y) {
+            for(int x=0; x<kSize; ++x) {
+                uint32_t i0 = y*(kSize+1) + x;
+                uint32_t i1 = i0 + 1;
+                uint32_t i2 = i0 + (kSize+1);
+                uint32_t i3 = i2 + 1;
+                uint32_t quad[] = { i0, i2, i1, i1, i2, i3 };
+                indices.insert(indices.end(), quad, quad+6);
+            }
+        }
+        // Scramble the triangle order to simulate an unoptimized mesh
+        srand(42);
+        uint32_t triangle_count = (uint32_t)indices.size()/3;
+        for(uint32_t ii=triangle_count-1; ii>0; --ii) {
+            uint32_t jj = rand() % (ii+1);
+            for(int kk=0; kk<3; ++kk)
+                std::swap(indices[ii*3+kk], indices[jj*3+kk]);
+        }
+    }
+    ~GridFixture() {
+    }
+    std::vector<uint32_t> sorted_triangles(const std::vector<uint32_t>& i) {
+        std::vector<uint32_t> tris;
+        for(size_t ii=0; ii<i.size(); ii+=3) {
+            uint32_t t[3] = { i[ii], i[ii+1], i[ii+2] };
+            // Rotate so the smallest index is first, preserving winding
+            while(t[0] > t[1] || t[0] > t[2]) {
+                uint32_t tmp = t[0]; t[0] = t[1]; t[1] = t[2]; t[2] = tmp;
+            }
+            tris.push_back((t[0] << 20) ^ (t[1] << 10) ^ t[2]);
+        }
+        std::sort(tris.begin(), tris.end());
+        return tris;
+    }
+
+    std::vector<float3>     positions;
+    std::vector<uint32_t>   indices;
+};
+
+TEST(AnalyzeSingleTriangle)
+{
+    uint32_t indices[] = { 0, 1, 2 };
+    VertexCacheStats stats = analyze_vertex_cache(indices, 3, 3, kVertexCacheSize);
+    CHECK_EQUAL_FLOAT(3.0f, stats.acmr);
+    CHECK_EQUAL_FLOAT(1.0f, stats.atvr);
+}
+TEST(AnalyzeSharedVertices)
+{
+    uint32_t indices[] = { 0, 1, 2, 2, 1, 3 };
+    VertexCacheStats stats = analyze_vertex_cache(indices, 6, 4, kVertexCacheSize);
+    CHECK_EQUAL_FLOAT(2.0f, stats.acmr);
+    CHECK_EQUAL_FLOAT(1.0f, stats.atvr);
+}
+TEST_FIXTURE(GridFixture, VertexCacheImprovesACMR)
+{
+    uint32_t vertex_count = (uint32_t)positions.size();
+    uint32_t index_count = (uint32_t)indices.size();
+    VertexCacheStats before = analyze_vertex_cache(&indices[0], index_count, vertex_count, kVertexCacheSize);
+
+    std::vector<uint32_t> optimized(index_count);
+    optimize_vertex_cache(&optimized[0], &indices[0], index_count, vertex_count);
+    VertexCacheStats after = analyze_vertex_cache(&optimized[0], index_count, vertex_count, kVertexCacheSize);
+
+    CHECK_LESS_THAN_FLOAT(after.acmr, before.acmr);
+    CHECK_LESS_THAN_FLOAT(after.acmr, 0.8f);
+    CHECK_TRUE(sorted_triangles(indices) == sorted_triangles(optimized));
+}
+TEST_FIXTURE(GridFixture, OverdrawKeepsTriangles)
+{
+    uint32_t vertex_count = (uint32_t)positions.size();
+    uint32_t index_count = (uint32_t)indices.size();
+    std::vector<uint32_t> optimized(index_count);
+    optimize_vertex_cache(&optimized[0], &indices[0], index_count, vertex_count);
+    VertexCacheStats cache = analyze_vertex_cache(&optimized[0], index_count, vertex_count, kVertexCacheSize);
+
+    std::vector<uint32_t> reordered = optimized;
+    optimize_overdraw(&reordered[0], index_count, &positions[0], sizeof(float3), vertex_count, 1.05f);
+    VertexCacheStats overdraw = analyze_vertex_cache(&reordered[0], index_count, vertex_count, kVertexCacheSize);
+
+    CHECK_TRUE(sorted_triangles(optimized) == sorted_triangles(reordered));
+    CHECK_LESS_THAN_FLOAT(overdraw.acmr, cache.acmr*1.25f);
+}
+TEST_FIXTURE(GridFixture, VertexFetchOrdersByFirstUse)
+{
+    // Add an unreferenced vertex that should be dropped
+    float3 unused = { -1.0f, -1.0f, -1.0f };
+    positions.push_back(unused);
+    uint32_t vertex_count = (uint32_t)positions.size();
+    uint32_t index_count = (uint32_t)indices.size();
+    std::vector<uint32_t> original = indices;
+
+    std::vector<float3> reordered(vertex_count);
+    uint32_t new_count = optimize_vertex_fetch(&reordered[0], &indices[0], index_count,
+                                               &positions[0], vertex_count, sizeof(float3));
+    CHECK_EQUAL(vertex_count-1, new_count);
+
+    uint32_t next = 0;
+    for(uint32_t ii=0; ii<index_count; ++ii) {
+        CHECK_LESS_THAN_EQUAL(indices[ii], next);
+        if(indices[ii] == next)
+            ++next;
+        CHECK_TRUE(float3equal(&positions[original[ii]], &reordered[indices[ii]]));
+    }
+}
+TEST(DeduplicatePositionsMergesSeams)
+{
+    // A quad split along a UV seam: vertices 2,3 duplicate 0,1's positions
+    struct Vertex { float3 pos; float u; };
+    Vertex vertices[] = {
+        { { 0.0f, 0.0f, 0.0f }, 0.0f },
+        { { 1.0f, 0.0f, 0.0f }, 0.0f },
+        { { 0.0f, 0.0f, 0.0f }, 1.0f },
+        { { 1.0f, 0.0f, 0.0f }, 1.0f },
+        { { 0.0f, 1.0f, 0.0f }, 0.5f },
+    };
+    uint32_t indices[] = { 0, 1, 4, 3, 2, 4 };
+    float3 positions[5];
+    uint32_t remapped[6];
+    uint32_t count = deduplicate_positions(positions, sizeof(float3), remapped,
+                                           vertices, sizeof(Vertex), sizeof(float3),
+                                           5, indices, 6);
+    CHECK_EQUAL(3, count);
+    for(int ii=0; ii<6; ++ii) {
+        CHECK_LESS_THAN(remapped[ii], count);
+        CHECK_TRUE(float3equal(&vertices[indices[ii]].pos, &positions[remapped[ii]]));
+    }
+    CHECK_EQUAL(remapped[0], remapped[4]);
+    CHECK_EQUAL(remapped[1], remapped[3]);
+}
+TEST_FIXTURE(GridFixture, MeshletsRespectLimits)
+{
+    uint32_t vertex_count = (uint32_t)positions.size();
+    uint32_t index_count = (uint32_t)indices.size();
+    std::vector<uint32_t> optimized(index_count);
+    optimize_vertex_cache(&optimized[0], &indices[0], index_count, vertex_count);
+
+    std::vector<Meshlet> meshlets(meshlet_count_bound(index_count, kMeshletMaxVertices, kMeshletMaxTriangles));
+    uint32_t count = build_meshlets(&meshlets[0], &optimized[0], index_count, vertex_count,
+                                    kMeshletMaxVertices, kMeshletMaxTriangles);
+    CHECK_LESS_THAN_EQUAL(count, (uint32_t)meshlets.size());
+
+    uint32_t next_index = 0;
+    for(uint32_t ii=0; ii<count; ++ii) {
+        const Meshlet& m = meshlets[ii];
+        CHECK_EQUAL(next_index, m.index_offset);
+        CHECK_LESS_THAN_EQUAL(m.vertex_count, (uint32_t)kMeshletMaxVertices);
+        CHECK_LESS_THAN_EQUAL(m.triangle_count, (uint32_t)kMeshletMaxTriangles);
+        next_index += m.triangle_count*3;
+
+        std::vector<uint32_t> unique(optimized.begin()+m.index_offset, optimized.begin()+next_index);
+        std::sort(unique.begin(), unique.end());
+        CHECK_EQUAL(m.vertex_count, (uint32_t)(std::unique(unique.begin(), unique.end()) - unique.begin()));
+    }
+    CHECK_EQUAL(index_count, next_index);
+}
+TEST_FIXTURE(GridFixture, MeshletBoundsContainTriangles)
+{
+    uint32_t triangle_count = 100;
+    MeshletBounds bounds = compute_meshlet_bounds(&indices[0], triangle_count, &positions[0], sizeof(float3));
+    for(uint32_t ii=0; ii<triangle_count*3; ++ii) {
+        float3 d = float3subtract(&positions[indices[ii]], &bounds.center);
+        CHECK_LESS_THAN_EQUAL_FLOAT(float3length(&d), bounds.radius + 0.0001f);
+    }
+    // A flat grid has a zero width normal cone
+    CHECK_EQUAL_FLOAT(1.0f, fabsf(bounds.cone_axis.y));
+    CHECK_LESS_THAN_FLOAT(bounds.cone_cutoff, 0.001f);
+}
+
+} // anonymous namespace
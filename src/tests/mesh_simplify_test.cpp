@@ -0,0 +1,143 @@
+/*! @file mesh_simplify_test.cpp
+ *  @author Kyle Weicht
+ *  @date 10/19/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "unit_test.h"
+#include "mesh_simplify.h"
+#include "vec_math.h"
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+namespace {
+
+/* A grid in the XZ plane. The vertices at x == kSeam are split in two, like a
+ * UV seam, with the right half of the grid using the copies.
+ */
+struct GridFixture {
+    enum { kSize = 32, kSeam = 16 };
+
+    GridFixture() {
+        for(int y=0; y<=kSize; ++y) {
+            for(int x=0; x<=kSize; ++x) {
+                float3 p = { (float)x, 0.0f, (float)y };
+                positions.push_back(p);
+            }
+        }
+        for(int y=0; y<=kSize; ++y) {
+            float3 p = { (float)kSeam, 0.0f, (float)y };
+            positions.push_back(p);
+        }
+        for(int y=0; y<kSize; ++y) {
+            for(int x=0; x<kSize; ++x) {
+                uint32_t quad[] = { _index(x,y), _index(x,y+1), _index(x+1,y),
+                                    _index(x+1,y), _index(x,y+1), _index(x+1,y+1) };
+                if(x >= kSeam) {
+                    for(int ii=0; ii<6; ++ii) {
+                        if(positions[quad[ii]].x == (float)kSeam)
+                            quad[ii] = seam_copy(quad[ii]);
+                    }
+                }
+                indices.insert(indices.end(), quad, quad+6);
+            }
+        }
+    }
+    ~GridFixture() {
+    }
+    uint32_t _index(int x, int y) const {
+        return (uint32_t)(y*(kSize+1) + x);
+    }
+    uint32_t seam_copy(uint32_t index) const {
+        return (kSize+1)*(kSize+1) + index/(kSize+1);
+    }
+    void displace(float amplitude) {
+        for(size_t ii=0; ii<positions.size(); ++ii)
+            positions[ii].y = sinf(positions[ii].x*0.4f) * cosf(positions[ii].z*0.3f) * amplitude;
+    }
+    bool referenced(const std::vector<uint32_t>& i, uint32_t index) const {
+        return std::find(i.begin(), i.end(), index) != i.end();
+    }
+    float3 normal(const std::vector<uint32_t>& i, size_t triangle) const {
+        const float3& p0 = positions[i[triangle*3+0]];
+        const float3& p1 = positions[i[triangle*3+1]];
+        const float3& p2 = positions[i[triangle*3+2]];
+        float3 e0 = float3subtract(&p1, &p0);
+        float3 e1 = float3subtract(&p2, &p0);
+        return float3cross(&e0, &e1);
+    }
+
+    std::vector<float3>     positions;
+    std::vector<uint32_t>   indices;
+};
+
+TEST_FIXTURE(GridFixture, SimplifyFlatGrid)
+{
+    uint32_t index_count = (uint32_t)indices.size();
+    std::vector<uint32_t> simplified(index_count);
+    float error = -1.0f;
+    uint32_t count = simplify_mesh(&simplified[0], &indices[0], index_count,
+                                   &positions[0], sizeof(float3), (uint32_t)positions.size(),
+                                   index_count/4, 1.0f, &error);
+    simplified.resize(count);
+    CHECK_LESS_THAN(count, index_count/2);
+    CHECK_EQUAL(0, count%3);
+    CHECK_LESS_THAN_FLOAT(error, 0.001f);
+    for(size_t ii=0; ii<count/3; ++ii) {
+        float3 n = normal(simplified, ii);
+        CHECK_LESS_THAN_FLOAT(0.0f, n.y);
+    }
+}
+TEST_FIXTURE(GridFixture, SimplifyKeepsBordersAndSeams)
+{
+    uint32_t index_count = (uint32_t)indices.size();
+    std::vector<uint32_t> simplified(index_count);
+    uint32_t count = simplify_mesh(&simplified[0], &indices[0], index_count,
+                                   &positions[0], sizeof(float3), (uint32_t)positions.size(),
+                                   0, 1.0f, NULL);
+    simplified.resize(count);
+    for(int ii=0; ii<=kSize; ++ii) {
+        CHECK_TRUE(referenced(simplified, _index(ii, 0)));
+        CHECK_TRUE(referenced(simplified, _index(ii, kSize)));
+        CHECK_TRUE(referenced(simplified, _index(0, ii)));
+        CHECK_TRUE(referenced(simplified, _index(kSize, ii)));
+        // Both sides of the seam keep their own vertices
+        CHECK_TRUE(referenced(simplified, _index(kSeam, ii)));
+        CHECK_TRUE(referenced(simplified, seam_copy(_index(kSeam, ii))));
+    }
+    // Nothing crosses the seam
+    uint32_t first_copy = (kSize+1)*(kSize+1);
+    for(size_t ii=0; ii<count; ii+=3) {
+        bool left = false, right = false;
+        for(int jj=0; jj<3; ++jj) {
+            uint32_t index = simplified[ii+jj];
+            if(index >= first_copy || positions[index].x > (float)kSeam)
+                right = true;
+            else if(positions[index].x < (float)kSeam)
+                left = true;
+        }
+        CHECK_FALSE(left && right);
+    }
+}
+TEST_FIXTURE(GridFixture, SimplifyRespectsErrorLimit)
+{
+    displace(2.0f);
+    uint32_t index_count = (uint32_t)indices.size();
+    std::vector<uint32_t> loose(index_count);
+    std::vector<uint32_t> tight(index_count);
+    float loose_error = 0.0f;
+    float tight_error = 0.0f;
+    uint32_t loose_count = simplify_mesh(&loose[0], &indices[0], index_count,
+                                         &positions[0], sizeof(float3), (uint32_t)positions.size(),
+                                         0, 10.0f, &loose_error);
+    uint32_t tight_count = simplify_mesh(&tight[0], &indices[0], index_count,
+                                         &positions[0], sizeof(float3), (uint32_t)positions.size(),
+                                         0, 0.05f, &tight_error);
+    CHECK_LESS_THAN(loose_count, tight_count);
+    CHECK_LESS_THAN(tight_count, index_count);
+    CHECK_LESS_THAN_EQUAL_FLOAT(tight_error, 0.05f);
+    CHECK_LESS_THAN_FLOAT(tight_error, loose_error);
+}
+
+} // anonymous namespace
@@ -0,0 +1,196 @@
+/*! @file occlusion_buffer_test.cpp
+ *  @author Kyle Weicht
+ *  @date 10/20/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "unit_test.h"
+#include "occlusion_buffer.h"
+
+#include <vector>
+
+namespace {
+
+enum {
+    kWidth = 64,
+    kHeight = 40    // Two and a half bands
+};
+
+// With an identity view projection positions are already in NDC, so texel
+// x covers [x/32 - 1, (x+1)/32 - 1] and row y [y/20 - 1, (y+1)/20 - 1]
+struct RasterFixture {
+    RasterFixture() : depth(kWidth*kHeight) {
+        occlusion_buffer_init(&buffer, &depth[0], kWidth, kHeight);
+        occlusion_buffer_clear(&buffer, &float4x4identity);
+    }
+    uint32_t draw(const float3* positions, const uint32_t* indices, uint32_t index_count) {
+        Occluder occluder = { float4x4identity, positions, indices, index_count };
+        return occlusion_buffer_draw(&buffer, &occluder, 1);
+    }
+    uint32_t covered(void) const {
+        uint32_t count = 0;
+        for(size_t ii=0; ii<depth.size(); ++ii)
+            count += (depth[ii] < 1.0f);
+        return count;
+    }
+    std::vector<float>  depth;
+    OcclusionBuffer     buffer;
+};
+
+uint32_t _random(uint32_t* state) {
+    *state = *state*1664525u + 1013904223u;
+    return *state >> 8;
+}
+float _random_float(uint32_t* state, float min, float max) {
+    return min + (max-min)*(_random(state) & 0xFFFF)/65535.0f;
+}
+
+TEST_FIXTURE(RasterFixture, BandSeamsMatchOneTriangleAtATime)
+{
+    // Small sloped triangles all over the screen, many crossing the rows
+    // where one band ends and the next starts
+    enum { kTriangles = kOcclusionMinThreadedTriangles + 500 };
+    std::vector<float3> positions;
+    std::vector<uint32_t> indices;
+    uint32_t state = 7;
+    for(uint32_t ii=0; ii<kTriangles; ++ii) {
+        float x = _random_float(&state, -1.1f, 1.1f);
+        float y = _random_float(&state, -1.1f, 1.1f);
+        for(int jj=0; jj<3; ++jj) {
+            float3 p = {
+                x + _random_float(&state, -0.15f, 0.15f),
+                y + _random_float(&state, -0.25f, 0.25f),
+                _random_float(&state, 0.05f, 0.95f)
+            };
+            positions.push_back(p);
+            indices.push_back((uint32_t)indices.size());
+        }
+    }
+    uint32_t drawn = draw(&positions[0], &indices[0], (uint32_t)indices.size());
+
+    RasterFixture single;
+    uint32_t single_drawn = 0;
+    for(uint32_t ii=0; ii<kTriangles; ++ii)
+        single_drawn += single.draw(&positions[0], &indices[ii*3], 3);
+    CHECK_EQUAL(single_drawn, drawn);
+    CHECK_LESS_THAN(kOcclusionMinThreadedTriangles, (int)drawn);
+    for(size_t ii=0; ii<depth.size(); ++ii)
+        CHECK_EQUAL_FLOAT(single.depth[ii], depth[ii]);
+
+    // Independently of the binning, the texel under each triangle's centroid
+    // is at least as near as the triangle is at the texel's center
+    uint32_t checked = 0;
+    for(uint32_t ii=0; ii<kTriangles; ++ii) {
+        const float3& a = positions[ii*3+0];
+        const float3& b = positions[ii*3+1];
+        const float3& c = positions[ii*3+2];
+        int tx = (int)(((a.x + b.x + c.x)/3.0f + 1.0f)*0.5f*kWidth);
+        int ty = (int)(((a.y + b.y + c.y)/3.0f + 1.0f)*0.5f*kHeight);
+        if(tx < 0 || ty < 0 || tx >= kWidth || ty >= kHeight)
+            continue;
+        float px = (tx + 0.5f)*2.0f/kWidth - 1.0f;
+        float py = (ty + 0.5f)*2.0f/kHeight - 1.0f;
+        float area = (b.x-a.x)*(c.y-a.y) - (c.x-a.x)*(b.y-a.y);
+        float wa = ((b.x-px)*(c.y-py) - (c.x-px)*(b.y-py))/area;
+        float wb = ((c.x-px)*(a.y-py) - (a.x-px)*(c.y-py))/area;
+        float wc = 1.0f - wa - wb;
+        if(area*area < 1e-6f || wa < 0.01f || wb < 0.01f || wc < 0.01f)
+            continue;
+        CHECK_LESS_THAN_FLOAT(depth[ty*kWidth + tx], wa*a.z + wb*b.z + wc*c.z + 1e-4f);
+        ++checked;
+    }
+    CHECK_LESS_THAN(kTriangles/4, (int)checked);
+}
+
+TEST_FIXTURE(RasterFixture, NearPlaneClippingIgnoresWinding)
+{
+    float4x4 proj = float4x4PerspectiveFovLH(DegToRad(90.0f), kWidth/(float)kHeight, 1.0f, 100.0f);
+    // One corner behind the camera leaves a quad, two leave a triangle
+    const float3 one_behind[] = { { 0.0f, 4.0f, -3.0f }, { -6.0f, -4.0f, 10.0f }, { 6.0f, -4.0f, 10.0f } };
+    const float3 two_behind[] = { { -6.0f, -4.0f, -3.0f }, { 6.0f, -4.0f, -3.0f }, { 0.0f, 4.0f, 10.0f } };
+    const float3* triangles[] = { one_behind, two_behind };
+    const uint32_t expected_drawn[] = { 2, 1 };
+    // Every rotation of both windings, so each corner starts the clip loop
+    const uint32_t orders[6][3] = { {0,1,2}, {1,2,0}, {2,0,1}, {0,2,1}, {2,1,0}, {1,0,2} };
+    for(int tt=0; tt<2; ++tt) {
+        std::vector<float> first;
+        for(int oo=0; oo<6; ++oo) {
+            occlusion_buffer_clear(&buffer, &proj);
+            CHECK_EQUAL(expected_drawn[tt], draw(triangles[tt], orders[oo], 3));
+            CHECK_LESS_THAN(0u, covered());
+            for(size_t ii=0; ii<depth.size(); ++ii)
+                CHECK_LESS_THAN_FLOAT(-1e-6f, depth[ii]);
+            if(oo == 0) {
+                first = depth;
+                continue;
+            }
+            // Clipping from another corner splits the quad along the other
+            // diagonal, the covered texels and their depths stay the same
+            for(size_t ii=0; ii<depth.size(); ++ii)
+                CHECK_EQUAL_FLOAT(first[ii], depth[ii]);
+        }
+    }
+    // Past the near plane the first triangle rises over the top of the
+    // screen. Its corner behind the camera would project below the center
+    // if it weren't clipped.
+    occlusion_buffer_clear(&buffer, &proj);
+    draw(one_behind, orders[3], 3);
+    CHECK_LESS_THAN_FLOAT(depth[(kHeight-1)*kWidth + kWidth/2], 1.0f);
+    CHECK_EQUAL_FLOAT(1.0f, depth[kWidth/2]);
+}
+
+TEST_FIXTURE(RasterFixture, BoxesAtTheBufferEdges)
+{
+    // Everything but the last column and the top row, reaching past the left
+    // and bottom edges
+    const float last_column = (kWidth-1)*2.0f/kWidth - 1.0f;
+    const float top_row = (kHeight-1)*2.0f/kHeight - 1.0f;
+    float3 wall[] = {
+        { -2.0f, -2.0f, 0.2f }, { last_column, -2.0f, 0.2f },
+        { last_column, top_row, 0.2f }, { -2.0f, top_row, 0.2f },
+    };
+    uint32_t indices[] = { 0, 1, 2, 0, 2, 3 };
+    CHECK_EQUAL(2u, draw(wall, indices, 6));
+    CHECK_EQUAL((uint32_t)((kWidth-1)*(kHeight-1)), covered());
+
+    // Spheres behind the wall. A box is clamped to the buffer, only the
+    // texels it covers on screen count.
+    float x[] = { -1.0f, 0.0f, 0.88f, 0.95f, 0.0f, 1.2f };
+    float y[] = { 0.0f, -1.0f, 0.0f, 0.0f, 0.95f, 0.0f };
+    float z[] = { 0.6f, 0.6f, 0.6f, 0.6f, 0.6f, 0.6f };
+    float radius[] = { 0.1f, 0.1f, 0.04f, 0.04f, 0.04f, 0.1f };
+    const int occluded[] = {
+        1,  // Half off the left edge
+        1,  // Half off the bottom edge
+        1,  // Ends in the column before the last
+        0,  // Reaches into the last column
+        0,  // Reaches into the top row
+        0   // Off screen isn't occluded
+    };
+    uint32_t visible[] = { 0, 1, 2, 3, 4, 5 };
+    for(int ii=0; ii<6; ++ii) {
+        float3 center = { x[ii], y[ii], z[ii] };
+        CHECK_EQUAL(occluded[ii], occlusion_buffer_occluded(&buffer, &center, radius[ii]));
+    }
+    CHECK_EQUAL(3u, occlusion_buffer_cull_spheres(&buffer, visible, 6, x, y, z, radius));
+    CHECK_EQUAL(3u, visible[0]);
+    CHECK_EQUAL(4u, visible[1]);
+    CHECK_EQUAL(5u, visible[2]);
+
+    // Filling the last column and row closes the gaps, boxes hanging over
+    // the right and top edges read up to the last texel and stop there
+    float3 rest[] = {
+        { last_column, -2.0f, 0.2f }, { 2.0f, -2.0f, 0.2f }, { 2.0f, 2.0f, 0.2f }, { last_column, 2.0f, 0.2f },
+        { -2.0f, top_row, 0.2f }, { 2.0f, top_row, 0.2f }, { 2.0f, 2.0f, 0.2f }, { -2.0f, 2.0f, 0.2f },
+    };
+    uint32_t rest_indices[] = { 0, 1, 2, 0, 2, 3, 4, 5, 6, 4, 6, 7 };
+    CHECK_EQUAL(4u, draw(rest, rest_indices, 12));
+    CHECK_EQUAL((uint32_t)(kWidth*kHeight), covered());
+    float3 right = { 1.0f, 0.0f, 0.6f };
+    float3 top = { 0.0f, 1.0f, 0.6f };
+    float3 corner = { 1.0f, 1.0f, 0.6f };
+    CHECK_TRUE(occlusion_buffer_occluded(&buffer, &right, 0.1f));
+    CHECK_TRUE(occlusion_buffer_occluded(&buffer, &top, 0.1f));
+    CHECK_TRUE(occlusion_buffer_occluded(&buffer, &corner, 0.1f));
+}
+
+} // anonymous namespace
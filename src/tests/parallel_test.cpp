@@ -0,0 +1,54 @@
+/*! @file parallel_test.cpp
+ *  @author Kyle Weicht
+ *  @date 10/19/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "unit_test.h"
+#include "parallel.h"
+
+#include <vector>
+
+namespace {
+
+void _increment(void* data, uint32_t begin, uint32_t end) {
+    uint32_t* counts = (uint32_t*)data;
+    for(uint32_t ii=begin; ii<end; ++ii)
+        ++counts[ii];
+}
+
+TEST(ParallelForVisitsEveryItemOnce)
+{
+    uint32_t sizes[] = { 0, 1, 7, 1000, 123457 };
+    for(int ii=0; ii<5; ++ii) {
+        std::vector<uint32_t> counts(sizes[ii]+1, 0);
+        parallel_for(_increment, &counts[0], sizes[ii], 16);
+        for(uint32_t jj=0; jj<sizes[ii]; ++jj)
+            CHECK_EQUAL(1u, counts[jj]);
+        CHECK_EQUAL(0u, counts[sizes[ii]]);
+    }
+}
+
+struct NestedLoop {
+    std::vector<uint32_t>   counts;
+    uint32_t                rows;
+    uint32_t                columns;
+};
+void _increment_rows(void* data, uint32_t begin, uint32_t end) {
+    NestedLoop* loop = (NestedLoop*)data;
+    for(uint32_t ii=begin; ii<end; ++ii)
+        parallel_for(_increment, &loop->counts[ii*loop->columns], loop->columns, 16);
+}
+
+TEST(ParallelForRunsNestedLoops)
+{
+    NestedLoop loop;
+    loop.rows = 64;
+    loop.columns = 1000;
+    loop.counts.assign(loop.rows*loop.columns, 0);
+    for(int ii=0; ii<10; ++ii)
+        parallel_for(_increment_rows, &loop, loop.rows, 1);
+    for(uint32_t ii=0; ii<loop.rows*loop.columns; ++ii)
+        CHECK_EQUAL(10u, loop.counts[ii]);
+}
+
+} // anonymous namespace
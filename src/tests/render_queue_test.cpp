@@ -0,0 +1,100 @@
+/*! @file render_queue_test.cpp
+ *  @author Kyle Weicht
+ *  @date 10/19/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "unit_test.h"
+#include "render_queue.h"
+
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+bool _key_less(const RenderKey& a, const RenderKey& b) {
+    return a.key < b.key;
+}
+
+TEST(RenderKeyFieldsSortMostSignificantFirst)
+{
+    // Pass beats everything below it, and so on down to depth
+    CHECK_LESS_THAN(render_key(kGeometryPass, 63, 1000, 60000, 1.0f, 1.0f),
+                    render_key(kShadowPass, 0, 0, 0, 0.0f, 1.0f));
+    CHECK_LESS_THAN(render_key(0, 1, 1000, 60000, 1.0f, 1.0f),
+                    render_key(0, 2, 0, 0, 0.0f, 1.0f));
+    CHECK_LESS_THAN(render_key(0, 0, 1, 60000, 1.0f, 1.0f),
+                    render_key(0, 0, 2, 0, 0.0f, 1.0f));
+    CHECK_LESS_THAN(render_key(0, 0, 0, 1, 1.0f, 1.0f),
+                    render_key(0, 0, 0, 2, 0.0f, 1.0f));
+    CHECK_LESS_THAN(render_key(0, 0, 0, 0, 0.25f, 1.0f),
+                    render_key(0, 0, 0, 0, 0.5f, 1.0f));
+}
+
+TEST(RenderKeyDepthIsClampedAndMonotonic)
+{
+    CHECK_EQUAL(render_key(0, 0, 0, 0, 0.0f, 100.0f), render_key(0, 0, 0, 0, -50.0f, 100.0f));
+    CHECK_EQUAL(render_key(0, 0, 0, 0, 100.0f, 100.0f), render_key(0, 0, 0, 0, 1e9f, 100.0f));
+    // Overflowing depth must not spill into the mesh field
+    CHECK_LESS_THAN(render_key(0, 0, 0, 0, 1e9f, 100.0f), render_key(0, 0, 0, 1, 0.0f, 100.0f));
+
+    uint64_t previous = 0;
+    for(int ii=0; ii<=1000; ++ii) {
+        uint64_t key = render_key(0, 0, 0, 0, ii*0.1f, 100.0f);
+        CHECK_LESS_THAN_EQUAL(previous, key);
+        previous = key;
+    }
+}
+
+TEST(SortRenderKeysMatchesStableSort)
+{
+    uint32_t sizes[] = { 0, 1, 2, 100, 4096 };
+    srand(42);
+    for(int ii=0; ii<5; ++ii) {
+        std::vector<RenderKey> keys(sizes[ii]+1);
+        std::vector<RenderKey> scratch(sizes[ii]+1);
+        for(uint32_t jj=0; jj<sizes[ii]; ++jj) {
+            // Few distinct values so stability matters
+            keys[jj].key = render_key(rand()%2, 0, rand()%5, rand()%7, (float)(rand()%4), 4.0f);
+            keys[jj].index = jj;
+            keys[jj]._padding = 0;
+        }
+        std::vector<RenderKey> expected(keys.begin(), keys.begin()+sizes[ii]);
+        std::stable_sort(expected.begin(), expected.end(), _key_less);
+
+        sort_render_keys(&keys[0], &scratch[0], sizes[ii]);
+        for(uint32_t jj=0; jj<sizes[ii]; ++jj) {
+            CHECK_EQUAL(expected[jj].key, keys[jj].key);
+            CHECK_EQUAL(expected[jj].index, keys[jj].index);
+        }
+    }
+}
+
+TEST(SortRenderKeysHandlesFullWidthKeys)
+{
+    RenderKey keys[3] = { { ~0ull, 0, 0 }, { 1ull << 63, 1, 0 }, { 1, 2, 0 } };
+    RenderKey scratch[3];
+    sort_render_keys(keys, scratch, 3);
+    CHECK_EQUAL(2u, keys[0].index);
+    CHECK_EQUAL(1u, keys[1].index);
+    CHECK_EQUAL(0u, keys[2].index);
+}
+
+TEST(CountStateChanges)
+{
+    RenderKey keys[4];
+    keys[0].key = render_key(0, 0, 1, 1, 0.0f, 1.0f);
+    keys[1].key = render_key(0, 0, 1, 1, 0.5f, 1.0f);
+    keys[2].key = render_key(0, 0, 1, 2, 0.0f, 1.0f);
+    keys[3].key = render_key(0, 0, 2, 2, 0.0f, 1.0f);
+
+    StateChanges changes = count_state_changes(keys, 4);
+    CHECK_EQUAL(1u, changes.programs);
+    CHECK_EQUAL(2u, changes.materials);
+    CHECK_EQUAL(2u, changes.meshes);
+
+    changes = count_state_changes(keys, 0);
+    CHECK_EQUAL(0u, changes.materials);
+}
+
+} // anonymous namespace
@@ -0,0 +1,117 @@
+/*! @file shadow_atlas_test.cpp
+ *  @author Kyle Weicht
+ *  @date 10/20/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "unit_test.h"
+#include "shadow_atlas.h"
+
+#include <math.h>
+
+namespace {
+
+// Row vector times matrix, the way the renderer transforms points
+float4 transform(const float4& p, const float4x4& m) {
+    float4 r = {
+        p.x*m.r0.x + p.y*m.r1.x + p.z*m.r2.x + p.w*m.r3.x,
+        p.x*m.r0.y + p.y*m.r1.y + p.z*m.r2.y + p.w*m.r3.y,
+        p.x*m.r0.z + p.y*m.r1.z + p.z*m.r2.z + p.w*m.r3.z,
+        p.x*m.r0.w + p.y*m.r1.w + p.z*m.r2.w + p.w*m.r3.w
+    };
+    return r;
+}
+bool overlap(const AtlasTile& a, const AtlasTile& b) {
+    return a.x < b.x + b.size && b.x < a.x + a.size &&
+           a.y < b.y + b.size && b.y < a.y + a.size;
+}
+
+TEST(AtlasTilesDontOverlap)
+{
+    ShadowAtlas atlas;
+    shadow_atlas_init(&atlas, 1024, 4);
+    AtlasTile tiles[8];
+    const uint32_t sizes[8] = { 512, 100, 256, 64, 256, 128, 64, 256 };
+    for(int ii=0; ii<8; ++ii) {
+        CHECK_TRUE(shadow_atlas_alloc(&atlas, sizes[ii], &tiles[ii]));
+        CHECK_GREATER_THAN_EQUAL(tiles[ii].size, sizes[ii]);
+        CHECK_LESS_THAN_EQUAL(tiles[ii].x + tiles[ii].size, 1024u);
+        CHECK_LESS_THAN_EQUAL(tiles[ii].y + tiles[ii].size, 1024u);
+        for(int jj=0; jj<ii; ++jj)
+            CHECK_FALSE(overlap(tiles[ii], tiles[jj]));
+    }
+    CHECK_EQUAL(128u, tiles[1].size);
+}
+
+TEST(AtlasFillsAndMerges)
+{
+    ShadowAtlas atlas;
+    shadow_atlas_init(&atlas, 1024, 4);
+    AtlasTile tiles[16];
+    for(int ii=0; ii<16; ++ii)
+        CHECK_TRUE(shadow_atlas_alloc(&atlas, 256, &tiles[ii]));
+    AtlasTile tile;
+    CHECK_FALSE(shadow_atlas_alloc(&atlas, 64, &tile));
+
+    // Freeing one quadrant's tiles makes room for a 512 again
+    for(int ii=0; ii<4; ++ii)
+        shadow_atlas_free(&atlas, &tiles[ii]);
+    CHECK_TRUE(shadow_atlas_alloc(&atlas, 512, &tile));
+    CHECK_EQUAL(512u, tile.size);
+    CHECK_FALSE(shadow_atlas_alloc(&atlas, 64, &tile));
+
+    // Smaller than the smallest tile rounds up to it
+    shadow_atlas_free(&atlas, &tiles[4]);
+    CHECK_TRUE(shadow_atlas_alloc(&atlas, 1, &tile));
+    CHECK_EQUAL(64u, tile.size);
+}
+
+TEST(PointShadowFacesCoverEachAxis)
+{
+    float4x4 view_projs[6];
+    float3 pos = { 10.0f, 2.0f, -5.0f };
+    point_shadow_view_projs(view_projs, &pos, 20.0f);
+    const float4 points[6] = {
+        { 15.0f, 2.0f, -5.0f, 1.0f }, { 5.0f, 2.0f, -5.0f, 1.0f },
+        { 10.0f, 7.0f, -5.0f, 1.0f }, { 10.0f, -3.0f, -5.0f, 1.0f },
+        { 10.0f, 2.0f, 0.0f, 1.0f }, { 10.0f, 2.0f, -10.0f, 1.0f }
+    };
+    for(int face=0; face<6; ++face) {
+        for(int ii=0; ii<6; ++ii) {
+            float4 p = transform(points[ii], view_projs[face]);
+            if(ii == face) {
+                CHECK_LESS_THAN_FLOAT(fabsf(p.x/p.w), 0.001f);
+                CHECK_LESS_THAN_FLOAT(fabsf(p.y/p.w), 0.001f);
+                CHECK_GREATER_THAN_FLOAT(p.z/p.w, 0.0f);
+                CHECK_LESS_THAN_FLOAT(p.z/p.w, 1.0f);
+            } else {
+                // Behind the face, or on the edge of its frustum
+                CHECK_TRUE(p.w < 0.001f || fabsf(p.x/p.w) > 0.999f || fabsf(p.y/p.w) > 0.999f);
+            }
+        }
+    }
+}
+
+TEST(SpotShadowTileMapping)
+{
+    float3 pos = { 0.0f, 10.0f, 0.0f };
+    float3 dir = { 0.0f, -1.0f, 0.0f };
+    float4x4 view_proj = spot_shadow_view_proj(&pos, &dir, cosf(DegToRad(30.0f)), 20.0f);
+    AtlasTile tile = { 256, 512, 128, 0 };
+    float4x4 to_atlas = shadow_atlas_tile_matrix(&view_proj, &tile, 1024);
+
+    // The cone's axis lands in the middle of the tile
+    float4 center = { 0.0f, 0.0f, 0.0f, 1.0f };
+    float4 p = transform(center, to_atlas);
+    CHECK_EQUAL_FLOAT((256.0f + 64.0f)/1024.0f, p.x/p.w);
+    CHECK_EQUAL_FLOAT((512.0f + 64.0f)/1024.0f, p.y/p.w);
+    CHECK_GREATER_THAN_FLOAT(p.z/p.w, 0.0f);
+    CHECK_LESS_THAN_FLOAT(p.z/p.w, 1.0f);
+
+    // And the edge of the cone on the edge of the tile
+    float4 edge = { tanf(DegToRad(30.0f))*10.0f, 0.0f, 0.0f, 1.0f };
+    p = transform(edge, to_atlas);
+    float u = p.x/p.w*1024.0f;
+    CHECK_TRUE(fabsf(u - 256.0f) < 0.01f || fabsf(u - 384.0f) < 0.01f);
+}
+
+} // anonymous namespace
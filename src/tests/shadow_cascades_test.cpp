@@ -0,0 +1,132 @@
+/*! @file shadow_cascades_test.cpp
+ *  @author Kyle Weicht
+ *  @date 10/20/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "unit_test.h"
+#include "shadow_cascades.h"
+
+#include <math.h>
+
+namespace {
+
+// Row vector times matrix, the way the renderer transforms points
+float4 transform(const float4& p, const float4x4& m) {
+    float4 r = {
+        p.x*m.r0.x + p.y*m.r1.x + p.z*m.r2.x + p.w*m.r3.x,
+        p.x*m.r0.y + p.y*m.r1.y + p.z*m.r2.y + p.w*m.r3.y,
+        p.x*m.r0.z + p.y*m.r1.z + p.z*m.r2.z + p.w*m.r3.z,
+        p.x*m.r0.w + p.y*m.r1.w + p.z*m.r2.w + p.w*m.r3.w
+    };
+    return r;
+}
+
+struct CascadeFixture {
+    CascadeFixture() {
+        proj = float4x4PerspectiveFovLH(DegToRad(50.0f), 16.0f/9.0f, 0.1f, 10000.0f);
+        camera = float4x4identity;
+        camera.r3.y = 5.0f;
+        float3 dir = { 0.3f, -1.0f, 0.2f };
+        light_dir = dir;
+    }
+    ~CascadeFixture() {
+    }
+    void build(float margin = 1.0f) {
+        build_shadow_cascades(cascades, kMaxShadowCascades, &camera, &proj,
+                              150.0f, 0.75f, &light_dir, 100.0f, 2048, margin);
+    }
+    // Clip space of a view space point
+    float4 project(const ShadowCascade& cascade, float x, float y, float z) {
+        float4 p = { x, y, z, 1.0f };
+        return transform(transform(p, camera), cascade.view_proj);
+    }
+
+    float4x4    proj;
+    float4x4    camera;
+    float3      light_dir;
+    ShadowCascade   cascades[kMaxShadowCascades];
+};
+
+TEST(CascadeSplits)
+{
+    float splits[4];
+    shadow_cascade_splits(splits, 4, 1.0f, 10000.0f, 1.0f);
+    CHECK_EQUAL_FLOAT(10.0f, splits[0]);
+    CHECK_EQUAL_FLOAT(100.0f, splits[1]);
+    CHECK_EQUAL_FLOAT(1000.0f, splits[2]);
+    CHECK_EQUAL_FLOAT(10000.0f, splits[3]);
+
+    shadow_cascade_splits(splits, 4, 1.0f, 9.0f, 0.0f);
+    CHECK_EQUAL_FLOAT(3.0f, splits[0]);
+    CHECK_EQUAL_FLOAT(5.0f, splits[1]);
+    CHECK_EQUAL_FLOAT(9.0f, splits[3]);
+}
+TEST_FIXTURE(CascadeFixture, CascadesCoverTheirSlice)
+{
+    build();
+    float tan_x = 1.0f/proj.r0.x;
+    float tan_y = 1.0f/proj.r1.y;
+    CHECK_EQUAL_FLOAT(0.1f, cascades[0].near_z);
+    CHECK_EQUAL_FLOAT(150.0f, cascades[kMaxShadowCascades-1].far_z);
+    for(int ii=0; ii<kMaxShadowCascades; ++ii) {
+        const ShadowCascade& cascade = cascades[ii];
+        if(ii) {
+            CHECK_EQUAL_FLOAT(cascades[ii-1].far_z, cascade.near_z);
+            // Nearer cascades are smaller, so sharper
+            CHECK_LESS_THAN_FLOAT(cascades[ii-1].radius, cascade.radius);
+        }
+        for(int corner=0; corner<8; ++corner) {
+            float z = (corner & 4) ? cascade.far_z : cascade.near_z;
+            float x = (corner & 1) ? z*tan_x : -z*tan_x;
+            float y = (corner & 2) ? z*tan_y : -z*tan_y;
+            float4 p = project(cascade, x, y, z);
+            CHECK_LESS_THAN_EQUAL_FLOAT(fabsf(p.x/p.w), 1.0f);
+            CHECK_LESS_THAN_EQUAL_FLOAT(fabsf(p.y/p.w), 1.0f);
+            CHECK_LESS_THAN_EQUAL_FLOAT(0.0f, p.z/p.w);
+            CHECK_LESS_THAN_EQUAL_FLOAT(p.z/p.w, 1.0f);
+        }
+    }
+}
+TEST_FIXTURE(CascadeFixture, CascadesMoveInWholeTexels)
+{
+    build();
+    ShadowCascade before = cascades[1];
+    camera.r3.x += 0.37f;
+    camera.r3.z += 1.21f;
+    build();
+    const ShadowCascade& after = cascades[1];
+    CHECK_EQUAL_FLOAT(before.radius, after.radius);
+
+    // The same world point moves by a whole number of texels
+    float4 p = { 10.0f, 0.0f, 20.0f, 1.0f };
+    float4 a = transform(p, before.view_proj);
+    float4 b = transform(p, after.view_proj);
+    float texels_x = (b.x-a.x)*0.5f*2048.0f;
+    float texels_y = (b.y-a.y)*0.5f*2048.0f;
+    CHECK_LESS_THAN_FLOAT(fabsf(texels_x - floorf(texels_x + 0.5f)), 0.01f);
+    CHECK_LESS_THAN_FLOAT(fabsf(texels_y - floorf(texels_y + 0.5f)), 0.01f);
+}
+TEST_FIXTURE(CascadeFixture, CachedCascadeCoversSmallMoves)
+{
+    build(1.25f);
+    ShadowCascade cached = cascades[2];
+    CHECK_TRUE(shadow_cascade_contains(&cached, &cascades[2]));
+
+    camera.r3.x += 1.0f;
+    build(1.25f);
+    CHECK_TRUE(shadow_cascade_contains(&cached, &cascades[2]));
+
+    // Far enough that the slice leaves the cached map
+    camera.r3.x += cached.radius;
+    build(1.25f);
+    CHECK_FALSE(shadow_cascade_contains(&cached, &cascades[2]));
+
+    // A tight fit has no room to move
+    build(1.0f);
+    cached = cascades[2];
+    camera.r3.z += 1.0f;
+    build(1.0f);
+    CHECK_FALSE(shadow_cascade_contains(&cached, &cascades[2]));
+}
+
+} // anonymous namespace
@@ -0,0 +1,128 @@
+/*! @file tangents_test.cpp
+ *  @author Kyle Weicht
+ *  @date 10/19/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "unit_test.h"
+#include "tangents.h"
+
+#include <math.h>
+#include <vector>
+
+namespace {
+
+/* A grid in the XZ plane with u along x and v along z */
+struct TangentGridFixture {
+    enum { kSize = 300 };
+
+    TangentGridFixture() {
+        for(int y=0; y<=kSize; ++y) {
+            for(int x=0; x<=kSize; ++x) {
+                VtxPosNormTex v = {
+                    { (float)x, 0.0f, (float)y },
+                    { 0.0f, 1.0f, 0.0f },
+                    { x/(float)kSize, y/(float)kSize }
+                };
+                vertices.push_back(v);
+            }
+        }
+        for(int y=0; y<kSize; ++y) {
+            for(int x=0; x<kSize; ++x) {
+                uint32_t i0 = y*(kSize+1) + x;
+                uint32_t quad[] = { i0, i0+kSize+1, i0+1, i0+1, i0+kSize+1, i0+kSize+2 };
+                indices.insert(indices.end(), quad, quad+6);
+            }
+        }
+    }
+    ~TangentGridFixture() {
+    }
+    void calculate(void) {
+        frames.resize(vertices.size());
+        calculate_tangents(&frames[0], &vertices[0], (uint32_t)vertices.size(), &indices[0], (uint32_t)indices.size());
+    }
+    float handedness(const VtxPosNormTanBitanTex& v) {
+        float3 c = float3cross(&v.norm, &v.tan);
+        return float3dot(&c, &v.bitan);
+    }
+
+    std::vector<VtxPosNormTex>          vertices;
+    std::vector<uint32_t>               indices;
+    std::vector<VtxPosNormTanBitanTex>  frames;
+};
+
+TEST_FIXTURE(TangentGridFixture, TangentsFollowUVs)
+{
+    calculate();
+    for(size_t ii=0; ii<frames.size(); ++ii) {
+        CHECK_EQUAL_FLOAT(1.0f, frames[ii].tan.x);
+        CHECK_EQUAL_FLOAT(1.0f, frames[ii].bitan.z);
+        CHECK_EQUAL_FLOAT(-1.0f, handedness(frames[ii]));
+    }
+}
+TEST_FIXTURE(TangentGridFixture, MirroredUVsFlipHandedness)
+{
+    for(size_t ii=0; ii<vertices.size(); ++ii)
+        vertices[ii].tex.x = 1.0f - vertices[ii].tex.x;
+    calculate();
+    for(size_t ii=0; ii<frames.size(); ++ii) {
+        CHECK_EQUAL_FLOAT(-1.0f, frames[ii].tan.x);
+        CHECK_EQUAL_FLOAT(1.0f, frames[ii].bitan.z);
+        CHECK_EQUAL_FLOAT(1.0f, handedness(frames[ii]));
+    }
+}
+TEST_FIXTURE(TangentGridFixture, TangentFramesAreOrthonormal)
+{
+    // Bend the grid and tilt the normals so every frame needs fixing up
+    for(size_t ii=0; ii<vertices.size(); ++ii) {
+        VtxPosNormTex& v = vertices[ii];
+        v.pos.y = sinf(v.pos.x*0.1f)*cosf(v.pos.z*0.07f)*5.0f;
+        v.norm.x = -0.5f*cosf(v.pos.x*0.1f)*cosf(v.pos.z*0.07f);
+        v.norm.z = 0.35f*sinf(v.pos.x*0.1f)*sinf(v.pos.z*0.07f);
+    }
+    calculate();
+    for(size_t ii=0; ii<frames.size(); ++ii) {
+        const VtxPosNormTanBitanTex& v = frames[ii];
+        CHECK_EQUAL_FLOAT(1.0f, float3length(&v.norm));
+        CHECK_EQUAL_FLOAT(1.0f, float3length(&v.tan));
+        CHECK_EQUAL_FLOAT(1.0f, float3length(&v.bitan));
+        CHECK_LESS_THAN_FLOAT(fabsf(float3dot(&v.norm, &v.tan)), 0.0001f);
+        CHECK_LESS_THAN_FLOAT(fabsf(float3dot(&v.tan, &v.bitan)), 0.0001f);
+        CHECK_LESS_THAN_FLOAT(0.0f, v.tan.x);
+    }
+}
+TEST(TangentsAreAveraged)
+{
+    // Vertex 0 is shared by a triangle with u along +x and one with u along +z
+    VtxPosNormTex vertices[] = {
+        { {  0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f } },
+        { {  1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 1.0f, 0.0f } },
+        { {  0.0f, 0.0f, 1.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 1.0f } },
+        { {  0.0f, 0.0f, 1.0f }, { 0.0f, 1.0f, 0.0f }, { 1.0f, 0.0f } },
+        { { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 1.0f } },
+    };
+    uint32_t indices[] = { 0, 2, 1, 0, 4, 3 };
+    VtxPosNormTanBitanTex frames[5];
+    calculate_tangents(frames, vertices, 5, indices, 6);
+    CHECK_EQUAL_FLOAT(sqrtf(0.5f), frames[0].tan.x);
+    CHECK_EQUAL_FLOAT(sqrtf(0.5f), frames[0].tan.z);
+    CHECK_EQUAL_FLOAT(0.0f, float3dot(&frames[0].tan, &frames[0].bitan));
+    CHECK_EQUAL_FLOAT(1.0f, frames[1].tan.x);
+    CHECK_EQUAL_FLOAT(1.0f, frames[3].tan.z);
+}
+TEST(TangentsWithoutUVs)
+{
+    VtxPosNormTex vertices[] = {
+        { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.5f, 0.5f } },
+        { { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.5f, 0.5f } },
+        { { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.5f, 0.5f } },
+    };
+    uint32_t indices[] = { 0, 1, 2 };
+    VtxPosNormTanBitanTex frames[3];
+    calculate_tangents(frames, vertices, 3, indices, 3);
+    for(int ii=0; ii<3; ++ii) {
+        CHECK_EQUAL_FLOAT(1.0f, float3length(&frames[ii].tan));
+        CHECK_EQUAL_FLOAT(0.0f, float3dot(&frames[ii].tan, &frames[ii].norm));
+    }
+}
+
+} // anonymous namespace
@@ -0,0 +1,72 @@
+/*! @file vertex_packing_test.cpp
+ *  @author Kyle Weicht
+ *  @date 10/19/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "unit_test.h"
+#include "vertex_packing.h"
+
+#include <math.h>
+
+namespace {
+
+TEST(HalfRoundTrip)
+{
+    const float values[] = { 0.0f, 1.0f, -1.0f, 0.5f, 10.0f, -25.0f, 65504.0f, 0.000061035156f };
+    for(int ii=0; ii<(int)(sizeof(values)/sizeof(values[0])); ++ii) {
+        CHECK_EQUAL_FLOAT(values[ii], half_to_float(float_to_half(values[ii])));
+    }
+    CHECK_EQUAL(0x3C00, float_to_half(1.0f));
+    CHECK_EQUAL(0x7C00, float_to_half(100000.0f));
+    CHECK_LESS_THAN_FLOAT(fabsf(half_to_float(float_to_half(3.14159f)) - 3.14159f), 0.002f);
+}
+TEST(OctahedralRoundTrip)
+{
+    for(int ii=0; ii<256; ++ii) {
+        float theta = ii * 0.1f;
+        float phi = ii * 0.37f;
+        float3 v = { sinf(theta)*cosf(phi), sinf(theta)*sinf(phi), cosf(theta) };
+        int16_t e[2];
+        oct_encode(&v, e);
+        float3 d = oct_decode(e);
+        CHECK_GREATER_THAN_FLOAT(float3dot(&v, &d), 0.99999f);
+    }
+    float3 down = { 0.0f, 0.0f, -1.0f };
+    int16_t e[2];
+    oct_encode(&down, e);
+    float3 d = oct_decode(e);
+    CHECK_GREATER_THAN_FLOAT(float3dot(&down, &d), 0.99999f);
+}
+TEST(PackVertices)
+{
+    VtxPosNormTanBitanTex src[3] = {
+        { {-10.0f, 0.0f, 5.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f} },
+        { { 10.0f, 2.0f, 5.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f,-1.0f}, {2.5f, 1.0f} },
+        { {  0.0f, 1.0f,-5.0f}, {0.0f, 2.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, {0.5f, 0.25f} },
+    };
+    VtxPackedPosNormTanTex dst[3];
+    float4x4 dequantize = pack_vertices(dst, src, 3);
+    CHECK_EQUAL(20, sizeof(VtxPackedPosNormTanTex));
+
+    for(int ii=0; ii<3; ++ii) {
+        // Row vector * matrix, like the shaders
+        float3 p = { dst[ii].pos[0]/65535.0f, dst[ii].pos[1]/65535.0f, dst[ii].pos[2]/65535.0f };
+        float3 r = { p.x*dequantize.r0.x + dequantize.r3.x,
+                     p.y*dequantize.r1.y + dequantize.r3.y,
+                     p.z*dequantize.r2.z + dequantize.r3.z };
+        CHECK_LESS_THAN_FLOAT(fabsf(r.x - src[ii].pos.x), 0.001f);
+        CHECK_LESS_THAN_FLOAT(fabsf(r.y - src[ii].pos.y), 0.001f);
+        CHECK_LESS_THAN_FLOAT(fabsf(r.z - src[ii].pos.z), 0.001f);
+
+        float3 n = oct_decode(dst[ii].norm);
+        CHECK_EQUAL_FLOAT(1.0f, n.y);
+        float3 t = oct_decode(dst[ii].tan);
+        CHECK_LESS_THAN_FLOAT(fabsf(float3dot(&n, &t)), 0.001f);
+        CHECK_EQUAL_FLOAT(src[ii].tex.x, half_to_float(dst[ii].tex[0]));
+    }
+    // cross(N,T) = cross(+Y,+X) = -Z
+    CHECK_EQUAL(-32767, dst[0].tan_sign);
+    CHECK_EQUAL(32767, dst[1].tan_sign);
+}
+
+} // anonymous namespace
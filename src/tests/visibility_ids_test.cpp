@@ -0,0 +1,91 @@
+/*! @file visibility_ids_test.cpp
+ *  @author Kyle Weicht
+ *  @date 10/20/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "unit_test.h"
+#include "visibility_ids.h"
+#include "mesh_cooker.h"
+
+#include <math.h>
+#include <vector>
+
+namespace {
+
+uint32_t _index(const MeshData& mesh, uint32_t index) {
+    if(mesh.index_size == 2)
+        return ((const uint16_t*)mesh.indices)[index];
+    return ((const uint32_t*)mesh.indices)[index];
+}
+
+TEST(VisibilitySplitsCoverTheRange)
+{
+    VisibilitySplit splits[4];
+    CHECK_EQUAL(3u, visibility_split_count(700*3, 256));
+    CHECK_EQUAL(3u, visibility_split_draw(splits, 30, 700*3, 256));
+    CHECK_EQUAL(30u, splits[0].first_index);
+    CHECK_EQUAL(256u*3, splits[0].index_count);
+    CHECK_EQUAL(30u + 512*3, splits[2].first_index);
+    CHECK_EQUAL(188u*3, splits[2].index_count);
+    CHECK_EQUAL(1u, visibility_split_draw(splits, 0, 256*3, 256));
+}
+
+/* Every split of every LOD drawn twice instanced, like the ID pass draws a
+ * cooked mesh. Each primitive's ID has to lead the resolve back to the
+ * triangle that was rasterized.
+ */
+TEST(VisibilityIdFindsTheDrawnTriangle)
+{
+    enum { kSize = 64, kMaxTriangles = 1024, kInstances = 2 };
+    std::vector<VtxPosNormTex> vertices;
+    std::vector<uint32_t> indices;
+    for(int y=0; y<=kSize; ++y) {
+        for(int x=0; x<=kSize; ++x) {
+            VtxPosNormTex v = {
+                { (float)x, sinf(x*0.3f)*cosf(y*0.2f), (float)y },
+                { 0.0f, 1.0f, 0.0f },
+                { x/(float)kSize, y/(float)kSize }
+            };
+            vertices.push_back(v);
+        }
+    }
+    for(int y=0; y<kSize; ++y) {
+        for(int x=0; x<kSize; ++x) {
+            uint32_t i0 = y*(kSize+1) + x;
+            uint32_t quad[] = { i0, i0+kSize+1, i0+1, i0+1, i0+kSize+1, i0+kSize+2 };
+            indices.insert(indices.end(), quad, quad+6);
+        }
+    }
+    CookedMesh cooked;
+    cook_mesh(&cooked, (uint32_t)vertices.size(), kVtxPosNormTex, (uint32_t)indices.size(), sizeof(uint32_t),
+              &vertices[0], &indices[0]);
+    const MeshData& mesh = cooked.data;
+    CHECK_LESS_THAN(1u, mesh.num_lods);
+
+    for(uint32_t lod=0; lod<mesh.num_lods; ++lod) {
+        const MeshLod& range = mesh.lods[lod];
+        std::vector<VisibilitySplit> splits(visibility_split_count(range.index_count, kMaxTriangles));
+        uint32_t num_splits = visibility_split_draw(&splits[0], range.index_offset, range.index_count, kMaxTriangles);
+        CHECK_EQUAL((uint32_t)splits.size(), num_splits);
+
+        // An entry per instance of each split
+        std::vector<VisibilitySplit> entries;
+        for(uint32_t split=0; split<num_splits; ++split)
+            entries.insert(entries.end(), kInstances, splits[split]);
+
+        uint32_t drawn = 0;
+        for(uint32_t entry=0; entry<(uint32_t)entries.size(); ++entry) {
+            const VisibilitySplit& draw = entries[entry];
+            for(uint32_t primitive=0; primitive<draw.index_count/3; ++primitive) {
+                uint32_t id = visibility_id(entry, primitive);
+                uint32_t resolved = visibility_triangle_index(&entries[0], id);
+                for(uint32_t corner=0; corner<3; ++corner)
+                    CHECK_EQUAL(_index(mesh, draw.first_index + primitive*3 + corner), _index(mesh, resolved + corner));
+            }
+            drawn += draw.index_count;
+        }
+        CHECK_EQUAL(range.index_count*kInstances, drawn);
+    }
+}
+
+} // anonymous namespace
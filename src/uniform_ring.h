@@ -0,0 +1,125 @@
+/*! @file uniform_ring.h
+ *  @brief A fenced ring of uniform buffer space, one segment per frame
+ *  @author Kyle Weicht
+ *  @date 10/20/26 3:10 AM
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ *	@addtogroup uniform_ring uniform_ring
+ *	@{
+ */
+#ifndef __uniform_ring_h__
+#define __uniform_ring_h__
+
+#include <string.h>
+
+/* Each frame writes all of its constants into its own segment before it
+ * draws anything. GL 3.3 can't draw from a buffer while it's mapped, so the
+ * segment is mapped once, unsynchronized, written and unmapped. The fence
+ * at the end of the frame keeps the next frame that reuses the segment from
+ * writing over data the GPU hasn't read.
+ */
+class UniformRing {
+public:
+
+enum { kNumSegments = 3 };
+
+void init(void) {
+    glGenBuffers(1, &_buffer);
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    _alignment = (uint32_t)alignment;
+    _segment_size = 0;
+    _segment = 0;
+    _used = 0;
+    _mapped = NULL;
+    for(int ii=0;ii<kNumSegments;++ii)
+        _fences[ii] = 0;
+}
+void shutdown(void) {
+    for(int ii=0;ii<kNumSegments;++ii) {
+        if(_fences[ii])
+            glDeleteSync(_fences[ii]);
+    }
+    glDeleteBuffers(1, &_buffer);
+}
+/*! @brief How much a block takes, with the padding binds need */
+uint32_t aligned_size(uint32_t size) const {
+    return (size + _alignment-1)/_alignment*_alignment;
+}
+/*! @brief Maps the next segment, after the GPU is done with it, with room
+ *         for at least bytes of blocks
+ *  @return Non-zero if it had to wait on the GPU
+ */
+int begin_frame(uint32_t bytes) {
+    int stalled = 0;
+    _segment = (_segment+1) % kNumSegments;
+    if(bytes > _segment_size) {
+        // Growing drops every segment, wait for all of them
+        for(int ii=0;ii<kNumSegments;++ii)
+            stalled |= _wait(ii);
+        _segment_size = aligned_size(bytes + bytes/2);
+        glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+        glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)_segment_size*kNumSegments, NULL, GL_STREAM_DRAW);
+    } else {
+        stalled = _wait(_segment);
+        glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+    }
+    _used = 0;
+    _mapped = (char*)glMapBufferRange(GL_UNIFORM_BUFFER, (GLintptr)(_segment*_segment_size), (GLsizeiptr)_segment_size,
+                                      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    return stalled;
+}
+/*! @brief Copies a block into the segment
+ *  @return Its offset in the buffer, for binding
+ */
+uint32_t write(const void* data, uint32_t size) {
+    uint32_t offset = _used;
+    _used += aligned_size(size);
+    assert(_used <= _segment_size);
+    if(_mapped)
+        memcpy(_mapped + offset, data, size);
+    return _segment*_segment_size + offset;
+}
+/*! @brief Unmaps the segment so it can be drawn from */
+void end_writes(void) {
+    glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+    if(_mapped)
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    _mapped = NULL;
+}
+/*! @brief Marks the segment as in use until the GPU gets here */
+void end_frame(void) {
+    _fences[_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+GLuint buffer(void) const { return _buffer; }
+uint32_t bytes_used(void) const { return _used; }
+
+private:
+
+int _wait(int segment) {
+    GLsync fence = _fences[segment];
+    if(!fence)
+        return 0;
+    int stalled = 0;
+    if(glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+        stalled = 1;
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, (GLuint64)1000000000); // A second
+    }
+    glDeleteSync(fence);
+    _fences[segment] = 0;
+    return stalled;
+}
+
+GLuint      _buffer;
+uint32_t    _alignment;
+uint32_t    _segment_size;
+uint32_t    _segment;
+uint32_t    _used;
+char*       _mapped;
+GLsync      _fences[kNumSegments];
+
+};
+
+/* @} */
+#endif /* include guard */
@@ -0,0 +1,167 @@
+/*! @file vertex_packing.cpp
+ *  @author Kyle Weicht
+ *  @date 10/19/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "vertex_packing.h"
+
+#include <math.h>
+#include <float.h>
+
+/*
+ * Internal
+ */
+namespace {
+
+union FloatBits {
+    uint32_t    u;
+    float       f;
+};
+
+float _sign_not_zero(float f) {
+    return (f >= 0.0f) ? 1.0f : -1.0f;
+}
+int16_t _to_snorm16(float f) {
+    if(f > 1.0f) f = 1.0f;
+    if(f < -1.0f) f = -1.0f;
+    return (int16_t)floorf(f*32767.0f + 0.5f);
+}
+uint16_t _to_unorm16(float f) {
+    if(f > 1.0f) f = 1.0f;
+    if(f < 0.0f) f = 0.0f;
+    return (uint16_t)floorf(f*65535.0f + 0.5f);
+}
+int _valid(const float3* v) {
+    float l = float3lengthSq(v);
+    return l > 1e-12f && l < FLT_MAX; // Catches NaN too
+}
+float3 _any_perpendicular(const float3* n) {
+    float3 axis = { 1.0f, 0.0f, 0.0f };
+    if(fabsf(n->x) > 0.9f) {
+        axis.x = 0.0f;
+        axis.y = 1.0f;
+    }
+    float3 t = float3cross(n, &axis);
+    return float3normalize(&t);
+}
+
+}
+
+/*
+ * External
+ */
+uint16_t float_to_half(float f) {
+    // Round to nearest even, handles denormals, infinity and NaN
+    const FloatBits f32_infinity = { 255u << 23 };
+    const FloatBits f16_max = { (127u + 16) << 23 };
+    const FloatBits denorm_magic = { ((127u - 15) + (23 - 10) + 1) << 23 };
+    FloatBits bits;
+    uint16_t result;
+
+    bits.f = f;
+    uint32_t sign = bits.u & 0x80000000u;
+    bits.u ^= sign;
+    if(bits.u >= f16_max.u) {
+        result = (bits.u > f32_infinity.u) ? 0x7E00 : 0x7C00;
+    } else if(bits.u < (113u << 23)) {
+        bits.f += denorm_magic.f;
+        result = (uint16_t)(bits.u - denorm_magic.u);
+    } else {
+        uint32_t mantissa_odd = (bits.u >> 13) & 1;
+        bits.u += ((uint32_t)(15 - 127) << 23) + 0xFFF;
+        bits.u += mantissa_odd;
+        result = (uint16_t)(bits.u >> 13);
+    }
+    return (uint16_t)(result | (sign >> 16));
+}
+float half_to_float(uint16_t h) {
+    const FloatBits magic = { 113u << 23 };
+    const uint32_t shifted_exponent = 0x7C00u << 13;
+    FloatBits bits;
+
+    bits.u = (uint32_t)(h & 0x7FFF) << 13;
+    uint32_t exponent = shifted_exponent & bits.u;
+    bits.u += (uint32_t)(127 - 15) << 23;
+    if(exponent == shifted_exponent) {
+        bits.u += (uint32_t)(128 - 16) << 23; // Inf/NaN
+    } else if(exponent == 0) {
+        bits.u += 1u << 23; // Denormal
+        bits.f -= magic.f;
+    }
+    bits.u |= (uint32_t)(h & 0x8000) << 16;
+    return bits.f;
+}
+void oct_encode(const float3* v, int16_t out[2]) {
+    float l1 = fabsf(v->x) + fabsf(v->y) + fabsf(v->z);
+    float u = v->x / l1;
+    float w = v->y / l1;
+    if(v->z < 0.0f) {
+        float fold_u = (1.0f - fabsf(w)) * _sign_not_zero(u);
+        float fold_w = (1.0f - fabsf(u)) * _sign_not_zero(w);
+        u = fold_u;
+        w = fold_w;
+    }
+    out[0] = _to_snorm16(u);
+    out[1] = _to_snorm16(w);
+}
+float3 oct_decode(const int16_t e[2]) {
+    float u = e[0] / 32767.0f;
+    float w = e[1] / 32767.0f;
+    float3 v = { u, w, 1.0f - fabsf(u) - fabsf(w) };
+    if(v.z < 0.0f) {
+        v.x = (1.0f - fabsf(w)) * _sign_not_zero(u);
+        v.y = (1.0f - fabsf(u)) * _sign_not_zero(w);
+    }
+    return float3normalize(&v);
+}
+float4x4 pack_vertices(VtxPackedPosNormTanTex* dst, const VtxPosNormTanBitanTex* src, uint32_t count) {
+    float3 min = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float3 max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for(uint32_t ii=0; ii<count; ++ii) {
+        const float3& p = src[ii].pos;
+        min.x = fminf(min.x, p.x); max.x = fmaxf(max.x, p.x);
+        min.y = fminf(min.y, p.y); max.y = fmaxf(max.y, p.y);
+        min.z = fminf(min.z, p.z); max.z = fmaxf(max.z, p.z);
+    }
+    float extent = fmaxf(max.x-min.x, fmaxf(max.y-min.y, max.z-min.z));
+    if(count == 0 || extent <= 0.0f)
+        extent = 1.0f;
+    if(count == 0)
+        min = float3zero;
+    float inv_extent = 1.0f/extent;
+
+    for(uint32_t ii=0; ii<count; ++ii) {
+        const VtxPosNormTanBitanTex& s = src[ii];
+        VtxPackedPosNormTanTex& d = dst[ii];
+
+        d.pos[0] = _to_unorm16((s.pos.x-min.x)*inv_extent);
+        d.pos[1] = _to_unorm16((s.pos.y-min.y)*inv_extent);
+        d.pos[2] = _to_unorm16((s.pos.z-min.z)*inv_extent);
+
+        float3 n = s.norm;
+        if(!_valid(&n)) {
+            n.x = 0.0f; n.y = 1.0f; n.z = 0.0f;
+        }
+        n = float3normalize(&n);
+
+        // Orthogonalize the tangent against the normal
+        float3 t = float3multiplyScalar(&n, float3dot(&n, &s.tan));
+        t = float3subtract(&s.tan, &t);
+        t = _valid(&t) ? float3normalize(&t) : _any_perpendicular(&n);
+
+        float3 b = float3cross(&n, &t);
+        float handedness = (float3dot(&b, &s.bitan) < 0.0f) ? -1.0f : 1.0f;
+
+        oct_encode(&n, d.norm);
+        oct_encode(&t, d.tan);
+        d.tan_sign = _to_snorm16(handedness);
+        d.tex[0] = float_to_half(s.tex.x);
+        d.tex[1] = float_to_half(s.tex.y);
+    }
+
+    float4x4 dequantize = float4x4Scale(extent, extent, extent);
+    dequantize.r3.x = min.x;
+    dequantize.r3.y = min.y;
+    dequantize.r3.z = min.z;
+    return dequantize;
+}
@@ -0,0 +1,32 @@
+/*! @file vertex_packing.h
+ *  @brief Conversion to the compressed vertex formats
+ *  @author Kyle Weicht
+ *  @date 10/19/26 1:40 PM
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ *	@addtogroup vertex_packing vertex_packing
+ *	@{
+ */
+#ifndef __vertex_packing_h__
+#define __vertex_packing_h__
+
+#include <stdint.h>
+#include "vec_math.h"
+#include "render.h"
+
+uint16_t float_to_half(float f);
+float half_to_float(uint16_t h);
+
+/*! @brief Octahedral encoding of a unit vector into two SNORM16 values */
+void oct_encode(const float3* v, int16_t out[2]);
+float3 oct_decode(const int16_t e[2]);
+
+/*! @brief Packs `count` vertices. Positions are quantized relative to the
+ *         vertex bounds with a uniform scale, so normals stay valid under the
+ *         returned transform.
+ *  @return The matrix that takes the quantized [0,1] positions back to model
+ *          space. Premultiply it into the world transform.
+ */
+float4x4 pack_vertices(VtxPackedPosNormTanTex* dst, const VtxPosNormTanBitanTex* src, uint32_t count);
+
+/* @} */
+#endif /* include guard */
@@ -0,0 +1,34 @@
+/*! @file visibility_ids.cpp
+ *  @author Kyle Weicht
+ *  @date 10/20/26
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ */
+#include "visibility_ids.h"
+
+/*
+ * External
+ */
+uint32_t visibility_split_count(uint32_t index_count, uint32_t max_triangles) {
+    uint32_t max_indices = max_triangles*3;
+    return (index_count + max_indices-1)/max_indices;
+}
+uint32_t visibility_split_draw(VisibilitySplit* splits, uint32_t first_index, uint32_t index_count,
+                               uint32_t max_triangles) {
+    uint32_t max_indices = max_triangles*3;
+    uint32_t count = 0;
+    for(uint32_t start=0; start<index_count; start+=max_indices) {
+        uint32_t remaining = index_count - start;
+        splits[count].first_index = first_index + start;
+        splits[count].index_count = remaining < max_indices ? remaining : max_indices;
+        ++count;
+    }
+    return count;
+}
+uint32_t visibility_id(uint32_t entry, uint32_t primitive) {
+    return ((entry + 1) << VISIBILITY_TRIANGLE_BITS) | primitive;
+}
+uint32_t visibility_triangle_index(const VisibilitySplit* splits, uint32_t id) {
+    uint32_t entry = (id >> VISIBILITY_TRIANGLE_BITS) - 1;
+    uint32_t primitive = id & ((1u << VISIBILITY_TRIANGLE_BITS) - 1);
+    return splits[entry].first_index + primitive*3;
+}
@@ -0,0 +1,55 @@
+/*! @file visibility_ids.h
+ *  @brief The visibility buffer's pixel IDs and how draws are split to fit
+ *         them, what the ID pass writes and the resolve reads back
+ *  @author Kyle Weicht
+ *  @date 10/20/26 11:10 AM
+ *  @copyright Copyright (c) 2012 Kyle Weicht. All rights reserved.
+ *	@addtogroup visibility_ids visibility_ids
+ *	@{
+ */
+#ifndef __visibility_ids_h__
+#define __visibility_ids_h__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Each pixel is a 32 bit ID, the entry of the draw it came from above
+ * gl_PrimitiveID in the draw. An entry is an instance of one split of a
+ * draw's index range, split so gl_PrimitiveID fits. The shaders'
+ * kTriangleBits match.
+ */
+#define VISIBILITY_TRIANGLE_BITS 16
+#define VISIBILITY_MAX_ENTRIES ((1 << (32-VISIBILITY_TRIANGLE_BITS)) - 1)    /* 0 is nothing drawn */
+
+typedef struct {
+    uint32_t    first_index;    /*!< What the split is drawn from, and what its entries record */
+    uint32_t    index_count;
+} VisibilitySplit;
+
+/*! @brief How many splits an index range needs */
+uint32_t visibility_split_count(uint32_t index_count, uint32_t max_triangles);
+
+/*! @brief Splits an index range into runs of at most max_triangles, which
+ *         is 1 << VISIBILITY_TRIANGLE_BITS when drawing
+ *  @return The number of splits
+ */
+uint32_t visibility_split_draw(VisibilitySplit* splits, uint32_t first_index, uint32_t index_count,
+                               uint32_t max_triangles);
+
+/*! @brief A pixel's ID, as visibility.fsh writes it */
+uint32_t visibility_id(uint32_t entry, uint32_t primitive);
+
+/*! @brief The first of a pixel's triangle's indices, as the resolve finds
+ *         it. splits are indexed by entry.
+ */
+uint32_t visibility_triangle_index(const VisibilitySplit* splits, uint32_t id);
+
+#ifdef __cplusplus
+} // extern "C" {
+#endif
+
+/* @} */
+#endif /* include guard */